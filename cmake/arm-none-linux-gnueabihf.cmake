@@ -0,0 +1,24 @@
+# Cross build for the ARM boards in target/ with the GNU-A toolchain of the README:
+#   cmake -S . -B build-arm -DCMAKE_TOOLCHAIN_FILE=cmake/arm-none-linux-gnueabihf.cmake
+# BBX15_ARM_TOOLCHAIN is the toolchain root (default /opt/gnu_bbx15, the link to gcc-arm-10.2-2020.11-...),
+# BBX15_ARM_FLAGS the code generation for the board (default Cortex-A15 of the BeagleBoard-X15/AI).
+
+set(CMAKE_SYSTEM_NAME Linux)
+set(CMAKE_SYSTEM_PROCESSOR arm)
+
+set(BBX15_ARM_TOOLCHAIN "/opt/gnu_bbx15" CACHE PATH "root of the arm-none-linux-gnueabihf toolchain")
+set(BBX15_ARM_FLAGS "-mcpu=cortex-a15 -mfpu=neon-vfpv4 -mfloat-abi=hard"
+    CACHE STRING "code generation for the board, e.g. -mcpu=cortex-a72 -mfpu=neon-fp-armv8 for the Pi 4")
+
+set(CMAKE_C_COMPILER ${BBX15_ARM_TOOLCHAIN}/bin/arm-none-linux-gnueabihf-gcc)
+set(CMAKE_CXX_COMPILER ${BBX15_ARM_TOOLCHAIN}/bin/arm-none-linux-gnueabihf-g++)
+set(CMAKE_C_FLAGS_INIT "${BBX15_ARM_FLAGS}")
+set(CMAKE_CXX_FLAGS_INIT "${BBX15_ARM_FLAGS}")
+# link time optimization needs the plugin aware archiver of the toolchain
+set(CMAKE_AR ${BBX15_ARM_TOOLCHAIN}/bin/arm-none-linux-gnueabihf-gcc-ar CACHE FILEPATH "")
+set(CMAKE_RANLIB ${BBX15_ARM_TOOLCHAIN}/bin/arm-none-linux-gnueabihf-gcc-ranlib CACHE FILEPATH "")
+
+set(CMAKE_FIND_ROOT_PATH ${BBX15_ARM_TOOLCHAIN}/arm-none-linux-gnueabihf/libc)
+set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
+set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   opt-in heap allocation counters per thread and no-allocation regions for the hot paths
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+/**
+ * @brief allocations of one thread
+ */
+struct AllocCounters {
+  uint64_t allocations{0};
+  uint64_t frees{0};
+  uint64_t bytes{0};        ///< requested by the allocations
+  uint64_t violations{0};   ///< allocations inside a no-allocation region
+};
+
+/**
+ * @brief heap allocation tracker
+ * @desc Built with -DBBX15_ALLOC_TRACKER (cmake -DBBX15_ALLOC_TRACKER=ON) the program links src/alloc_tracker.cpp,
+ *       which replaces the global operator new and delete. Every allocation increments counters of the calling
+ *       thread, plain thread_local stores without locks. An allocation inside a NoAllocRegion is a violation: it is
+ *       counted, and in abort mode (-DBBX15_ALLOC_ABORT) the region is named on stderr and the program aborts like
+ *       a failed assertion. Without the definition all counters stay zero and the regions compile to nothing.
+ */
+class AllocTracker {
+ public:
+#ifdef BBX15_ALLOC_TRACKER
+  static constexpr bool kEnabled = true;
+#else
+  static constexpr bool kEnabled = false;
+#endif
+
+  enum class Mode { kCount, kAbort };
+
+  static void SetMode(Mode mode) { mode_.store(mode, std::memory_order_relaxed); }
+
+  /**
+   * @brief counters of the calling thread
+   */
+  static const AllocCounters& Thread() { return local_; }
+
+  /**
+   * @brief violations of all threads
+   */
+  static uint64_t Violations() { return violations_.load(std::memory_order_relaxed); }
+
+  static void Print(std::FILE* out = stdout) {
+    if (!kEnabled) {
+      return;
+    }
+    const char* region = last_region_.load(std::memory_order_relaxed);
+    std::fprintf(out, "allocation tracker: no-allocation region violations=%llu%s%s\n",
+                 static_cast<unsigned long long>(Violations()), region ? ", last in " : "", region ? region : "");
+  }
+
+  static void OnAllocate(size_t bytes) {
+    ++local_.allocations;
+    local_.bytes += bytes;
+    if (region_) {
+      Violation();
+    }
+  }
+
+  static void OnFree() { ++local_.frees; }
+
+ private:
+  friend class NoAllocRegion;
+
+  static void Violation() {
+    ++local_.violations;
+    violations_.fetch_add(1, std::memory_order_relaxed);
+    last_region_.store(region_, std::memory_order_relaxed);
+    if (mode_.load(std::memory_order_relaxed) == Mode::kAbort) {
+      // no stdio, it may allocate
+      static constexpr char kMessage[] = "heap allocation in no-allocation region ";
+      [[maybe_unused]] auto written = write(STDERR_FILENO, kMessage, sizeof(kMessage) - 1);
+      written = write(STDERR_FILENO, region_, std::strlen(region_));
+      written = write(STDERR_FILENO, "\n", 1);
+      std::abort();
+    }
+  }
+
+  // constant initialized, so the hooks may use them at any time of a thread's life
+  static inline thread_local AllocCounters local_{};
+  static inline thread_local const char* region_{nullptr};
+  static inline std::atomic<uint64_t> violations_{0};
+  static inline std::atomic<const char*> last_region_{nullptr};
+#ifdef BBX15_ALLOC_ABORT
+  static inline std::atomic<Mode> mode_{Mode::kAbort};
+#else
+  static inline std::atomic<Mode> mode_{Mode::kCount};
+#endif
+};
+
+/**
+ * @brief scope that must not allocate, regions nest
+ * @param name - string literal reported for violations
+ */
+class NoAllocRegion {
+ public:
+  explicit NoAllocRegion(const char* name) {
+    if constexpr (AllocTracker::kEnabled) {
+      previous_ = AllocTracker::region_;
+      AllocTracker::region_ = name;
+    }
+  }
+  ~NoAllocRegion() {
+    if constexpr (AllocTracker::kEnabled) {
+      AllocTracker::region_ = previous_;
+    }
+  }
+
+  NoAllocRegion(const NoAllocRegion&) = delete;
+  NoAllocRegion& operator=(const NoAllocRegion&) = delete;
+
+ private:
+  const char* previous_{nullptr};
+};
@@ -0,0 +1,348 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   asynchronous binary logger: the tasks store the raw arguments, a background thread formats them
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cycle_clock.hpp>
+
+/**
+ * @brief log a printf style message from a task, e.g. BBX15_LOG("GOOSE %s: stNum=%u\n", ref.c_str(), st_num)
+ * @desc The format must be a string literal and is checked by the compiler against the arguments as for printf.
+ *       Arguments are integers, floating point values, pointers and C strings, strings are copied into the record.
+ */
+#define BBX15_LOG(format, ...)                          \
+  do {                                                  \
+    if (false) {                                        \
+      std::printf(format __VA_OPT__(, ) __VA_ARGS__);   \
+    }                                                   \
+    AsyncLog::Write(format __VA_OPT__(, ) __VA_ARGS__); \
+  } while (0)
+
+namespace async_log_detail {
+
+/**
+ * @brief a format string with static storage; its address identifies the message
+ */
+struct Format {
+  consteval Format(const char* format) : text(format) {}   // NOLINT: implicit from string literals only
+  const char* text;
+};
+
+template <class T>
+constexpr bool kIsString = std::is_same_v<T, const char*> || std::is_same_v<T, char*>;
+
+/**
+ * @brief bytes an argument needs at least, a string its terminating zero
+ */
+template <class T>
+constexpr size_t MinSize() {
+  if constexpr (kIsString<T>) {
+    return 1;
+  } else {
+    static_assert(std::is_arithmetic_v<T> || std::is_pointer_v<T>, "BBX15_LOG: unsupported argument type");
+    return sizeof(T);
+  }
+}
+
+template <class T>
+void Encode(uint8_t*& p, const uint8_t* end, size_t reserve, T value) {
+  if constexpr (kIsString<T>) {
+    const char* text = value ? value : "(null)";
+    // bounded by the record, not by the source: strnlen would make gcc warn about char arrays shorter than it
+    const size_t limit = static_cast<size_t>(end - p) - reserve - 1;
+    size_t length = 0;
+    while (length < limit && text[length] != '\0') {
+      ++length;
+    }
+    std::memcpy(p, text, length);
+    p[length] = '\0';
+    p += length + 1;
+  } else {
+    std::memcpy(p, &value, sizeof(T));
+    p += sizeof(T);
+  }
+}
+
+template <class T>
+auto Decode(const uint8_t*& p) {
+  if constexpr (kIsString<T>) {
+    const char* text = reinterpret_cast<const char*>(p);
+    p += std::strlen(text) + 1;
+    return text;
+  } else {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+  }
+}
+
+}   // namespace async_log_detail
+
+/**
+ * @brief logger of the worker threads
+ * @desc Write() copies the format string address, a formatting function and the raw arguments into a fixed size
+ *       record of a ring owned by the calling thread; it takes no lock, makes no syscall and does not format.
+ *       A background thread started by Start() collects the records of all rings every kFlushIntervalMs, orders
+ *       them by their time stamp, formats them with fprintf and flushes the output. A full ring drops the record
+ *       and counts it, the formatter reports drops as a log line of its own. Without a running formatter Write()
+ *       prints directly. Reports of several lines written by Print() functions stay synchronous.
+ */
+class AsyncLog {
+ public:
+  static constexpr size_t kRecordSize = 256;
+  static constexpr size_t kRingRecords = 256;   ///< per running thread, 64 KB
+  static constexpr int kFlushIntervalMs = 10;
+
+  /**
+   * @brief start the formatter thread
+   */
+  static void Start(std::FILE* out = stdout) {
+    State& state = Global();
+    if (state.thread.joinable()) {
+      return;
+    }
+    state.out = out;
+    state.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    state.stop = false;
+    state.thread = std::thread([&state]() {
+      pthread_setname_np(pthread_self(), "async-log");
+      while (!state.stop.load(std::memory_order_acquire)) {
+        pollfd pfd{state.event_fd, POLLIN, 0};
+        poll(&pfd, 1, kFlushIntervalMs);
+        Drain(state);
+      }
+      Drain(state);
+    });
+    state.running.store(true, std::memory_order_release);
+  }
+
+  /**
+   * @brief write all pending records and stop the formatter, later messages are printed directly
+   */
+  static void Stop() {
+    State& state = Global();
+    if (!state.thread.joinable()) {
+      return;
+    }
+    state.running.store(false, std::memory_order_release);
+    state.stop.store(true, std::memory_order_release);
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = write(state.event_fd, &one, sizeof(one));
+    state.thread.join();
+    close(state.event_fd);
+    state.event_fd = -1;
+  }
+
+  template <class... Args>
+  static void Write(async_log_detail::Format format, Args... args) {
+    static_assert((async_log_detail::MinSize<Args>() + ... + 0) <= kPayload, "BBX15_LOG: too many arguments");
+    if (!Global().running.load(std::memory_order_acquire)) {
+      Record record;
+      Fill(record, format.text, args...);
+      record.print(stdout, record.format, record.data);
+      return;
+    }
+    Ring& ring = Local();
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= kRingRecords) {
+      ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return;
+    }
+    Fill(ring.records[head % kRingRecords], format.text, args...);
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief register the ring of the calling thread now instead of on its first message, e.g. before a region that
+   *        must not allocate
+   */
+  static void RegisterThread() { Local(); }
+
+  static uint64_t Written() { return Global().written.load(std::memory_order_relaxed); }
+
+  static uint64_t Dropped() {
+    State& state = Global();
+    std::lock_guard lock(state.mutex);
+    uint64_t dropped = 0;
+    for (const auto& ring : state.rings) {
+      dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+  }
+
+  static void Print(std::FILE* out = stdout) {
+    std::fprintf(out, "async log: records=%llu dropped=%llu\n", static_cast<unsigned long long>(Written()),
+                 static_cast<unsigned long long>(Dropped()));
+  }
+
+ private:
+  using PrintFunction = void (*)(std::FILE*, const char*, const uint8_t*);
+  static constexpr size_t kHeader = sizeof(uint64_t) + sizeof(const char*) + sizeof(PrintFunction);
+  static constexpr size_t kPayload = kRecordSize - kHeader;
+
+  struct Record {
+    uint64_t ticks;
+    const char* format;
+    PrintFunction print;
+    uint8_t data[kPayload];
+  };
+  static_assert(sizeof(Record) == kRecordSize);
+
+  /**
+   * @brief single producer, single consumer ring of one thread
+   */
+  struct Ring {
+    alignas(64) std::atomic<uint64_t> head{0};   ///< written by the owner thread
+    alignas(64) std::atomic<uint64_t> tail{0};   ///< written by the formatter
+    std::atomic<uint64_t> dropped{0};            ///< written by the owner thread
+    std::atomic<bool> owned{true};               ///< false once the owner thread exited
+    uint64_t reported{0};                        ///< drops already reported by the formatter
+    Record records[kRingRecords];
+  };
+
+  struct State {
+    std::mutex mutex;   ///< guards rings
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> written{0};
+    std::FILE* out{stdout};
+    int event_fd{-1};
+    std::thread thread;
+  };
+
+  template <class... Args>
+  static void PrintRecord(std::FILE* out, const char* format, const uint8_t* data) {
+    if constexpr (sizeof...(Args) == 0) {
+      std::fputs(format, out);
+    } else {
+      // braced initialization decodes the arguments from left to right
+      const std::tuple<decltype(async_log_detail::Decode<Args>(data))...> values{
+         async_log_detail::Decode<Args>(data)...};
+      std::apply([&](auto... value) { std::fprintf(out, format, value...); }, values);
+    }
+  }
+
+  template <class... Args>
+  static void Fill(Record& record, const char* format, Args... args) {
+    record.ticks = CycleClock::Ticks();
+    record.format = format;
+    record.print = PrintRecord<Args...>;
+    [[maybe_unused]] uint8_t* p = record.data;
+    [[maybe_unused]] size_t reserve = (async_log_detail::MinSize<Args>() + ... + 0);
+    ((reserve -= async_log_detail::MinSize<Args>(),
+      async_log_detail::Encode(p, record.data + kPayload, reserve, args)),
+     ...);
+  }
+
+  /**
+   * @brief format the pending records of all rings in time stamp order
+   */
+  static void Drain(State& state) {
+    struct Pending {
+      uint64_t ticks;
+      Ring* ring;
+      uint64_t index;
+    };
+    std::vector<Pending> pending;
+    std::vector<std::pair<Ring*, uint64_t>> heads;
+    {
+      std::lock_guard lock(state.mutex);
+      for (const auto& ring : state.rings) {
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (uint64_t i = ring->tail.load(std::memory_order_relaxed); i < head; ++i) {
+          pending.push_back({ring->records[i % kRingRecords].ticks, ring.get(), i});
+        }
+        heads.emplace_back(ring.get(), head);
+      }
+    }
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const Pending& a, const Pending& b) { return a.ticks < b.ticks; });
+    for (const auto& entry : pending) {
+      const Record& record = entry.ring->records[entry.index % kRingRecords];
+      record.print(state.out, record.format, record.data);
+    }
+    uint64_t dropped = 0;
+    for (auto& [ring, head] : heads) {
+      ring->tail.store(head, std::memory_order_release);
+      const uint64_t total = ring->dropped.load(std::memory_order_relaxed);
+      dropped += total - ring->reported;
+      ring->reported = total;
+    }
+    if (dropped) {
+      std::fprintf(state.out, "async log: %llu records dropped\n", static_cast<unsigned long long>(dropped));
+    }
+    if (!pending.empty() || dropped) {
+      std::fflush(state.out);
+      state.written.fetch_add(pending.size(), std::memory_order_relaxed);
+    }
+  }
+
+  static State& Global() {
+    static State state;
+    return state;
+  }
+
+  /**
+   * @brief ring of the calling thread, released when the thread exits
+   */
+  struct Owner {
+    Ring* ring;
+    ~Owner() { ring->owned.store(false, std::memory_order_release); }
+  };
+
+  /**
+   * @brief ring of the calling thread, registered on its first message
+   * @desc Rings outlive their threads until the formatter drained them, then a new thread takes one over instead
+   *       of allocating another, so restarted tasks do not grow the log.
+   */
+  static Ring& Local() {
+    static thread_local Owner owner{[] {
+      State& state = Global();
+      std::lock_guard lock(state.mutex);
+      for (const auto& ring : state.rings) {
+        if (!ring->owned.load(std::memory_order_acquire) &&
+            ring->tail.load(std::memory_order_acquire) == ring->head.load(std::memory_order_relaxed)) {
+          ring->owned.store(true, std::memory_order_relaxed);
+          return ring.get();
+        }
+      }
+      state.rings.push_back(std::make_unique<Ring>());
+      return state.rings.back().get();
+    }()};
+    return *owner.ring;
+  }
+};
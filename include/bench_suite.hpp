@@ -0,0 +1,435 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   measurements of the board benchmark suite and their JSON report
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <numbers>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <board_info.hpp>
+#include <cycle_clock.hpp>
+#include <fswatch.hpp>
+#include <fswatch_bounded.hpp>
+#include <sv.hpp>
+#include <sv_publisher.hpp>
+#include <sv_source.hpp>
+
+/**
+ * @brief one figure of the suite
+ */
+struct BenchResult {
+  std::string name;
+  double value{0};
+  std::string unit;
+  bool higher_is_better{false};
+};
+
+namespace bench_detail {
+
+inline std::string JsonString(const std::string& text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      quoted += ' ';
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+/**
+ * @brief value of "key": in a line, a string is unquoted
+ */
+inline std::optional<std::string> JsonField(const std::string& line, const std::string& key) {
+  size_t p = line.find("\"" + key + "\":");
+  if (p == std::string::npos) {
+    return std::nullopt;
+  }
+  p = line.find_first_not_of(' ', p + key.size() + 3);
+  if (p == std::string::npos) {
+    return std::nullopt;
+  }
+  std::string value;
+  if (line[p] != '"') {
+    const size_t end = line.find_first_of(",}", p);
+    return line.substr(p, end == std::string::npos ? std::string::npos : end - p);
+  }
+  for (++p; p < line.size() && line[p] != '"'; ++p) {
+    if (line[p] == '\\' && p + 1 < line.size()) {
+      ++p;
+    }
+    value += line[p];
+  }
+  return value;
+}
+
+}   // namespace bench_detail
+
+/**
+ * @brief results of one board
+ * @desc Stored as JSON with the board on one line and one line per result; ReadJson() reads files written by
+ *       WriteJson() only, it is not a general JSON parser.
+ */
+struct BenchReport {
+  BoardInfo board;
+  std::string date;       ///< UTC, ISO 8601
+  std::string settings;   ///< measurement settings, results of different settings do not compare
+  std::vector<BenchResult> results;
+
+  const BenchResult* Find(const std::string& name) const {
+    for (const auto& result : results) {
+      if (result.name == name) {
+        return &result;
+      }
+    }
+    return nullptr;
+  }
+
+  void WriteJson(std::FILE* out) const {
+    using bench_detail::JsonString;
+    std::fprintf(out,
+                 "{\n  \"board\": {\"model\": %s, \"cpu\": %s, \"kernel\": %s, \"governor\": %s, \"cores\": %u},\n",
+                 JsonString(board.model).c_str(), JsonString(board.cpu).c_str(), JsonString(board.kernel).c_str(),
+                 JsonString(board.governor).c_str(), board.cores);
+    std::fprintf(out, "  \"date\": %s,\n  \"settings\": %s,\n  \"results\": [\n", JsonString(date).c_str(),
+                 JsonString(settings).c_str());
+    for (size_t i = 0; i < results.size(); ++i) {
+      const BenchResult& result = results[i];
+      std::fprintf(out, "    {\"name\": %s, \"value\": %.3f, \"unit\": %s, \"better\": \"%s\"}%s\n",
+                   JsonString(result.name).c_str(), result.value, JsonString(result.unit).c_str(),
+                   result.higher_is_better ? "higher" : "lower", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+  }
+
+  static BenchReport ReadJson(const std::string& path) {
+    using bench_detail::JsonField;
+    std::ifstream in(path);
+    if (!in) {
+      throw std::runtime_error("BenchReport: cannot open " + path);
+    }
+    BenchReport report;
+    for (std::string line; std::getline(in, line);) {
+      if (line.find("\"board\":") != std::string::npos) {
+        report.board.model = JsonField(line, "model").value_or("");
+        report.board.cpu = JsonField(line, "cpu").value_or("");
+        report.board.kernel = JsonField(line, "kernel").value_or("");
+        report.board.governor = JsonField(line, "governor").value_or("");
+        report.board.cores = static_cast<unsigned>(std::stoul(JsonField(line, "cores").value_or("0")));
+      } else if (auto date = JsonField(line, "date")) {
+        report.date = *date;
+      } else if (auto settings = JsonField(line, "settings")) {
+        report.settings = *settings;
+      } else if (auto name = JsonField(line, "name")) {
+        const auto value = JsonField(line, "value");
+        if (!value) {
+          throw std::runtime_error("BenchReport: " + path + ": result without value: " + *name);
+        }
+        report.results.push_back(BenchResult{*name, std::stod(*value), JsonField(line, "unit").value_or(""),
+                                             JsonField(line, "better").value_or("") == "higher"});
+      }
+    }
+    if (report.board.model.empty()) {
+      throw std::runtime_error("BenchReport: " + path + ": no board");
+    }
+    return report;
+  }
+};
+
+namespace bench_suite {
+
+/**
+ * @brief median, p99 and maximum of samples in ns, returned in us
+ */
+struct Percentiles {
+  double p50_us{0};
+  double p99_us{0};
+  double max_us{0};
+};
+
+inline Percentiles Summarize(std::vector<int64_t>& samples) {
+  if (samples.empty()) {
+    return {};
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto at = [&](double quantile) {
+    return static_cast<double>(samples[static_cast<size_t>(quantile * static_cast<double>(samples.size() - 1))]) /
+           1000.0;
+  };
+  return {at(0.5), at(0.99), static_cast<double>(samples.back()) / 1000.0};
+}
+
+/**
+ * @brief SCHED_FIFO for the calling thread
+ * @return false without the privilege, the measurement then runs with the normal policy
+ */
+inline bool SetRealtime(int priority) {
+  sched_param param{};
+  param.sched_priority = priority;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+struct FswatchStorm {
+  uint64_t events{0};     ///< received by the callback
+  uint64_t expected{0};   ///< caused by the storm
+  int64_t elapsed_ns{0};
+};
+
+namespace bench_detail {
+
+template <class Watcher>
+FswatchStorm RunStorm(Watcher& watcher, const std::string& dir, unsigned files) {
+  constexpr unsigned kEventsPerFile = 5;   // created, opened, modified, closed, deleted
+  constexpr unsigned kBatchFiles = 500;    // stays well below the inotify queue limit of 16384 events
+  constexpr int64_t kBatchTimeoutNs = 5'000'000'000;
+
+  std::atomic<uint64_t> received{0};
+  watcher.on({fswatch::Event::FILE_CREATED, fswatch::Event::FILE_OPENED, fswatch::Event::FILE_MODIFIED,
+              fswatch::Event::FILE_CLOSED, fswatch::Event::FILE_DELETED},
+             [&](const auto&) { received.fetch_add(1, std::memory_order_release); });
+  // written by the watcher thread before failed is set
+  std::string error;
+  std::atomic<bool> failed{false};
+  std::thread thread([&]() {
+    try {
+      watcher.start();
+    } catch (const std::exception& e) {
+      error = e.what();
+      failed.store(true, std::memory_order_release);
+    }
+  });
+  // the watch is added by the thread, events before it are lost
+  const timespec settle{0, 100'000'000};
+  nanosleep(&settle, nullptr);
+
+  FswatchStorm storm;
+  const char payload[] = "storm\n";
+  const int64_t start = CycleClock::MonotonicNs();
+  for (unsigned done = 0; done < files && !failed.load(std::memory_order_acquire); done += kBatchFiles) {
+    for (unsigned i = done; i < done + kBatchFiles && i < files; ++i) {
+      const std::string path = dir + "/f" + std::to_string(i);
+      const int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd < 0) {
+        break;
+      }
+      [[maybe_unused]] auto written = write(fd, payload, sizeof(payload) - 1);
+      close(fd);
+      unlink(path.c_str());
+      storm.expected += kEventsPerFile;
+    }
+    const int64_t deadline = CycleClock::MonotonicNs() + kBatchTimeoutNs;
+    while (received.load(std::memory_order_acquire) < storm.expected && !failed.load(std::memory_order_acquire) &&
+           CycleClock::MonotonicNs() < deadline) {
+      std::this_thread::yield();
+    }
+  }
+  storm.elapsed_ns = CycleClock::MonotonicNs() - start;
+  storm.events = received.load(std::memory_order_acquire);
+
+  watcher.stop();
+  thread.join();
+  rmdir(dir.c_str());
+  if (!error.empty()) {
+    throw std::runtime_error("fswatch storm: " + error);
+  }
+  return storm;
+}
+
+}   // namespace bench_detail
+
+/**
+ * @brief create, write, close and delete files in a temporary directory watched by fswatch
+ * @desc The files are written in batches; before the next batch the watcher catches up, an overflowing inotify
+ *       queue ends fswatch and is counted by bounded_fswatch.
+ * @param parent - directory of the temporary directory
+ * @param files - number of files, 5 events each
+ * @param capacity - watches of a bounded_fswatch, 0 - fswatch
+ */
+inline FswatchStorm RunFswatchStorm(const std::string& parent, unsigned files, size_t capacity = 0) {
+  std::string dir = parent + "/fswatch_storm.XXXXXX";
+  if (!mkdtemp(dir.data())) {
+    throw std::runtime_error("fswatch storm: cannot create a directory in " + parent);
+  }
+  if (capacity) {
+    bounded_fswatch_limits limits;
+    limits.max_watches = capacity;
+    bounded_fswatch watcher(limits);
+    watcher.add_root(dir);
+    return bench_detail::RunStorm(watcher, dir, files);
+  }
+  fswatch watcher(dir);
+  return bench_detail::RunStorm(watcher, dir, files);
+}
+
+/**
+ * @brief wake-up lateness and period deviation of a periodic real-time thread
+ */
+struct PeriodicTiming {
+  std::vector<int64_t> latency_ns;   ///< wake-up after the programmed time
+  std::vector<int64_t> jitter_ns;    ///< |interval between wake-ups - period|
+  bool realtime{false};              ///< ran with SCHED_FIFO
+};
+
+/**
+ * @brief absolute clock_nanosleep() loop at SCHED_FIFO 80 like the task loops
+ * @param period_ns - period
+ * @param seconds - run time
+ * @param load - busy threads at the normal policy on every core meanwhile
+ */
+inline PeriodicTiming RunPeriodic(int64_t period_ns, double seconds, bool load) {
+  std::atomic<bool> busy{load};
+  std::vector<std::thread> hogs;
+  for (unsigned i = 0; load && i < std::max(1u, std::thread::hardware_concurrency()); ++i) {
+    hogs.emplace_back([&busy]() {
+      volatile uint64_t spin = 0;
+      while (busy.load(std::memory_order_relaxed)) {
+        spin = spin + 1;
+      }
+    });
+  }
+
+  PeriodicTiming timing;
+  std::thread thread([&]() {
+    timing.realtime = SetRealtime(80);
+    const auto count = static_cast<size_t>(seconds * 1e9 / static_cast<double>(period_ns));
+    timing.latency_ns.reserve(count);
+    timing.jitter_ns.reserve(count);
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    int64_t previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+      next.tv_nsec += period_ns;
+      while (next.tv_nsec >= 1'000'000'000) {
+        next.tv_nsec -= 1'000'000'000;
+        ++next.tv_sec;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+      const int64_t now = CycleClock::MonotonicNs();
+      timing.latency_ns.push_back(now - (next.tv_sec * 1'000'000'000 + next.tv_nsec));
+      if (previous) {
+        timing.jitter_ns.push_back(std::abs(now - previous - period_ns));
+      }
+      previous = now;
+    }
+  });
+  thread.join();
+  busy.store(false, std::memory_order_relaxed);
+  for (auto& hog : hogs) {
+    hog.join();
+  }
+  return timing;
+}
+
+/**
+ * @brief cost of source sample plus SvEncoder::SetSample per frame in ns, 8 streams interleaved
+ */
+inline double SvEncodeCost(unsigned frames, uint32_t samples_per_second) {
+  constexpr size_t kStreams = 8;
+  const uint8_t dst[6]{0x01, 0x0C, 0xCD, 0x04, 0x00, 0x01};
+  const uint8_t src[6]{0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  std::vector<SvEncoder> encoders;
+  std::vector<std::unique_ptr<SvSource>> sources;
+  for (size_t i = 0; i < kStreams; ++i) {
+    char sv_id[16];
+    std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02zu", i + 1);
+    encoders.emplace_back(dst, src, static_cast<uint16_t>(0x4000 + i), sv_id, 1);
+    sources.push_back(std::make_unique<SvSineSource>(samples_per_second, 50.0, 100.0, 63500.0,
+                                                     2.0 * std::numbers::pi * i / kStreams));
+  }
+  volatile uint8_t sink = 0;
+  const int64_t start = CycleClock::MonotonicNs();
+  for (unsigned i = 0; i < frames; ++i) {
+    int32_t value[kSvChannels];
+    uint32_t quality[kSvChannels];
+    const unsigned stream = i % kStreams;
+    const uint64_t index = i / kStreams;
+    sources[stream]->Next(index, value, quality);
+    encoders[stream].SetSample(static_cast<uint16_t>(index % samples_per_second), value, quality);
+    sink = sink + encoders[stream].data()[encoders[stream].size() - 1];
+  }
+  return static_cast<double>(CycleClock::MonotonicNs() - start) / frames;
+}
+
+struct SvPublishJitter {
+  double stream_p99_us{0};   ///< p99 send jitter of the worst stream, histogram bucket bound
+  double wake_p99_us{0};     ///< p99 wake-up jitter of the timing loop, histogram bucket bound
+  uint64_t overruns{0};
+  uint64_t send_errors{0};
+};
+
+/**
+ * @brief publish simulated merging units at SCHED_FIFO 80 and take the jitter of the publisher
+ */
+inline SvPublishJitter RunSvPublish(const std::string& interface_name, uint32_t streams, uint32_t samples_per_second,
+                                    double seconds) {
+  SvPublisher publisher(interface_name, samples_per_second);
+  char sv_id[kSvMaxIdLength];
+  for (uint32_t i = 0; i < streams; ++i) {
+    std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02u", i + 1);
+    publisher.AddStream(sv_id, static_cast<uint16_t>(0x4000 + i),
+                        std::make_unique<SvSineSource>(samples_per_second, 50.0, 100.0, 230.0,
+                                                       2.0 * std::numbers::pi * i / streams));
+  }
+  std::exception_ptr error;
+  std::thread thread([&]() {
+    SetRealtime(80);
+    try {
+      publisher.Start();
+    } catch (...) {
+      error = std::current_exception();
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  publisher.Stop();
+  thread.join();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  SvPublishJitter jitter{0, publisher.Jitter().Percentile(0.99) / 1000.0, publisher.GetStatistics().overruns,
+                         publisher.GetStatistics().send_errors};
+  for (size_t i = 0; i < publisher.StreamCount(); ++i) {
+    jitter.stream_p99_us = std::max(jitter.stream_p99_us, publisher.StreamJitter(i).Percentile(0.99) / 1000.0);
+  }
+  return jitter;
+}
+
+}   // namespace bench_suite
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   identity of the board a measurement was taken on
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <sys/utsname.h>
+
+/**
+ * @brief board model from the device tree, otherwise machine name and kernel release
+ */
+inline std::string BoardIdentity() {
+  std::ifstream model("/proc/device-tree/model");
+  std::string name;
+  if (std::getline(model, name, '\0') && !name.empty()) {
+    return name;
+  }
+  utsname info{};
+  uname(&info);
+  return std::string(info.machine) + " " + info.release;
+}
+
+/**
+ * @brief what decides the timing results of a board
+ */
+struct BoardInfo {
+  std::string model;      ///< BoardIdentity()
+  std::string cpu;        ///< model name of /proc/cpuinfo
+  std::string kernel;     ///< release and version, the version tells PREEMPT or PREEMPT_RT
+  std::string governor;   ///< cpufreq governor of cpu0, "none" without cpufreq
+  unsigned cores{0};
+};
+
+inline BoardInfo ReadBoardInfo() {
+  BoardInfo board;
+  board.model = BoardIdentity();
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  for (std::string line; std::getline(cpuinfo, line);) {
+    if (line.rfind("model name", 0) == 0) {
+      const size_t colon = line.find(':');
+      board.cpu = colon != std::string::npos && colon + 2 <= line.size() ? line.substr(colon + 2) : line;
+      break;
+    }
+  }
+  utsname info{};
+  uname(&info);
+  board.kernel = std::string(info.release) + " " + info.version;
+  std::ifstream governor("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+  if (!std::getline(governor, board.governor) || board.governor.empty()) {
+    board.governor = "none";
+  }
+  board.cores = std::thread::hardware_concurrency();
+  return board;
+}
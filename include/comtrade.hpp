@@ -0,0 +1,445 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   COMTRADE (IEEE C37.111) reader and resampling to SV streams
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define COMTRADE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define COMTRADE_SSE2 1
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sv.hpp>
+#include <sv_source.hpp>
+
+/**
+ * @brief COMTRADE record: configuration and analog samples
+ * @desc The .dat file is memory mapped and decoded once; ASCII, BINARY, BINARY32 and FLOAT32 are supported.
+ *       Digital channels are skipped.
+ */
+class ComtradeRecord {
+ public:
+  struct Analog {
+    std::string name;
+    std::string phase;
+    std::string unit;
+    double a{1};   ///< value = a * raw + b
+    double b{0};
+  };
+
+  /**
+   * @brief load a record
+   * @param cfg_path - path of the .cfg file, the .dat file has the same stem
+   */
+  explicit ComtradeRecord(const std::filesystem::path& cfg_path) {
+    ParseConfig(cfg_path);
+    LoadData(DataPath(cfg_path));
+  }
+
+  const std::vector<Analog>& Channels() const { return analogs_; }
+  size_t SampleCount() const { return times_.size(); }
+
+  /**
+   * @brief time of a sample in seconds relative to the first sample
+   */
+  double Time(size_t sample) const { return times_[sample]; }
+
+  /**
+   * @brief scaled value of an analog channel
+   */
+  double Value(size_t channel, size_t sample) const { return values_[sample * analogs_.size() + channel]; }
+
+ private:
+  enum class Format { kAscii, kBinary, kBinary32, kFloat32 };
+
+  static std::vector<std::string> Split(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    for (std::string field; std::getline(stream, field, ',');) {
+      field.erase(0, field.find_first_not_of(" \t"));
+      field.erase(field.find_last_not_of(" \t\r") + 1);
+      fields.push_back(field);
+    }
+    return fields;
+  }
+
+  static std::filesystem::path DataPath(const std::filesystem::path& cfg_path) {
+    for (const char* extension : {".dat", ".DAT", ".Dat"}) {
+      auto path = cfg_path;
+      path.replace_extension(extension);
+      if (std::filesystem::exists(path)) {
+        return path;
+      }
+    }
+    throw std::runtime_error("COMTRADE: no data file for " + cfg_path.string());
+  }
+
+  void ParseConfig(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file) {
+      throw std::runtime_error("COMTRADE: cannot open " + path.string());
+    }
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(file, line);) {
+      lines.push_back(line);
+    }
+    size_t n = 1;   // station, device, revision year
+    auto next = [&]() -> std::vector<std::string> {
+      if (n >= lines.size()) {
+        throw std::runtime_error("COMTRADE: truncated configuration " + path.string());
+      }
+      return Split(lines[n++]);
+    };
+
+    auto counts = next();
+    if (counts.size() < 3) {
+      throw std::runtime_error("COMTRADE: invalid channel counts");
+    }
+    const size_t analog_count = std::stoul(counts[1]);
+    const size_t digital_count = std::stoul(counts[2]);
+    for (size_t i = 0; i < analog_count; ++i) {
+      auto f = next();
+      if (f.size() < 7) {
+        throw std::runtime_error("COMTRADE: invalid analog channel line");
+      }
+      analogs_.push_back(Analog{f[1], f[2], f[4], std::stod(f[5]), std::stod(f[6])});
+    }
+    n += digital_count;
+    digital_words_ = (digital_count + 15) / 16;
+    next();   // line frequency
+    const size_t rate_count = std::stoul(next().at(0));
+    for (size_t i = 0; i < rate_count; ++i) {
+      auto f = next();
+      rates_.push_back({std::stod(f.at(0)), std::stoull(f.at(1))});
+    }
+    next();   // start time
+    next();   // trigger time
+    std::string format = next().at(0);
+    std::transform(format.begin(), format.end(), format.begin(), [](unsigned char c) { return std::toupper(c); });
+    if (format == "ASCII") {
+      format_ = Format::kAscii;
+    } else if (format == "BINARY") {
+      format_ = Format::kBinary;
+    } else if (format == "BINARY32") {
+      format_ = Format::kBinary32;
+    } else if (format == "FLOAT32") {
+      format_ = Format::kFloat32;
+    } else {
+      throw std::runtime_error("COMTRADE: unsupported file type " + format);
+    }
+    if (n < lines.size()) {
+      auto f = Split(lines[n]);
+      if (!f.empty() && !f[0].empty()) {
+        time_multiplier_ = std::stod(f[0]);
+      }
+    }
+  }
+
+  /**
+   * @brief time of sample number n (0 based) from the sampling rate table, negative if timestamps must be used
+   */
+  double RateTime(uint64_t n) const {
+    double t = 0;
+    uint64_t first = 0;
+    for (const auto& [rate, last] : rates_) {
+      if (rate <= 0) {
+        return -1;
+      }
+      if (n < last) {
+        return t + static_cast<double>(n - first) / rate;
+      }
+      t += static_cast<double>(last - first) / rate;
+      first = last;
+    }
+    return -1;
+  }
+
+  void LoadData(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error("COMTRADE: cannot open " + path.string());
+    }
+    struct stat st {};
+    fstat(fd, &st);
+    const auto size = static_cast<size_t>(st.st_size);
+    void* map = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+      throw std::runtime_error("COMTRADE: cannot map " + path.string());
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    try {
+      if (format_ == Format::kAscii) {
+        DecodeAscii(static_cast<const char*>(map), size);
+      } else {
+        DecodeBinary(static_cast<const uint8_t*>(map), size);
+      }
+    } catch (...) {
+      munmap(map, size);
+      throw;
+    }
+    munmap(map, size);
+  }
+
+  void AddSample(uint64_t index, double timestamp) {
+    const double t = RateTime(index);
+    times_.push_back(t >= 0 ? t : timestamp * time_multiplier_ * 1e-6);
+  }
+
+  void DecodeAscii(const char* p, size_t size) {
+    const char* end = p + size;
+    auto field = [&](double& value) {
+      while (p < end && (*p == ' ' || *p == ',' || *p == '\t')) {
+        ++p;
+      }
+      // strtod on a terminated copy: the mapping has no terminator, std::from_chars for double needs gcc 11
+      const char* token = p;
+      while (p < end && *p != ' ' && *p != ',' && *p != '\t' && *p != '\r' && *p != '\n') {
+        ++p;
+      }
+      char text[64];
+      const auto length = static_cast<size_t>(p - token);
+      char* parsed = text;
+      if (length < sizeof(text)) {
+        std::memcpy(text, token, length);
+        text[length] = '\0';
+        value = std::strtod(text, &parsed);
+      }
+      if (parsed == text) {
+        value = 0;   // missing or invalid values
+      }
+    };
+    uint64_t index = 0;
+    while (p < end) {
+      while (p < end && (*p == '\r' || *p == '\n' || *p == ' ')) {
+        ++p;
+      }
+      if (p == end) {
+        break;
+      }
+      double number, timestamp, value;
+      field(number);
+      field(timestamp);
+      for (size_t ch = 0; ch < analogs_.size(); ++ch) {
+        field(value);
+        values_.push_back(analogs_[ch].a * value + analogs_[ch].b);
+      }
+      const char* eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+      p = eol ? eol + 1 : end;   // digital channels
+      AddSample(index++, timestamp);
+    }
+  }
+
+  void DecodeBinary(const uint8_t* p, size_t size) {
+    const size_t analog_size = format_ == Format::kBinary ? 2 : 4;
+    const size_t record = 8 + analogs_.size() * analog_size + digital_words_ * 2;
+    const size_t count = size / record;
+    values_.reserve(count * analogs_.size());
+    times_.reserve(count);
+    for (size_t index = 0; index < count; ++index, p += record) {
+      uint32_t timestamp;
+      std::memcpy(&timestamp, p + 4, 4);   // little endian, as the boards
+      const uint8_t* q = p + 8;
+      for (size_t ch = 0; ch < analogs_.size(); ++ch, q += analog_size) {
+        double raw;
+        if (format_ == Format::kBinary) {
+          int16_t v;
+          std::memcpy(&v, q, 2);
+          raw = v;
+        } else if (format_ == Format::kBinary32) {
+          int32_t v;
+          std::memcpy(&v, q, 4);
+          raw = v;
+        } else {
+          float v;
+          std::memcpy(&v, q, 4);
+          raw = v;
+        }
+        values_.push_back(analogs_[ch].a * raw + analogs_[ch].b);
+      }
+      AddSample(index, timestamp);
+    }
+  }
+
+  std::vector<Analog> analogs_;
+  std::vector<std::pair<double, uint64_t>> rates_;
+  size_t digital_words_{0};
+  Format format_{Format::kAscii};
+  double time_multiplier_{1};
+  std::vector<double> times_;
+  std::vector<double> values_;
+};
+
+//-----------------------------------------------------------------------------
+// resampling
+//-----------------------------------------------------------------------------
+namespace sv_detail {
+
+/**
+ * @brief out = round(a + t * (b - a)) for the 8 channels of one sample, halves rounded away from zero
+ * @desc Reference of SvLerp, the vector paths give the same values.
+ */
+inline void SvLerpScalar(const float* a, const float* b, float t, int32_t* out) {
+  for (size_t i = 0; i < kSvChannels; ++i) {
+    const float v = a[i] + t * (b[i] - a[i]);
+    out[i] = static_cast<int32_t>(std::lround(v));
+  }
+}
+
+/**
+ * @brief out = round(a + t * (b - a)) for the 8 channels of one sample, halves rounded away from zero
+ * @desc Truncated first, then corrected by one where the exact remainder reaches 0.5: the conversions of both
+ *       instruction sets round to nearest even or truncate, adding 0.5 before truncating rounds e.g. 0.49999997 up.
+ */
+inline void SvLerp(const float* a, const float* b, float t, int32_t* out) {
+#if defined(COMTRADE_NEON)
+  for (size_t i = 0; i < kSvChannels; i += 4) {
+    float32x4_t va = vld1q_f32(a + i);
+    float32x4_t v = vaddq_f32(va, vmulq_n_f32(vsubq_f32(vld1q_f32(b + i), va), t));
+    int32x4_t whole = vcvtq_s32_f32(v);
+    uint32x4_t up = vcageq_f32(vsubq_f32(v, vcvtq_f32_s32(whole)), vdupq_n_f32(0.5f));
+    int32x4_t sign = vbslq_s32(vcltq_f32(v, vdupq_n_f32(0)), vdupq_n_s32(-1), vdupq_n_s32(1));
+    vst1q_s32(out + i, vaddq_s32(whole, vandq_s32(sign, vreinterpretq_s32_u32(up))));
+  }
+#elif defined(COMTRADE_SSE2)
+  const __m128 vt = _mm_set1_ps(t);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  for (size_t i = 0; i < kSvChannels; i += 4) {
+    __m128 va = _mm_load_ps(a + i);
+    __m128 v = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(b + i), va), vt));
+    __m128i whole = _mm_cvttps_epi32(v);
+    __m128 remainder = _mm_and_ps(_mm_sub_ps(v, _mm_cvtepi32_ps(whole)), abs_mask);
+    __m128i up = _mm_castps_si128(_mm_cmpge_ps(remainder, _mm_set1_ps(0.5f)));
+    // -1 or 1 by the sign of v: (v < 0 ? all ones : 0) | 1
+    __m128i sign = _mm_or_si128(_mm_castps_si128(_mm_cmplt_ps(v, _mm_setzero_ps())), _mm_set1_epi32(1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(whole, _mm_and_si128(sign, up)));
+  }
+#else
+  SvLerpScalar(a, b, t, out);
+#endif
+}
+
+}   // namespace sv_detail
+
+/**
+ * @brief map COMTRADE channels to the 8 SV channels and resample to the SV rate
+ * @desc Without a mapping the first three current channels go to Ia, Ib, Ic (In as their sum) and the first three
+ *       voltage channels to Va, Vb, Vc (Vn as their sum). Values are scaled to 9-2LE units (1 mA, 10 mV).
+ *       The result is computed completely before publishing, the publisher loop only copies samples.
+ * @param record - loaded record
+ * @param samples_per_second - SV sample rate
+ * @param mapping - COMTRADE channel index per SV channel, -1 for zero, empty for the automatic mapping
+ * @return samples, sample-major with kSvChannels values per sample
+ */
+inline std::vector<int32_t> ComtradeResample(const ComtradeRecord& record, uint32_t samples_per_second,
+                                             std::vector<int> mapping = {}) {
+  const auto& channels = record.Channels();
+  std::array<float, kSvChannels> scale{};
+  if (mapping.empty()) {
+    mapping.assign(kSvChannels, -1);
+    size_t currents = 0, voltages = 0;
+    for (size_t ch = 0; ch < channels.size(); ++ch) {
+      std::string unit = channels[ch].unit;
+      std::transform(unit.begin(), unit.end(), unit.begin(), [](unsigned char c) { return std::toupper(c); });
+      if ((unit == "A" || unit == "KA") && currents < 3) {
+        mapping[currents++] = static_cast<int>(ch);
+      } else if ((unit == "V" || unit == "KV") && voltages < 3) {
+        mapping[4 + voltages++] = static_cast<int>(ch);
+      }
+    }
+  }
+  for (size_t sv = 0; sv < kSvChannels && sv < mapping.size(); ++sv) {
+    if (mapping[sv] < 0 || static_cast<size_t>(mapping[sv]) >= channels.size()) {
+      mapping[sv] = -1;
+      continue;
+    }
+    std::string unit = channels[mapping[sv]].unit;
+    std::transform(unit.begin(), unit.end(), unit.begin(), [](unsigned char c) { return std::toupper(c); });
+    const float kilo = unit.size() > 1 && unit[0] == 'K' ? 1000.0f : 1.0f;
+    scale[sv] = (sv < 4 ? 1000.0f : 100.0f) * kilo;
+  }
+  mapping.resize(kSvChannels, -1);
+  const bool neutral_current = mapping[3] < 0, neutral_voltage = mapping[7] < 0;
+
+  // source samples mapped and scaled, sample-major
+  const size_t count = record.SampleCount();
+  std::vector<float> source((count + 1) * kSvChannels + 4);
+  float* aligned = reinterpret_cast<float*>((reinterpret_cast<uintptr_t>(source.data()) + 15) & ~uintptr_t{15});
+  for (size_t n = 0; n < count; ++n) {
+    float* sample = aligned + n * kSvChannels;
+    for (size_t sv = 0; sv < kSvChannels; ++sv) {
+      sample[sv] = mapping[sv] < 0 ? 0.0f : static_cast<float>(record.Value(mapping[sv], n)) * scale[sv];
+    }
+    if (neutral_current) {
+      sample[3] = sample[0] + sample[1] + sample[2];
+    }
+    if (neutral_voltage) {
+      sample[7] = sample[4] + sample[5] + sample[6];
+    }
+  }
+  if (count == 0) {
+    return {};
+  }
+
+  const double duration = record.Time(count - 1) - record.Time(0);
+  const auto out_count = static_cast<size_t>(duration * samples_per_second) + 1;
+  std::vector<int32_t> out(out_count * kSvChannels);
+  size_t i = 0;
+  for (size_t k = 0; k < out_count; ++k) {
+    const double t = record.Time(0) + static_cast<double>(k) / samples_per_second;
+    while (i + 2 < count && record.Time(i + 1) <= t) {
+      ++i;
+    }
+    const size_t j = i + 1 < count ? i + 1 : i;
+    const double span = record.Time(j) - record.Time(i);
+    const float fraction = span > 0 ? static_cast<float>(std::clamp((t - record.Time(i)) / span, 0.0, 1.0)) : 0.0f;
+    sv_detail::SvLerp(aligned + i * kSvChannels, aligned + j * kSvChannels, fraction, &out[k * kSvChannels]);
+  }
+  return out;
+}
+
+/**
+ * @brief SV source playing a COMTRADE record
+ */
+class ComtradeSource : public SvTableSource {
+ public:
+  ComtradeSource(const std::filesystem::path& cfg_path, uint32_t samples_per_second, bool loop,
+                 std::vector<int> mapping = {})
+      : SvTableSource(ComtradeResample(ComtradeRecord(cfg_path), samples_per_second, std::move(mapping)), loop) {}
+};
@@ -0,0 +1,474 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   configuration file of the tasks and the difference between two configurations for a live reload
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fnmatch.h>
+
+#include <scl_parser.hpp>
+
+/**
+ * @brief file system events selectable in the [watch] section
+ */
+enum ConfigWatchEvent : uint32_t {
+  kWatchCreated = 1 << 0,
+  kWatchOpened = 1 << 1,
+  kWatchModified = 1 << 2,
+  kWatchClosed = 1 << 3,
+  kWatchDeleted = 1 << 4,
+};
+
+/**
+ * @brief SV publisher and subscriber settings, the same as the command line options
+ */
+struct SvConfig {
+  std::string subscribe;     ///< interface, empty - no subscriber
+  std::string publish;       ///< interface, empty - no publisher
+  uint32_t rate{4000};
+  uint32_t frequency{50};
+  double analysis{0};
+  std::string align;
+  uint32_t align_skew{32};
+  std::string comtrade;
+  bool loop{false};
+  uint32_t simulate{0};
+  uint32_t loops{1};
+  uint32_t launch_time{0};   ///< SO_TXTIME lead in us, 0 - user-space timing
+  std::string xdp;           ///< AF_XDP backend: generic native zerocopy, empty - packet sockets
+  uint32_t busy_poll{0};     ///< AF_XDP busy polling in us, 0 - off
+  std::vector<SclSvControl> streams;   ///< SV control blocks of the IED in the SCL file, published
+  std::vector<std::string> expected;   ///< svIDs of the other IEDs in the SCL file, subscribed
+};
+
+/**
+ * @brief everything a configuration file may set
+ */
+struct Config {
+  std::vector<std::string> roots;   ///< absolute, normalized root directories
+  uint32_t events{kWatchClosed | kWatchModified | kWatchDeleted};
+  std::vector<std::string> excludes;     ///< fnmatch patterns on the file name
+  uint32_t test_period_ms{1000};         ///< test task period without wakeups
+  std::map<std::string, int> priorities;   ///< task name - SCHED_FIFO priority, 0 - SCHED_OTHER
+  SvConfig sv;
+  std::string goose_publish;
+  std::string goose_subscribe;
+  std::string log_level{"info"};
+  std::string scl_file;                      ///< absolute, normalized SCD/CID file, empty - none
+  std::string scl_ied;                       ///< IED of the board in the SCL file
+  std::vector<SclGseControl> goose_blocks;   ///< GOOSE control blocks of the IED in the SCL file, published
+
+  /**
+   * @brief event of a file below one of the roots, neither excluded nor deselected
+   * @param path - zero terminated, as the paths of both watchers
+   */
+  bool Watched(uint32_t event, std::string_view path) const {
+    if (!(events & event)) {
+      return false;
+    }
+    const size_t slash = path.rfind('/');
+    const char* name = path.data() + (slash == std::string_view::npos ? 0 : slash + 1);   // no copy, called per event
+    for (const auto& pattern : excludes) {
+      if (fnmatch(pattern.c_str(), name, 0) == 0) {
+        return false;
+      }
+    }
+    return std::any_of(roots.begin(), roots.end(), [&](const std::string& root) {
+      return path.size() > root.size() && path.compare(0, root.size(), root) == 0 &&
+             (path[root.size()] == '/' || root == "/");
+    });
+  }
+
+  void Print(std::FILE* out = stdout) const {
+    for (const auto& root : roots) {
+      std::fprintf(out, "watch root %s\n", root.c_str());
+    }
+    for (const auto& pattern : excludes) {
+      std::fprintf(out, "watch exclude %s\n", pattern.c_str());
+    }
+    for (const auto& [task, priority] : priorities) {
+      std::fprintf(out, "task %s priority %d\n", task.c_str(), priority);
+    }
+    std::fprintf(out, "test period %u ms, log level %s\n", test_period_ms, log_level.c_str());
+  }
+};
+
+/**
+ * @brief what a reload has to touch
+ */
+struct ConfigDiff {
+  std::vector<std::string> roots_added;
+  std::vector<std::string> roots_removed;
+  std::vector<std::string> priorities;   ///< tasks whose priority changed
+  bool filter{false};                    ///< events or excludes
+  bool test{false};
+  bool log{false};
+  bool sv_subscriber{false};
+  bool sv_publisher{false};
+  bool goose_publisher{false};
+  bool goose_subscriber{false};
+
+  bool Empty() const {
+    return roots_added.empty() && roots_removed.empty() && priorities.empty() && !filter && !test && !log &&
+           !sv_subscriber && !sv_publisher && !goose_publisher && !goose_subscriber;
+  }
+
+  /**
+   * @brief one line summary, e.g. "+root /data, filter, restart sv-publisher"
+   */
+  std::string Describe() const {
+    std::string text;
+    auto add = [&](const std::string& item) { text += (text.empty() ? "" : ", ") + item; };
+    for (const auto& root : roots_added) {
+      add("+root " + root);
+    }
+    for (const auto& root : roots_removed) {
+      add("-root " + root);
+    }
+    if (filter) {
+      add("filter");
+    }
+    if (test) {
+      add("test period");
+    }
+    if (log) {
+      add("log level");
+    }
+    for (const auto& task : priorities) {
+      add("priority " + task);
+    }
+    for (const auto& [changed, task] :
+         {std::pair{sv_subscriber, "sv-subscriber"}, std::pair{sv_publisher, "sv-publisher"},
+          std::pair{goose_publisher, "goose-publisher"}, std::pair{goose_subscriber, "goose-subscriber"}}) {
+      if (changed) {
+        add(std::string("restart ") + task);
+      }
+    }
+    return text.empty() ? "no changes" : text;
+  }
+};
+
+/**
+ * @brief compare two configurations
+ */
+inline ConfigDiff DiffConfig(const Config& from, const Config& to) {
+  ConfigDiff diff;
+  for (const auto& root : to.roots) {
+    if (std::find(from.roots.begin(), from.roots.end(), root) == from.roots.end()) {
+      diff.roots_added.push_back(root);
+    }
+  }
+  for (const auto& root : from.roots) {
+    if (std::find(to.roots.begin(), to.roots.end(), root) == to.roots.end()) {
+      diff.roots_removed.push_back(root);
+    }
+  }
+  for (const auto& [task, priority] : to.priorities) {
+    const auto it = from.priorities.find(task);
+    if (it == from.priorities.end() || it->second != priority) {
+      diff.priorities.push_back(task);
+    }
+  }
+  for (const auto& [task, priority] : from.priorities) {
+    if (!to.priorities.contains(task)) {
+      diff.priorities.push_back(task);   // back to SCHED_OTHER
+    }
+  }
+  diff.filter = from.events != to.events || from.excludes != to.excludes;
+  diff.test = from.test_period_ms != to.test_period_ms;
+  diff.log = from.log_level != to.log_level;
+
+  const SvConfig& a = from.sv;
+  const SvConfig& b = to.sv;
+  diff.sv_subscriber = a.subscribe != b.subscribe ||
+                       (!b.subscribe.empty() && (a.rate != b.rate || a.frequency != b.frequency ||
+                                                 a.analysis != b.analysis || a.align != b.align ||
+                                                 a.align_skew != b.align_skew || a.xdp != b.xdp ||
+                                                 a.busy_poll != b.busy_poll || a.expected != b.expected));
+  diff.sv_publisher = a.publish != b.publish ||
+                      (!b.publish.empty() && (a.rate != b.rate || a.frequency != b.frequency ||
+                                              a.comtrade != b.comtrade || a.loop != b.loop ||
+                                              a.simulate != b.simulate || a.loops != b.loops ||
+                                              a.launch_time != b.launch_time || a.xdp != b.xdp ||
+                                              a.busy_poll != b.busy_poll || a.streams != b.streams));
+  diff.goose_publisher = from.goose_publish != to.goose_publish ||
+                         (!to.goose_publish.empty() && from.goose_blocks != to.goose_blocks);
+  diff.goose_subscriber = from.goose_subscribe != to.goose_subscribe;
+  return diff;
+}
+
+/**
+ * @brief root directory as kept in Config::roots: absolute, normalized, without a trailing slash
+ */
+inline std::string NormalRoot(const std::string& path) {
+  std::string root = std::filesystem::absolute(path).lexically_normal().string();
+  if (root.size() > 1 && root.back() == '/') {
+    root.pop_back();
+  }
+  return root;
+}
+
+namespace config_detail {
+
+inline std::string_view Trim(std::string_view text) {
+  const size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+inline uint32_t ToUnsigned(const std::string& value) {
+  size_t end = 0;
+  const unsigned long number = std::stoul(value, &end);
+  if (end != value.size() || number > UINT32_MAX) {
+    throw std::invalid_argument(value);
+  }
+  return static_cast<uint32_t>(number);
+}
+
+inline bool ToBool(const std::string& value) {
+  if (value == "true" || value == "yes" || value == "on" || value == "1") {
+    return true;
+  }
+  if (value == "false" || value == "no" || value == "off" || value == "0") {
+    return false;
+  }
+  throw std::invalid_argument(value);
+}
+
+inline uint32_t ToEvents(const std::string& value) {
+  static constexpr std::pair<const char*, uint32_t> kEvents[] = {
+     {"created", kWatchCreated}, {"opened", kWatchOpened}, {"modified", kWatchModified},
+     {"closed", kWatchClosed},   {"deleted", kWatchDeleted},
+  };
+  uint32_t events = 0;
+  for (size_t begin = 0; begin < value.size();) {
+    size_t end = value.find_first_of(", ", begin);
+    end = end == std::string::npos ? value.size() : end;
+    const std::string name = value.substr(begin, end - begin);
+    begin = end + 1;
+    if (name.empty()) {
+      continue;
+    }
+    const auto it = std::find_if(std::begin(kEvents), std::end(kEvents), [&](auto& e) { return name == e.first; });
+    if (it == std::end(kEvents)) {
+      throw std::invalid_argument(name);
+    }
+    events |= it->second;
+  }
+  return events;
+}
+
+}   // namespace config_detail
+
+/**
+ * @brief parse a configuration file on top of a base configuration, usually the command line options
+ * @desc INI format, '#' or ';' start a comment line. A section repeats its key for lists, the first root or
+ *       exclude of the file replaces the list of the base:
+ *         [watch]
+ *         root = /tmp
+ *         root = /var/lib/bbx15
+ *         events = closed, modified, deleted     # created opened modified closed deleted
+ *         exclude = *.swp
+ *         [task test]
+ *         period = 1000                          # ms, test task only
+ *         priority = 0                           # SCHED_FIFO 1..99, 0 - SCHED_OTHER
+ *         [task sv-publisher]
+ *         priority = 80
+ *         [sv]
+ *         subscribe = eth1                       # rate frequency analysis align align_skew
+ *         publish = eth1                         # comtrade loop simulate loops launch_time
+ *         xdp = generic                          # generic native zerocopy, busy_poll (us)
+ *         [goose]
+ *         publish = eth1
+ *         subscribe = eth1
+ *         [scl]
+ *         file = /etc/bbx15/station.scd          # reloaded on change as well, see LoadScl()
+ *         ied = MU01
+ *         [log]
+ *         level = info                           # error warning info debug
+ * @throw std::runtime_error with the line number of the first error
+ */
+inline Config ParseConfig(std::string_view text, Config config = {}) {
+  using namespace config_detail;
+  std::string section;
+  std::string task;
+  bool own_roots = false;
+  bool own_excludes = false;
+  size_t line_number = 0;
+
+  for (size_t begin = 0; begin < text.size(); ++line_number) {
+    size_t end = text.find('\n', begin);
+    end = end == std::string_view::npos ? text.size() : end;
+    const std::string_view line = Trim(text.substr(begin, end - begin));
+    begin = end + 1;
+    auto error = [&](const std::string& message) {
+      return std::runtime_error("Config: line " + std::to_string(line_number + 1) + ": " + message);
+    };
+    if (line.empty() || line.front() == '#' || line.front() == ';') {
+      continue;
+    }
+    if (line.front() == '[') {
+      if (line.back() != ']') {
+        throw error("unterminated section");
+      }
+      section = std::string(Trim(line.substr(1, line.size() - 2)));
+      task.clear();
+      if (section.starts_with("task ")) {
+        task = std::string(Trim(std::string_view(section).substr(5)));
+        section = "task";
+      }
+      if (section != "watch" && section != "task" && section != "sv" && section != "goose" && section != "log" &&
+          section != "scl") {
+        throw error("unknown section [" + section + "]");
+      }
+      continue;
+    }
+    const size_t equal = line.find('=');
+    if (equal == std::string_view::npos) {
+      throw error("expected key = value");
+    }
+    const std::string key(Trim(line.substr(0, equal)));
+    std::string value(Trim(line.substr(equal + 1)));
+    if (const size_t comment = value.find(" #"); comment != std::string::npos) {
+      value = std::string(Trim(std::string_view(value).substr(0, comment)));
+    }
+
+    try {
+      if (section == "watch" && key == "root") {
+        if (!own_roots) {
+          config.roots.clear();
+          own_roots = true;
+        }
+        const std::string root = NormalRoot(value);
+        if (std::find(config.roots.begin(), config.roots.end(), root) == config.roots.end()) {
+          config.roots.push_back(root);
+        }
+      } else if (section == "watch" && key == "events") {
+        config.events = ToEvents(value);
+      } else if (section == "watch" && key == "exclude") {
+        if (!own_excludes) {
+          config.excludes.clear();
+          own_excludes = true;
+        }
+        config.excludes.push_back(value);
+      } else if (section == "task" && key == "priority") {
+        const uint32_t priority = ToUnsigned(value);
+        if (priority > 99) {
+          throw error("priority out of range 0..99");
+        }
+        config.priorities[task] = static_cast<int>(priority);
+      } else if (section == "task" && key == "period" && task == "test") {
+        config.test_period_ms = std::max<uint32_t>(ToUnsigned(value), 1);
+      } else if (section == "sv" && key == "subscribe") {
+        config.sv.subscribe = value;
+      } else if (section == "sv" && key == "publish") {
+        config.sv.publish = value;
+      } else if (section == "sv" && key == "rate") {
+        config.sv.rate = ToUnsigned(value);
+      } else if (section == "sv" && key == "frequency") {
+        config.sv.frequency = ToUnsigned(value);
+      } else if (section == "sv" && key == "analysis") {
+        config.sv.analysis = std::stod(value);
+      } else if (section == "sv" && key == "align") {
+        config.sv.align = value;
+      } else if (section == "sv" && key == "align_skew") {
+        config.sv.align_skew = ToUnsigned(value);
+      } else if (section == "sv" && key == "comtrade") {
+        config.sv.comtrade = value;
+      } else if (section == "sv" && key == "loop") {
+        config.sv.loop = ToBool(value);
+      } else if (section == "sv" && key == "simulate") {
+        config.sv.simulate = ToUnsigned(value);
+      } else if (section == "sv" && key == "loops") {
+        config.sv.loops = std::max<uint32_t>(ToUnsigned(value), 1);
+      } else if (section == "sv" && key == "launch_time") {
+        config.sv.launch_time = ToUnsigned(value);
+      } else if (section == "sv" && key == "xdp") {
+        if (value != "generic" && value != "native" && value != "zerocopy") {
+          throw std::invalid_argument(value);
+        }
+        config.sv.xdp = value;
+      } else if (section == "sv" && key == "busy_poll") {
+        config.sv.busy_poll = ToUnsigned(value);
+      } else if (section == "scl" && key == "file") {
+        config.scl_file = std::filesystem::absolute(value).lexically_normal().string();
+      } else if (section == "scl" && key == "ied") {
+        config.scl_ied = value;
+      } else if (section == "goose" && key == "publish") {
+        config.goose_publish = value;
+      } else if (section == "goose" && key == "subscribe") {
+        config.goose_subscribe = value;
+      } else if (section == "log" && key == "level") {
+        if (value != "error" && value != "warning" && value != "info" && value != "debug") {
+          throw std::invalid_argument(value);
+        }
+        config.log_level = value;
+      } else {
+        throw error("unknown key " + key + (section.empty() ? "" : " in [" + section + "]"));
+      }
+    } catch (std::invalid_argument&) {
+      throw error("invalid value for " + key + ": " + value);
+    } catch (std::out_of_range&) {
+      throw error("value out of range for " + key + ": " + value);
+    }
+  }
+  return config;
+}
+
+/**
+ * @brief read the SCL file of a configuration and take the control blocks of its IED
+ * @desc The SV and GOOSE control blocks of the IED are published, the SV streams of all other IEDs are expected by
+ *       the subscriber. Without an IED nothing is published from the file and every SV stream is expected. The
+ *       lists are part of the configuration, a changed file restarts only the tasks whose streams changed.
+ * @throw std::runtime_error if the file cannot be read or parsed, or has no control block of the IED
+ */
+inline void LoadScl(Config& config) {
+  config.sv.streams.clear();
+  config.sv.expected.clear();
+  config.goose_blocks.clear();
+  if (config.scl_file.empty()) {
+    return;
+  }
+  Scl scl = ReadScl(config.scl_file);
+  for (auto& cb : scl.sv) {
+    if (!config.scl_ied.empty() && cb.ied == config.scl_ied) {
+      config.sv.streams.push_back(std::move(cb));
+    } else {
+      config.sv.expected.push_back(cb.sv_id);
+    }
+  }
+  for (auto& cb : scl.goose) {
+    if (!config.scl_ied.empty() && cb.ied == config.scl_ied) {
+      config.goose_blocks.push_back(std::move(cb));
+    }
+  }
+  if (!config.scl_ied.empty() && config.sv.streams.empty() && config.goose_blocks.empty()) {
+    throw std::runtime_error("SCL: no control block of IED " + config.scl_ied + " in " + config.scl_file);
+  }
+}
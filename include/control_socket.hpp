@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   line based control commands on a Unix stream socket, driven by the caller's poll loop
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief control socket without a thread of its own
+ * @desc The owner adds the descriptors to its poll set with AddPollFds() and hands the result to Process(), which
+ *       accepts clients, splits their input into lines and answers every line with the handler's reply. Clients
+ *       may send several commands over one connection, e.g.
+ *         echo stats | socat - UNIX-CONNECT:/run/bbx15.sock
+ *       All sockets are non-blocking, a slow client cannot stall the loop for more than kSendTimeoutMs.
+ */
+class ControlSocket {
+ public:
+  static constexpr size_t kMaxClients = 8;
+  static constexpr size_t kMaxLine = 4096;
+  static constexpr int kSendTimeoutMs = 100;
+
+  explicit ControlSocket(std::string path) : path_(std::move(path)) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path_.size() >= sizeof(addr.sun_path)) {
+      throw std::runtime_error("Control socket: path too long: " + path_);
+    }
+    std::strcpy(addr.sun_path, path_.c_str());
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+      throw std::runtime_error("Control socket: socket failed: " + std::string(strerror(errno)));
+    }
+    unlink(path_.c_str());   // left over from a previous run
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd_, 4) < 0) {
+      const std::string error = strerror(errno);
+      close(fd_);
+      throw std::runtime_error("Control socket: cannot listen on " + path_ + ": " + error);
+    }
+  }
+
+  ControlSocket(const ControlSocket&) = delete;
+  ControlSocket& operator=(const ControlSocket&) = delete;
+  ~ControlSocket() {
+    for (auto& client : clients_) {
+      close(client.fd);
+    }
+    close(fd_);
+    unlink(path_.c_str());
+  }
+
+  /**
+   * @brief append the listening socket and all clients to a poll set
+   */
+  void AddPollFds(std::vector<pollfd>& fds) const {
+    fds.push_back({fd_, POLLIN, 0});
+    for (const auto& client : clients_) {
+      fds.push_back({client.fd, POLLIN, 0});
+    }
+  }
+
+  /**
+   * @brief serve the ready descriptors of a poll set filled by AddPollFds()
+   * @param handler - callable as std::string handler(std::string_view line), returns the reply
+   */
+  template <class Handler>
+  void Process(const std::vector<pollfd>& fds, Handler&& handler) {
+    bool accept_pending = false;
+    for (const auto& pfd : fds) {
+      if (!pfd.revents) {
+        continue;
+      }
+      if (pfd.fd == fd_) {
+        accept_pending = true;
+        continue;
+      }
+      for (auto& client : clients_) {
+        if (client.fd == pfd.fd && !Receive(client, handler)) {
+          close(client.fd);
+          client.fd = -1;
+        }
+      }
+    }
+    std::erase_if(clients_, [](const Client& client) { return client.fd < 0; });
+    if (accept_pending) {
+      Accept();
+    }
+  }
+
+  const std::string& Path() const { return path_; }
+
+ private:
+  struct Client {
+    int fd;
+    std::string input;
+  };
+
+  void Accept() {
+    for (int client; (client = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0;) {
+      if (clients_.size() >= kMaxClients) {
+        static constexpr char kBusy[] = "error: too many clients\n";
+        [[maybe_unused]] auto sent = send(client, kBusy, sizeof(kBusy) - 1, MSG_NOSIGNAL);
+        close(client);
+        continue;
+      }
+      clients_.push_back(Client{client, {}});
+    }
+  }
+
+  /**
+   * @return false if the client is to be closed
+   */
+  template <class Handler>
+  bool Receive(Client& client, Handler& handler) {
+    char buffer[1024];
+    const ssize_t got = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) {
+      return false;
+    }
+    if (got < 0) {
+      return true;
+    }
+    client.input.append(buffer, static_cast<size_t>(got));
+    for (size_t end; (end = client.input.find('\n')) != std::string::npos;) {
+      std::string_view line(client.input.data(), end);
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      if (!line.empty() && !Send(client.fd, handler(line))) {
+        return false;
+      }
+      client.input.erase(0, end + 1);
+    }
+    return client.input.size() <= kMaxLine;
+  }
+
+  static bool Send(int fd, const std::string& reply) {
+    const char* data = reply.data();
+    size_t size = reply.size();
+    while (size > 0) {
+      const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EAGAIN) {
+        pollfd pfd{fd, POLLOUT, 0};
+        if (poll(&pfd, 1, kSendTimeoutMs) <= 0) {
+          return false;
+        }
+        continue;
+      }
+      if (sent <= 0) {
+        return false;
+      }
+      data += sent;
+      size -= static_cast<size_t>(sent);
+    }
+    return true;
+  }
+
+  std::string path_;
+  int fd_{-1};
+  std::vector<Client> clients_;
+};
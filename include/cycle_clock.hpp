@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   architectural counter (CNTVCT/TSC) calibrated against CLOCK_MONOTONIC
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief time stamps for instrumentation
+ * @desc Ticks() reads the counter with one instruction: CNTVCT_EL0 on AArch64, CNTVCT on ARMv7 with the generic
+ *       timer (built with -mcpu=cortex-a15/-a7, or CYCLE_CLOCK_CNTVCT defined), the TSC on x86. Other targets fall
+ *       back to clock_gettime(CLOCK_MONOTONIC). Ticks are converted to CLOCK_MONOTONIC nanoseconds with a
+ *       multiply-shift whose parameters are published through a sequence lock. The first conversion calibrates
+ *       over 10 ms; Recalibrate(), called about once per second from a housekeeping thread, refines the rate over
+ *       the whole run time and re-anchors the conversion so that drift against CLOCK_MONOTONIC stays bounded.
+ *       Hot paths store raw ticks and convert later.
+ */
+class CycleClock {
+ public:
+#if defined(__aarch64__) || defined(__x86_64__) || defined(__i386__) || \
+   (defined(__arm__) && (defined(__ARM_ARCH_7VE__) || defined(CYCLE_CLOCK_CNTVCT)))
+  static constexpr bool kHardware = true;
+#else
+  static constexpr bool kHardware = false;
+#endif
+
+  /**
+   * @brief raw counter value
+   */
+  static uint64_t Ticks() {
+#if defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#elif defined(__arm__) && (defined(__ARM_ARCH_7VE__) || defined(CYCLE_CLOCK_CNTVCT))
+    uint32_t low, high;
+    asm volatile("mrrc p15, 1, %0, %1, c14" : "=r"(low), "=r"(high));
+    return static_cast<uint64_t>(high) << 32 | low;
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(MonotonicNs());
+#endif
+  }
+
+  /**
+   * @brief CLOCK_MONOTONIC time of a tick value
+   */
+  static int64_t ToNs(uint64_t ticks) {
+    if constexpr (!kHardware) {
+      return static_cast<int64_t>(ticks);
+    }
+    Calibration c = Load();
+    const int64_t delta = static_cast<int64_t>(ticks - c.base_ticks);
+    return c.base_ns + (delta >= 0 ? MulShift(static_cast<uint64_t>(delta), c)
+                                   : -MulShift(static_cast<uint64_t>(-delta), c));
+  }
+
+  /**
+   * @brief duration of a tick difference in ns
+   */
+  static int64_t TicksToNs(int64_t ticks) {
+    if constexpr (!kHardware) {
+      return ticks;
+    }
+    Calibration c = Load();
+    return ticks >= 0 ? MulShift(static_cast<uint64_t>(ticks), c) : -MulShift(static_cast<uint64_t>(-ticks), c);
+  }
+
+  static int64_t NowNs() { return ToNs(Ticks()); }
+
+  /**
+   * @brief counter frequency in Hz as currently calibrated
+   */
+  static double Frequency() {
+    if constexpr (!kHardware) {
+      return 1e9;
+    }
+    Calibration c = Load();
+    return std::ldexp(1e9, static_cast<int>(c.shift)) / static_cast<double>(c.mult);
+  }
+
+  /**
+   * @brief refine the rate against CLOCK_MONOTONIC, single caller thread
+   * @return deviation of the previous conversion from CLOCK_MONOTONIC at this moment in ns
+   */
+  static int64_t Recalibrate() {
+    if constexpr (!kHardware) {
+      return 0;
+    }
+    Load();   // make sure the initial calibration is done
+    const Sample now = Pair();
+    const int64_t deviation = ToNs(now.ticks) - now.ns;
+    const Sample anchor{anchor_ticks_.load(std::memory_order_relaxed), anchor_ns_.load(std::memory_order_relaxed)};
+    Store(anchor, now);
+    last_deviation_ns_.store(deviation, std::memory_order_relaxed);
+    return deviation;
+  }
+
+  /**
+   * @brief deviation found by the last Recalibrate()
+   */
+  static int64_t LastDeviationNs() { return last_deviation_ns_.load(std::memory_order_relaxed); }
+
+  static int64_t MonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+  }
+
+ private:
+  struct Calibration {
+    uint64_t base_ticks;
+    int64_t base_ns;
+    uint32_t mult;
+    uint32_t shift;
+  };
+
+  struct Sample {
+    uint64_t ticks;
+    int64_t ns;
+  };
+
+  /**
+   * @brief delta * mult >> shift without 128 bit arithmetic (ARMv7)
+   */
+  static int64_t MulShift(uint64_t delta, const Calibration& c) {
+    const uint64_t high = (delta >> 32) * c.mult;
+    const uint64_t low = ((delta & 0xFFFFFFFFu) * c.mult) >> c.shift;
+    return static_cast<int64_t>((high << (32 - c.shift)) + low);
+  }
+
+  /**
+   * @brief counter and CLOCK_MONOTONIC read as close together as possible, best of five
+   */
+  static Sample Pair() {
+    Sample best{0, 0};
+    uint64_t best_window = UINT64_MAX;
+    for (int i = 0; i < 5; ++i) {
+      const uint64_t before = Ticks();
+      const int64_t ns = MonotonicNs();
+      const uint64_t after = Ticks();
+      if (after - before < best_window) {
+        best_window = after - before;
+        best = Sample{before + (after - before) / 2, ns};
+      }
+    }
+    return best;
+  }
+
+  /**
+   * @brief publish a new conversion: rate from anchor to now, based at now
+   */
+  static void Store(const Sample& anchor, const Sample& now) {
+    const double ns_per_tick = static_cast<double>(now.ns - anchor.ns) / static_cast<double>(now.ticks - anchor.ticks);
+    uint32_t shift = 32;
+    while (shift > 0 && std::ldexp(ns_per_tick, static_cast<int>(shift)) >= 4294967295.0) {
+      --shift;
+    }
+    const auto mult = static_cast<uint32_t>(std::llround(std::ldexp(ns_per_tick, static_cast<int>(shift))));
+
+    seq_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    base_ticks_.store(now.ticks, std::memory_order_relaxed);
+    base_ns_.store(now.ns, std::memory_order_relaxed);
+    mult_.store(mult, std::memory_order_relaxed);
+    shift_.store(shift, std::memory_order_relaxed);
+    seq_.fetch_add(1, std::memory_order_release);
+  }
+
+  static bool Initialize() {
+    const Sample anchor = Pair();
+    const timespec wait{0, 10'000'000};
+    nanosleep(&wait, nullptr);
+    const Sample now = Pair();
+    anchor_ticks_.store(anchor.ticks, std::memory_order_relaxed);
+    anchor_ns_.store(anchor.ns, std::memory_order_relaxed);
+    Store(anchor, now);
+    return true;
+  }
+
+  static Calibration Load() {
+    [[maybe_unused]] static const bool initialized = Initialize();
+    Calibration c;
+    uint32_t seq;
+    do {
+      seq = seq_.load(std::memory_order_acquire);
+      c.base_ticks = base_ticks_.load(std::memory_order_relaxed);
+      c.base_ns = base_ns_.load(std::memory_order_relaxed);
+      c.mult = mult_.load(std::memory_order_relaxed);
+      c.shift = shift_.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != seq_.load(std::memory_order_relaxed));
+    return c;
+  }
+
+  static inline std::atomic<uint32_t> seq_{0};
+  static inline std::atomic<uint64_t> base_ticks_{0};
+  static inline std::atomic<int64_t> base_ns_{0};
+  static inline std::atomic<uint32_t> mult_{1};
+  static inline std::atomic<uint32_t> shift_{0};
+  static inline std::atomic<uint64_t> anchor_ticks_{0};
+  static inline std::atomic<int64_t> anchor_ns_{0};
+  static inline std::atomic<int64_t> last_deviation_ns_{0};
+};
@@ -1,17 +1,28 @@
 #pragma once
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 #ifdef __linux__
 #include <errno.h>
 #include <limits.h>
 #include <signal.h>
+#include <sys/eventfd.h>
 #include <sys/inotify.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <unistd.h>
+
+#include <trace_events.hpp>
+#include <usdt.hpp>
 #define MAX_EVENTS 1024 /*Max. number of events to process at one go*/
 #define LEN_NAME                                                               \
   16 /*Assuming that the length of the filename won't exceed 16 bytes*/
@@ -19,7 +30,8 @@
 #define EVENT_BUF_LEN                                                          \
   (MAX_EVENTS * (EVENT_SIZE + LEN_NAME)) /*buffer to store the data of         \
                                             events*/
-#define WATCH_FLAGS (IN_CREATE | IN_MODIFY | IN_DELETE | IN_OPEN | IN_CLOSE)
+#define WATCH_FLAGS                                                            \
+  (IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_DELETE | IN_OPEN | IN_CLOSE)
 
 // Keep going  while run == true, or, in other words, until user hits ctrl-c
 static bool run = true;
@@ -56,21 +68,37 @@ public:
   // Erase watch specified by pd (parent watch descriptor) and name from watch
   // list. Returns full name (for display etc), and wd, which is required for
   // inotify_rm_watch.
+  // *wd is -1 and the name empty if there is no such watch.
   std::string erase(int pd, const std::string &name, int *wd) {
-    wd_elem pelem = {pd, name};
-    *wd = rwatch[pelem];
-    rwatch.erase(pelem);
-    const wd_elem &elem = watch[*wd];
-    std::string dir = elem.name;
-    watch.erase(*wd);
+    auto rit = rwatch.find(wd_elem{pd, name});
+    if (rit == rwatch.end()) {
+      *wd = -1;
+      return {};
+    }
+    *wd = rit->second;
+    rwatch.erase(rit);
+    auto it = watch.find(*wd);
+    if (it == watch.end()) {
+      return {};
+    }
+    std::string dir = it->second.name;
+    watch.erase(it);
     return dir;
   }
   // Given a watch descriptor, return the full directory name as string.
   // Recurses up parent WDs to assemble name, an idea borrowed from Windows
-  // change journals.
-  std::string get(int wd) {
-    const wd_elem &elem = watch[wd];
-    return elem.pd == -1 ? elem.name : this->get(elem.pd) + "/" + elem.name;
+  // change journals. Empty if the wd or one of its parents is no longer
+  // watched, e.g. for events queued before its root was removed.
+  std::string get(int wd) const {
+    auto it = watch.find(wd);
+    if (it == watch.end()) {
+      return {};
+    }
+    if (it->second.pd == -1) {
+      return it->second.name;
+    }
+    const std::string parent = get(it->second.pd);
+    return parent.empty() ? parent : parent + "/" + it->second.name;
   }
   // Given a parent wd and name (provided in IN_DELETE events), return the watch
   // descriptor. Main purpose is to help remove directories from watch list.
@@ -78,6 +106,30 @@ public:
     wd_elem elem = {pd, name};
     return rwatch[elem];
   }
+  // Given a parent wd and name, return the watch descriptor or -1 if there is
+  // no such watch.
+  int find(int pd, const std::string &name) const {
+    auto it = rwatch.find(wd_elem{pd, name});
+    return it == rwatch.end() ? -1 : it->second;
+  }
+  // Remove a watch and the watches of all its subdirectories.
+  void erase_tree(int fd, int wd) {
+    for (auto wi = watch.begin(); wi != watch.end();) {
+      if (wi->second.pd == wd) {
+        const int child = wi->first;
+        erase_tree(fd, child);
+        wi = watch.upper_bound(child);
+      } else {
+        ++wi;
+      }
+    }
+    auto it = watch.find(wd);
+    if (it != watch.end()) {
+      inotify_rm_watch(fd, wd);
+      rwatch.erase(it->second);
+      watch.erase(it);
+    }
+  }
   void cleanup(int fd) {
     for (auto wi = watch.begin(); wi != watch.end();) {
       inotify_rm_watch(fd, wi->first);
@@ -110,6 +162,7 @@ public:
   struct EventInfo {
     Event type;
     std::filesystem::path path;
+    uint32_t mask;   // inotify mask, e.g. tells IN_CLOSE_WRITE from IN_CLOSE_NOWRITE
   };
 
   fswatch() {}
@@ -136,6 +189,34 @@ public:
     append_to_path(tail...);
   }
 
+  // Add a root directory. While start() runs the watch is added by the
+  // watcher thread, the other roots are not disturbed.
+  void add_root(const std::string &path) {
+    auto root = expand(std::filesystem::path(path));
+    if (!std::filesystem::is_directory(root)) {
+      throw std::invalid_argument("not a directory: " + path);
+    }
+    request(std::move(root), true);
+  }
+
+  // Remove a root directory and the watches of its subdirectories.
+  void remove_root(const std::string &path) {
+    auto root = expand(std::filesystem::path(path));
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex);
+      if (std::find(paths.begin(), paths.end(), root) == paths.end()) {
+        throw std::invalid_argument("not a watched root: " + path);
+      }
+    }
+    request(std::move(root), false);
+  }
+
+  // Root directories, requests not yet applied by the watcher excluded.
+  std::vector<std::filesystem::path> roots() {
+    std::lock_guard<std::mutex> lock(requests_mutex);
+    return paths;
+  }
+
   void on(const Event &event,
           const std::function<void(const EventInfo &)> &action) {
     callbacks[event] = action;
@@ -149,7 +230,15 @@ public:
   }
 
 #ifdef __linux__
-  void stop() { run = false; }
+  void stop() {
+    run = false;
+    // wake up select(), the roots may not see any further event
+    std::lock_guard<std::mutex> lock(requests_mutex);
+    if (request_fd >= 0) {
+      const uint64_t one = 1;
+      [[maybe_unused]] auto written = write(request_fd, &one, sizeof(one));
+    }
+  }
 
   void start() {
     // std::map used to keep track of wd (watch descriptors) and directory names
@@ -187,15 +276,18 @@ public:
       throw std::runtime_error("inotify_init failed");
     }
 
-    // use select watch list for non-blocking inotify read
-    FD_ZERO(&watch_set);
-    FD_SET(fd, &watch_set);
+    // root directories added or removed while running are signalled here
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex);
+      request_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
 
     int wd;
-    for (auto& path : paths) {
+    for (auto& path : roots()) {
       auto path_string = path.string();
       const char *root = path_string.c_str();
       wd = inotify_add_watch(fd, root, WATCH_FLAGS);
+      BBX15_PROBE2(watch_add, wd, root);
       // add wd and directory name to Watch map
       watch.insert(-1, root, wd);
     }
@@ -206,29 +298,56 @@ public:
       // select syntax is beyond the scope of this sample but, don't worry, the
       // fd+1 is correct: select needs the the highest fd (+1) as the first
       // parameter.
-      select(fd + 1, &watch_set, NULL, NULL, NULL);
+      FD_ZERO(&watch_set);
+      FD_SET(fd, &watch_set);
+      if (request_fd >= 0) {
+        FD_SET(request_fd, &watch_set);
+      }
+      if (select((fd > request_fd ? fd : request_fd) + 1, &watch_set, NULL,
+                 NULL, NULL) < 0) {
+        continue;
+      }
+      if (request_fd >= 0 && FD_ISSET(request_fd, &watch_set)) {
+        apply_requests(fd, watch);
+      }
+      if (!FD_ISSET(fd, &watch_set)) {
+        continue;
+      }
 
       // Read event(s) from non-blocking inotify fd (non-blocking specified in
       // inotify_init1 above).
+      TraceSpan batch_span("fswatch read batch");
+      if (Tracer::Enabled()) {
+        int pending = 0;
+        ioctl(fd, FIONREAD, &pending);
+        Tracer::Counter("inotify queue bytes", pending);
+      }
+      BBX15_PROBE(read_batch_start);
       int length = read(fd, buffer, EVENT_BUF_LEN);
       if (run && length < 0) {
         throw std::runtime_error("failed to read event(s) from inotify fd");
       }
 
       // Loop through event buffer
-      for (int i = 0; i < length;) {
+      int batch_events = 0;
+      for (int i = 0; i < length; ++batch_events) {
         struct inotify_event *event = (struct inotify_event *)&buffer[i];
+        BBX15_PROBE3(event_decode, event->wd, event->mask, event->len);
         // Never actually seen this
         if (event->wd == -1) {
+          BBX15_PROBE1(overflow, event->mask);
           throw std::runtime_error(
               "inotify IN_Q_OVERFLOW - Event queue overflowed");
         }
         // Never seen this either
         if (event->mask & IN_Q_OVERFLOW) {
+          BBX15_PROBE1(overflow, event->mask);
           throw std::runtime_error(
               "inotify IN_Q_OVERFLOW - Event queue overflowed");
         }
-        if (event->len) {
+        // events read after remove_root() may refer to watches already removed
+        current_dir = event->len ? watch.get(event->wd) : std::string();
+        if (event->len && !current_dir.empty()) {
           if (event->mask & IN_IGNORED) {
             // Watch was removed explicitly (inotify_rm_watch) or automatically
             // (file was deleted, or filesystem was unmounted)
@@ -237,62 +356,74 @@ public:
                 "(inotify_rm_watch) or automatically (file was deleted, or "
                 "filesystem was unmounted)");
           }
-          if (event->mask & IN_CREATE) {
-            current_dir = watch.get(event->wd);
+          // a file or directory renamed into a watched directory appears
+          // like a created one, e.g. a configuration saved atomically
+          if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
             if (event->mask & IN_ISDIR) {
               new_dir = current_dir + "/" + event->name;
               wd = inotify_add_watch(fd, new_dir.c_str(), WATCH_FLAGS);
+              BBX15_PROBE2(watch_add, wd, new_dir.c_str());
               watch.insert(event->wd, event->name, wd);
               total_dir_events++;
-              run_callback(Event::DIR_CREATED, current_dir, event->name);
+              run_callback(Event::DIR_CREATED, current_dir, event->name, event->mask);
             } else {
               total_file_events++;
-              run_callback(Event::FILE_CREATED, current_dir, event->name);
+              run_callback(Event::FILE_CREATED, current_dir, event->name, event->mask);
             }
           } else if (event->mask & IN_MODIFY) {
             if (event->mask & IN_ISDIR) {
-              run_callback(Event::DIR_MODIFIED, current_dir, event->name);
+              run_callback(Event::DIR_MODIFIED, current_dir, event->name, event->mask);
             } else {
-              run_callback(Event::FILE_MODIFIED, current_dir, event->name);
+              run_callback(Event::FILE_MODIFIED, current_dir, event->name, event->mask);
             }
           } else if (event->mask & IN_DELETE) {
             if (event->mask & IN_ISDIR) {
               // Directory was deleted
               new_dir = watch.erase(event->wd, event->name, &wd);
-              inotify_rm_watch(fd, wd);
+              if (wd >= 0) {
+                inotify_rm_watch(fd, wd);
+              }
+              BBX15_PROBE2(watch_remove, wd, new_dir.c_str());
               total_dir_events--;
-              run_callback(Event::DIR_DELETED, current_dir, event->name);
+              run_callback(Event::DIR_DELETED, current_dir, event->name, event->mask);
             } else {
               // File was deleted
-              current_dir = watch.get(event->wd);
               total_file_events--;
-              run_callback(Event::FILE_DELETED, current_dir, event->name);
+              run_callback(Event::FILE_DELETED, current_dir, event->name, event->mask);
             }
           } else if (event->mask & IN_OPEN) {
-            current_dir = watch.get(event->wd);
             if (event->mask & IN_ISDIR) {
               // Directory was opened
-              run_callback(Event::DIR_OPENED, current_dir, event->name);
+              run_callback(Event::DIR_OPENED, current_dir, event->name, event->mask);
             } else {
               // File was opened
-              run_callback(Event::FILE_OPENED, current_dir, event->name);
+              run_callback(Event::FILE_OPENED, current_dir, event->name, event->mask);
             }
           } else if (event->mask & IN_CLOSE) {
-            current_dir = watch.get(event->wd);
             if (event->mask & IN_ISDIR) {
               // Directory was closed
-              run_callback(Event::DIR_CLOSED, current_dir, event->name);
+              run_callback(Event::DIR_CLOSED, current_dir, event->name, event->mask);
             } else {
               // File was closed
-              run_callback(Event::FILE_CLOSED, current_dir, event->name);
+              run_callback(Event::FILE_CLOSED, current_dir, event->name, event->mask);
             }
           }
         }
         i += EVENT_SIZE + event->len;
       }
+      BBX15_PROBE1(read_batch_end, length);
+      Tracer::Counter("fswatch events per batch", batch_events);
     }
 
     // Cleanup
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex);
+      if (request_fd >= 0) {
+        close(request_fd);
+        request_fd = -1;
+      }
+      requests.clear();
+    }
     watch.cleanup(fd);
     close(fd);
     fflush(stdout);
@@ -303,6 +434,66 @@ private:
   // Root directory of the file watcher
   std::vector<std::filesystem::path> paths;
 
+  // Root directories to add (true) or remove (false), guarded by
+  // requests_mutex together with paths
+  std::mutex requests_mutex;
+  std::vector<std::pair<std::filesystem::path, bool>> requests;
+  int request_fd = -1;
+
+  void request(std::filesystem::path root, bool add) {
+    std::lock_guard<std::mutex> lock(requests_mutex);
+    if (request_fd < 0) {
+      // not running: just update the roots for the next start()
+      if (add && std::find(paths.begin(), paths.end(), root) == paths.end()) {
+        paths.push_back(std::move(root));
+      } else if (!add) {
+        paths.erase(std::remove(paths.begin(), paths.end(), root), paths.end());
+      }
+      return;
+    }
+    requests.emplace_back(std::move(root), add);
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = write(request_fd, &one, sizeof(one));
+  }
+
+#ifdef __linux__
+  // Watcher thread: add or remove the requested root directories.
+  void apply_requests(int fd, Watch &watch) {
+    uint64_t count;
+    [[maybe_unused]] auto got = read(request_fd, &count, sizeof(count));
+    std::vector<std::pair<std::filesystem::path, bool>> pending;
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex);
+      pending.swap(requests);
+    }
+    for (auto &[root, add] : pending) {
+      const std::string root_string = root.string();
+      std::lock_guard<std::mutex> lock(requests_mutex);
+      const bool watched =
+          std::find(paths.begin(), paths.end(), root) != paths.end();
+      if (add && !watched) {
+        const int wd = inotify_add_watch(fd, root_string.c_str(), WATCH_FLAGS);
+        if (wd < 0) {
+          std::cerr << "inotify_add_watch " << root_string
+                    << " failed: " << strerror(errno) << std::endl;
+          continue;
+        }
+        BBX15_PROBE2(watch_add, wd, root_string.c_str());
+        watch.insert(-1, root_string, wd);
+        paths.push_back(root);
+      } else if (!add && watched) {
+        const int wd = watch.find(-1, root_string);
+        if (wd >= 0) {
+          BBX15_PROBE2(watch_remove, wd, root_string.c_str());
+          watch.erase_tree(fd, wd);
+        }
+        paths.erase(std::remove(paths.begin(), paths.end(), root),
+                    paths.end());
+      }
+    }
+  }
+#endif
+
   // Callback functions based on file status
   std::map<Event, std::function<void(const EventInfo &)>> callbacks;
 
@@ -324,10 +515,13 @@ private:
   }
 
   void run_callback(const Event &event, const std::string &current_dir,
-                    const std::string &filename) {
+                    const std::string &filename, uint32_t mask) {
     if (is_callback_registered(event)) {
+      BBX15_PROBE2(dispatch_begin, static_cast<int>(event), filename.c_str());
+      TraceSpan span("fswatch callback");
       callbacks[event](EventInfo{
-          event, std::filesystem::path(current_dir + "/" + filename)});
+          event, std::filesystem::path(current_dir + "/" + filename), mask});
+      BBX15_PROBE1(dispatch_end, static_cast<int>(event));
     }
   }
 };
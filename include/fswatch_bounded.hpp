@@ -0,0 +1,601 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   file system watcher with fixed capacity: no heap allocation after start(), for the small boards
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <limits.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fswatch.hpp>
+#include <trace_events.hpp>
+#include <usdt.hpp>
+
+/**
+ * @brief capacity of a bounded_fswatch, fixed at construction
+ */
+struct bounded_fswatch_limits {
+  size_t max_watches = 256;          ///< watched directories, the roots included
+  size_t name_bytes = 16 * 1024;     ///< names of the watched directories, the roots with their full path
+  size_t max_subscribers = 4;        ///< callbacks registered by on()
+  size_t max_queued_events = 256;    ///< inotify events read at once, longer names shorten the batch
+  size_t max_roots = 8;              ///< root directories and pending add or remove requests each
+};
+
+/**
+ * @brief drops and usage of a bounded_fswatch
+ */
+struct bounded_fswatch_counters {
+  uint64_t events{0};            ///< events passed to the subscribers
+  uint64_t dropped_watches{0};   ///< directories not watched: no free watch or name bytes left
+  uint64_t dropped_paths{0};     ///< events not passed on: the path exceeds PATH_MAX or its parent is unknown
+  uint64_t overflows{0};         ///< inotify queue overflows, the kernel dropped events
+  size_t watches{0};
+  size_t name_bytes{0};
+};
+
+/**
+ * @brief inotify watcher with the interface of fswatch and storage preallocated as flat arrays
+ * @desc The watch table is an open addressing hash of the watch descriptors, the directory names are packed into one
+ *       name pool that is compacted when a directory goes away, the path of an event is assembled in a fixed buffer
+ *       and passed as a view. Subscribers and root requests occupy fixed slots. After start() the watcher thread
+ *       allocates nothing, memory_bytes() is the whole storage. Exhaustion degrades instead of failing: a directory
+ *       beyond the watch or name capacity is not watched, an event whose path cannot be built is not passed on and an
+ *       inotify queue overflow is skipped; each is counted. Subdirectories are watched when they are created, as
+ *       with fswatch; a watch is freed when inotify reports it removed (IN_IGNORED).
+ */
+class bounded_fswatch {
+public:
+  using Event = fswatch::Event;
+
+  static constexpr size_t kMaxRootPath = 256;   ///< bytes of a root path, terminating zero included
+
+  /**
+   * @brief an event; path points into the buffer of the watcher, valid during the callback and zero terminated
+   */
+  struct event_view {
+    Event type;
+    std::string_view path;
+    uint32_t mask;   // inotify mask, e.g. tells IN_CLOSE_WRITE from IN_CLOSE_NOWRITE
+  };
+
+  using callback = std::function<void(const event_view &)>;
+
+  explicit bounded_fswatch(const bounded_fswatch_limits &limits = {})
+      : limits_(limits),
+        table_size_(std::bit_ceil(2 * (limits.max_watches ? limits.max_watches : 1))),
+        buffer_size_(limits.max_queued_events * (sizeof(inotify_event) + NAME_MAX + 1)),
+        slots_(std::make_unique<slot[]>(table_size_)),
+        chain_(std::make_unique<const slot *[]>(limits.max_watches + 1)),
+        names_(std::make_unique<char[]>(limits.name_bytes)),
+        path_(std::make_unique<char[]>(kPathBytes)),
+        buffer_(std::make_unique<char[]>(buffer_size_)),
+        subscribers_(std::make_unique<subscriber[]>(limits.max_subscribers)),
+        roots_(std::make_unique<root[]>(limits.max_roots)),
+        requests_(std::make_unique<request[]>(limits.max_roots)) {
+    if (!limits.max_queued_events || limits.max_roots == 0) {
+      throw std::invalid_argument("bounded_fswatch: no queued events or roots");
+    }
+    for (size_t i = 0; i < table_size_; ++i) {
+      slots_[i].wd = -1;
+    }
+  }
+
+  bounded_fswatch(const bounded_fswatch &) = delete;
+  bounded_fswatch &operator=(const bounded_fswatch &) = delete;
+
+  // Add a root directory. While start() runs the watch is added by the
+  // watcher thread, the other roots are not disturbed.
+  void add_root(const std::string &path) {
+    char root_path[kMaxRootPath];
+    expand(path, root_path);
+    struct stat status;
+    if (stat(root_path, &status) != 0 || !S_ISDIR(status.st_mode)) {
+      throw std::invalid_argument("not a directory: " + path);
+    }
+    request_root(root_path, true);
+  }
+
+  // Remove a root directory and the watches of its subdirectories.
+  void remove_root(const std::string &path) {
+    char root_path[kMaxRootPath];
+    expand(path, root_path);
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex_);
+      if (find_root(root_path) < 0) {
+        throw std::invalid_argument("not a watched root: " + path);
+      }
+    }
+    request_root(root_path, false);
+  }
+
+  // Root directories, requests not yet applied by the watcher excluded.
+  std::vector<std::filesystem::path> roots() {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    std::vector<std::filesystem::path> paths;
+    for (size_t i = 0; i < root_count_; ++i) {
+      paths.emplace_back(roots_[i].path);
+    }
+    return paths;
+  }
+
+  // Register a callback for the events, before start(). Every subscriber of
+  // an event is called, in the order of registration.
+  void on(const std::vector<Event> &events, callback action) {
+    if (running_.load(std::memory_order_acquire)) {
+      throw std::invalid_argument("bounded_fswatch: subscribe before start()");
+    }
+    if (subscriber_count_ == limits_.max_subscribers) {
+      throw std::invalid_argument("bounded_fswatch: too many subscribers");
+    }
+    subscriber &entry = subscribers_[subscriber_count_++];
+    for (auto event : events) {
+      entry.events |= 1u << static_cast<unsigned>(event);
+    }
+    entry.action = std::move(action);
+  }
+
+  void on(const Event &event, callback action) { on(std::vector<Event>{event}, std::move(action)); }
+
+  void stop() {
+    stop_.store(true, std::memory_order_release);
+    // wake up select(), the roots may not see any further event
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    if (request_fd_ >= 0) {
+      const uint64_t one = 1;
+      [[maybe_unused]] auto written = write(request_fd_, &one, sizeof(one));
+    }
+  }
+
+  void start() {
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error("inotify_init failed");
+    }
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex_);
+      request_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      for (size_t i = 0; i < root_count_; ++i) {
+        add_watch(fd, -1, roots_[i].path, std::strlen(roots_[i].path));
+      }
+    }
+    running_.store(true, std::memory_order_release);
+
+    fd_set watch_set;
+    while (!stop_.load(std::memory_order_acquire)) {
+      FD_ZERO(&watch_set);
+      FD_SET(fd, &watch_set);
+      FD_SET(request_fd_, &watch_set);
+      if (select((fd > request_fd_ ? fd : request_fd_) + 1, &watch_set, nullptr, nullptr, nullptr) < 0) {
+        continue;
+      }
+      if (FD_ISSET(request_fd_, &watch_set)) {
+        apply_requests(fd);
+      }
+      if (!FD_ISSET(fd, &watch_set)) {
+        continue;
+      }
+
+      TraceSpan batch_span("fswatch read batch");
+      if (Tracer::Enabled()) {
+        int pending = 0;
+        ioctl(fd, FIONREAD, &pending);
+        Tracer::Counter("inotify queue bytes", pending);
+      }
+      BBX15_PROBE(read_batch_start);
+      const ssize_t length = read(fd, buffer_.get(), buffer_size_);
+      int batch_events = 0;
+      for (ssize_t i = 0; i < length; ++batch_events) {
+        const auto *event = reinterpret_cast<const inotify_event *>(&buffer_[i]);
+        BBX15_PROBE3(event_decode, event->wd, event->mask, event->len);
+        i += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        if (event->wd == -1 || (event->mask & IN_Q_OVERFLOW)) {
+          BBX15_PROBE1(overflow, event->mask);
+          count(overflows_);
+        } else if (event->mask & IN_IGNORED) {
+          erase_watch(event->wd);
+        } else if (event->len) {
+          decode(fd, *event);
+        }
+      }
+      BBX15_PROBE1(read_batch_end, length);
+      Tracer::Counter("fswatch events per batch", batch_events);
+    }
+
+    running_.store(false, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex_);
+      close(request_fd_);
+      request_fd_ = -1;
+      request_count_ = 0;
+    }
+    for (size_t i = 0; i < table_size_; ++i) {
+      if (slots_[i].wd >= 0) {
+        inotify_rm_watch(fd, slots_[i].wd);
+        slots_[i].wd = -1;
+      }
+    }
+    watch_count_ = 0;
+    names_used_ = 0;
+    close(fd);
+  }
+
+  bounded_fswatch_counters counters() const {
+    bounded_fswatch_counters result;
+    result.events = events_.load(std::memory_order_relaxed);
+    result.dropped_watches = dropped_watches_.load(std::memory_order_relaxed);
+    result.dropped_paths = dropped_paths_.load(std::memory_order_relaxed);
+    result.overflows = overflows_.load(std::memory_order_relaxed);
+    result.watches = watch_count_.load(std::memory_order_relaxed);
+    result.name_bytes = names_used_.load(std::memory_order_relaxed);
+    return result;
+  }
+
+  // Bytes of the preallocated storage, the object itself included.
+  size_t memory_bytes() const {
+    return sizeof(*this) + table_size_ * sizeof(slot) + (limits_.max_watches + 1) * sizeof(const slot *) +
+           limits_.name_bytes + kPathBytes + buffer_size_ + limits_.max_subscribers * sizeof(subscriber) +
+           limits_.max_roots * (sizeof(root) + sizeof(request));
+  }
+
+  void print(std::FILE *out = stdout) const {
+    const bounded_fswatch_counters now = counters();
+    std::fprintf(out,
+                 "fswatch bounded: %zu bytes, watches %zu/%zu, name bytes %zu/%zu, events %llu, dropped watches "
+                 "%llu, dropped paths %llu, overflows %llu\n",
+                 memory_bytes(), now.watches, limits_.max_watches, now.name_bytes, limits_.name_bytes,
+                 static_cast<unsigned long long>(now.events), static_cast<unsigned long long>(now.dropped_watches),
+                 static_cast<unsigned long long>(now.dropped_paths), static_cast<unsigned long long>(now.overflows));
+  }
+
+private:
+  static constexpr size_t kPathBytes = PATH_MAX + NAME_MAX + 2;
+
+  // watch descriptor -1 marks a free slot
+  struct slot {
+    int wd;
+    int parent;   // -1 for a root
+    uint32_t name_offset;
+    uint32_t name_length;
+  };
+
+  struct subscriber {
+    uint32_t events{0};   // bit per Event
+    callback action;
+  };
+
+  struct root {
+    char path[kMaxRootPath];
+  };
+
+  struct request {
+    char path[kMaxRootPath];
+    bool add;
+  };
+
+  const bounded_fswatch_limits limits_;
+  const size_t table_size_;   // power of two, at least twice max_watches
+  const size_t buffer_size_;
+  std::unique_ptr<slot[]> slots_;
+  std::unique_ptr<const slot *[]> chain_;   // parents of a path, from the directory up to its root
+  std::unique_ptr<char[]> names_;
+  std::unique_ptr<char[]> path_;
+  std::unique_ptr<char[]> buffer_;
+  std::unique_ptr<subscriber[]> subscribers_;
+  size_t subscriber_count_ = 0;
+
+  // written by the watcher thread, read by counters()
+  std::atomic<size_t> watch_count_{0};
+  std::atomic<size_t> names_used_{0};
+  std::atomic<uint64_t> events_{0};
+  std::atomic<uint64_t> dropped_watches_{0};
+  std::atomic<uint64_t> dropped_paths_{0};
+  std::atomic<uint64_t> overflows_{0};
+
+  std::atomic<bool> running_{false};
+  std::atomic<bool> stop_{false};
+
+  // roots and the add (true) or remove (false) requests not yet applied,
+  // guarded by requests_mutex_
+  std::mutex requests_mutex_;
+  std::unique_ptr<root[]> roots_;
+  size_t root_count_ = 0;
+  std::unique_ptr<request[]> requests_;
+  size_t request_count_ = 0;
+  int request_fd_ = -1;
+
+  static void count(std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // "~" is the home directory, as with fswatch
+  static void expand(const std::string &path, char (&out)[kMaxRootPath]) {
+    const char *home = "";
+    const char *rest = path.empty() ? "." : path.c_str();
+    if (rest[0] == '~') {
+      home = getenv("HOME");
+      if (!home) {
+        throw std::invalid_argument("HOME environment variable not set.");
+      }
+      ++rest;
+    }
+    if (std::snprintf(out, kMaxRootPath, "%s%s", home, rest) >= static_cast<int>(kMaxRootPath)) {
+      throw std::invalid_argument("root path too long: " + path);
+    }
+  }
+
+  // with requests_mutex_ held
+  int find_root(const char *path) const {
+    for (size_t i = 0; i < root_count_; ++i) {
+      if (std::strcmp(roots_[i].path, path) == 0) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  void request_root(const char *path, bool add) {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    if (request_fd_ < 0) {
+      // not running: just update the roots for the next start()
+      apply_root(-1, path, add);
+      return;
+    }
+    if (request_count_ == limits_.max_roots) {
+      throw std::runtime_error("bounded_fswatch: too many pending root requests");
+    }
+    request &entry = requests_[request_count_++];
+    std::memcpy(entry.path, path, kMaxRootPath);
+    entry.add = add;
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = write(request_fd_, &one, sizeof(one));
+  }
+
+  // Update the roots, and the watches with an inotify fd, with
+  // requests_mutex_ held.
+  void apply_root(int fd, const char *path, bool add) {
+    const int index = find_root(path);
+    if (add && index < 0) {
+      if (root_count_ == limits_.max_roots) {
+        std::fprintf(stderr, "bounded_fswatch: no root slot left for %s\n", path);
+        return;
+      }
+      if (fd >= 0 && !add_watch(fd, -1, path, std::strlen(path))) {
+        return;
+      }
+      std::memcpy(roots_[root_count_++].path, path, kMaxRootPath);
+    } else if (!add && index >= 0) {
+      if (fd >= 0) {
+        const slot *entry = find_child(-1, path, std::strlen(path));
+        if (entry) {
+          BBX15_PROBE2(watch_remove, entry->wd, path);
+          erase_tree(fd, entry->wd);
+        }
+      }
+      roots_[index] = roots_[--root_count_];
+    }
+  }
+
+  // Watcher thread: add or remove the requested root directories.
+  void apply_requests(int fd) {
+    uint64_t pending;
+    [[maybe_unused]] auto got = read(request_fd_, &pending, sizeof(pending));
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    for (size_t i = 0; i < request_count_; ++i) {
+      apply_root(fd, requests_[i].path, requests_[i].add);
+    }
+    request_count_ = 0;
+  }
+
+  slot *find_watch(int wd) const {
+    for (size_t i = static_cast<size_t>(wd) & (table_size_ - 1);; i = (i + 1) & (table_size_ - 1)) {
+      if (slots_[i].wd == wd) {
+        return &slots_[i];
+      }
+      if (slots_[i].wd < 0) {
+        return nullptr;
+      }
+    }
+  }
+
+  const slot *find_child(int parent, const char *name, size_t length) const {
+    for (size_t i = 0; i < table_size_; ++i) {
+      const slot &entry = slots_[i];
+      if (entry.wd >= 0 && entry.parent == parent && entry.name_length == length &&
+          std::memcmp(&names_[entry.name_offset], name, length) == 0) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  // Watch a directory, its path is in path_ unless it is a root. Returns
+  // false and counts the drop if the capacity is exhausted.
+  bool add_watch(int fd, int parent, const char *name, size_t length) {
+    if (watch_count_.load(std::memory_order_relaxed) == limits_.max_watches ||
+        names_used_.load(std::memory_order_relaxed) + length > limits_.name_bytes) {
+      count(dropped_watches_);
+      return false;
+    }
+    const int wd = inotify_add_watch(fd, parent < 0 ? name : path_.get(), WATCH_FLAGS);
+    if (wd < 0) {
+      std::fprintf(stderr, "inotify_add_watch %s failed: %s\n", parent < 0 ? name : path_.get(), strerror(errno));
+      return false;
+    }
+    BBX15_PROBE2(watch_add, wd, parent < 0 ? name : path_.get());
+    if (find_watch(wd)) {
+      return true;   // the same directory again, e.g. renamed back
+    }
+    size_t i = static_cast<size_t>(wd) & (table_size_ - 1);
+    while (slots_[i].wd >= 0) {
+      i = (i + 1) & (table_size_ - 1);
+    }
+    const size_t used = names_used_.load(std::memory_order_relaxed);
+    std::memcpy(&names_[used], name, length);
+    slots_[i] = slot{wd, parent, static_cast<uint32_t>(used), static_cast<uint32_t>(length)};
+    names_used_.store(used + length, std::memory_order_relaxed);
+    watch_count_.store(watch_count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Free the slot and the name of a watch, inotify already removed it.
+  void erase_watch(int wd) {
+    slot *entry = find_watch(wd);
+    if (!entry) {
+      return;
+    }
+    // compact the name pool
+    const uint32_t offset = entry->name_offset;
+    const uint32_t length = entry->name_length;
+    const size_t used = names_used_.load(std::memory_order_relaxed);
+    std::memmove(&names_[offset], &names_[offset + length], used - offset - length);
+    names_used_.store(used - length, std::memory_order_relaxed);
+    for (size_t i = 0; i < table_size_; ++i) {
+      if (slots_[i].wd >= 0 && slots_[i].name_offset > offset) {
+        slots_[i].name_offset -= length;
+      }
+    }
+    // backward shift deletion keeps the probe sequences without tombstones
+    const size_t mask = table_size_ - 1;
+    size_t hole = static_cast<size_t>(entry - slots_.get());
+    slots_[hole].wd = -1;
+    for (size_t next = (hole + 1) & mask; slots_[next].wd >= 0; next = (next + 1) & mask) {
+      const size_t home = static_cast<size_t>(slots_[next].wd) & mask;
+      const bool stays = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+      if (!stays) {
+        slots_[hole] = slots_[next];
+        slots_[next].wd = -1;
+        hole = next;
+      }
+    }
+    watch_count_.store(watch_count_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+  }
+
+  // Remove a watch and the watches of all its subdirectories.
+  void erase_tree(int fd, int wd) {
+    for (size_t i = 0; i < table_size_;) {
+      if (slots_[i].wd >= 0 && slots_[i].parent == wd) {
+        erase_tree(fd, slots_[i].wd);
+        i = 0;   // erasing shifted the slots
+      } else {
+        ++i;
+      }
+    }
+    inotify_rm_watch(fd, wd);
+    erase_watch(wd);
+  }
+
+  // Assemble the path of a directory and optionally a name in path_, return
+  // its length or 0 if it does not fit or a parent is unknown.
+  size_t build_path(int wd, const char *name) {
+    size_t depth = 0;
+    for (const slot *entry = find_watch(wd); entry; entry = entry->parent < 0 ? nullptr : find_watch(entry->parent)) {
+      if (depth > limits_.max_watches) {
+        return 0;
+      }
+      chain_[depth++] = entry;
+      if (entry->parent >= 0 && !find_watch(entry->parent)) {
+        return 0;
+      }
+    }
+    if (!depth) {
+      return 0;
+    }
+    size_t length = 0;
+    for (size_t i = depth; i-- > 0;) {
+      const slot *entry = chain_[i];
+      if (length + entry->name_length + 1 >= PATH_MAX) {
+        return 0;
+      }
+      if (i + 1 < depth) {
+        path_[length++] = '/';
+      }
+      std::memcpy(&path_[length], &names_[entry->name_offset], entry->name_length);
+      length += entry->name_length;
+    }
+    if (name) {
+      const size_t name_length = std::strlen(name);
+      path_[length++] = '/';
+      std::memcpy(&path_[length], name, name_length);
+      length += name_length;
+    }
+    path_[length] = '\0';
+    return length;
+  }
+
+  void decode(int fd, const inotify_event &event) {
+    const bool dir = event.mask & IN_ISDIR;
+    Event type;
+    // a file or directory renamed into a watched directory appears like a
+    // created one, e.g. a configuration saved atomically
+    if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+      type = dir ? Event::DIR_CREATED : Event::FILE_CREATED;
+    } else if (event.mask & IN_MODIFY) {
+      type = dir ? Event::DIR_MODIFIED : Event::FILE_MODIFIED;
+    } else if (event.mask & IN_DELETE) {
+      type = dir ? Event::DIR_DELETED : Event::FILE_DELETED;   // the watch goes with IN_IGNORED
+    } else if (event.mask & IN_OPEN) {
+      type = dir ? Event::DIR_OPENED : Event::FILE_OPENED;
+    } else if (event.mask & IN_CLOSE) {
+      type = dir ? Event::DIR_CLOSED : Event::FILE_CLOSED;
+    } else {
+      return;
+    }
+    const size_t length = build_path(event.wd, event.name);
+    if (!length) {
+      count(dropped_paths_);
+      return;
+    }
+    if (type == Event::DIR_CREATED) {
+      add_watch(fd, event.wd, event.name, std::strlen(event.name));
+    }
+    dispatch(type, std::string_view(path_.get(), length), event.mask);
+  }
+
+  void dispatch(Event type, std::string_view path, uint32_t mask) {
+    const uint32_t bit = 1u << static_cast<unsigned>(type);
+    for (size_t i = 0; i < subscriber_count_; ++i) {
+      if (subscribers_[i].events & bit) {
+        BBX15_PROBE2(dispatch_begin, static_cast<int>(type), path.data());
+        TraceSpan span("fswatch callback");
+        subscribers_[i].action(event_view{type, path, mask});
+        BBX15_PROBE1(dispatch_end, static_cast<int>(type));
+        count(events_);
+      }
+    }
+  }
+};
@@ -0,0 +1,500 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   IEC 61850-8-1 GOOSE frame encoder and decoder
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <sv.hpp>
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+constexpr uint16_t kGooseEtherType = 0x88B8;   ///< IEC 61850-8-1 GOOSE ethertype
+constexpr size_t kGooseMaxEntries = 64;        ///< data set members decoded per frame
+constexpr size_t kGooseMaxFrameSize = 1518;    ///< untagged ethernet frame
+constexpr size_t kGooseMaxRefLength = 129;     ///< VisibleString129 for gocbRef and datSet
+
+/**
+ * @brief basic types of data set members
+ */
+enum class GooseType : uint8_t {
+  kBoolean,
+  kInteger,
+  kUnsigned,
+  kFloat,
+  kQuality,   ///< IEC 61850-7-3 Quality, 13 bit BIT STRING
+};
+
+/**
+ * @brief one data set member
+ */
+struct GooseValue {
+  GooseType type{GooseType::kBoolean};
+  bool boolean{false};
+  int64_t integer{0};   ///< kInteger, kUnsigned and kQuality (bit i = quality bit i, see SvQuality)
+  float real{0};
+
+  static GooseValue Boolean(bool value) { return GooseValue{GooseType::kBoolean, value, 0, 0}; }
+  static GooseValue Integer(int32_t value) { return GooseValue{GooseType::kInteger, false, value, 0}; }
+  static GooseValue Unsigned(uint32_t value) { return GooseValue{GooseType::kUnsigned, false, value, 0}; }
+  static GooseValue Float(float value) { return GooseValue{GooseType::kFloat, false, 0, value}; }
+  static GooseValue Quality(uint16_t value) { return GooseValue{GooseType::kQuality, false, value, 0}; }
+
+  bool operator==(const GooseValue& other) const = default;
+};
+
+/**
+ * @brief one decoded GOOSE frame
+ * @desc string views point into the received frame and are valid only while the frame buffer is valid
+ */
+struct GooseFrame {
+  uint16_t app_id{0};
+  uint16_t vlan_tci{0};
+  std::string_view gocb_ref;
+  uint32_t time_allowed_to_live{0};   ///< ms
+  std::string_view dat_set;
+  std::string_view go_id;   ///< optional, empty if not sent
+  uint64_t t{0};   ///< UtcTime, seconds in the upper 32 bits, fraction of second (2^-24 s) and quality below
+  uint32_t st_num{0};
+  uint32_t sq_num{0};
+  bool simulation{false};
+  uint32_t conf_rev{0};
+  bool nds_com{false};
+  uint32_t num_dat_set_entries{0};
+  size_t count{0};   ///< decoded members, at most kGooseMaxEntries
+  GooseValue values[kGooseMaxEntries];
+};
+
+//-----------------------------------------------------------------------------
+// BER helpers
+//-----------------------------------------------------------------------------
+namespace goose_detail {
+
+inline uint8_t* PutLength(uint8_t* p, size_t length) {
+  if (length < 0x80) {
+    *p++ = static_cast<uint8_t>(length);
+  } else if (length < 0x100) {
+    *p++ = 0x81;
+    *p++ = static_cast<uint8_t>(length);
+  } else {
+    *p++ = 0x82;
+    *p++ = static_cast<uint8_t>(length >> 8);
+    *p++ = static_cast<uint8_t>(length);
+  }
+  return p;
+}
+
+/**
+ * @brief write a minimal two's complement INTEGER, at most 10 octets
+ */
+inline uint8_t* PutInteger(uint8_t* p, uint8_t tag, int64_t value) {
+  uint8_t bytes[8];
+  size_t n = 0;
+  do {
+    bytes[n++] = static_cast<uint8_t>(value);
+    value >>= 8;
+  } while (n < 8 && !((value == 0 && (bytes[n - 1] & 0x80) == 0) || (value == -1 && (bytes[n - 1] & 0x80))));
+  *p++ = tag;
+  *p++ = static_cast<uint8_t>(n);
+  while (n) {
+    *p++ = bytes[--n];
+  }
+  return p;
+}
+
+inline void PutInteger(std::vector<uint8_t>& out, uint8_t tag, int64_t value) {
+  uint8_t encoded[10];
+  out.insert(out.end(), encoded, PutInteger(encoded, tag, value));
+}
+
+inline void PutString(std::vector<uint8_t>& out, uint8_t tag, std::string_view value) {
+  uint8_t length[3];
+  out.push_back(tag);
+  out.insert(out.end(), length, PutLength(length, value.size()));
+  out.insert(out.end(), value.begin(), value.end());
+}
+
+inline void PutBoolean(std::vector<uint8_t>& out, uint8_t tag, bool value) {
+  out.push_back(tag);
+  out.push_back(1);
+  out.push_back(value ? 0xFF : 0x00);
+}
+
+/**
+ * @brief append one data set member with its MMS Data tag
+ */
+inline void PutValue(std::vector<uint8_t>& out, const GooseValue& value) {
+  switch (value.type) {
+    case GooseType::kBoolean:
+      PutBoolean(out, 0x83, value.boolean);
+      break;
+    case GooseType::kInteger:
+      PutInteger(out, 0x85, value.integer);
+      break;
+    case GooseType::kUnsigned:
+      PutInteger(out, 0x86, value.integer);
+      break;
+    case GooseType::kFloat: {
+      uint32_t bits;
+      std::memcpy(&bits, &value.real, 4);
+      const uint8_t encoded[] = {0x87, 5, 8, static_cast<uint8_t>(bits >> 24), static_cast<uint8_t>(bits >> 16),
+                                 static_cast<uint8_t>(bits >> 8), static_cast<uint8_t>(bits)};
+      out.insert(out.end(), std::begin(encoded), std::end(encoded));
+      break;
+    }
+    case GooseType::kQuality: {
+      // 13 bits, bit 0 first: MSB of the first octet
+      uint16_t bits = 0;
+      for (int i = 0; i < 13; ++i) {
+        if (value.integer & (1 << i)) {
+          bits |= static_cast<uint16_t>(0x8000 >> i);
+        }
+      }
+      const uint8_t encoded[] = {0x84, 3, 3, static_cast<uint8_t>(bits >> 8), static_cast<uint8_t>(bits)};
+      out.insert(out.end(), std::begin(encoded), std::end(encoded));
+      break;
+    }
+  }
+}
+
+inline int64_t GetInteger(const uint8_t* p, size_t length) {
+  int64_t value = length && (p[0] & 0x80) ? -1 : 0;
+  for (size_t i = 0; i < length && i < 8; ++i) {
+    value = static_cast<int64_t>(static_cast<uint64_t>(value) << 8 | p[i]);
+  }
+  return value;
+}
+
+/**
+ * @brief decode one MMS Data member, unsupported types are skipped by the caller
+ */
+inline bool GetValue(uint8_t tag, const uint8_t* p, size_t length, GooseValue& value) {
+  switch (tag) {
+    case 0x83:
+      value = GooseValue::Boolean(length && p[0]);
+      return true;
+    case 0x85:
+      value = GooseValue{GooseType::kInteger, false, GetInteger(p, length), 0};
+      return true;
+    case 0x86:
+      value = GooseValue{GooseType::kUnsigned, false, GetInteger(p, length), 0};
+      return true;
+    case 0x87:
+      if (length == 5 && p[0] == 8) {
+        const uint32_t bits = sv_detail::BigEndian(p + 1, 4);
+        float real;
+        std::memcpy(&real, &bits, 4);
+        value = GooseValue::Float(real);
+        return true;
+      }
+      return false;
+    case 0x84: {
+      // the first octet counts the unused bits of the last one, 0..7, and is 0 for an empty bit string
+      if (length < 1 || p[0] > 7 || (length == 1 && p[0] != 0)) {
+        return false;
+      }
+      const size_t bits = (length - 1) * 8 - p[0];   // bit i is read from p[1 + i / 8], within length - 1 octets
+      uint16_t quality = 0;
+      for (size_t i = 0; i < bits && i < 16; ++i) {
+        if (p[1 + i / 8] & (0x80 >> (i % 8))) {
+          quality |= static_cast<uint16_t>(1u << i);
+        }
+      }
+      value = GooseValue::Quality(quality);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+}   // namespace goose_detail
+
+/**
+ * @brief UtcTime of a CLOCK_REALTIME time stamp, time quality: 10 bit accuracy, clock not synchronized unknown
+ */
+inline uint64_t GooseUtcTime(const timespec& ts) {
+  const uint64_t fraction = (static_cast<uint64_t>(ts.tv_nsec) << 24) / 1'000'000'000;
+  return static_cast<uint64_t>(static_cast<uint32_t>(ts.tv_sec)) << 32 | fraction << 8 | 0x0A;
+}
+
+/**
+ * @brief nanoseconds since the epoch of a UtcTime
+ */
+inline int64_t GooseUtcTimeNs(uint64_t t) {
+  const uint64_t fraction = (t >> 8) & 0xFFFFFF;
+  return static_cast<int64_t>(t >> 32) * 1'000'000'000 + static_cast<int64_t>((fraction * 1'000'000'000) >> 24);
+}
+
+//-----------------------------------------------------------------------------
+// decoder
+//-----------------------------------------------------------------------------
+/**
+ * @brief decode a complete ethernet frame carrying GOOSE
+ * @param data - frame starting with destination MAC
+ * @param size - frame length
+ * @param frame - decoded content
+ * @return true if the frame is a valid GOOSE frame
+ */
+inline bool GooseDecode(const uint8_t* data, size_t size, GooseFrame& frame) {
+  const uint8_t* p = data + 12;
+  const uint8_t* end = data + size;
+  if (size < 14 + 8) {
+    return false;
+  }
+  uint16_t ether_type = static_cast<uint16_t>(sv_detail::BigEndian(p, 2));
+  p += 2;
+  frame.vlan_tci = 0;
+  if (ether_type == kVlanEtherType) {
+    if (end - p < 4 + 8) {
+      return false;
+    }
+    frame.vlan_tci = static_cast<uint16_t>(sv_detail::BigEndian(p, 2));
+    ether_type = static_cast<uint16_t>(sv_detail::BigEndian(p + 2, 2));
+    p += 4;
+  }
+  if (ether_type != kGooseEtherType) {
+    return false;
+  }
+  frame.app_id = static_cast<uint16_t>(sv_detail::BigEndian(p, 2));
+  const size_t pdu_length = sv_detail::BigEndian(p + 2, 2);
+  if (pdu_length < 8 || static_cast<size_t>(end - p) < pdu_length) {
+    return false;
+  }
+  end = p + pdu_length;
+  p += 8;   // APPID, Length, Reserved1, Reserved2
+
+  uint8_t tag;
+  size_t length;
+  if (!sv_detail::BerHeader(p, end, tag, length) || tag != 0x61) {
+    return false;
+  }
+  end = p + length;
+  frame.count = 0;
+  frame.go_id = {};   // optional
+  unsigned seen = 0;
+  while (p < end) {
+    if (!sv_detail::BerHeader(p, end, tag, length)) {
+      return false;
+    }
+    switch (tag) {
+      case 0x80:
+        frame.gocb_ref = std::string_view(reinterpret_cast<const char*>(p), length);
+        break;
+      case 0x81:
+        frame.time_allowed_to_live = static_cast<uint32_t>(goose_detail::GetInteger(p, length));
+        break;
+      case 0x82:
+        frame.dat_set = std::string_view(reinterpret_cast<const char*>(p), length);
+        break;
+      case 0x83:
+        frame.go_id = std::string_view(reinterpret_cast<const char*>(p), length);
+        break;
+      case 0x84:
+        frame.t = length == 8
+                      ? (static_cast<uint64_t>(sv_detail::BigEndian(p, 4)) << 32 | sv_detail::BigEndian(p + 4, 4))
+                      : 0;
+        break;
+      case 0x85:
+        frame.st_num = static_cast<uint32_t>(goose_detail::GetInteger(p, length));
+        break;
+      case 0x86:
+        frame.sq_num = static_cast<uint32_t>(goose_detail::GetInteger(p, length));
+        break;
+      case 0x87:
+        frame.simulation = length && p[0];
+        break;
+      case 0x88:
+        frame.conf_rev = static_cast<uint32_t>(goose_detail::GetInteger(p, length));
+        break;
+      case 0x89:
+        frame.nds_com = length && p[0];
+        break;
+      case 0x8A:
+        frame.num_dat_set_entries = static_cast<uint32_t>(goose_detail::GetInteger(p, length));
+        break;
+      case 0xAB: {   // allData
+        const uint8_t* q = p;
+        const uint8_t* q_end = p + length;
+        while (q < q_end) {
+          uint8_t member_tag;
+          size_t member_length;
+          if (!sv_detail::BerHeader(q, q_end, member_tag, member_length)) {
+            return false;
+          }
+          if (frame.count < kGooseMaxEntries &&
+              goose_detail::GetValue(member_tag, q, member_length, frame.values[frame.count])) {
+            ++frame.count;
+          }
+          q += member_length;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    seen |= tag >= 0x80 && tag <= 0x86 ? 1u << (tag - 0x80) : 0;
+    p += length;
+  }
+  return (seen & 0x77) == 0x77;   // gocbRef..sqNum are mandatory, goID is optional
+}
+
+//-----------------------------------------------------------------------------
+// encoder
+//-----------------------------------------------------------------------------
+/**
+ * @brief GOOSE frame of one control block built from a precomputed template
+ * @desc The ethernet header, gocbRef, datSet, goID and the part from simulation to allData are encoded once (the
+ *       latter again on every state change). Encode() only writes timeAllowedtoLive, t, stNum and sqNum between the
+ *       precomputed parts and fixes the length fields, which keeps the BER encoding minimal without re-encoding the
+ *       data set for retransmissions.
+ */
+class GooseEncoder {
+ public:
+  /**
+   * @brief constructor
+   * @param dst - destination MAC (01-0C-CD-01-xx-xx)
+   * @param src - source MAC
+   * @param app_id - APPID (0x0000..0x3FFF)
+   * @param gocb_ref - GoCB reference
+   * @param dat_set - data set reference
+   * @param go_id - goID
+   * @param conf_rev - configuration revision
+   * @param vlan_id - VLAN id of the 802.1Q tag, negative - untagged
+   * @param priority - 802.1Q priority
+   */
+  GooseEncoder(const uint8_t dst[6], const uint8_t src[6], uint16_t app_id, std::string_view gocb_ref,
+               std::string_view dat_set, std::string_view go_id, uint32_t conf_rev, int vlan_id = -1,
+               uint8_t priority = 4)
+      : conf_rev_(conf_rev) {
+    if (gocb_ref.empty() || gocb_ref.size() > kGooseMaxRefLength || dat_set.size() > kGooseMaxRefLength ||
+        go_id.size() > kGooseMaxRefLength) {
+      throw std::invalid_argument("GOOSE encoder: invalid reference length");
+    }
+    uint8_t* p = frame_;
+    std::memcpy(p, dst, 6);
+    std::memcpy(p + 6, src, 6);
+    p += 12;
+    if (vlan_id >= 0) {
+      p = Put16(p, kVlanEtherType);
+      p = Put16(p, static_cast<uint16_t>((priority & 7) << 13 | (vlan_id & 0x0FFF)));
+    }
+    p = Put16(p, kGooseEtherType);
+    header_offset_ = static_cast<size_t>(p - frame_);
+    Put16(p, app_id);
+    std::memset(p + 4, 0, 4);   // reserved 1, reserved 2
+
+    goose_detail::PutString(gocb_ref_, 0x80, gocb_ref);
+    goose_detail::PutString(ids_, 0x82, dat_set);
+    goose_detail::PutString(ids_, 0x83, go_id);
+    SetValues({});
+  }
+
+  /**
+   * @brief re-encode the data set part, called on a state change
+   */
+  void SetValues(const std::vector<GooseValue>& values) {
+    std::vector<uint8_t> data;
+    for (const auto& value : values) {
+      goose_detail::PutValue(data, value);
+    }
+    tail_.clear();
+    goose_detail::PutBoolean(tail_, 0x87, false);   // simulation
+    goose_detail::PutInteger(tail_, 0x88, conf_rev_);
+    goose_detail::PutBoolean(tail_, 0x89, false);   // ndsCom
+    goose_detail::PutInteger(tail_, 0x8A, static_cast<int64_t>(values.size()));
+    uint8_t length[3];
+    tail_.push_back(0xAB);
+    tail_.insert(tail_.end(), length, goose_detail::PutLength(length, data.size()));
+    tail_.insert(tail_.end(), data.begin(), data.end());
+    if (header_offset_ + 8 + 4 + gocb_ref_.size() + 10 + ids_.size() + kMaxFieldsSize + tail_.size() >
+        kGooseMaxFrameSize) {
+      throw std::length_error("GOOSE encoder: data set does not fit into one frame");
+    }
+  }
+
+  /**
+   * @brief encode the frame for one transmission
+   * @param t - UtcTime of the last state change
+   * @param st_num - state number
+   * @param sq_num - sequence number
+   * @param time_allowed_to_live - ms
+   */
+  void Encode(uint64_t t, uint32_t st_num, uint32_t sq_num, uint32_t time_allowed_to_live) {
+    uint8_t tal[10];
+    const size_t tal_size = static_cast<size_t>(goose_detail::PutInteger(tal, 0x81, time_allowed_to_live) - tal);
+    uint8_t fields[kMaxFieldsSize];
+    uint8_t* f = fields;
+    *f++ = 0x84;
+    *f++ = 8;
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      *f++ = static_cast<uint8_t>(t >> shift);
+    }
+    f = goose_detail::PutInteger(f, 0x85, st_num);
+    f = goose_detail::PutInteger(f, 0x86, sq_num);
+    const size_t fields_size = static_cast<size_t>(f - fields);
+
+    const size_t pdu_length = gocb_ref_.size() + tal_size + ids_.size() + fields_size + tail_.size();
+    uint8_t* header = frame_ + header_offset_;
+    uint8_t* p = header + 8;
+    *p++ = 0x61;
+    p = goose_detail::PutLength(p, pdu_length);
+    p = Append(p, gocb_ref_);
+    std::memcpy(p, tal, tal_size);
+    p += tal_size;
+    p = Append(p, ids_);
+    std::memcpy(p, fields, fields_size);
+    p += fields_size;
+    p = Append(p, tail_);
+    size_ = static_cast<size_t>(p - frame_);
+    Put16(header + 2, static_cast<uint16_t>(p - header));
+  }
+
+  const uint8_t* data() const { return frame_; }
+  size_t size() const { return size_; }
+
+ private:
+  static constexpr size_t kMaxFieldsSize = 10 + 2 * 7;   ///< t, stNum, sqNum
+
+  static uint8_t* Put16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+    return p + 2;
+  }
+
+  static uint8_t* Append(uint8_t* p, const std::vector<uint8_t>& part) {
+    std::memcpy(p, part.data(), part.size());
+    return p + part.size();
+  }
+
+  uint32_t conf_rev_;
+  size_t header_offset_{0};
+  std::vector<uint8_t> gocb_ref_;
+  std::vector<uint8_t> ids_;
+  std::vector<uint8_t> tail_;
+  uint8_t frame_[kGooseMaxFrameSize]{};
+  size_t size_{0};
+};
@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   GOOSE publisher with timer wheel driven retransmission
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cycle_clock.hpp>
+#include <goose.hpp>
+#include <latency_histogram.hpp>
+#include <timer_wheel.hpp>
+
+/**
+ * @brief configuration of one GOOSE control block
+ */
+struct GooseControlBlock {
+  std::string gocb_ref;
+  std::string dat_set;
+  std::string go_id;
+  uint16_t app_id{0x0001};
+  uint32_t conf_rev{1};
+  uint32_t min_interval_ms{2};    ///< first retransmission after a state change, doubled up to the heartbeat
+  uint32_t heartbeat_ms{1000};    ///< retransmission interval in steady state
+  uint8_t dst[6]{};               ///< destination MAC, all zero - 01-0C-CD-01-<index>
+  int vlan_id{-1};                ///< VLAN id of the 802.1Q tag, negative - untagged
+  uint8_t vlan_priority{4};
+};
+
+/**
+ * @brief publishes any number of GOOSE control blocks from one thread
+ * @desc A state change is sent at once with a new stNum and then retransmitted after min, 2 min, 4 min ... ms
+ *       until the heartbeat interval is reached. All retransmissions are driven by one 1 ms timer wheel; the
+ *       thread sleeps until the next armed tick or until SetValues() signals a state change through an eventfd.
+ *       timeAllowedtoLive is twice the interval to the next retransmission.
+ */
+class GoosePublisher {
+ public:
+  static constexpr int64_t kTickNs = 1'000'000;   ///< timer wheel resolution
+
+  struct Statistics {
+    uint64_t state_changes{0};    ///< stNum increments
+    uint64_t frames{0};           ///< frames sent
+    uint64_t send_errors{0};      ///< failed sends
+  };
+
+  explicit GoosePublisher(std::string interface_name) : interface_name_(std::move(interface_name)) { Open(); }
+
+  GoosePublisher(const GoosePublisher&) = delete;
+  GoosePublisher& operator=(const GoosePublisher&) = delete;
+  ~GoosePublisher() { Close(); }
+
+  /**
+   * @brief add a control block before Start(), destination MAC 01-0C-CD-01-<index> unless configured
+   * @return control block index
+   */
+  size_t AddControlBlock(const GooseControlBlock& config, std::vector<GooseValue> values) {
+    if (config.min_interval_ms == 0 || config.heartbeat_ms < config.min_interval_ms) {
+      throw std::invalid_argument("GOOSE publisher: invalid retransmission intervals");
+    }
+    const size_t index = blocks_.size();
+    const uint8_t dst_index[6] = {0x01, 0x0C, 0xCD, 0x01, static_cast<uint8_t>(index >> 8),
+                                  static_cast<uint8_t>(index)};
+    const uint8_t none[6]{};
+    const uint8_t* dst = std::memcmp(config.dst, none, sizeof(none)) ? config.dst : dst_index;
+    blocks_.push_back(Block{GooseEncoder(dst, mac_, config.app_id, config.gocb_ref, config.dat_set, config.go_id,
+                                         config.conf_rev, config.vlan_id, config.vlan_priority),
+                            config, values, std::move(values)});
+    return index;
+  }
+
+  /**
+   * @brief change the data set values of a control block, may be called from any thread
+   * @return false if the values did not change (no new state)
+   */
+  bool SetValues(size_t index, const std::vector<GooseValue>& values) {
+    {
+      std::lock_guard lock(mutex_);
+      auto& block = blocks_[index];
+      if (values == block.pending) {
+        return false;
+      }
+      block.pending = values;
+      if (!block.changed) {
+        block.changed = true;
+        block.change_ticks = CycleClock::Ticks();
+      }
+    }
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = write(event_fd_, &one, sizeof(one));
+    return true;
+  }
+
+  /**
+   * @brief publish until Stop() is called; every control block starts with stNum 1
+   */
+  void Start() {
+    origin_ns_ = NowNs();
+    wheel_.Reserve(blocks_.size());
+    wheel_.SetNow(0);
+    {
+      std::lock_guard lock(mutex_);
+      for (auto& block : blocks_) {
+        block.changed = true;
+        block.change_ticks = CycleClock::Ticks();
+      }
+    }
+    while (run_.load(std::memory_order_relaxed)) {
+      SendStateChanges();
+      const int64_t now = NowNs();
+      wheel_.Advance(static_cast<uint64_t>((now - origin_ns_) / kTickNs), [this](size_t id) { Retransmit(id); });
+
+      const uint64_t next = wheel_.NextDue();
+      int64_t timeout = next == TimerWheel<>::kIdle ? 100 * kTickNs
+                                                    : origin_ns_ + static_cast<int64_t>(next) * kTickNs - NowNs();
+      timeout = timeout < 0 ? 0 : timeout;
+      const timespec ts{static_cast<time_t>(timeout / 1'000'000'000), static_cast<long>(timeout % 1'000'000'000)};
+      pollfd pfd{event_fd_, POLLIN, 0};
+      if (ppoll(&pfd, 1, &ts, nullptr) > 0) {
+        uint64_t count;
+        [[maybe_unused]] auto got = read(event_fd_, &count, sizeof(count));
+      }
+    }
+  }
+
+  void Stop() {
+    run_ = false;
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = write(event_fd_, &one, sizeof(one));
+  }
+
+  /**
+   * @brief statistics, consistent when read after Start() returned
+   */
+  const Statistics& GetStatistics() const { return stats_; }
+
+  /**
+   * @brief time from SetValues() to the return of send() for the first frame of the new state
+   */
+  const LatencyHistogram& Latency() const { return latency_; }
+
+  void Print(std::FILE* out = stdout) const {
+    std::fprintf(out, "GOOSE publisher %s: %zu control block(s) state changes=%llu frames=%llu send errors=%llu\n",
+                 interface_name_.c_str(), blocks_.size(), static_cast<unsigned long long>(stats_.state_changes),
+                 static_cast<unsigned long long>(stats_.frames), static_cast<unsigned long long>(stats_.send_errors));
+    for (const auto& block : blocks_) {
+      std::fprintf(out, " %s: stNum=%u sqNum=%u\n", block.config.gocb_ref.c_str(), block.st_num, block.sq_num);
+    }
+    latency_.Print(" state change to send", out);
+  }
+
+ private:
+  struct Block {
+    GooseEncoder encoder;
+    GooseControlBlock config;
+    std::vector<GooseValue> values;    ///< published state, publisher thread only
+    std::vector<GooseValue> pending;   ///< latest SetValues(), guarded by mutex_
+    bool changed{false};               ///< guarded by mutex_
+    uint64_t change_ticks{0};          ///< CycleClock, guarded by mutex_
+    uint32_t st_num{0};
+    uint32_t sq_num{0};
+    uint32_t interval_ms{0};   ///< interval to the next retransmission
+    uint64_t t{0};             ///< UtcTime of the state change
+  };
+
+  static int64_t NowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+  }
+
+  void SendStateChanges() {
+    for (size_t id = 0; id < blocks_.size(); ++id) {
+      auto& block = blocks_[id];
+      uint64_t change_ticks;
+      {
+        std::lock_guard lock(mutex_);
+        if (!block.changed) {
+          continue;
+        }
+        block.changed = false;
+        block.values.swap(block.pending);
+        block.pending = block.values;
+        change_ticks = block.change_ticks;
+      }
+      timespec now;
+      clock_gettime(CLOCK_REALTIME, &now);
+      block.t = GooseUtcTime(now);
+      block.st_num = block.st_num == UINT32_MAX ? 1 : block.st_num + 1;
+      block.sq_num = 0;
+      block.interval_ms = block.config.min_interval_ms;
+      block.encoder.SetValues(block.values);
+      Send(block);
+      latency_.Add(CycleClock::TicksToNs(static_cast<int64_t>(CycleClock::Ticks() - change_ticks)));
+      ++stats_.state_changes;
+      wheel_.Schedule(id, Tick() + block.interval_ms);
+    }
+  }
+
+  void Retransmit(size_t id) {
+    auto& block = blocks_[id];
+    block.sq_num = block.sq_num == UINT32_MAX ? 1 : block.sq_num + 1;
+    const uint32_t doubled = block.interval_ms * 2;
+    block.interval_ms = doubled < block.config.heartbeat_ms ? doubled : block.config.heartbeat_ms;
+    Send(block);
+    wheel_.Schedule(id, wheel_.Now() + block.interval_ms);
+  }
+
+  void Send(Block& block) {
+    block.encoder.Encode(block.t, block.st_num, block.sq_num, 2 * block.interval_ms);
+    if (send(fd_, block.encoder.data(), block.encoder.size(), 0) < 0) {
+      ++stats_.send_errors;
+    } else {
+      ++stats_.frames;
+    }
+  }
+
+  uint64_t Tick() const { return static_cast<uint64_t>((NowNs() - origin_ns_) / kTickNs); }
+
+  void Open() {
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    fd_ = socket(AF_PACKET, SOCK_RAW, 0);   // transmit only
+    if (fd_ < 0 || event_fd_ < 0) {
+      Close();
+      throw std::runtime_error("GOOSE publisher: socket failed: " + std::string(strerror(errno)));
+    }
+    ifreq ifr{};
+    std::strncpy(ifr.ifr_name, interface_name_.c_str(), IFNAMSIZ - 1);
+    if (ioctl(fd_, SIOCGIFHWADDR, &ifr) < 0) {
+      Close();
+      throw std::runtime_error("GOOSE publisher: unknown interface " + interface_name_);
+    }
+    std::memcpy(mac_, ifr.ifr_hwaddr.sa_data, 6);
+
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_ifindex = static_cast<int>(if_nametoindex(interface_name_.c_str()));
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      Close();
+      throw std::runtime_error("GOOSE publisher: cannot bind to interface " + interface_name_);
+    }
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    if (event_fd_ >= 0) {
+      close(event_fd_);
+      event_fd_ = -1;
+    }
+  }
+
+  std::string interface_name_;
+  int fd_{-1};
+  int event_fd_{-1};
+  uint8_t mac_[6]{};
+  std::vector<Block> blocks_;
+  std::mutex mutex_;
+  TimerWheel<> wheel_;
+  int64_t origin_ns_{0};
+  std::atomic<bool> run_{true};
+  Statistics stats_;
+  LatencyHistogram latency_;
+};
@@ -0,0 +1,257 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   GOOSE subscriber with stNum/sqNum tracking and timeAllowedtoLive supervision
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <goose.hpp>
+#include <latency_histogram.hpp>
+
+/**
+ * @brief GOOSE subscriber on a raw packet socket for ethertype 0x88B8
+ * @desc GOOSE traffic is sparse, so frames are read with recvmsg() and a kernel receive timestamp. Every control
+ *       block (by gocbRef) is tracked: a new stNum is a state change, sqNum must count up within a state, and a
+ *       control block expires when no frame arrives within the timeAllowedtoLive of the last one.
+ */
+class GooseSubscriber {
+ public:
+  struct Statistics {
+    uint64_t frames{0};           ///< frames received
+    uint64_t frames_invalid{0};   ///< frames which failed to decode
+  };
+
+  /**
+   * @brief state of one control block
+   */
+  struct Stream {
+    std::string gocb_ref;
+    uint32_t st_num{0};
+    uint32_t sq_num{0};
+    int64_t expires_ns{0};             ///< CLOCK_MONOTONIC
+    bool expired{false};
+    uint64_t frames{0};
+    uint64_t state_changes{0};
+    uint64_t missed_states{0};         ///< stNum jumped by more than one
+    uint64_t missed_frames{0};         ///< sqNum jumped by more than one
+    uint64_t duplicates{0};            ///< same stNum/sqNum again
+    uint64_t out_of_order{0};          ///< sqNum or stNum went back
+    uint64_t expirations{0};           ///< timeAllowedtoLive elapsed without a frame
+    LatencyHistogram transfer;         ///< receive time - t of the first frame of each new state
+  };
+
+  explicit GooseSubscriber(std::string interface_name) : interface_name_(std::move(interface_name)) {}
+  GooseSubscriber(const GooseSubscriber&) = delete;
+  GooseSubscriber& operator=(const GooseSubscriber&) = delete;
+  ~GooseSubscriber() { Close(); }
+
+  /**
+   * @brief receive until Stop() is called
+   * @param handler - callable as handler(const GooseFrame&, const Stream&, bool state_changed) for every frame
+   * @param expired - callable as expired(const Stream&) when a control block exceeds its timeAllowedtoLive
+   */
+  template <class Handler, class Expired>
+  void Start(Handler&& handler, Expired&& expired) {
+    Open();
+    GooseFrame frame;
+    uint8_t buffer[kGooseMaxFrameSize + 64];
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(timespec))];
+
+    while (run_.load(std::memory_order_relaxed)) {
+      const int64_t now = NowNs();
+      int64_t timeout = kPollTimeoutNs;
+      for (auto& stream : streams_) {
+        if (stream.expired) {
+          continue;
+        }
+        if (stream.expires_ns <= now) {
+          stream.expired = true;
+          ++stream.expirations;
+          expired(static_cast<const Stream&>(stream));
+        } else if (stream.expires_ns - now < timeout) {
+          timeout = stream.expires_ns - now;
+        }
+      }
+      pollfd pfd{fd_, POLLIN, 0};
+      const timespec ts{static_cast<time_t>(timeout / 1'000'000'000), static_cast<long>(timeout % 1'000'000'000)};
+      if (ppoll(&pfd, 1, &ts, nullptr) <= 0) {
+        continue;
+      }
+
+      iovec iov{buffer, sizeof(buffer)};
+      msghdr msg{};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      const ssize_t size = recvmsg(fd_, &msg, MSG_DONTWAIT);
+      if (size <= 0) {
+        continue;
+      }
+      timespec received{};
+      for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMPNS) {
+          std::memcpy(&received, CMSG_DATA(c), sizeof(received));
+        }
+      }
+      ++stats_.frames;
+      if (!GooseDecode(buffer, static_cast<size_t>(size), frame)) {
+        ++stats_.frames_invalid;
+        continue;
+      }
+      auto& stream = Find(frame.gocb_ref);
+      const bool state_changed = Track(stream, frame, received);
+      handler(static_cast<const GooseFrame&>(frame), static_cast<const Stream&>(stream), state_changed);
+    }
+    Close();
+  }
+
+  void Stop() { run_ = false; }
+
+  /**
+   * @brief statistics, only consistent when read from the receiving thread or after Start() returned
+   */
+  const Statistics& GetStatistics() const { return stats_; }
+  const std::vector<Stream>& Streams() const { return streams_; }
+
+  void Print(std::FILE* out = stdout) const {
+    std::fprintf(out, "GOOSE subscriber %s: frames=%llu invalid=%llu control blocks=%zu\n", interface_name_.c_str(),
+                 static_cast<unsigned long long>(stats_.frames), static_cast<unsigned long long>(stats_.frames_invalid),
+                 streams_.size());
+    for (const auto& s : streams_) {
+      std::fprintf(out,
+                   " %s: stNum=%u sqNum=%u frames=%llu states=%llu missed states=%llu missed frames=%llu "
+                   "duplicates=%llu out-of-order=%llu expired=%llu%s\n",
+                   s.gocb_ref.c_str(), s.st_num, s.sq_num, static_cast<unsigned long long>(s.frames),
+                   static_cast<unsigned long long>(s.state_changes), static_cast<unsigned long long>(s.missed_states),
+                   static_cast<unsigned long long>(s.missed_frames), static_cast<unsigned long long>(s.duplicates),
+                   static_cast<unsigned long long>(s.out_of_order), static_cast<unsigned long long>(s.expirations),
+                   s.expired ? " (expired)" : "");
+      s.transfer.Print("  state change transfer", out);
+    }
+  }
+
+ private:
+  static constexpr int64_t kPollTimeoutNs = 100'000'000;   ///< bound for reacting on Stop()
+
+  static int64_t NowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+  }
+
+  Stream& Find(std::string_view gocb_ref) {
+    for (auto& stream : streams_) {
+      if (stream.gocb_ref == gocb_ref) {
+        return stream;
+      }
+    }
+    Stream stream;
+    stream.gocb_ref = gocb_ref;
+    streams_.push_back(std::move(stream));
+    return streams_.back();
+  }
+
+  /**
+   * @brief update the control block state
+   * @return true if the frame carries a new state
+   */
+  static bool Track(Stream& stream, const GooseFrame& frame, const timespec& received) {
+    bool state_changed = false;
+    if (stream.frames == 0 || stream.expired) {
+      state_changed = stream.frames == 0 || frame.st_num != stream.st_num;
+    } else if (frame.st_num != stream.st_num) {
+      if (frame.st_num == stream.st_num + 1 || (stream.st_num == UINT32_MAX && frame.st_num == 1)) {
+        state_changed = true;
+      } else if (frame.st_num > stream.st_num) {
+        stream.missed_states += frame.st_num - stream.st_num - 1;
+        state_changed = true;
+      } else {
+        ++stream.out_of_order;   // older state or publisher restart
+        state_changed = true;
+      }
+    } else if (frame.sq_num == stream.sq_num) {
+      ++stream.duplicates;
+    } else if (frame.sq_num < stream.sq_num) {
+      if (!(stream.sq_num == UINT32_MAX && frame.sq_num == 1)) {
+        ++stream.out_of_order;
+      }
+    } else if (frame.sq_num > stream.sq_num + 1) {
+      stream.missed_frames += frame.sq_num - stream.sq_num - 1;
+    }
+    if (state_changed) {
+      ++stream.state_changes;
+      if (received.tv_sec && frame.t) {
+        stream.transfer.Add(static_cast<int64_t>(received.tv_sec) * 1'000'000'000 + received.tv_nsec -
+                            GooseUtcTimeNs(frame.t));
+      }
+    }
+    stream.st_num = frame.st_num;
+    stream.sq_num = frame.sq_num;
+    stream.expires_ns = NowNs() + static_cast<int64_t>(frame.time_allowed_to_live) * 1'000'000;
+    stream.expired = false;
+    ++stream.frames;
+    return state_changed;
+  }
+
+  void Open() {
+    fd_ = socket(AF_PACKET, SOCK_RAW, htons(kGooseEtherType));
+    if (fd_ < 0) {
+      throw std::runtime_error("GOOSE subscriber: packet socket failed: " + std::string(strerror(errno)));
+    }
+    int on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(kGooseEtherType);
+    addr.sll_ifindex = static_cast<int>(if_nametoindex(interface_name_.c_str()));
+    if (addr.sll_ifindex == 0 || bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      Close();
+      throw std::runtime_error("GOOSE subscriber: cannot bind to interface " + interface_name_);
+    }
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  std::string interface_name_;
+  int fd_{-1};
+  std::vector<Stream> streams_;
+  std::atomic<bool> run_{true};
+  Statistics stats_;
+};
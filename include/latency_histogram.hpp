@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   fixed size latency/jitter histogram
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+
+/**
+ * @brief histogram of durations in power of two microsecond buckets plus min/max/mean
+ * @desc bucket 0 counts values below 1 us, bucket i values in [2^(i-1), 2^i) us; no allocation, single writer
+ */
+class LatencyHistogram {
+ public:
+  static constexpr size_t kBuckets = 24;
+
+  void Add(int64_t ns) {
+    if (ns < 0) {
+      ns = -ns;   // early wake-ups count as jitter as well
+    }
+    ++count_;
+    sum_ += ns;
+    if (ns < min_) {
+      min_ = ns;
+    }
+    if (ns > max_) {
+      max_ = ns;
+    }
+    const uint64_t us = static_cast<uint64_t>(ns) / 1000;
+    size_t bucket = us ? static_cast<size_t>(std::bit_width(us)) : 0;
+    ++buckets_[bucket < kBuckets ? bucket : kBuckets - 1];
+  }
+
+  void Reset() { *this = LatencyHistogram(); }
+
+  void Merge(const LatencyHistogram& other) {
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = other.min_ < min_ ? other.min_ : min_;
+    max_ = other.max_ > max_ ? other.max_ : max_;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+  }
+
+  uint64_t Count() const { return count_; }
+  int64_t Min() const { return count_ ? min_ : 0; }
+  int64_t Max() const { return max_; }
+  int64_t Mean() const { return count_ ? sum_ / static_cast<int64_t>(count_) : 0; }
+  uint64_t Bucket(size_t index) const { return buckets_[index]; }
+
+  /**
+   * @brief upper bound of the bucket holding the given quantile, in ns
+   */
+  int64_t Percentile(double quantile) const {
+    const auto target = static_cast<uint64_t>(quantile * static_cast<double>(count_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += buckets_[i];
+      if (seen > target) {
+        const int64_t bound = (int64_t{1} << i) * 1000;
+        return bound < max_ ? bound : max_;
+      }
+    }
+    return max_;
+  }
+
+  void Print(const char* name, std::FILE* out = stdout) const {
+    std::fprintf(out, "%s: n=%llu min=%.1f mean=%.1f p99=%.1f max=%.1f us\n", name,
+                 static_cast<unsigned long long>(count_), Min() / 1000.0, Mean() / 1000.0, Percentile(0.99) / 1000.0,
+                 Max() / 1000.0);
+  }
+
+ private:
+  uint64_t count_{0};
+  int64_t sum_{0};
+  int64_t min_{std::numeric_limits<int64_t>::max()};
+  int64_t max_{0};
+  uint64_t buckets_[kBuckets]{};
+};
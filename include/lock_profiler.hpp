@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   opt-in contention profile of the task synchronization: wait and hold time per named lock
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include <cycle_clock.hpp>
+
+/**
+ * @brief counters of one named lock, updated with relaxed atomics by the threads using it
+ * @desc Histograms have power of two nanosecond buckets: bucket 0 counts 0 ns (uncontended acquisitions), bucket i
+ *       values in [2^(i-1), 2^i) ns.
+ */
+struct LockStats {
+  static constexpr size_t kBuckets = 40;
+
+  explicit LockStats(const char* lock_name) : name(lock_name) {}
+
+  void Acquired(int64_t wait_ns, bool contended) {
+    acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (contended) {
+      contentions.fetch_add(1, std::memory_order_relaxed);
+    }
+    wait_total_ns.fetch_add(static_cast<uint64_t>(wait_ns), std::memory_order_relaxed);
+    Add(wait, wait_max_ns, wait_ns);
+  }
+
+  void Released(int64_t hold_ns) {
+    hold_total_ns.fetch_add(static_cast<uint64_t>(hold_ns), std::memory_order_relaxed);
+    Add(hold, hold_max_ns, hold_ns);
+  }
+
+  /**
+   * @brief upper bound of the bucket holding the given quantile, in ns
+   */
+  static int64_t Percentile(const std::atomic<uint64_t> (&buckets)[kBuckets], uint64_t max, double quantile) {
+    uint64_t count = 0;
+    for (const auto& bucket : buckets) {
+      count += bucket.load(std::memory_order_relaxed);
+    }
+    const auto target = static_cast<uint64_t>(quantile * static_cast<double>(count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += buckets[i].load(std::memory_order_relaxed);
+      if (seen > target) {
+        const uint64_t bound = i ? uint64_t{1} << i : 0;
+        return static_cast<int64_t>(std::min(bound, max));
+      }
+    }
+    return static_cast<int64_t>(max);
+  }
+
+  const char* name;
+  std::atomic<uint64_t> acquisitions{0};
+  std::atomic<uint64_t> contentions{0};   ///< acquisitions that found the lock taken
+  std::atomic<uint64_t> wait_total_ns{0};
+  std::atomic<uint64_t> hold_total_ns{0};
+  std::atomic<uint64_t> wait_max_ns{0};
+  std::atomic<uint64_t> hold_max_ns{0};
+  std::atomic<uint64_t> wait[kBuckets]{};
+  std::atomic<uint64_t> hold[kBuckets]{};
+
+ private:
+  static void Add(std::atomic<uint64_t> (&buckets)[kBuckets], std::atomic<uint64_t>& max, int64_t ns) {
+    const auto value = static_cast<uint64_t>(ns > 0 ? ns : 0);
+    const size_t bucket = static_cast<size_t>(std::bit_width(value));
+    buckets[bucket < kBuckets ? bucket : kBuckets - 1].fetch_add(1, std::memory_order_relaxed);
+    uint64_t seen = max.load(std::memory_order_relaxed);
+    while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+  }
+};
+
+/**
+ * @brief registry and report of the profiled locks
+ * @desc Built with -DBBX15_LOCK_PROFILER (cmake -DBBX15_LOCK_PROFILER=ON) ProfiledMutex measures every acquisition;
+ *       without it ProfiledMutex is a std::mutex, ProfiledLock and ProfiledConditionVariable the standard types,
+ *       and Print() prints nothing.
+ */
+class LockProfiler {
+ public:
+#ifdef BBX15_LOCK_PROFILER
+  static constexpr bool kEnabled = true;
+#else
+  static constexpr bool kEnabled = false;
+#endif
+
+  static void Register(LockStats* stats) {
+    State& state = Global();
+    std::lock_guard lock(state.mutex);
+    state.locks.push_back(stats);
+  }
+
+  static void Unregister(LockStats* stats) {
+    State& state = Global();
+    std::lock_guard lock(state.mutex);
+    state.locks.erase(std::remove(state.locks.begin(), state.locks.end(), stats), state.locks.end());
+  }
+
+  /**
+   * @brief locks ranked by total wait time
+   */
+  static void Print(std::FILE* out = stdout) {
+    if (!kEnabled) {
+      return;
+    }
+    State& state = Global();
+    std::lock_guard lock(state.mutex);
+    std::vector<LockStats*> locks = state.locks;
+    std::sort(locks.begin(), locks.end(), [](const LockStats* a, const LockStats* b) {
+      return a->wait_total_ns.load(std::memory_order_relaxed) > b->wait_total_ns.load(std::memory_order_relaxed);
+    });
+    std::fprintf(out, "lock contention, ranked by total wait (us; p99 is a power of two bucket bound):\n");
+    std::fprintf(out, "%-24s %10s %10s %7s %12s %9s %9s %9s %9s %9s\n", "lock", "acquired", "contended", "%",
+                 "wait total", "wait p99", "wait max", "hold mean", "hold p99", "hold max");
+    for (const LockStats* stats : locks) {
+      const uint64_t acquisitions = stats->acquisitions.load(std::memory_order_relaxed);
+      const uint64_t contentions = stats->contentions.load(std::memory_order_relaxed);
+      const auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+      std::fprintf(
+         out, "%-24s %10llu %10llu %6.2f%% %12.1f %9.1f %9.1f %9.2f %9.1f %9.1f\n", stats->name,
+         static_cast<unsigned long long>(acquisitions), static_cast<unsigned long long>(contentions),
+         acquisitions ? 100.0 * static_cast<double>(contentions) / static_cast<double>(acquisitions) : 0.0,
+         us(stats->wait_total_ns.load(std::memory_order_relaxed)),
+         us(LockStats::Percentile(stats->wait, stats->wait_max_ns.load(std::memory_order_relaxed), 0.99)),
+         us(stats->wait_max_ns.load(std::memory_order_relaxed)),
+         acquisitions ? us(stats->hold_total_ns.load(std::memory_order_relaxed)) / static_cast<double>(acquisitions)
+                      : 0.0,
+         us(LockStats::Percentile(stats->hold, stats->hold_max_ns.load(std::memory_order_relaxed), 0.99)),
+         us(stats->hold_max_ns.load(std::memory_order_relaxed)));
+    }
+  }
+
+ private:
+  struct State {
+    std::mutex mutex;   ///< guards locks
+    std::vector<LockStats*> locks;
+  };
+
+  // constructed on first use, profiled locks are globals of other translation units
+  static State& Global() {
+    static State state;
+    return state;
+  }
+};
+
+#ifdef BBX15_LOCK_PROFILER
+/**
+ * @brief named mutex measuring wait and hold time
+ * @desc An uncontended acquisition costs a try_lock and one time stamp; a contended one waits in lock() between two
+ *       time stamps. The hold time is measured from the acquisition to unlock(), the owner keeps its start.
+ */
+class ProfiledMutex {
+ public:
+  explicit ProfiledMutex(const char* name) : stats_(name) { LockProfiler::Register(&stats_); }
+  ~ProfiledMutex() { LockProfiler::Unregister(&stats_); }
+
+  ProfiledMutex(const ProfiledMutex&) = delete;
+  ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+  void lock() {
+    if (mutex_.try_lock()) {
+      acquired_ = CycleClock::Ticks();
+      stats_.Acquired(0, false);
+      return;
+    }
+    const uint64_t start = CycleClock::Ticks();
+    mutex_.lock();
+    acquired_ = CycleClock::Ticks();
+    stats_.Acquired(CycleClock::TicksToNs(static_cast<int64_t>(acquired_ - start)), true);
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    acquired_ = CycleClock::Ticks();
+    stats_.Acquired(0, false);
+    return true;
+  }
+
+  void unlock() {
+    const int64_t hold = CycleClock::TicksToNs(static_cast<int64_t>(CycleClock::Ticks() - acquired_));
+    mutex_.unlock();
+    stats_.Released(hold);
+  }
+
+  const LockStats& Stats() const { return stats_; }
+
+ private:
+  std::mutex mutex_;
+  uint64_t acquired_{0};   ///< written and read by the owner only
+  LockStats stats_;
+};
+
+using ProfiledLock = std::unique_lock<ProfiledMutex>;
+// waits release and re-acquire the mutex through ProfiledMutex, so the hold time excludes the wait
+using ProfiledConditionVariable = std::condition_variable_any;
+#else
+/**
+ * @brief std::mutex, the name is dropped
+ */
+class ProfiledMutex : public std::mutex {
+ public:
+  explicit ProfiledMutex(const char*) {}
+};
+
+using ProfiledLock = std::unique_lock<std::mutex>;
+using ProfiledConditionVariable = std::condition_variable;
+#endif
@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   counters, gauges and histograms with per-thread shards, rendered in Prometheus text format
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace metrics_detail {
+constexpr size_t kShards = 8;   ///< writers are spread over the shards, a power of two
+
+/**
+ * @brief shard of the calling thread, threads get consecutive shards in the order of their first update
+ */
+inline size_t ShardIndex() {
+  static std::atomic<size_t> next{0};
+  static thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+  return index;
+}
+
+/**
+ * @brief counter on its own cache line so that threads on different shards never share a line
+ */
+struct alignas(64) Cell {
+  std::atomic<uint64_t> value{0};
+};
+}   // namespace metrics_detail
+
+/**
+ * @brief monotonic counter
+ * @desc Inc() is a relaxed add to the shard of the calling thread; scraping sums the shards.
+ */
+class MetricCounter {
+ public:
+  void Inc(uint64_t n = 1) { cells_[metrics_detail::ShardIndex()].value.fetch_add(n, std::memory_order_relaxed); }
+
+  uint64_t Value() const {
+    uint64_t sum = 0;
+    for (const auto& cell : cells_) {
+      sum += cell.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  metrics_detail::Cell cells_[metrics_detail::kShards];
+};
+
+/**
+ * @brief value that goes up and down, last Set() wins
+ */
+class MetricGauge {
+ public:
+  void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  void Add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  alignas(64) std::atomic<int64_t> value_{0};
+};
+
+/**
+ * @brief histogram of durations in the power of two microsecond buckets of LatencyHistogram
+ * @desc Bucket 0 counts durations below 1 us, bucket i durations in [2^(i-1), 2^i) us. Observe() is three relaxed
+ *       adds to the shard of the calling thread.
+ */
+class MetricHistogram {
+ public:
+  static constexpr size_t kBuckets = 24;
+
+  void Observe(int64_t ns) {
+    ns = ns < 0 ? 0 : ns;
+    const uint64_t us = static_cast<uint64_t>(ns) / 1000;
+    const size_t bucket = us ? static_cast<size_t>(std::bit_width(us)) : 0;
+    Shard& shard = shards_[metrics_detail::ShardIndex()];
+    shard.buckets[bucket < kBuckets ? bucket : kBuckets - 1].fetch_add(1, std::memory_order_relaxed);
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.sum_ns.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief upper bound of a bucket in seconds
+   */
+  static double UpperBound(size_t bucket) { return static_cast<double>(uint64_t{1} << bucket) * 1e-6; }
+
+  /**
+   * @brief sum of all shards, buckets are not cumulative
+   */
+  void Collect(uint64_t (&buckets)[kBuckets], uint64_t& count, uint64_t& sum_ns) const {
+    count = sum_ns = 0;
+    for (auto& bucket : buckets) {
+      bucket = 0;
+    }
+    for (const auto& shard : shards_) {
+      for (size_t i = 0; i < kBuckets; ++i) {
+        buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+      }
+      count += shard.count.load(std::memory_order_relaxed);
+      sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> buckets[kBuckets]{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum_ns{0};
+  };
+
+  Shard shards_[metrics_detail::kShards];
+};
+
+/**
+ * @brief process wide registry of metrics
+ * @desc Metrics are created once at start-up and live as long as the process; the returned references stay valid.
+ *       Metrics with the same name and different labels form one family. Only registration and rendering take
+ *       the registry lock, updates never do.
+ * @code
+ *   static auto& frames = Metrics().Counter("bbx15_sv_frames_total", "SV frames received");
+ *   frames.Inc();
+ * @endcode
+ */
+class MetricsRegistry {
+ public:
+  /**
+   * @param name - metric name, [a-zA-Z_:][a-zA-Z0-9_:]*
+   * @param help - description
+   * @param labels - label set without braces, e.g. task="fswatch", empty - no labels
+   */
+  MetricCounter& Counter(const std::string& name, const std::string& help, const std::string& labels = "") {
+    std::lock_guard lock(mutex_);
+    Add(name, help, labels, Type::kCounter, counters_.size());
+    return counters_.emplace_back();
+  }
+
+  MetricGauge& Gauge(const std::string& name, const std::string& help, const std::string& labels = "") {
+    std::lock_guard lock(mutex_);
+    Add(name, help, labels, Type::kGauge, gauges_.size());
+    return gauges_.emplace_back();
+  }
+
+  MetricHistogram& Histogram(const std::string& name, const std::string& help, const std::string& labels = "") {
+    std::lock_guard lock(mutex_);
+    Add(name, help, labels, Type::kHistogram, histograms_.size());
+    return histograms_.emplace_back();
+  }
+
+  /**
+   * @brief all metrics in Prometheus text exposition format 0.0.4
+   */
+  std::string Render() const {
+    std::lock_guard lock(mutex_);
+    std::string text;
+    char line[512];
+    const std::string* family = nullptr;
+    for (const auto& entry : Sorted()) {
+      if (!family || *family != entry->name) {
+        family = &entry->name;
+        static constexpr const char* kTypes[] = {"counter", "gauge", "histogram"};
+        text += "# HELP " + entry->name + " " + entry->help + "\n";
+        text += "# TYPE " + entry->name + " " + kTypes[static_cast<int>(entry->type)] + "\n";
+      }
+      const std::string braces = entry->labels.empty() ? "" : "{" + entry->labels + "}";
+      switch (entry->type) {
+        case Type::kCounter:
+          std::snprintf(line, sizeof(line), "%s%s %llu\n", entry->name.c_str(), braces.c_str(),
+                        static_cast<unsigned long long>(counters_[entry->index].Value()));
+          text += line;
+          break;
+        case Type::kGauge:
+          std::snprintf(line, sizeof(line), "%s%s %lld\n", entry->name.c_str(), braces.c_str(),
+                        static_cast<long long>(gauges_[entry->index].Value()));
+          text += line;
+          break;
+        case Type::kHistogram: {
+          uint64_t buckets[MetricHistogram::kBuckets];
+          uint64_t count, sum_ns;
+          histograms_[entry->index].Collect(buckets, count, sum_ns);
+          const std::string prefix = entry->labels.empty() ? "{" : "{" + entry->labels + ",";
+          uint64_t cumulative = 0;
+          for (size_t i = 0; i + 1 < MetricHistogram::kBuckets; ++i) {
+            cumulative += buckets[i];
+            std::snprintf(line, sizeof(line), "%s_bucket%sle=\"%g\"} %llu\n", entry->name.c_str(), prefix.c_str(),
+                          MetricHistogram::UpperBound(i), static_cast<unsigned long long>(cumulative));
+            text += line;
+          }
+          std::snprintf(line, sizeof(line), "%s_bucket%sle=\"+Inf\"} %llu\n%s_sum%s %.9f\n%s_count%s %llu\n",
+                        entry->name.c_str(), prefix.c_str(), static_cast<unsigned long long>(count),
+                        entry->name.c_str(), braces.c_str(), static_cast<double>(sum_ns) * 1e-9, entry->name.c_str(),
+                        braces.c_str(), static_cast<unsigned long long>(count));
+          text += line;
+          break;
+        }
+      }
+    }
+    return text;
+  }
+
+ private:
+  enum class Type { kCounter, kGauge, kHistogram };
+
+  struct Entry {
+    std::string name;
+    std::string help;
+    std::string labels;
+    Type type;
+    size_t index{0};
+  };
+
+  void Add(const std::string& name, const std::string& help, const std::string& labels, Type type, size_t index) {
+    entries_.push_back(Entry{name, help, labels, type, index});
+  }
+
+  /**
+   * @brief entries grouped by family, in registration order of the families
+   */
+  std::vector<const Entry*> Sorted() const {
+    std::vector<const Entry*> sorted;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      bool seen = false;
+      for (size_t j = 0; j < i && !seen; ++j) {
+        seen = entries_[j].name == entries_[i].name;
+      }
+      for (size_t j = i; !seen && j < entries_.size(); ++j) {
+        if (entries_[j].name == entries_[i].name) {
+          sorted.push_back(&entries_[j]);
+        }
+      }
+    }
+    return sorted;
+  }
+
+  mutable std::mutex mutex_;
+  std::deque<Entry> entries_;
+  std::deque<MetricCounter> counters_;   ///< deques keep the references stable
+  std::deque<MetricGauge> gauges_;
+  std::deque<MetricHistogram> histograms_;
+};
+
+/**
+ * @brief the registry of the process
+ */
+inline MetricsRegistry& Metrics() {
+  static MetricsRegistry registry;
+  return registry;
+}
@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   HTTP endpoint serving the metrics registry on a Unix socket or a loopback port
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <metrics.hpp>
+
+/**
+ * @brief serves Metrics().Render() to every HTTP request, e.g. GET /metrics
+ * @desc The address is a TCP port on 127.0.0.1 if it consists of digits only, otherwise the path of a Unix socket
+ *       (curl --unix-socket <path> http://localhost/metrics). Start() lowers the calling thread to SCHED_IDLE and
+ *       nice 19, so serving a scrape only uses otherwise idle CPU time and never delays the tasks; the metrics
+ *       themselves are read with relaxed loads and do not lock out their writers.
+ */
+class MetricsServer {
+ public:
+  explicit MetricsServer(std::string address) : address_(std::move(address)) { Open(); }
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+  ~MetricsServer() { Close(); }
+
+  /**
+   * @brief serve until Stop() is called
+   */
+  void Start() {
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    setpriority(PRIO_PROCESS, 0, 19);   // thread nice value for kernels without SCHED_IDLE
+
+    while (run_.load(std::memory_order_relaxed)) {
+      pollfd pfd[2] = {{fd_, POLLIN, 0}, {event_fd_, POLLIN, 0}};
+      if (poll(pfd, 2, -1) <= 0 || !(pfd[0].revents & POLLIN)) {
+        continue;
+      }
+      const int client = accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0) {
+        continue;
+      }
+      Serve(client);
+      close(client);
+    }
+  }
+
+  void Stop() {
+    run_ = false;
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = write(event_fd_, &one, sizeof(one));
+  }
+
+  uint64_t Requests() const { return requests_.load(std::memory_order_relaxed); }
+
+  void Print(std::FILE* out = stdout) const {
+    std::fprintf(out, "metrics server %s: requests=%llu\n", address_.c_str(),
+                 static_cast<unsigned long long>(Requests()));
+  }
+
+ private:
+  static constexpr int kRequestTimeoutMs = 1000;   ///< a client must send its request within this time
+
+  /**
+   * @brief read the request header and answer with the current metrics
+   */
+  void Serve(int client) {
+    char request[2048];
+    size_t size = 0;
+    while (size < sizeof(request) - 1) {
+      pollfd pfd{client, POLLIN, 0};
+      if (poll(&pfd, 1, kRequestTimeoutMs) <= 0) {
+        return;
+      }
+      const ssize_t got = recv(client, request + size, sizeof(request) - 1 - size, 0);
+      if (got <= 0) {
+        return;
+      }
+      size += static_cast<size_t>(got);
+      request[size] = '\0';
+      if (std::strstr(request, "\r\n\r\n") || std::strstr(request, "\n\n")) {
+        break;
+      }
+    }
+    const std::string body = Metrics().Render();
+    char header[160];
+    const int length = std::snprintf(header, sizeof(header),
+                                     "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                                     body.size());
+    if (SendAll(client, header, static_cast<size_t>(length)) && std::strncmp(request, "HEAD", 4) != 0) {
+      SendAll(client, body.data(), body.size());
+    }
+    requests_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static bool SendAll(int client, const char* data, size_t size) {
+    while (size > 0) {
+      const ssize_t sent = send(client, data, size, MSG_NOSIGNAL);
+      if (sent <= 0) {
+        return false;
+      }
+      data += sent;
+      size -= static_cast<size_t>(sent);
+    }
+    return true;
+  }
+
+  void Open() {
+    const bool tcp = !address_.empty() && address_.find_first_not_of("0123456789") == std::string::npos;
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    fd_ = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || event_fd_ < 0) {
+      Close();
+      throw std::runtime_error("Metrics server: socket failed: " + std::string(strerror(errno)));
+    }
+    int result;
+    if (tcp) {
+      int on = 1;
+      setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      sockaddr_in addr{};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(static_cast<uint16_t>(std::stoul(address_)));
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      result = bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    } else {
+      sockaddr_un addr{};
+      addr.sun_family = AF_UNIX;
+      if (address_.size() >= sizeof(addr.sun_path)) {
+        Close();
+        throw std::runtime_error("Metrics server: socket path too long: " + address_);
+      }
+      std::strcpy(addr.sun_path, address_.c_str());
+      unlink(address_.c_str());   // left over from a previous run
+      result = bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+      unix_path_ = result == 0 ? address_ : "";
+    }
+    if (result < 0 || listen(fd_, 8) < 0) {
+      const std::string error = strerror(errno);
+      Close();
+      throw std::runtime_error("Metrics server: cannot listen on " + address_ + ": " + error);
+    }
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    if (event_fd_ >= 0) {
+      close(event_fd_);
+      event_fd_ = -1;
+    }
+    if (!unix_path_.empty()) {
+      unlink(unix_path_.c_str());
+      unix_path_.clear();
+    }
+  }
+
+  std::string address_;
+  std::string unix_path_;   ///< bound Unix socket, removed on close
+  int fd_{-1};
+  int event_fd_{-1};
+  std::atomic<bool> run_{true};
+  std::atomic<uint64_t> requests_{0};
+};
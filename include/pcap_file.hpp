@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   memory mapped pcap/pcapng capture file
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief one frame of a capture, data points into the mapped file
+ */
+struct PcapFrame {
+  const uint8_t* data;
+  uint32_t size;
+  int64_t ts_ns;   ///< capture timestamp in ns
+};
+
+/**
+ * @brief capture file mapped read only and indexed once
+ * @desc Classic pcap (microsecond and nanosecond variants) and pcapng (EPB/SPB, if_tsresol) in host byte order.
+ */
+class PcapFile {
+ public:
+  explicit PcapFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error("pcap: cannot open " + path);
+    }
+    struct stat st {};
+    fstat(fd, &st);
+    size_ = static_cast<size_t>(st.st_size);
+    void* map = size_ ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+      throw std::runtime_error("pcap: cannot map " + path);
+    }
+    data_ = static_cast<const uint8_t*>(map);
+    try {
+      Index();
+    } catch (...) {
+      munmap(const_cast<uint8_t*>(data_), size_);
+      throw;
+    }
+  }
+
+  PcapFile(const PcapFile&) = delete;
+  PcapFile& operator=(const PcapFile&) = delete;
+  ~PcapFile() { munmap(const_cast<uint8_t*>(data_), size_); }
+
+  const std::vector<PcapFrame>& Frames() const { return frames_; }
+
+ private:
+  static uint32_t Get32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, 4);
+    return value;
+  }
+
+  void Index() {
+    if (size_ < 24) {
+      throw std::runtime_error("pcap: file too short");
+    }
+    const uint32_t magic = Get32(data_);
+    if (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D) {
+      IndexPcap(magic == 0xA1B23C4D ? 1 : 1000);
+    } else if (magic == 0x0A0D0D0A) {
+      IndexPcapng();
+    } else {
+      throw std::runtime_error("pcap: unknown format or byte order");
+    }
+  }
+
+  void IndexPcap(int64_t ns_per_unit) {
+    size_t offset = 24;
+    while (offset + 16 <= size_) {
+      const uint8_t* p = data_ + offset;
+      const uint32_t caplen = Get32(p + 8);
+      if (offset + 16 + caplen > size_) {
+        break;
+      }
+      frames_.push_back(PcapFrame{p + 16, caplen,
+                                  static_cast<int64_t>(Get32(p)) * 1'000'000'000 + Get32(p + 4) * ns_per_unit});
+      offset += 16 + caplen;
+    }
+  }
+
+  void IndexPcapng() {
+    std::vector<uint64_t> units_per_second;   // per interface
+    size_t offset = 0;
+    while (offset + 12 <= size_) {
+      const uint8_t* p = data_ + offset;
+      const uint32_t type = Get32(p);
+      const uint32_t length = Get32(p + 4);
+      if (length < 12 || length % 4 != 0 || offset + length > size_) {
+        break;
+      }
+      if (type == 0x0A0D0D0A) {
+        units_per_second.clear();
+      } else if (type == 0x00000001) {
+        units_per_second.push_back(InterfaceResolution(p, length));
+      } else if (type == 0x00000006 && length >= 32) {
+        const uint32_t interface = Get32(p + 8);
+        const uint64_t ts = (static_cast<uint64_t>(Get32(p + 12)) << 32) | Get32(p + 16);
+        const uint64_t units = interface < units_per_second.size() ? units_per_second[interface] : 1'000'000;
+        const uint32_t caplen = Get32(p + 20);
+        if (28 + caplen <= length) {
+          frames_.push_back(PcapFrame{p + 28, caplen, ToNs(ts, units)});
+        }
+      } else if (type == 0x00000003 && length >= 16) {
+        const uint32_t caplen = length - 16 < Get32(p + 8) ? length - 16 : Get32(p + 8);
+        frames_.push_back(PcapFrame{p + 12, caplen, frames_.empty() ? 0 : frames_.back().ts_ns});
+      }
+      offset += length;
+    }
+  }
+
+  static int64_t ToNs(uint64_t ts, uint64_t units_per_second) {
+    const uint64_t seconds = ts / units_per_second;
+    const uint64_t fraction = ts % units_per_second;
+    return static_cast<int64_t>(seconds * 1'000'000'000 + fraction * 1'000'000'000 / units_per_second);
+  }
+
+  /**
+   * @brief timestamp units per second from the if_tsresol option of an IDB
+   */
+  static uint64_t InterfaceResolution(const uint8_t* p, uint32_t length) {
+    size_t offset = 16;
+    while (offset + 4 <= length - 4) {
+      uint16_t code, option_length;
+      std::memcpy(&code, p + offset, 2);
+      std::memcpy(&option_length, p + offset + 2, 2);
+      if (code == 0) {
+        break;
+      }
+      if (code == 9 && option_length >= 1) {
+        const uint8_t resolution = p[offset + 4];
+        uint64_t units = 1;
+        for (int i = 0; i < (resolution & 0x7F); ++i) {
+          units *= (resolution & 0x80) ? 2 : 10;
+        }
+        return units;
+      }
+      offset += 4 + ((option_length + 3u) & ~3u);
+    }
+    return 1'000'000;
+  }
+
+  const uint8_t* data_{nullptr};
+  size_t size_{0};
+  std::vector<PcapFrame> frames_;
+};
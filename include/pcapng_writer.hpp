@@ -0,0 +1,391 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   pcapng capture-to-disk sink with aligned buffers and a writer thread
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief writes captured frames as pcapng (nanosecond timestamps, Ethernet link type)
+ * @desc The capture thread appends Enhanced Packet Blocks into one of several large buffers aligned for O_DIRECT.
+ *       Full buffers are handed to a writer thread; only the aligned part is written, the tail moves to the next
+ *       buffer so the file offset stays aligned. If no buffer is free the frame is dropped and counted, the capture
+ *       thread never waits for storage. Files are rotated by size and/or capture time. If the file system does not
+ *       support O_DIRECT the file is written through the page cache.
+ */
+class PcapngWriter {
+ public:
+  struct Statistics {
+    uint64_t frames{0};         ///< frames written into buffers
+    uint64_t bytes{0};          ///< bytes handed to the writer thread
+    uint64_t drops{0};          ///< frames dropped because all buffers were waiting for storage
+    uint64_t files{0};          ///< files started
+    uint64_t write_errors{0};   ///< failed writes, the buffer content is lost
+  };
+
+  /**
+   * @brief constructor
+   * @param path - file name, rotated files get the suffix _NNNNN before .pcapng
+   * @param max_file_bytes - rotate when a file would exceed this size, 0 - no size limit
+   * @param max_file_seconds - rotate when capture time in a file exceeds this, 0 - no time limit
+   * @param buffer_bytes - size of one buffer, multiple of 4096
+   * @param buffer_count - number of buffers, at least 2
+   */
+  explicit PcapngWriter(std::string path, uint64_t max_file_bytes = 0, uint32_t max_file_seconds = 0,
+                        size_t buffer_bytes = 4u << 20, size_t buffer_count = 8)
+      : path_(std::move(path)),
+        max_file_bytes_(max_file_bytes),
+        max_file_seconds_(max_file_seconds),
+        buffer_bytes_(buffer_bytes),
+        buffers_(buffer_count) {
+    if (buffer_count < 2 || buffer_bytes_ % kAlignment != 0 || buffer_bytes_ < 16 * kAlignment) {
+      throw std::invalid_argument("pcapng writer: invalid buffer configuration");
+    }
+    for (auto& buffer : buffers_) {
+      buffer.data.reset(static_cast<uint8_t*>(std::aligned_alloc(kAlignment, buffer_bytes_)));
+      if (!buffer.data) {
+        throw std::bad_alloc();
+      }
+    }
+    if (path_.size() > 7 && path_.compare(path_.size() - 7, 7, ".pcapng") == 0) {
+      path_.resize(path_.size() - 7);
+    }
+  }
+
+  PcapngWriter(const PcapngWriter&) = delete;
+  PcapngWriter& operator=(const PcapngWriter&) = delete;
+  ~PcapngWriter() { Stop(); }
+
+  void Start() {
+    fill_ = 0;
+    buffers_[fill_].used = 0;
+    new_file_ = true;
+    run_ = true;
+    writer_ = std::thread([this]() { WriterLoop(); });
+  }
+
+  /**
+   * @brief flush the current buffer, close the file and join the writer thread
+   */
+  void Stop() {
+    if (!writer_.joinable()) {
+      return;
+    }
+    if (buffers_[fill_].used) {
+      Submit(true);
+    }
+    run_ = false;
+    Signal();
+    writer_.join();
+  }
+
+  /**
+   * @brief append a frame, called from the capture thread only
+   */
+  void Write(const uint8_t* data, size_t size, const timespec& ts) {
+    const size_t padded = (size + 3) & ~size_t{3};
+    const size_t block = 32 + padded;
+    if (block + kHeaderBytes > buffer_bytes_ - kAlignment) {
+      ++stats_.drops;
+      return;
+    }
+    if (!new_file_ && NeedsRotation(block, ts)) {
+      if (!NextBufferFree()) {
+        ++stats_.drops;
+        return;
+      }
+      Submit(true);
+    }
+    Buffer* buffer = &buffers_[fill_];
+    if (buffer->used + block > buffer_bytes_) {
+      if (!NextBufferFree()) {
+        ++stats_.drops;
+        return;
+      }
+      Submit(false);
+      buffer = &buffers_[fill_];
+    }
+    if (new_file_) {
+      WriteHeaders(*buffer);
+      file_bytes_ = kHeaderBytes;
+      file_start_ = ts;
+      new_file_ = false;
+      ++stats_.files;
+    }
+
+    uint8_t* p = buffer->data.get() + buffer->used;
+    const uint64_t ns = static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000u + static_cast<uint64_t>(ts.tv_nsec);
+    Put32(p, 0x00000006);   // Enhanced Packet Block
+    Put32(p + 4, static_cast<uint32_t>(block));
+    Put32(p + 8, 0);   // interface id
+    Put32(p + 12, static_cast<uint32_t>(ns >> 32));
+    Put32(p + 16, static_cast<uint32_t>(ns));
+    Put32(p + 20, static_cast<uint32_t>(size));
+    Put32(p + 24, static_cast<uint32_t>(size));
+    std::memcpy(p + 28, data, size);
+    std::memset(p + 28 + size, 0, padded - size);
+    Put32(p + 28 + padded, static_cast<uint32_t>(block));
+    buffer->used += block;
+    file_bytes_ += block;
+    ++stats_.frames;
+  }
+
+  /**
+   * @brief statistics, frames/drops are owned by the capture thread, bytes/errors by the writer thread
+   */
+  Statistics GetStatistics() const {
+    Statistics stats = stats_;
+    stats.bytes = bytes_written_.load(std::memory_order_relaxed);
+    stats.write_errors = write_errors_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  void Print(std::FILE* out = stdout) const {
+    const Statistics stats = GetStatistics();
+    std::fprintf(out, "pcapng %s: frames=%llu bytes=%llu files=%llu drops(storage)=%llu write errors=%llu%s\n",
+                 path_.c_str(), static_cast<unsigned long long>(stats.frames),
+                 static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.files),
+                 static_cast<unsigned long long>(stats.drops), static_cast<unsigned long long>(stats.write_errors),
+                 direct_io_ ? "" : " (buffered I/O)");
+  }
+
+ private:
+  static constexpr size_t kAlignment = 4096;
+  static constexpr size_t kHeaderBytes = 28 + 32;   // SHB + IDB with if_tsresol
+
+  enum : uint32_t { kFree = 0, kFull = 1 };
+
+  struct FreeDeleter {
+    void operator()(uint8_t* p) const { std::free(p); }
+  };
+
+  struct Buffer {
+    std::unique_ptr<uint8_t, FreeDeleter> data;
+    size_t used{0};
+    size_t submit{0};        ///< bytes to write, aligned unless end_of_file
+    bool end_of_file{false};
+    std::atomic<uint32_t> state{kFree};
+  };
+
+  static void Put32(uint8_t* p, uint32_t value) { std::memcpy(p, &value, 4); }   // host byte order, see BOM
+
+  void WriteHeaders(Buffer& buffer) {
+    uint8_t* p = buffer.data.get() + buffer.used;
+    // Section Header Block
+    Put32(p, 0x0A0D0D0A);
+    Put32(p + 4, 28);
+    Put32(p + 8, 0x1A2B3C4D);
+    Put32(p + 12, 0x00000001);   // version 1.0
+    Put32(p + 16, 0xFFFFFFFF);   // section length unknown
+    Put32(p + 20, 0xFFFFFFFF);
+    Put32(p + 24, 28);
+    // Interface Description Block, Ethernet, if_tsresol = 9 (nanoseconds)
+    p += 28;
+    Put32(p, 0x00000001);
+    Put32(p + 4, 32);
+    Put32(p + 8, 1);        // LINKTYPE_ETHERNET, reserved
+    Put32(p + 12, 65535);   // snaplen
+    Put32(p + 16, 0x00010009);
+    Put32(p + 20, 0x00000009);
+    Put32(p + 24, 0);   // opt_endofopt
+    Put32(p + 28, 32);
+    buffer.used += kHeaderBytes;
+  }
+
+  bool NeedsRotation(size_t block, const timespec& ts) const {
+    if (max_file_bytes_ && file_bytes_ + block > max_file_bytes_) {
+      return true;
+    }
+    return max_file_seconds_ && ts.tv_sec - file_start_.tv_sec >= static_cast<time_t>(max_file_seconds_);
+  }
+
+  bool NextBufferFree() const {
+    return buffers_[(fill_ + 1) % buffers_.size()].state.load(std::memory_order_acquire) == kFree;
+  }
+
+  /**
+   * @brief hand the current buffer to the writer thread and continue in the next (free) one
+   * @param end_of_file - write everything and close the file afterwards
+   */
+  void Submit(bool end_of_file) {
+    Buffer& buffer = buffers_[fill_];
+    Buffer& next = buffers_[(fill_ + 1) % buffers_.size()];
+    next.used = 0;
+    buffer.end_of_file = end_of_file;
+    buffer.submit = buffer.used;
+    if (!end_of_file) {
+      // keep the file offset aligned: the unaligned tail is written with the next buffer
+      const size_t tail = buffer.used % kAlignment;
+      buffer.submit = buffer.used - tail;
+      std::memcpy(next.data.get(), buffer.data.get() + buffer.submit, tail);
+      next.used = tail;
+    } else {
+      new_file_ = true;
+    }
+    buffer.state.store(kFull, std::memory_order_release);
+    fill_ = (fill_ + 1) % buffers_.size();
+    Signal();
+  }
+
+  /**
+   * @brief wake up the writer thread, once per submitted buffer
+   */
+  void Signal() {
+    {
+      std::lock_guard lock(submit_mutex_);
+      ++submitted_;
+    }
+    submit_condition_.notify_one();
+  }
+
+  std::string FileName() const {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%05u.pcapng", file_index_);
+    return path_ + suffix;
+  }
+
+  void OpenFile() {
+    const std::string name = FileName();
+    fd_ = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT | O_CLOEXEC, 0644);
+    direct_io_ = fd_ >= 0;
+    if (fd_ < 0) {
+      fd_ = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd_ < 0) {
+      std::fprintf(stderr, "pcapng writer: cannot open %s: %s\n", name.c_str(), std::strerror(errno));
+    }
+  }
+
+  bool WriteAll(const uint8_t* data, size_t size) {
+    while (size) {
+      ssize_t written = ::write(fd_, data, size);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written < 0 && errno == EINVAL && direct_io_) {
+        // O_DIRECT rejected by the file system at write time
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+        direct_io_ = false;
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      size -= static_cast<size_t>(written);
+    }
+    return true;
+  }
+
+  void WriteBuffer(Buffer& buffer) {
+    if (fd_ < 0) {
+      OpenFile();
+    }
+    bool ok = fd_ >= 0;
+    const size_t aligned = buffer.submit & ~(kAlignment - 1);
+    if (ok && aligned) {
+      ok = WriteAll(buffer.data.get(), aligned);
+    }
+    if (ok && buffer.submit > aligned) {
+      // only the last buffer of a file has an unaligned tail
+      if (direct_io_) {
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+      }
+      ok = WriteAll(buffer.data.get() + aligned, buffer.submit - aligned);
+    }
+    if (ok) {
+      bytes_written_.fetch_add(buffer.submit, std::memory_order_relaxed);
+    } else {
+      write_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (buffer.end_of_file && fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+      ++file_index_;
+    }
+  }
+
+  void WriterLoop() {
+    size_t index = 0;
+    uint32_t seen = 0;
+    for (;;) {
+      Buffer& buffer = buffers_[index];
+      if (buffer.state.load(std::memory_order_acquire) == kFull) {
+        WriteBuffer(buffer);
+        buffer.state.store(kFree, std::memory_order_release);
+        index = (index + 1) % buffers_.size();
+        continue;
+      }
+      if (!run_.load(std::memory_order_acquire)) {
+        if (buffer.state.load(std::memory_order_acquire) == kFull) {
+          continue;   // submitted just before the stop request
+        }
+        break;
+      }
+      std::unique_lock lock(submit_mutex_);
+      submit_condition_.wait(lock, [&]() { return submitted_ != seen; });
+      seen = submitted_;
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  std::string path_;
+  uint64_t max_file_bytes_;
+  uint32_t max_file_seconds_;
+  size_t buffer_bytes_;
+  std::vector<Buffer> buffers_;
+
+  // capture thread
+  size_t fill_{0};
+  bool new_file_{true};
+  uint64_t file_bytes_{0};
+  timespec file_start_{};
+  Statistics stats_;
+
+  // writer thread
+  int fd_{-1};
+  bool direct_io_{true};
+  unsigned file_index_{0};
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> write_errors_{0};
+
+  std::atomic<bool> run_{false};
+  std::mutex submit_mutex_;
+  std::condition_variable submit_condition_;
+  uint32_t submitted_{0};   ///< guarded by submit_mutex_
+  std::thread writer_;
+};
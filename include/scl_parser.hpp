@@ -0,0 +1,706 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   streaming SCL (SCD/CID/ICD) reader: SV and GOOSE control blocks, their data sets and addresses
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief destination of a control block from the Communication section
+ */
+struct SclAddress {
+  bool valid{false};   ///< an SMV or GSE address was found
+  uint8_t mac[6]{};
+  uint16_t app_id{0};
+  int vlan_id{-1};     ///< -1 - untagged
+  uint8_t vlan_priority{4};
+
+  bool operator==(const SclAddress&) const = default;
+};
+
+/**
+ * @brief SampledValueControl of an LN0
+ */
+struct SclSvControl {
+  std::string ied;
+  std::string ld_inst;
+  std::string name;
+  std::string dat_set;
+  std::string sv_id;                  ///< smvID
+  uint32_t conf_rev{0};
+  uint32_t smp_rate{0};
+  std::string smp_mod{"SmpPerPeriod"};
+  uint32_t no_asdu{1};
+  std::vector<std::string> members;   ///< FCDA of the data set, "LD/LN.DO.DA [FC]"
+  SclAddress address;
+
+  bool operator==(const SclSvControl&) const = default;
+};
+
+/**
+ * @brief GSEControl of an LN0
+ */
+struct SclGseControl {
+  std::string ied;
+  std::string ld_inst;
+  std::string name;
+  std::string dat_set;
+  std::string go_id;                  ///< appID attribute
+  uint32_t conf_rev{0};
+  std::string type{"GOOSE"};
+  uint32_t min_time_ms{0};            ///< from the GSE address, 0 - not given
+  uint32_t max_time_ms{0};
+  std::vector<std::string> members;
+  SclAddress address;
+
+  std::string Reference() const { return ied + ld_inst + "/LLN0$GO$" + name; }
+  std::string DataSetReference() const { return ied + ld_inst + "/LLN0$" + dat_set; }
+  bool operator==(const SclGseControl&) const = default;
+};
+
+/**
+ * @brief what the tasks need of an SCL file
+ */
+struct Scl {
+  std::vector<SclSvControl> sv;
+  std::vector<SclGseControl> goose;
+  size_t bytes{0};   ///< size of the parsed text
+
+  void Print(std::FILE* out = stdout) const {
+    std::fprintf(out, "SCL: %zu bytes, %zu SV and %zu GOOSE control block(s)\n", bytes, sv.size(), goose.size());
+    for (const auto& cb : sv) {
+      std::fprintf(out, " SV %s%s/LLN0.%s svID=%s appID=0x%04X mac=%02X-%02X-%02X-%02X-%02X-%02X vlan=%d confRev=%u "
+                   "smpRate=%u %s channels=%zu\n",
+                   cb.ied.c_str(), cb.ld_inst.c_str(), cb.name.c_str(), cb.sv_id.c_str(), cb.address.app_id,
+                   cb.address.mac[0], cb.address.mac[1], cb.address.mac[2], cb.address.mac[3], cb.address.mac[4],
+                   cb.address.mac[5], cb.address.vlan_id, cb.conf_rev, cb.smp_rate, cb.smp_mod.c_str(),
+                   cb.members.size());
+    }
+    for (const auto& cb : goose) {
+      std::fprintf(out, " GOOSE %s goID=%s appID=0x%04X mac=%02X-%02X-%02X-%02X-%02X-%02X vlan=%d confRev=%u "
+                   "members=%zu\n",
+                   cb.Reference().c_str(), cb.go_id.c_str(), cb.address.app_id, cb.address.mac[0], cb.address.mac[1],
+                   cb.address.mac[2], cb.address.mac[3], cb.address.mac[4], cb.address.mac[5], cb.address.vlan_id,
+                   cb.conf_rev, cb.members.size());
+    }
+  }
+};
+
+namespace scl_detail {
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * @brief element or attribute name without its namespace prefix
+ */
+inline std::string_view LocalName(std::string_view name) {
+  const size_t colon = name.find(':');
+  return colon == std::string_view::npos ? name : name.substr(colon + 1);
+}
+
+inline void AppendUtf8(std::string& text, uint32_t code) {
+  if (code < 0x80) {
+    text += static_cast<char>(code);
+  } else if (code < 0x800) {
+    text += static_cast<char>(0xC0 | code >> 6);
+    text += static_cast<char>(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    text += static_cast<char>(0xE0 | code >> 12);
+    text += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+    text += static_cast<char>(0x80 | (code & 0x3F));
+  } else {
+    text += static_cast<char>(0xF0 | code >> 18);
+    text += static_cast<char>(0x80 | (code >> 12 & 0x3F));
+    text += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+    text += static_cast<char>(0x80 | (code & 0x3F));
+  }
+}
+
+/**
+ * @brief attribute value or text with the predefined and numeric character references replaced
+ */
+inline std::string Decode(std::string_view raw) {
+  std::string text;
+  text.reserve(raw.size());
+  for (size_t i = 0; i < raw.size();) {
+    const size_t amp = raw.find('&', i);
+    text.append(raw.substr(i, amp == std::string_view::npos ? std::string_view::npos : amp - i));
+    if (amp == std::string_view::npos) {
+      break;
+    }
+    const size_t semicolon = raw.find(';', amp);
+    if (semicolon == std::string_view::npos) {
+      throw std::runtime_error("SCL: unterminated character reference");
+    }
+    const std::string_view entity = raw.substr(amp + 1, semicolon - amp - 1);
+    if (entity == "amp") {
+      text += '&';
+    } else if (entity == "lt") {
+      text += '<';
+    } else if (entity == "gt") {
+      text += '>';
+    } else if (entity == "quot") {
+      text += '"';
+    } else if (entity == "apos") {
+      text += '\'';
+    } else if (entity.size() > 1 && entity[0] == '#') {
+      const bool hex = entity[1] == 'x';
+      uint32_t code = 0;
+      const char* first = entity.data() + (hex ? 2 : 1);
+      const auto [end, error] = std::from_chars(first, entity.data() + entity.size(), code, hex ? 16 : 10);
+      if (error != std::errc() || end != entity.data() + entity.size() || code > 0x10FFFF) {
+        throw std::runtime_error("SCL: invalid character reference &" + std::string(entity) + ";");
+      }
+      AppendUtf8(text, code);
+    } else {
+      throw std::runtime_error("SCL: unknown entity &" + std::string(entity) + ";");
+    }
+    i = semicolon + 1;
+  }
+  return text;
+}
+
+inline std::string_view Trim(std::string_view text) {
+  while (!text.empty() && IsSpace(text.front())) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && IsSpace(text.back())) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
+
+inline uint32_t ToUnsigned(std::string_view text, int base = 10) {
+  text = Trim(text);
+  uint32_t value = 0;
+  const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+  if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+    throw std::runtime_error("SCL: invalid number \"" + std::string(text) + "\"");
+  }
+  return value;
+}
+
+/**
+ * @brief MAC-Address as six hex pairs separated by '-' (or ':')
+ */
+inline void ToMac(std::string_view text, uint8_t mac[6]) {
+  text = Trim(text);
+  bool valid = text.size() == 17;
+  for (size_t i = 2; valid && i < text.size(); i += 3) {
+    valid = text[i] == '-' || text[i] == ':';
+  }
+  if (!valid) {
+    throw std::runtime_error("SCL: invalid MAC-Address \"" + std::string(text) + "\"");
+  }
+  for (size_t i = 0; i < 6; ++i) {
+    mac[i] = static_cast<uint8_t>(ToUnsigned(text.substr(i * 3, 2), 16));
+  }
+}
+
+}   // namespace scl_detail
+
+/**
+ * @brief attributes of a start tag, parsed on request
+ */
+class SclAttributes {
+ public:
+  explicit SclAttributes(std::string_view raw = {}) : raw_(raw) {}
+
+  /**
+   * @brief value as written in the file, character references not replaced
+   * @param name - attribute name without namespace prefix; prefixed attributes of other namespaces are not matched
+   * @return empty if the attribute is missing
+   */
+  std::string_view Raw(std::string_view name) const {
+    using scl_detail::IsSpace;
+    for (size_t i = 0; i < raw_.size();) {
+      while (i < raw_.size() && IsSpace(raw_[i])) {
+        ++i;
+      }
+      const size_t name_begin = i;
+      while (i < raw_.size() && raw_[i] != '=' && !IsSpace(raw_[i])) {
+        ++i;
+      }
+      const std::string_view attribute = raw_.substr(name_begin, i - name_begin);
+      while (i < raw_.size() && (IsSpace(raw_[i]) || raw_[i] == '=')) {
+        ++i;
+      }
+      if (i >= raw_.size() || (raw_[i] != '"' && raw_[i] != '\'')) {
+        return {};
+      }
+      const size_t close = raw_.find(raw_[i], i + 1);
+      if (close == std::string_view::npos) {
+        return {};
+      }
+      if (attribute == name) {
+        return raw_.substr(i + 1, close - i - 1);
+      }
+      i = close + 1;
+    }
+    return {};
+  }
+
+  std::string Get(std::string_view name) const { return scl_detail::Decode(Raw(name)); }
+
+  uint32_t Unsigned(std::string_view name, uint32_t missing) const {
+    const std::string_view value = Raw(name);
+    return value.empty() ? missing : scl_detail::ToUnsigned(value);
+  }
+
+ private:
+  std::string_view raw_;
+};
+
+/**
+ * @brief SAX style XML reader over a text in memory, e.g. a mapped file
+ * @desc The reader finds the tags with memchr() and hands element names and attributes to the callbacks as views of
+ *       the text, nothing is copied. Comments, processing instructions, CDATA sections and the document type are
+ *       skipped. A start callback returning false skips the element with all its children at tag level, without
+ *       further callbacks and without parsing their attributes: that is where a reader of a few control blocks in a
+ *       large SCD spends its time. Only what XML needs for the tag structure is checked, not the schema.
+ */
+class SclReader {
+ public:
+  explicit SclReader(std::string_view text) : begin_(text.data()), pos_(text.data()), end_(text.data() + text.size()) {}
+
+  /**
+   * @param start - callable as bool start(std::string_view name, const SclAttributes&), false - skip the children
+   * @param end - callable as end(std::string_view name, std::string_view text), text is the raw content since the
+   *              last tag, the content of a leaf element
+   * @throw std::runtime_error with the byte offset on a malformed tag structure
+   */
+  template <class Start, class End>
+  void Parse(Start&& start, End&& end) {
+    size_t depth = 0;
+    for (Token token = Next(); token.kind != kEof; token = Next()) {
+      if (token.kind == kEmpty) {
+        start(token.name, token.attributes);
+        end(token.name, std::string_view{});
+      } else if (token.kind == kStart) {
+        if (start(token.name, token.attributes)) {
+          ++depth;
+        } else {
+          Skip();
+        }
+      } else {
+        if (depth == 0) {
+          Error("unbalanced end tag");
+        }
+        --depth;
+        end(token.name, token.text);
+      }
+    }
+    if (depth) {
+      Error("unexpected end of file");
+    }
+  }
+
+ private:
+  enum Kind { kStart, kEmpty, kEnd, kEof };
+
+  struct Token {
+    Kind kind;
+    std::string_view name;
+    SclAttributes attributes;
+    std::string_view text;
+  };
+
+  [[noreturn]] void Error(const char* message) const {
+    throw std::runtime_error(std::string("SCL: ") + message + " at byte " + std::to_string(pos_ - begin_));
+  }
+
+  /**
+   * @return first occurrence of c behind from, end_ if none
+   */
+  const char* Find(const char* from, char c) const {
+    const auto* found = static_cast<const char*>(std::memchr(from, c, static_cast<size_t>(end_ - from)));
+    return found ? found : end_;
+  }
+
+  /**
+   * @return first quote of either kind in [from, to), nullptr if none
+   */
+  static const char* FindQuote(const char* from, const char* to) {
+    for (; from < to; ++from) {
+      if (*from == '"' || *from == '\'') {
+        return from;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief move behind the next occurrence of the terminator
+   */
+  void SkipPast(std::string_view terminator) {
+    const std::string_view rest(pos_, static_cast<size_t>(end_ - pos_));
+    const size_t found = rest.find(terminator);
+    if (found == std::string_view::npos) {
+      Error("unterminated markup");
+    }
+    pos_ += found + terminator.size();
+  }
+
+  Token Next() {
+    using scl_detail::IsSpace;
+    for (;;) {
+      const char* text_begin = pos_;
+      const auto* open = static_cast<const char*>(std::memchr(pos_, '<', static_cast<size_t>(end_ - pos_)));
+      if (!open) {
+        pos_ = end_;
+        return Token{kEof, {}, SclAttributes{}, {}};
+      }
+      const std::string_view text(text_begin, static_cast<size_t>(open - text_begin));
+      pos_ = open + 1;
+      if (pos_ == end_) {
+        Error("unterminated tag");
+      }
+      const std::string_view rest(pos_, static_cast<size_t>(end_ - pos_));
+      if (*pos_ == '?') {
+        SkipPast("?>");
+        continue;
+      }
+      if (*pos_ == '!') {
+        if (rest.starts_with("!--")) {
+          SkipPast("-->");
+        } else if (rest.starts_with("![CDATA[")) {
+          SkipPast("]]>");
+        } else {
+          const size_t bracket = rest.find_first_of("[>");
+          SkipPast(bracket != std::string_view::npos && rest[bracket] == '[' ? "]>" : ">");
+        }
+        continue;
+      }
+      if (*pos_ == '/') {
+        const auto* close = static_cast<const char*>(std::memchr(pos_, '>', static_cast<size_t>(end_ - pos_)));
+        if (!close) {
+          Error("unterminated end tag");
+        }
+        std::string_view name(pos_ + 1, static_cast<size_t>(close - pos_ - 1));
+        while (!name.empty() && IsSpace(name.back())) {
+          name.remove_suffix(1);
+        }
+        pos_ = close + 1;
+        return Token{kEnd, scl_detail::LocalName(name), SclAttributes{}, text};
+      }
+
+      const char* name_begin = pos_;
+      while (pos_ < end_ && !IsSpace(*pos_) && *pos_ != '>' && *pos_ != '/') {
+        ++pos_;
+      }
+      const std::string_view name(name_begin, static_cast<size_t>(pos_ - name_begin));
+      const char* attributes_begin = pos_;
+      // the end of the tag: the first '>' behind the last attribute value, values may contain '>'
+      const char* close = Find(pos_, '>');
+      for (const char* quote = FindQuote(pos_, close); quote;) {
+        const char* value_end = Find(quote + 1, *quote);
+        if (value_end == end_) {
+          Error("unterminated attribute value");
+        }
+        if (value_end > close) {
+          close = Find(value_end + 1, '>');
+        }
+        quote = FindQuote(value_end + 1, close);
+      }
+      pos_ = close;
+      if (pos_ == end_ || name.empty()) {
+        Error("unterminated tag");
+      }
+      const bool empty = pos_[-1] == '/';
+      const SclAttributes attributes(
+         std::string_view(attributes_begin, static_cast<size_t>(pos_ - attributes_begin - (empty ? 1 : 0))));
+      ++pos_;
+      return Token{empty ? kEmpty : kStart, scl_detail::LocalName(name), attributes, text};
+    }
+  }
+
+  /**
+   * @brief move behind the end tag of the element just started
+   */
+  void Skip() {
+    for (size_t depth = 1; depth;) {
+      const Token token = Next();
+      if (token.kind == kEof) {
+        Error("unexpected end of file");
+      }
+      if (token.kind == kStart) {
+        ++depth;
+      } else if (token.kind == kEnd) {
+        --depth;
+      }
+    }
+  }
+
+  const char* begin_;
+  const char* pos_;
+  const char* end_;
+};
+
+/**
+ * @brief extract the SV and GOOSE control blocks with their data sets and addresses
+ * @desc The Communication section gives the addresses (SMV and GSE of a ConnectedAP), the LN0 of each logical
+ *       device the data sets and control blocks. Everything else, the Substation section, the DataTypeTemplates,
+ *       the LN and DOI of the IEDs, is skipped unparsed; memory grows with the extracted content, not with the file.
+ *       Only the data sets of the LN0 being read are kept, a control block refers to a data set of its own LN0.
+ * @throw std::runtime_error on malformed XML or invalid values of the extracted attributes
+ */
+inline Scl ParseScl(std::string_view text) {
+  using scl_detail::ToUnsigned;
+  struct DataSet {
+    std::string name;
+    std::vector<std::string> members;
+  };
+  struct Address {
+    std::string key;   ///< iedName/ldInst/cbName
+    SclAddress address;
+    uint32_t min_time_ms{0};
+    uint32_t max_time_ms{0};
+  };
+
+  Scl scl;
+  scl.bytes = text.size();
+  std::vector<Address> addresses;
+  std::string ied;
+  std::string ld_inst;
+  std::vector<DataSet> data_sets;   // of the current LN0
+  bool in_ln0 = false;
+  bool in_data_set = false;
+  bool in_address = false;   // SMV or GSE of a ConnectedAP
+  Address address;
+  std::string_view parameter;   // type of the P element being read
+
+  const auto members = [&](const std::string& name) {
+    for (const auto& data_set : data_sets) {
+      if (data_set.name == name) {
+        return data_set.members;
+      }
+    }
+    return std::vector<std::string>{};
+  };
+
+  SclReader reader(text);
+  reader.Parse(
+     [&](std::string_view name, const SclAttributes& attributes) {
+       if (name == "SCL" || name == "Communication" || name == "SubNetwork" || name == "AccessPoint" ||
+           name == "Server") {
+         return true;
+       }
+       if (name == "ConnectedAP") {
+         ied = attributes.Get("iedName");
+         return true;
+       }
+       if (name == "SMV" || name == "GSE") {
+         in_address = true;
+         address = Address{ied + '/' + attributes.Get("ldInst") + '/' + attributes.Get("cbName"), {}, 0, 0};
+         return true;
+       }
+       if (in_address) {
+         if (name == "P") {
+           parameter = attributes.Raw("type");
+         }
+         return name == "Address" || name == "P" || name == "MinTime" || name == "MaxTime";
+       }
+       if (name == "IED") {
+         ied = attributes.Get("name");
+         return true;
+       }
+       if (name == "LDevice") {
+         ld_inst = attributes.Get("inst");
+         return true;
+       }
+       if (name == "LN0") {
+         in_ln0 = true;
+         data_sets.clear();
+         return true;
+       }
+       if (in_ln0 && name == "DataSet") {
+         in_data_set = true;
+         data_sets.push_back(DataSet{attributes.Get("name"), {}});
+         return true;
+       }
+       if (in_data_set && name == "FCDA") {
+         const std::string do_name = attributes.Get("doName");
+         const std::string da_name = attributes.Get("daName");
+         data_sets.back().members.push_back(attributes.Get("ldInst") + '/' + attributes.Get("prefix") +
+                                            attributes.Get("lnClass") + attributes.Get("lnInst") + '.' + do_name +
+                                            (da_name.empty() ? "" : "." + da_name) + " [" + attributes.Get("fc") +
+                                            ']');
+         return false;
+       }
+       if (in_ln0 && name == "SampledValueControl") {
+         SclSvControl cb;
+         cb.ied = ied;
+         cb.ld_inst = ld_inst;
+         cb.name = attributes.Get("name");
+         cb.dat_set = attributes.Get("datSet");
+         cb.sv_id = attributes.Get("smvID");
+         cb.conf_rev = attributes.Unsigned("confRev", 0);
+         cb.smp_rate = attributes.Unsigned("smpRate", 0);
+         if (!attributes.Raw("smpMod").empty()) {
+           cb.smp_mod = attributes.Get("smpMod");
+         }
+         cb.no_asdu = attributes.Unsigned("nofASDU", 1);
+         cb.members = members(cb.dat_set);
+         scl.sv.push_back(std::move(cb));
+         return false;
+       }
+       if (in_ln0 && name == "GSEControl") {
+         SclGseControl cb;
+         cb.ied = ied;
+         cb.ld_inst = ld_inst;
+         cb.name = attributes.Get("name");
+         cb.dat_set = attributes.Get("datSet");
+         cb.go_id = attributes.Get("appID");
+         cb.conf_rev = attributes.Unsigned("confRev", 0);
+         if (!attributes.Raw("type").empty()) {
+           cb.type = attributes.Get("type");
+         }
+         cb.members = members(cb.dat_set);
+         scl.goose.push_back(std::move(cb));
+         return false;
+       }
+       return false;   // Header, Substation, DataTypeTemplates, LN, DOI, Inputs ...
+     },
+     [&](std::string_view name, std::string_view content) {
+       if (in_address && name == "P") {
+         if (parameter == "MAC-Address") {
+           scl_detail::ToMac(content, address.address.mac);
+           address.address.valid = true;
+         } else if (parameter == "APPID") {
+           address.address.app_id = static_cast<uint16_t>(ToUnsigned(content, 16));
+         } else if (parameter == "VLAN-ID") {
+           address.address.vlan_id = static_cast<int>(ToUnsigned(content, 16) & 0x0FFF);
+         } else if (parameter == "VLAN-PRIORITY") {
+           address.address.vlan_priority = static_cast<uint8_t>(ToUnsigned(content) & 7);
+         }
+       } else if (in_address && name == "MinTime") {
+         address.min_time_ms = ToUnsigned(content);
+       } else if (in_address && name == "MaxTime") {
+         address.max_time_ms = ToUnsigned(content);
+       } else if (name == "SMV" || name == "GSE") {
+         in_address = false;
+         addresses.push_back(std::move(address));
+       } else if (name == "DataSet") {
+         in_data_set = false;
+       } else if (name == "LN0") {
+         in_ln0 = false;
+         data_sets.clear();
+       }
+     });
+
+  // the Communication section usually precedes the IEDs, the join waits for the whole file anyway
+  std::unordered_map<std::string, const Address*> by_key;
+  for (const auto& entry : addresses) {
+    by_key.emplace(entry.key, &entry);
+  }
+  for (auto& cb : scl.sv) {
+    const auto it = by_key.find(cb.ied + '/' + cb.ld_inst + '/' + cb.name);
+    if (it != by_key.end()) {
+      cb.address = it->second->address;
+    }
+  }
+  for (auto& cb : scl.goose) {
+    const auto it = by_key.find(cb.ied + '/' + cb.ld_inst + '/' + cb.name);
+    if (it != by_key.end()) {
+      cb.address = it->second->address;
+      cb.min_time_ms = it->second->min_time_ms;
+      cb.max_time_ms = it->second->max_time_ms;
+    }
+  }
+  return scl;
+}
+
+namespace scl_detail {
+
+inline bool SameFile(const struct stat& a, const struct stat& b) {
+  return a.st_ino == b.st_ino && a.st_size == b.st_size && a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+         a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+}   // namespace scl_detail
+
+/**
+ * @brief map an SCL file read-only and parse it
+ * @desc The pages are read ahead sequentially (MADV_SEQUENTIAL) and belong to the page cache, the heap holds only
+ *       the extracted control blocks. A file that changes while it is mapped is mapped again. The file must not
+ *       be truncated during the parse, pages past its new end raise SIGBUS: reload it only once it was closed
+ *       after writing or renamed into place.
+ * @throw std::runtime_error if the file cannot be read or parsed
+ */
+inline Scl ReadScl(const std::string& file) {
+  constexpr int kAttempts = 5;
+  constexpr auto kRetryDelay = std::chrono::milliseconds(50);
+  size_t size = 0;
+  void* map = MAP_FAILED;
+  for (int attempt = 1;; ++attempt) {
+    const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error("SCL: cannot open " + file + ": " + strerror(errno));
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+      close(fd);
+      throw std::runtime_error("SCL: " + file + " is empty");
+    }
+    size = static_cast<size_t>(st.st_size);
+    map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("SCL: cannot map " + file + ": " + strerror(errno));
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    struct stat mapped{};
+    const bool unchanged = fstat(fd, &mapped) == 0 && scl_detail::SameFile(st, mapped);
+    close(fd);
+    if (unchanged) {
+      break;
+    }
+    munmap(map, size);
+    if (attempt == kAttempts) {
+      throw std::runtime_error("SCL: " + file + " keeps changing");
+    }
+    std::this_thread::sleep_for(kRetryDelay);   // still being written
+  }
+
+  try {
+    Scl scl = ParseScl(std::string_view(static_cast<const char*>(map), size));
+    munmap(map, size);
+    return scl;
+  } catch (const std::exception& error) {
+    munmap(map, size);
+    throw std::runtime_error(file + ": " + error.what());
+  }
+}
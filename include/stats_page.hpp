@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   fixed layout statistics page in /dev/shm, read by external monitors without syscalls in the process
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr uint32_t kStatsPageMagic = 0x53584242;   ///< "BBXS"
+constexpr uint32_t kStatsPageVersion = 1;
+constexpr size_t kStatsPageSlots = 64;
+constexpr size_t kStatsPageBuckets = 24;     ///< power of two microsecond buckets as in LatencyHistogram
+constexpr size_t kStatsPageNameLength = 40;
+
+enum class StatsSlotKind : uint32_t {
+  kFree,
+  kCounter,     ///< count, any number of writers
+  kGauge,       ///< value and its maximum, one writer
+  kHistogram,   ///< durations in ns, one writer
+};
+
+/**
+ * @brief one statistic; all fields are lock-free atomics, which are address free and may live in shared memory
+ */
+struct StatsPageSlot {
+  std::atomic<uint32_t> seq;   ///< odd while the writer updates a gauge or histogram
+  std::atomic<StatsSlotKind> kind;
+  char name[kStatsPageNameLength];
+  std::atomic<uint64_t> count;   ///< counter value, histogram samples
+  std::atomic<int64_t> value;    ///< gauge value, last histogram sample
+  std::atomic<int64_t> max;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> buckets[kStatsPageBuckets];
+};
+
+/**
+ * @brief the page as mapped by the process and by the monitors
+ */
+struct StatsPageLayout {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_size;   ///< sizeof(StatsPageSlot) of the writer, readers refuse a different layout
+  int32_t pid;
+  int64_t start_ns;     ///< CLOCK_MONOTONIC at creation
+  std::atomic<uint32_t> slots;
+  uint32_t reserved;
+  StatsPageSlot slot[kStatsPageSlots];
+};
+
+/**
+ * @brief consistent copy of a slot
+ */
+struct StatsSnapshot {
+  StatsSlotKind kind{StatsSlotKind::kFree};
+  std::string name;
+  uint64_t count{0};
+  int64_t value{0};
+  int64_t max{0};
+  uint64_t sum{0};
+  uint64_t buckets[kStatsPageBuckets]{};
+};
+
+/**
+ * @brief statistics page /dev/shm/<name>
+ * @desc The process creates the page and allocates its slots before the tasks start; afterwards updating a slot is
+ *       a few relaxed stores into the mapping. Gauges and histograms have exactly one writer thread and are
+ *       published under a per-slot sequence lock, so a monitor never sees a torn histogram; counters are single
+ *       atomic adds and may be updated from any thread. Monitors map the page read-only and poll it, the process
+ *       does not notice them. All static update functions accept nullptr, so call sites need no check whether the
+ *       page is enabled.
+ */
+class StatsPage {
+ public:
+  /**
+   * @brief create (or replace) the page for writing
+   */
+  static StatsPage Create(const std::string& name) { return StatsPage(name, true); }
+
+  /**
+   * @brief map an existing page read-only
+   */
+  static StatsPage Open(const std::string& name) { return StatsPage(name, false); }
+
+  StatsPage(StatsPage&& other) noexcept
+      : path_(std::move(other.path_)), page_(other.page_), owner_(other.owner_) {
+    other.page_ = nullptr;
+    other.owner_ = false;
+  }
+  StatsPage(const StatsPage&) = delete;
+  StatsPage& operator=(const StatsPage&) = delete;
+  ~StatsPage() {
+    if (page_) {
+      munmap(page_, sizeof(StatsPageLayout));
+    }
+    if (owner_) {
+      unlink(path_.c_str());
+    }
+  }
+
+  /**
+   * @brief allocate a slot, before the writer threads start
+   * @return nullptr if all slots are used
+   */
+  StatsPageSlot* Allocate(const std::string& name, StatsSlotKind kind) {
+    const uint32_t index = page_->slots.load(std::memory_order_relaxed);
+    if (index >= kStatsPageSlots) {
+      return nullptr;
+    }
+    StatsPageSlot& slot = page_->slot[index];
+    std::strncpy(slot.name, name.c_str(), kStatsPageNameLength - 1);
+    slot.kind.store(kind, std::memory_order_relaxed);
+    page_->slots.store(index + 1, std::memory_order_release);
+    return &slot;
+  }
+
+  static void Add(StatsPageSlot* slot, uint64_t n = 1) {
+    if (slot) {
+      slot->count.fetch_add(n, std::memory_order_relaxed);
+    }
+  }
+
+  static void Set(StatsPageSlot* slot, int64_t value) {
+    if (!slot) {
+      return;
+    }
+    Begin(*slot);
+    slot->value.store(value, std::memory_order_relaxed);
+    if (value > slot->max.load(std::memory_order_relaxed)) {
+      slot->max.store(value, std::memory_order_relaxed);
+    }
+    End(*slot);
+  }
+
+  static void Observe(StatsPageSlot* slot, int64_t ns) {
+    if (!slot) {
+      return;
+    }
+    ns = ns < 0 ? -ns : ns;
+    const uint64_t us = static_cast<uint64_t>(ns) / 1000;
+    const size_t bucket = us ? static_cast<size_t>(std::bit_width(us)) : 0;
+    auto& counter = slot->buckets[bucket < kStatsPageBuckets ? bucket : kStatsPageBuckets - 1];
+    Begin(*slot);
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    slot->count.store(slot->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    slot->sum.store(slot->sum.load(std::memory_order_relaxed) + static_cast<uint64_t>(ns), std::memory_order_relaxed);
+    slot->value.store(ns, std::memory_order_relaxed);
+    if (ns > slot->max.load(std::memory_order_relaxed)) {
+      slot->max.store(ns, std::memory_order_relaxed);
+    }
+    End(*slot);
+  }
+
+  /**
+   * @brief number of allocated slots
+   */
+  size_t Slots() const { return page_->slots.load(std::memory_order_acquire); }
+
+  /**
+   * @brief consistent copy of slot index, retried while its writer is active
+   */
+  StatsSnapshot Read(size_t index) const {
+    const StatsPageSlot& slot = page_->slot[index];
+    StatsSnapshot snapshot;
+    snapshot.name.assign(slot.name, strnlen(slot.name, kStatsPageNameLength));
+    uint32_t seq;
+    do {
+      seq = slot.seq.load(std::memory_order_acquire);
+      snapshot.kind = slot.kind.load(std::memory_order_relaxed);
+      snapshot.count = slot.count.load(std::memory_order_relaxed);
+      snapshot.value = slot.value.load(std::memory_order_relaxed);
+      snapshot.max = slot.max.load(std::memory_order_relaxed);
+      snapshot.sum = slot.sum.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < kStatsPageBuckets; ++i) {
+        snapshot.buckets[i] = slot.buckets[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != slot.seq.load(std::memory_order_relaxed));
+    return snapshot;
+  }
+
+  int Pid() const { return page_->pid; }
+  int64_t StartNs() const { return page_->start_ns; }
+  const std::string& Path() const { return path_; }
+
+ private:
+  StatsPage(const std::string& name, bool create) : path_("/dev/shm/" + name) {
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs lock-free atomics");
+    const int fd = open(path_.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("Stats page: cannot open " + path_ + ": " + strerror(errno));
+    }
+    if (create && ftruncate(fd, sizeof(StatsPageLayout)) < 0) {
+      const std::string error = strerror(errno);
+      close(fd);
+      throw std::runtime_error("Stats page: cannot size " + path_ + ": " + error);
+    }
+    struct stat st{};
+    if (!create && (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(StatsPageLayout))) {
+      close(fd);
+      throw std::runtime_error("Stats page: " + path_ + " is not a stats page");
+    }
+    void* map = mmap(nullptr, sizeof(StatsPageLayout), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      throw std::runtime_error("Stats page: mmap of " + path_ + " failed: " + strerror(errno));
+    }
+    page_ = static_cast<StatsPageLayout*>(map);
+    owner_ = create;
+    if (create) {
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      page_->version = kStatsPageVersion;
+      page_->slot_size = sizeof(StatsPageSlot);
+      page_->pid = static_cast<int32_t>(getpid());
+      page_->start_ns = static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+      std::atomic_thread_fence(std::memory_order_release);
+      page_->magic = kStatsPageMagic;   // the page is valid from here on
+    } else if (page_->magic != kStatsPageMagic || page_->version != kStatsPageVersion ||
+               page_->slot_size != sizeof(StatsPageSlot)) {
+      munmap(page_, sizeof(StatsPageLayout));
+      page_ = nullptr;
+      throw std::runtime_error("Stats page: " + path_ + " has an unknown layout");
+    }
+  }
+
+  static void Begin(StatsPageSlot& slot) {
+    slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  static void End(StatsPageSlot& slot) {
+    slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  std::string path_;
+  StatsPageLayout* page_{nullptr};
+  bool owner_{false};
+};
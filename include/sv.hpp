@@ -0,0 +1,405 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   IEC 61850-9-2LE sampled values frame layout and decoder
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+//-----------------------------------------------------------------------------
+// Defines and constants
+//-----------------------------------------------------------------------------
+constexpr uint16_t kSvEtherType = 0x88BA;   ///< IEC 61850-9-2 ethertype
+constexpr uint16_t kVlanEtherType = 0x8100; ///< IEEE 802.1Q tag
+constexpr size_t kSvChannels = 8;           ///< 9-2LE: 4 currents + 4 voltages
+constexpr size_t kSvMaxAsdu = 8;            ///< 9-2LE: 1 ASDU at 80 spc, 8 ASDU at 256 spc
+constexpr size_t kSvMaxIdLength = 65;       ///< VisibleString(SIZE(1..65)) for svID
+constexpr size_t kSvMaxFrameSize = 256;     ///< encoded frame with one ASDU
+
+/**
+ * @brief quality bits of a 9-2LE channel (IEC 61850-7-3 Quality, LSB first)
+ */
+enum SvQuality : uint32_t {
+  kSvQualityValidityMask = 0x0003,
+  kSvQualityGood = 0x0000,
+  kSvQualityInvalid = 0x0001,
+  kSvQualityQuestionable = 0x0003,
+  kSvQualityOverflow = 0x0004,
+  kSvQualityOutOfRange = 0x0008,
+  kSvQualityBadReference = 0x0010,
+  kSvQualityOscillatory = 0x0020,
+  kSvQualityFailure = 0x0040,
+  kSvQualityOldData = 0x0080,
+  kSvQualityInconsistent = 0x0100,
+  kSvQualityInaccurate = 0x0200,
+  kSvQualitySourceSubstituted = 0x0400,
+  kSvQualityTest = 0x0800,
+  kSvQualityOperatorBlocked = 0x1000,
+  kSvQualityDerived = 0x2000,
+};
+
+/**
+ * @brief smpSynch values
+ */
+enum SvSmpSynch : uint8_t {
+  kSvSmpSynchNone = 0,
+  kSvSmpSynchLocal = 1,
+  kSvSmpSynchGlobal = 2,
+};
+
+/**
+ * @brief one decoded ASDU
+ * @desc svID points into the received frame and is valid only while the frame buffer is valid
+ */
+struct SvAsdu {
+  std::string_view sv_id;
+  uint16_t smp_cnt{0};
+  uint32_t conf_rev{0};
+  uint8_t smp_synch{kSvSmpSynchNone};
+  int32_t value[kSvChannels]{};
+  uint32_t quality[kSvChannels]{};
+};
+
+/**
+ * @brief one decoded SV frame
+ */
+struct SvFrame {
+  uint16_t app_id{0};
+  uint16_t vlan_tci{0};
+  uint8_t no_asdu{0};
+  SvAsdu asdu[kSvMaxAsdu];
+};
+
+//-----------------------------------------------------------------------------
+// BER helpers
+//-----------------------------------------------------------------------------
+namespace sv_detail {
+
+/**
+ * @brief read BER tag and definite length
+ * @param p - cursor, advanced past tag and length
+ * @param end - end of buffer
+ * @param tag - read tag
+ * @param length - read length
+ * @return true if tag and the whole value fits into the buffer
+ */
+inline bool BerHeader(const uint8_t*& p, const uint8_t* end, uint8_t& tag, size_t& length) {
+  if (end - p < 2) {
+    return false;
+  }
+  tag = *p++;
+  uint8_t first = *p++;
+  if (first < 0x80) {
+    length = first;
+  } else {
+    size_t octets = first & 0x7F;
+    if (octets == 0 || octets > 2 || static_cast<size_t>(end - p) < octets) {
+      return false;
+    }
+    length = 0;
+    while (octets--) {
+      length = (length << 8) | *p++;
+    }
+  }
+  return static_cast<size_t>(end - p) >= length;
+}
+
+inline uint32_t BigEndian(const uint8_t* p, size_t length) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < length && i < 4; ++i) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+/**
+ * @brief decode one ASDU (content of tag 0x30)
+ */
+inline bool DecodeAsdu(const uint8_t* p, const uint8_t* end, SvAsdu& asdu) {
+  bool has_data = false;
+  while (p < end) {
+    uint8_t tag;
+    size_t length;
+    if (!BerHeader(p, end, tag, length)) {
+      return false;
+    }
+    switch (tag) {
+      case 0x80:   // svID
+        asdu.sv_id = std::string_view(reinterpret_cast<const char*>(p), length);
+        break;
+      case 0x82:   // smpCnt
+        asdu.smp_cnt = static_cast<uint16_t>(BigEndian(p, length));
+        break;
+      case 0x83:   // confRev
+        asdu.conf_rev = BigEndian(p, length);
+        break;
+      case 0x85:   // smpSynch
+        asdu.smp_synch = length ? p[0] : static_cast<uint8_t>(kSvSmpSynchNone);
+        break;
+      case 0x87: {   // seqData: (INT32 value, UINT32 quality) per channel
+        size_t channels = length / 8;
+        for (size_t ch = 0; ch < kSvChannels; ++ch) {
+          if (ch < channels) {
+            asdu.value[ch] = static_cast<int32_t>(BigEndian(p + ch * 8, 4));
+            asdu.quality[ch] = BigEndian(p + ch * 8 + 4, 4);
+          } else {
+            asdu.value[ch] = 0;
+            asdu.quality[ch] = kSvQualityInvalid;
+          }
+        }
+        has_data = true;
+        break;
+      }
+      default:   // datSet, refrTm, smpRate, smpMod are not needed here
+        break;
+    }
+    p += length;
+  }
+  return has_data && !asdu.sv_id.empty();
+}
+
+}   // namespace sv_detail
+
+/**
+ * @brief FNV-1a hash of an svID, used to look up per stream state
+ */
+inline uint32_t SvIdHash(std::string_view id) {
+  uint32_t hash = 2166136261u;
+  for (char c : id) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * @brief svID kept in place by the per stream tables: up to kSvMaxIdLength characters, terminated, with its hash
+ */
+struct SvIdString {
+  char text[kSvMaxIdLength + 1];
+  uint8_t length;
+  uint32_t hash;
+
+  /**
+   * @return false and unchanged for an empty svID or one longer than kSvMaxIdLength
+   */
+  bool Assign(std::string_view id, uint32_t id_hash) {
+    if (id.empty() || id.size() > kSvMaxIdLength) {
+      return false;
+    }
+    std::memcpy(text, id.data(), id.size());
+    text[id.size()] = '\0';
+    length = static_cast<uint8_t>(id.size());
+    hash = id_hash;
+    return true;
+  }
+
+  bool Equals(std::string_view id) const { return length == id.size() && std::memcmp(text, id.data(), length) == 0; }
+  bool Equals(std::string_view id, uint32_t id_hash) const { return hash == id_hash && Equals(id); }
+  std::string_view View() const { return {text, length}; }
+};
+
+//-----------------------------------------------------------------------------
+// decoder
+//-----------------------------------------------------------------------------
+/**
+ * @brief decode a complete ethernet frame carrying IEC 61850-9-2 sampled values
+ * @param data - frame starting with destination MAC
+ * @param size - frame length
+ * @param frame - decoded content
+ * @return true if the frame is a valid SV frame
+ */
+inline bool SvDecode(const uint8_t* data, size_t size, SvFrame& frame) {
+  const uint8_t* p = data + 12;
+  const uint8_t* end = data + size;
+  if (size < 14 + 8) {
+    return false;
+  }
+  uint16_t ether_type = static_cast<uint16_t>(sv_detail::BigEndian(p, 2));
+  p += 2;
+  frame.vlan_tci = 0;
+  if (ether_type == kVlanEtherType) {
+    if (end - p < 4 + 8) {
+      return false;
+    }
+    frame.vlan_tci = static_cast<uint16_t>(sv_detail::BigEndian(p, 2));
+    ether_type = static_cast<uint16_t>(sv_detail::BigEndian(p + 2, 2));
+    p += 4;
+  }
+  if (ether_type != kSvEtherType) {
+    return false;
+  }
+  frame.app_id = static_cast<uint16_t>(sv_detail::BigEndian(p, 2));
+  size_t pdu_length = sv_detail::BigEndian(p + 2, 2);
+  if (pdu_length < 8 || static_cast<size_t>(end - p) < pdu_length) {
+    return false;
+  }
+  end = p + pdu_length;
+  p += 8;   // APPID, Length, Reserved1, Reserved2
+
+  uint8_t tag;
+  size_t length;
+  if (!sv_detail::BerHeader(p, end, tag, length) || tag != 0x60) {
+    return false;
+  }
+  end = p + length;
+  frame.no_asdu = 0;
+  while (p < end) {
+    if (!sv_detail::BerHeader(p, end, tag, length)) {
+      return false;
+    }
+    if (tag == 0xA2) {   // seqASDU
+      const uint8_t* q = p;
+      const uint8_t* q_end = p + length;
+      while (q < q_end && frame.no_asdu < kSvMaxAsdu) {
+        size_t asdu_length;
+        if (!sv_detail::BerHeader(q, q_end, tag, asdu_length) || tag != 0x30) {
+          return false;
+        }
+        if (!sv_detail::DecodeAsdu(q, q + asdu_length, frame.asdu[frame.no_asdu])) {
+          return false;
+        }
+        ++frame.no_asdu;
+        q += asdu_length;
+      }
+    }
+    p += length;
+  }
+  return frame.no_asdu > 0;
+}
+
+//-----------------------------------------------------------------------------
+// encoder
+//-----------------------------------------------------------------------------
+/**
+ * @brief encoded 9-2LE frame with one ASDU, built once per stream
+ * @desc Only smpCnt and seqData change between samples; SetSample() patches them in place at fixed offsets.
+ */
+class SvEncoder {
+ public:
+  /**
+   * @brief constructor
+   * @param dst - destination MAC (01-0C-CD-04-xx-xx)
+   * @param src - source MAC
+   * @param app_id - APPID (0x4000..0x7FFF)
+   * @param sv_id - svID, 1..65 characters
+   * @param conf_rev - configuration revision
+   * @param smp_synch - smpSynch
+   * @param vlan_id - VLAN id of the 802.1Q tag, negative - untagged
+   * @param priority - 802.1Q priority
+   */
+  SvEncoder(const uint8_t dst[6], const uint8_t src[6], uint16_t app_id, std::string_view sv_id, uint32_t conf_rev,
+            uint8_t smp_synch = kSvSmpSynchLocal, int vlan_id = -1, uint8_t priority = 4) {
+    if (sv_id.empty() || sv_id.size() > kSvMaxIdLength) {
+      throw std::invalid_argument("SV encoder: invalid svID length");
+    }
+    uint8_t* p = frame_;
+    std::memcpy(p, dst, 6);
+    std::memcpy(p + 6, src, 6);
+    p += 12;
+    if (vlan_id >= 0) {
+      p = Put16(p, kVlanEtherType);
+      p = Put16(p, static_cast<uint16_t>((priority & 7) << 13 | (vlan_id & 0x0FFF)));
+    }
+    p = Put16(p, kSvEtherType);
+    uint8_t* header = p;
+    p = Put16(p, app_id);
+    p += 6;   // length, reserved 1, reserved 2
+
+    const size_t asdu_length = 2 + sv_id.size() + 4 + 6 + 3 + 2 + kSvChannels * 8;
+    const size_t seq_length = LengthSize(asdu_length) + 1 + asdu_length;
+    const size_t pdu_length = 3 + 1 + LengthSize(seq_length) + seq_length;
+    *p++ = 0x60;
+    p = PutLength(p, pdu_length);
+    *p++ = 0x80;   // noASDU
+    *p++ = 1;
+    *p++ = 1;
+    *p++ = 0xA2;   // seqASDU
+    p = PutLength(p, seq_length);
+    *p++ = 0x30;   // ASDU
+    p = PutLength(p, asdu_length);
+    *p++ = 0x80;   // svID
+    *p++ = static_cast<uint8_t>(sv_id.size());
+    std::memcpy(p, sv_id.data(), sv_id.size());
+    p += sv_id.size();
+    *p++ = 0x82;   // smpCnt
+    *p++ = 2;
+    smp_cnt_offset_ = static_cast<size_t>(p - frame_);
+    p += 2;
+    *p++ = 0x83;   // confRev
+    *p++ = 4;
+    p = Put16(Put16(p, static_cast<uint16_t>(conf_rev >> 16)), static_cast<uint16_t>(conf_rev));
+    *p++ = 0x85;   // smpSynch
+    *p++ = 1;
+    *p++ = smp_synch;
+    *p++ = 0x87;   // seqData
+    *p++ = static_cast<uint8_t>(kSvChannels * 8);
+    data_offset_ = static_cast<size_t>(p - frame_);
+    p += kSvChannels * 8;
+    size_ = static_cast<size_t>(p - frame_);
+    Put16(header + 2, static_cast<uint16_t>(p - header));
+    std::memset(header + 4, 0, 4);
+  }
+
+  /**
+   * @brief patch sample counter, values and quality
+   */
+  void SetSample(uint16_t smp_cnt, const int32_t* value, const uint32_t* quality) {
+    Put16(frame_ + smp_cnt_offset_, smp_cnt);
+    uint8_t* p = frame_ + data_offset_;
+    for (size_t ch = 0; ch < kSvChannels; ++ch, p += 8) {
+      Put32(p, static_cast<uint32_t>(value[ch]));
+      Put32(p + 4, quality[ch]);
+    }
+  }
+
+  const uint8_t* data() const { return frame_; }
+  uint8_t* data() { return frame_; }
+  size_t size() const { return size_; }
+
+ private:
+  static uint8_t* Put16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+    return p + 2;
+  }
+
+  static void Put32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+  }
+
+  static size_t LengthSize(size_t length) { return length < 0x80 ? 1 : 2; }
+
+  static uint8_t* PutLength(uint8_t* p, size_t length) {
+    if (length >= 0x80) {
+      *p++ = 0x81;
+    }
+    *p++ = static_cast<uint8_t>(length);
+    return p;
+  }
+
+  uint8_t frame_[kSvMaxFrameSize]{};
+  size_t size_{0};
+  size_t smp_cnt_offset_{0};
+  size_t data_offset_{0};
+};
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   time alignment of several SV streams by smpCnt
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+
+#include <sv.hpp>
+
+/**
+ * @brief samples of all aligned streams with the same smpCnt
+ * @desc value/quality point into the alignment ring and are valid only during the callback;
+ *       for streams without a sample (bit not set in present) they are nullptr
+ */
+template <size_t MaxStreams>
+struct SvAlignedSample {
+  uint16_t smp_cnt;
+  uint32_t present;    ///< bit i set: stream i delivered this smpCnt
+  timespec first_ts;   ///< capture time of the first stream's sample
+  timespec last_ts;    ///< capture time of the last stream's sample
+  const int32_t* value[MaxStreams];
+  const uint32_t* quality[MaxStreams];
+};
+
+/**
+ * @brief ring per stream indexed by smpCnt relative to the next sample to emit
+ * @desc A sample vector is emitted as soon as all streams delivered its smpCnt. It is emitted with gaps flagged if a
+ *       stream runs ahead by more than the maximum skew or if the oldest pending sample waited longer than the
+ *       timeout. Late samples (already emitted smpCnt) are dropped and counted. Memory is fixed by the template
+ *       arguments, latency by skew and timeout.
+ * @tparam MaxStreams - number of aligned streams, at most 32
+ * @tparam Depth - ring length in samples, upper bound of the skew
+ */
+template <size_t MaxStreams = 8, size_t Depth = 64>
+class SvAlignBuffer {
+ public:
+  static_assert(MaxStreams <= 32, "presence is a 32 bit mask");
+  using Sample = SvAlignedSample<MaxStreams>;
+  using Consumer = std::function<void(const Sample&)>;
+
+  struct Statistics {
+    uint64_t complete{0};        ///< emitted with all streams present
+    uint64_t gaps{0};            ///< emitted with at least one stream missing
+    uint64_t skew_flushes{0};    ///< emitted because a stream ran ahead by more than the skew
+    uint64_t timeout_flushes{0}; ///< emitted because the oldest sample timed out
+    uint64_t late{0};            ///< samples arriving after their smpCnt was emitted
+    uint64_t unknown{0};         ///< samples of streams not registered
+    int64_t latency_max_ns{0};   ///< first capture to emit
+    int64_t latency_sum_ns{0};
+  };
+
+  /**
+   * @brief constructor
+   * @param samples_per_second - smpCnt wraps to 0 at this value
+   * @param max_skew - samples a stream may run ahead of the slowest one, at most Depth
+   * @param timeout_ns - time a sample vector waits for missing streams
+   * @param consumer - receives aligned sample vectors in smpCnt order
+   */
+  SvAlignBuffer(uint32_t samples_per_second, uint32_t max_skew, int64_t timeout_ns, Consumer consumer)
+      : samples_per_second_(samples_per_second),
+        max_skew_(max_skew),
+        timeout_ns_(timeout_ns),
+        consumer_(std::move(consumer)) {
+    if (max_skew_ == 0 || max_skew_ > Depth || max_skew_ >= samples_per_second_ / 2) {
+      throw std::invalid_argument("SV alignment: maximum skew out of range");
+    }
+  }
+
+  /**
+   * @brief register a stream to align
+   * @return stream index used in the aligned sample
+   */
+  size_t AddStream(std::string_view sv_id) {
+    if (stream_count_ == MaxStreams || !streams_[stream_count_].sv_id.Assign(sv_id, SvIdHash(sv_id))) {
+      throw std::invalid_argument("SV alignment: cannot add stream");
+    }
+    all_mask_ |= 1u << stream_count_;
+    return stream_count_++;
+  }
+
+  void Insert(const SvFrame& frame, const timespec& ts) {
+    for (uint8_t i = 0; i < frame.no_asdu; ++i) {
+      Insert(frame.asdu[i], ts);
+    }
+  }
+
+  void Insert(const SvAsdu& asdu, const timespec& ts) {
+    const int index = Find(asdu.sv_id);
+    if (index < 0 || asdu.smp_cnt >= samples_per_second_) {
+      ++stats_.unknown;
+      return;
+    }
+    if (!started_) {
+      started_ = true;
+      emit_cnt_ = asdu.smp_cnt;
+      emit_slot_ = 0;
+    }
+    uint32_t distance = Distance(asdu.smp_cnt);
+    if (distance >= samples_per_second_ / 2) {
+      ++stats_.late;
+      Expire(ts);
+      return;
+    }
+    while (distance >= max_skew_) {
+      ++stats_.skew_flushes;
+      Emit();
+      --distance;
+    }
+    Row& row = rows_[(emit_slot_ + distance) % Depth];
+    const uint32_t bit = 1u << index;
+    if (row.present == 0) {
+      row.first_ts = ts;
+      ++pending_rows_;
+    }
+    row.present |= bit;
+    row.last_ts = ts;
+    std::memcpy(row.value[index], asdu.value, sizeof(asdu.value));
+    std::memcpy(row.quality[index], asdu.quality, sizeof(asdu.quality));
+
+    while (rows_[emit_slot_].present == all_mask_) {
+      Emit(ts);
+    }
+    Expire(ts);
+  }
+
+  /**
+   * @brief emit pending samples which waited longer than the timeout
+   * @param now - current time on the capture clock (CLOCK_REALTIME)
+   */
+  void Expire(const timespec& now) {
+    while (pending_rows_ != 0) {
+      const Row& row = rows_[emit_slot_];
+      // an empty head row expires with the first later row which has data
+      const bool expired = row.present != 0 ? ElapsedNs(row.first_ts, now) > timeout_ns_ : PendingBehindHead(now);
+      if (!expired) {
+        break;
+      }
+      if (row.present != 0) {
+        ++stats_.timeout_flushes;
+      }
+      Emit(now);
+    }
+  }
+
+  const Statistics& GetStatistics() const { return stats_; }
+
+  /**
+   * @brief bit i set: stream i was added
+   */
+  uint32_t StreamMask() const { return all_mask_; }
+
+  /**
+   * @brief memory used by the buffer in bytes, constant
+   */
+  static constexpr size_t MemoryBytes() { return sizeof(SvAlignBuffer); }
+
+  void Print(std::FILE* out = stdout) const {
+    const uint64_t emitted = stats_.complete + stats_.gaps;
+    std::fprintf(out,
+                 "SV alignment: %zu stream(s) skew=%u samples timeout=%lld us memory=%zu bytes\n"
+                 " complete=%llu gaps=%llu skew-flushes=%llu timeout-flushes=%llu late=%llu unknown=%llu "
+                 "latency avg=%lld us max=%lld us\n",
+                 stream_count_, max_skew_, static_cast<long long>(timeout_ns_ / 1000), MemoryBytes(),
+                 static_cast<unsigned long long>(stats_.complete), static_cast<unsigned long long>(stats_.gaps),
+                 static_cast<unsigned long long>(stats_.skew_flushes),
+                 static_cast<unsigned long long>(stats_.timeout_flushes), static_cast<unsigned long long>(stats_.late),
+                 static_cast<unsigned long long>(stats_.unknown),
+                 static_cast<long long>(emitted ? stats_.latency_sum_ns / static_cast<int64_t>(emitted) / 1000 : 0),
+                 static_cast<long long>(stats_.latency_max_ns / 1000));
+  }
+
+ private:
+  struct Stream {
+    SvIdString sv_id{};
+  };
+
+  struct Row {
+    uint32_t present{0};
+    timespec first_ts{};
+    timespec last_ts{};
+    int32_t value[MaxStreams][kSvChannels]{};
+    uint32_t quality[MaxStreams][kSvChannels]{};
+  };
+
+  static int64_t ElapsedNs(const timespec& from, const timespec& to) {
+    return (static_cast<int64_t>(to.tv_sec) - from.tv_sec) * 1'000'000'000 + (to.tv_nsec - from.tv_nsec);
+  }
+
+  int Find(std::string_view id) const {
+    const uint32_t hash = SvIdHash(id);
+    for (size_t i = 0; i < stream_count_; ++i) {
+      if (streams_[i].sv_id.Equals(id, hash)) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  /**
+   * @brief forward distance of smpCnt from the next sample to emit, modulo samples per second
+   */
+  uint32_t Distance(uint16_t smp_cnt) const {
+    return (smp_cnt + samples_per_second_ - emit_cnt_) % samples_per_second_;
+  }
+
+  /**
+   * @brief true if a row after the (empty) head row has timed out
+   */
+  bool PendingBehindHead(const timespec& now) const {
+    for (uint32_t n = 1; n < max_skew_; ++n) {
+      const Row& row = rows_[(emit_slot_ + n) % Depth];
+      if (row.present != 0) {
+        return ElapsedNs(row.first_ts, now) > timeout_ns_;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief hand the head row to the consumer and advance
+   * @param now - emit time for the latency statistics, the row's last capture time if not given
+   */
+  void Emit(const timespec* now = nullptr) {
+    Row& row = rows_[emit_slot_];
+    if (row.present != 0) {
+      Sample sample;
+      sample.smp_cnt = static_cast<uint16_t>(emit_cnt_);
+      sample.present = row.present;
+      sample.first_ts = row.first_ts;
+      sample.last_ts = row.last_ts;
+      for (size_t i = 0; i < MaxStreams; ++i) {
+        const bool present = (row.present >> i) & 1;
+        sample.value[i] = present ? row.value[i] : nullptr;
+        sample.quality[i] = present ? row.quality[i] : nullptr;
+      }
+      const int64_t latency = ElapsedNs(row.first_ts, now ? *now : row.last_ts);
+      stats_.latency_sum_ns += latency;
+      if (latency > stats_.latency_max_ns) {
+        stats_.latency_max_ns = latency;
+      }
+      if (row.present == all_mask_) {
+        ++stats_.complete;
+      } else {
+        ++stats_.gaps;
+      }
+      if (consumer_) {
+        consumer_(sample);
+      }
+      --pending_rows_;
+    }
+    row.present = 0;
+    emit_slot_ = (emit_slot_ + 1) % Depth;
+    emit_cnt_ = (emit_cnt_ + 1) % samples_per_second_;
+  }
+
+  void Emit(const timespec& now) { Emit(&now); }
+
+  uint32_t samples_per_second_;
+  uint32_t max_skew_;
+  int64_t timeout_ns_;
+  Consumer consumer_;
+  Stream streams_[MaxStreams];
+  size_t stream_count_{0};
+  uint32_t all_mask_{0};
+  bool started_{false};
+  uint32_t emit_cnt_{0};
+  size_t emit_slot_{0};
+  uint32_t pending_rows_{0};   ///< rows holding at least one sample
+  Row rows_[Depth];
+  Statistics stats_;
+};
+
+/**
+ * @brief consumer of the aligned sample vectors in the SV subscriber: which streams are missing, differential current
+ * @desc The differential current of a phase is its sum over all streams of a complete vector, zero for merging units
+ *       measuring the currents into one node; its maximum is the residual of alignment and measurement.
+ */
+template <size_t MaxStreams = 8>
+struct SvAlignReport {
+  uint32_t missing{0};               ///< streams missing in the last vector
+  uint16_t smp_cnt{0};               ///< of the last vector
+  int64_t differential[3]{};         ///< of the last complete vector, Ia Ib Ic in 1 mA
+  int64_t differential_max[3]{};     ///< largest magnitude over all complete vectors
+
+  /**
+   * @param sample - emitted vector
+   * @param streams - bit mask of the aligned streams
+   * @return true if the streams missing changed with this vector, e.g. to log gaps once
+   */
+  bool Add(const SvAlignedSample<MaxStreams>& sample, uint32_t streams) {
+    const uint32_t absent = streams & ~sample.present;
+    const bool changed = absent != missing;
+    missing = absent;
+    smp_cnt = sample.smp_cnt;
+    if (absent == 0) {
+      for (size_t phase = 0; phase < 3; ++phase) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < MaxStreams; ++i) {
+          sum += sample.value[i] ? sample.value[i][phase] : 0;
+        }
+        differential[phase] = sum;
+        differential_max[phase] = std::max(differential_max[phase], sum < 0 ? -sum : sum);
+      }
+    }
+    return changed;
+  }
+
+  void Print(std::FILE* out = stdout) const {
+    std::fprintf(out, "SV alignment: differential current max Ia=%lld Ib=%lld Ic=%lld mA, missing streams 0x%x\n",
+                 static_cast<long long>(differential_max[0]), static_cast<long long>(differential_max[1]),
+                 static_cast<long long>(differential_max[2]), missing);
+  }
+};
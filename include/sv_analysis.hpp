@@ -0,0 +1,294 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   RMS, fundamental phasor and frequency of received SV streams
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <numbers>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SV_ANALYSIS_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SV_ANALYSIS_SSE2 1
+#endif
+
+#include <sv.hpp>
+
+//-----------------------------------------------------------------------------
+// kernels, vectorized over the 8 channels of one sample
+//-----------------------------------------------------------------------------
+namespace sv_detail {
+
+/**
+ * @brief sliding DFT and sum of squares update for one sample of all channels
+ * @param raw - new sample, raw 9-2LE values
+ * @param scale - per channel scale to engineering units
+ * @param old - sample leaving the window, replaced by the new one
+ * @param re, im - DFT bin of the fundamental
+ * @param sq - sum of squares over the window
+ * @param c, s - twiddle cos/sin of the sample position
+ */
+inline void SvDftUpdate(const int32_t* raw, const float* scale, float* old, float* re, float* im, float* sq, float c,
+                        float s) {
+#if defined(SV_ANALYSIS_NEON)
+  for (size_t i = 0; i < kSvChannels; i += 4) {
+    float32x4_t x = vmulq_f32(vcvtq_f32_s32(vld1q_s32(raw + i)), vld1q_f32(scale + i));
+    float32x4_t o = vld1q_f32(old + i);
+    float32x4_t d = vsubq_f32(x, o);
+    vst1q_f32(re + i, vmlaq_n_f32(vld1q_f32(re + i), d, c));
+    vst1q_f32(im + i, vmlsq_n_f32(vld1q_f32(im + i), d, s));
+    vst1q_f32(sq + i, vmlsq_f32(vmlaq_f32(vld1q_f32(sq + i), x, x), o, o));
+    vst1q_f32(old + i, x);
+  }
+#elif defined(SV_ANALYSIS_SSE2)
+  const __m128 vc = _mm_set1_ps(c);
+  const __m128 vs = _mm_set1_ps(s);
+  for (size_t i = 0; i < kSvChannels; i += 4) {
+    __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + i))),
+                          _mm_load_ps(scale + i));
+    __m128 o = _mm_load_ps(old + i);
+    __m128 d = _mm_sub_ps(x, o);
+    _mm_store_ps(re + i, _mm_add_ps(_mm_load_ps(re + i), _mm_mul_ps(d, vc)));
+    _mm_store_ps(im + i, _mm_sub_ps(_mm_load_ps(im + i), _mm_mul_ps(d, vs)));
+    _mm_store_ps(sq + i, _mm_add_ps(_mm_load_ps(sq + i), _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(o, o))));
+    _mm_store_ps(old + i, x);
+  }
+#else
+  for (size_t i = 0; i < kSvChannels; ++i) {
+    float x = static_cast<float>(raw[i]) * scale[i];
+    float d = x - old[i];
+    re[i] += d * c;
+    im[i] -= d * s;
+    sq[i] += x * x - old[i] * old[i];
+    old[i] = x;
+  }
+#endif
+}
+
+}   // namespace sv_detail
+
+/**
+ * @brief analysis result of one stream
+ * @desc magnitude and rms in engineering units (A, V), angle in radians relative to the start of the second
+ */
+struct SvPhasorResult {
+  std::string_view sv_id;
+  timespec ts;
+  float rms[kSvChannels];
+  float magnitude[kSvChannels];
+  float angle[kSvChannels];
+  float frequency;   ///< Hz, 0 if the reference channel has no signal
+};
+
+/**
+ * @brief per channel RMS, fundamental phasor (sliding DFT over one nominal cycle) and frequency for several streams
+ * @desc Samples are kept sample-major with the 8 channels of a sample contiguous, so each update is two 4-lane
+ *       vector operations. The window position is smpCnt modulo samples per cycle, which makes the phasor angles of
+ *       synchronized merging units comparable. Accumulated rounding is removed by recomputing the sums once a second.
+ * @tparam MaxStreams - number of streams analysed
+ * @tparam MaxSamplesPerCycle - upper bound for the window (256 for 9-2 at 256 samples/cycle)
+ */
+template <size_t MaxStreams = 16, size_t MaxSamplesPerCycle = 256>
+class SvAnalysis {
+ public:
+  using Publisher = std::function<void(const SvPhasorResult&)>;
+
+  /**
+   * @brief constructor
+   * @param samples_per_second - SV sample rate
+   * @param nominal_frequency - 50 or 60 Hz
+   * @param publish_rate - results per second and stream handed to the publisher
+   * @param publisher - receives the results, called from the capture thread
+   */
+  SvAnalysis(uint32_t samples_per_second, uint32_t nominal_frequency, double publish_rate, Publisher publisher)
+      : samples_per_second_(samples_per_second),
+        nominal_frequency_(static_cast<float>(nominal_frequency)),
+        window_(nominal_frequency ? samples_per_second / nominal_frequency : 0),
+        publisher_(std::move(publisher)) {
+    if (window_ < 4 || window_ > MaxSamplesPerCycle || window_ * nominal_frequency != samples_per_second) {
+      throw std::invalid_argument("SV analysis: unsupported samples per cycle");
+    }
+    publish_interval_ = publish_rate > 0 ? static_cast<uint64_t>(samples_per_second / publish_rate) : 0;
+    if (publish_interval_ == 0) {
+      publish_interval_ = 1;
+    }
+    for (size_t n = 0; n < window_; ++n) {
+      double theta = 2.0 * std::numbers::pi * static_cast<double>(n) / window_;
+      cos_[n] = static_cast<float>(std::cos(theta));
+      sin_[n] = static_cast<float>(std::sin(theta));
+    }
+    for (size_t ch = 0; ch < kSvChannels; ++ch) {
+      scale_[ch] = ch < 4 ? 0.001f : 0.01f;   // 9-2LE: 1 mA and 10 mV per LSB
+    }
+  }
+
+  /**
+   * @brief channel used for the frequency estimate (default: first voltage)
+   */
+  void SetReferenceChannel(size_t channel) { reference_channel_ = channel % kSvChannels; }
+
+  void Process(const SvFrame& frame, const timespec& ts) {
+    for (uint8_t i = 0; i < frame.no_asdu; ++i) {
+      Process(frame.asdu[i], ts);
+    }
+  }
+
+  void Process(const SvAsdu& asdu, const timespec& ts) {
+    int index = Find(asdu.sv_id);
+    if (index < 0) {
+      return;
+    }
+    Stream& s = streams_[index];
+    const size_t n = asdu.smp_cnt % window_;
+    sv_detail::SvDftUpdate(asdu.value, scale_, s.history[n], s.re, s.im, s.sq, cos_[n], sin_[n]);
+    ++s.samples;
+
+    if (n == 0) {
+      UpdateFrequency(s);
+    }
+    if (s.samples % samples_per_second_ == 0) {
+      Recompute(s);
+    }
+    if (s.samples % publish_interval_ == 0 && s.samples >= window_) {
+      Publish(s, ts);
+    }
+  }
+
+ private:
+  struct Stream {
+    alignas(16) float history[MaxSamplesPerCycle][kSvChannels];
+    alignas(16) float re[kSvChannels];
+    alignas(16) float im[kSvChannels];
+    alignas(16) float sq[kSvChannels];
+    SvIdString sv_id;
+    uint64_t samples;
+    uint64_t last_cycle_sample;
+    float last_angle;
+    bool has_angle;
+    double frequency_sum;
+    uint32_t frequency_count;
+    float frequency;
+  };
+
+  int Find(std::string_view id) {
+    const uint32_t hash = SvIdHash(id);
+    for (size_t i = 0; i < stream_count_; ++i) {
+      if (streams_[i].sv_id.Equals(id, hash)) {
+        return static_cast<int>(i);
+      }
+    }
+    if (stream_count_ == MaxStreams || id.empty() || id.size() > kSvMaxIdLength) {
+      return -1;
+    }
+    Stream& s = streams_[stream_count_];
+    std::memset(&s, 0, sizeof(s));
+    s.sv_id.Assign(id, hash);
+    return static_cast<int>(stream_count_++);
+  }
+
+  /**
+   * @brief per cycle frequency estimate from the rotation of the reference phasor
+   */
+  void UpdateFrequency(Stream& s) {
+    const size_t ch = reference_channel_;
+    const float magnitude = std::sqrt(s.re[ch] * s.re[ch] + s.im[ch] * s.im[ch]);
+    if (s.samples < window_ || magnitude * kSqrt2 / window_ < kMinMagnitude) {
+      s.has_angle = false;
+      return;
+    }
+    const float angle = std::atan2(s.im[ch], s.re[ch]);
+    if (s.has_angle) {
+      float delta = angle - s.last_angle;
+      delta -= kTwoPi * std::round(delta / kTwoPi);
+      const float elapsed = static_cast<float>(s.samples - s.last_cycle_sample) / samples_per_second_;
+      s.frequency_sum += nominal_frequency_ + delta / (kTwoPi * elapsed);
+      ++s.frequency_count;
+    }
+    s.last_angle = angle;
+    s.last_cycle_sample = s.samples;
+    s.has_angle = true;
+  }
+
+  /**
+   * @brief recompute the running sums from the window to drop accumulated rounding errors
+   */
+  void Recompute(Stream& s) {
+    double re[kSvChannels]{}, im[kSvChannels]{}, sq[kSvChannels]{};
+    for (size_t n = 0; n < window_; ++n) {
+      for (size_t ch = 0; ch < kSvChannels; ++ch) {
+        const double x = s.history[n][ch];
+        re[ch] += x * cos_[n];
+        im[ch] -= x * sin_[n];
+        sq[ch] += x * x;
+      }
+    }
+    for (size_t ch = 0; ch < kSvChannels; ++ch) {
+      s.re[ch] = static_cast<float>(re[ch]);
+      s.im[ch] = static_cast<float>(im[ch]);
+      s.sq[ch] = static_cast<float>(sq[ch]);
+    }
+  }
+
+  void Publish(Stream& s, const timespec& ts) {
+    SvPhasorResult result;
+    result.sv_id = s.sv_id.View();
+    result.ts = ts;
+    const float phasor_scale = kSqrt2 / window_;
+    for (size_t ch = 0; ch < kSvChannels; ++ch) {
+      result.rms[ch] = std::sqrt(std::max(s.sq[ch], 0.0f) / window_);
+      result.magnitude[ch] = std::sqrt(s.re[ch] * s.re[ch] + s.im[ch] * s.im[ch]) * phasor_scale;
+      result.angle[ch] = std::atan2(s.im[ch], s.re[ch]);
+    }
+    if (s.frequency_count) {
+      s.frequency = static_cast<float>(s.frequency_sum / s.frequency_count);
+      s.frequency_sum = 0;
+      s.frequency_count = 0;
+    } else if (!s.has_angle) {
+      s.frequency = 0;
+    }
+    result.frequency = s.frequency;
+    if (publisher_) {
+      publisher_(result);
+    }
+  }
+
+  static constexpr float kTwoPi = 2.0f * std::numbers::pi_v<float>;
+  static constexpr float kSqrt2 = std::numbers::sqrt2_v<float>;
+  static constexpr float kMinMagnitude = 1e-3f;
+
+  uint32_t samples_per_second_;
+  float nominal_frequency_;
+  size_t window_;
+  uint64_t publish_interval_{1};
+  size_t reference_channel_{4};
+  Publisher publisher_;
+  alignas(16) float cos_[MaxSamplesPerCycle]{};
+  alignas(16) float sin_[MaxSamplesPerCycle]{};
+  alignas(16) float scale_[kSvChannels]{};
+  Stream streams_[MaxStreams];
+  size_t stream_count_{0};
+};
@@ -0,0 +1,508 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   sampled values publisher with absolute deadline timing or SO_TXTIME launch times
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/netlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/rtnetlink.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <latency_histogram.hpp>
+#include <metrics.hpp>
+#include <sv.hpp>
+#include <sv_source.hpp>
+#include <xdp_socket.hpp>
+
+namespace sv_publisher_detail {
+
+/**
+ * @brief whether a qdisc of the given kind is attached to the interface, as root or child
+ */
+inline bool HasQdisc(int ifindex, const char* kind) {
+  const int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0) {
+    return false;
+  }
+  struct {
+    nlmsghdr header;
+    tcmsg message;
+  } request{};
+  request.header.nlmsg_len = sizeof(request);
+  request.header.nlmsg_type = RTM_GETQDISC;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.message.tcm_family = AF_UNSPEC;
+  bool found = false;
+  if (send(fd, &request, sizeof(request), 0) == static_cast<ssize_t>(sizeof(request))) {
+    alignas(nlmsghdr) char buffer[16384];
+    for (bool done = false; !done;) {
+      int length = static_cast<int>(recv(fd, buffer, sizeof(buffer), 0));
+      if (length <= 0) {
+        break;
+      }
+      for (auto* header = reinterpret_cast<nlmsghdr*>(buffer); NLMSG_OK(header, length);
+           header = NLMSG_NEXT(header, length)) {
+        if (header->nlmsg_type == NLMSG_DONE || header->nlmsg_type == NLMSG_ERROR) {
+          done = true;
+          break;
+        }
+        const auto* message = static_cast<const tcmsg*>(NLMSG_DATA(header));
+        if (header->nlmsg_type != RTM_NEWQDISC || message->tcm_ifindex != ifindex) {
+          continue;
+        }
+        int attributes = static_cast<int>(header->nlmsg_len - NLMSG_LENGTH(sizeof(tcmsg)));
+        for (auto* attribute = reinterpret_cast<const rtattr*>(reinterpret_cast<const char*>(message) +
+                                                                NLMSG_ALIGN(sizeof(tcmsg)));
+             RTA_OK(attribute, attributes); attribute = RTA_NEXT(attribute, attributes)) {
+          const auto* value = static_cast<const char*>(RTA_DATA(attribute));
+          if (attribute->rta_type == TCA_KIND && std::strcmp(value, kind) == 0) {
+            found = true;
+          }
+        }
+      }
+    }
+  }
+  close(fd);
+  return found;
+}
+
+}   // namespace sv_publisher_detail
+
+/**
+ * @brief publishes one frame per sample and stream on a raw packet socket
+ * @desc Samples are sent at absolute CLOCK_REALTIME deadlines starting at a full second, so smpCnt is the sample
+ *       number within the second. The streams are split over one or more timing loops, each loop on its own core;
+ *       a loop patches the encoded frames of its streams and hands them to the kernel in sendmmsg() batches.
+ *       Jitter is recorded per loop (wake-up) and per stream (time the stream's batch was sent).
+ *       With launch time (SetLaunchTime()) a loop wakes up ahead of the deadline and stamps every frame with it
+ *       (SO_TXTIME); the ETF qdisc of the interface holds the frames back and sends them at the deadline.
+ *       With UseXdp() the frames are queued on the TX ring of an AF_XDP socket, bypassing the qdisc, and one loop
+ *       serves all streams.
+ */
+class SvPublisher {
+ public:
+  static constexpr size_t kBatch = 64;   ///< frames per sendmmsg()
+
+  struct Statistics {
+    uint64_t ticks{0};           ///< sample periods served (summed over the loops)
+    uint64_t frames{0};          ///< frames sent
+    uint64_t send_errors{0};     ///< failed sends
+    uint64_t overruns{0};        ///< wake-ups later than one sample period
+    uint64_t launch_misses{0};   ///< frames dropped by the qdisc: launch time missed or invalid
+  };
+
+  /**
+   * @brief constructor, opens the packet socket
+   * @param interface_name - network interface
+   * @param samples_per_second - sample rate of all streams
+   */
+  SvPublisher(std::string interface_name, uint32_t samples_per_second)
+      : interface_name_(std::move(interface_name)), samples_per_second_(samples_per_second) {
+    if (samples_per_second_ == 0) {
+      throw std::invalid_argument("SV publisher: sample rate must not be 0");
+    }
+    Open();
+  }
+
+  SvPublisher(const SvPublisher&) = delete;
+  SvPublisher& operator=(const SvPublisher&) = delete;
+  ~SvPublisher() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  /**
+   * @brief add a stream
+   * @param dst - destination MAC, nullptr - 01-0C-CD-04-00-<index>
+   * @param vlan_id - VLAN id of the 802.1Q tag, negative - untagged
+   * @return stream index
+   */
+  size_t AddStream(std::string_view sv_id, uint16_t app_id, std::unique_ptr<SvSource> source, uint32_t conf_rev = 1,
+                   uint8_t smp_synch = kSvSmpSynchLocal, const uint8_t* dst = nullptr, int vlan_id = -1,
+                   uint8_t vlan_priority = 4) {
+    const size_t index = streams_.size();
+    const uint8_t dst_index[6] = {0x01, 0x0C, 0xCD, 0x04, static_cast<uint8_t>(index >> 8),
+                                  static_cast<uint8_t>(index)};
+    streams_.push_back(Stream{SvEncoder(dst ? dst : dst_index, mac_, app_id, sv_id, conf_rev, smp_synch, vlan_id,
+                                        vlan_priority),
+                              std::move(source),
+                              {}});
+    return index;
+  }
+
+  /**
+   * @brief number of timing loops, set before Start()
+   * @desc with more than one loop, loop i runs pinned to core i % cores; loop 0 runs in the thread calling Start()
+   */
+  void SetLoops(unsigned loops) { loop_count_ = loops ? loops : 1; }
+
+  /**
+   * @brief count overruns and failed sends into metrics as they happen as well, before Start()
+   * @desc GetStatistics() is consistent only after Start() returned; the metrics are read while the loops run.
+   */
+  void SetMetrics(MetricCounter* overruns, MetricCounter* send_errors) {
+    overrun_metric_ = overruns;
+    send_error_metric_ = send_errors;
+  }
+
+  /**
+   * @brief send through an AF_XDP socket instead of the packet socket, before Start()
+   * @desc The socket has one TX ring, so all streams are served by one loop; launch time is not available.
+   * @return false if AF_XDP is not available, the publisher keeps the packet socket and Backend() tells why
+   */
+  bool UseXdp(const XdpOptions& options) {
+    try {
+      xdp_ = std::make_unique<XdpSocket>(interface_name_, options, false);
+      backend_ = xdp_->Mode();
+      SetLaunchTime(0);
+      return true;
+    } catch (const std::exception& error) {
+      backend_ = std::string("packet socket, ") + error.what();
+      return false;
+    }
+  }
+
+  /**
+   * @brief transmit path, e.g. "packet socket" or "AF_XDP generic copy"
+   */
+  const std::string& Backend() const { return backend_; }
+
+  /**
+   * @brief hand the frames to the kernel lead_ns ahead of their deadline with an SO_TXTIME launch time, before Start()
+   * @desc Needs an ETF qdisc on the interface, e.g. tc qdisc replace dev eth1 root etf clockid CLOCK_TAI delta 200000;
+   *       the lead must cover the wake-up jitter of the loops and the delta. Without the qdisc the frames would leave
+   *       lead_ns early, so the publisher falls back to user-space timing, as it does if the socket option fails.
+   * @param lead_ns - hand-off ahead of the deadline, 0 - user-space timing
+   * @return true if launch time is used, Timing() describes the mode or the reason of the fallback
+   */
+  bool SetLaunchTime(int64_t lead_ns) {
+    launch_lead_ns_ = 0;
+    timing_ = "user space";
+    if (lead_ns <= 0) {
+      return false;
+    }
+    if (xdp_) {
+      timing_ = "user space, AF_XDP bypasses the qdisc";
+      return false;
+    }
+    if (!sv_publisher_detail::HasQdisc(ifindex_, "etf")) {
+      timing_ = "user space, no etf qdisc on " + interface_name_;
+      return false;
+    }
+    const sock_txtime txtime{CLOCK_TAI, SOF_TXTIME_REPORT_ERRORS};
+    if (setsockopt(fd_, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) < 0) {
+      timing_ = "user space, SO_TXTIME failed: " + std::string(strerror(errno));
+      return false;
+    }
+    launch_lead_ns_ = lead_ns;
+    timing_ = "launch time, lead " + std::to_string(lead_ns / 1000) + " us";
+    return true;
+  }
+
+  const std::string& Timing() const { return timing_; }
+
+  /**
+   * @brief publish until Stop() is called
+   */
+  void Start() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const int64_t start = (static_cast<int64_t>(now.tv_sec) + 1) * 1'000'000'000;
+    // launch times are CLOCK_TAI, the deadlines CLOCK_REALTIME: the offset is the whole leap seconds
+    timespec tai;
+    clock_gettime(CLOCK_TAI, &tai);
+    clock_gettime(CLOCK_REALTIME, &now);
+    tai_offset_ns_ = static_cast<int64_t>(tai.tv_sec - now.tv_sec +
+                                          (tai.tv_nsec - now.tv_nsec + 500'000'000) / 1'000'000'000) *
+                     1'000'000'000;
+
+    // the TX ring of the AF_XDP socket has one producer: a single loop
+    const size_t loop_count = xdp_ ? 1 : loop_count_;
+    const size_t loops = loop_count < streams_.size() ? loop_count : (streams_.empty() ? 1 : streams_.size());
+    loops_.assign(loops, Loop{});
+    for (size_t i = 0; i < loops; ++i) {
+      loops_[i].first = streams_.size() * i / loops;
+      loops_[i].last = streams_.size() * (i + 1) / loops;
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < loops; ++i) {
+      threads.emplace_back([this, i, start]() { Run(loops_[i], start, static_cast<int>(i)); });
+    }
+    Run(loops_[0], start, loops > 1 ? 0 : -1);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  void Stop() { run_ = false; }
+
+  /**
+   * @brief statistics, consistent when read after Start() returned
+   */
+  Statistics GetStatistics() const {
+    Statistics total;
+    for (const auto& loop : loops_) {
+      total.ticks += loop.stats.ticks;
+      total.frames += loop.stats.frames;
+      total.send_errors += loop.stats.send_errors;
+      total.overruns += loop.stats.overruns;
+      total.launch_misses += loop.stats.launch_misses;
+    }
+    return total;
+  }
+
+  /**
+   * @brief wake-up jitter of all loops
+   */
+  LatencyHistogram Jitter() const {
+    LatencyHistogram total;
+    for (const auto& loop : loops_) {
+      total.Merge(loop.jitter);
+    }
+    return total;
+  }
+
+  size_t StreamCount() const { return streams_.size(); }
+
+  /**
+   * @brief timing loops of the last Start(), at most SetLoops() and one with AF_XDP
+   */
+  size_t LoopCount() const { return loops_.size(); }
+
+  /**
+   * @brief send time of the frames of one stream against their deadline
+   */
+  const LatencyHistogram& StreamJitter(size_t index) const { return streams_[index].jitter; }
+
+  void Print(std::FILE* out = stdout, bool per_stream = false) const {
+    const auto stats = GetStatistics();
+    std::fprintf(out,
+                 "SV publisher %s: %zu stream(s) %zu loop(s) ticks=%llu frames=%llu send errors=%llu overruns=%llu\n",
+                 interface_name_.c_str(), streams_.size(), loops_.size(), static_cast<unsigned long long>(stats.ticks),
+                 static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.send_errors),
+                 static_cast<unsigned long long>(stats.overruns));
+    std::fprintf(out, " %s, timing: %s, launch misses=%llu\n", backend_.c_str(), timing_.c_str(),
+                 static_cast<unsigned long long>(stats.launch_misses));
+    Jitter().Print(" wake-up jitter", out);
+    for (size_t i = 0; per_stream && i < streams_.size(); ++i) {
+      char name[48];
+      std::snprintf(name, sizeof(name), " [%zu] send jitter", i);
+      streams_[i].jitter.Print(name, out);
+    }
+  }
+
+ private:
+  struct Stream {
+    SvEncoder encoder;
+    std::unique_ptr<SvSource> source;
+    LatencyHistogram jitter;
+  };
+
+  struct Loop {
+    size_t first{0};   ///< streams [first, last) served by the loop
+    size_t last{0};
+    Statistics stats;
+    LatencyHistogram jitter;
+  };
+
+  static constexpr uint64_t kErrorPollTicks = 256;   ///< launch time: error queue read every n sample periods
+
+  /**
+   * @brief one timing loop
+   * @desc With launch time the wake-up jitter and the send times refer to the hand-off, lead ahead of the deadline.
+   * @param core - core to pin the calling thread to, -1 - no pinning
+   */
+  void Run(Loop& loop, int64_t start, int core) {
+    if (core >= 0) {
+      const unsigned cores = std::thread::hardware_concurrency();
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cores ? static_cast<unsigned>(core) % cores : 0, &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    const int64_t period = 1'000'000'000 / samples_per_second_;   // overrun threshold only
+    const int64_t lead = launch_lead_ns_;
+    mmsghdr messages[kBatch]{};
+    iovec vectors[kBatch]{};
+    alignas(cmsghdr) uint8_t controls[kBatch][CMSG_SPACE(sizeof(uint64_t))]{};
+    for (size_t i = 0; lead && i < kBatch; ++i) {
+      messages[i].msg_hdr.msg_control = controls[i];
+      messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+      cmsghdr* control = CMSG_FIRSTHDR(&messages[i].msg_hdr);
+      control->cmsg_level = SOL_SOCKET;
+      control->cmsg_type = SCM_TXTIME;
+      control->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    }
+    int32_t value[kSvChannels];
+    uint32_t quality[kSvChannels];
+    timespec now;
+
+    for (uint64_t index = 0; run_.load(std::memory_order_relaxed); ++index) {
+      // exact for rates that do not divide the second, e.g. 4800 sps: no rounding error accumulates
+      const int64_t deadline_ns = start + static_cast<int64_t>(index / samples_per_second_) * 1'000'000'000 +
+                                  static_cast<int64_t>(index % samples_per_second_) * 1'000'000'000 /
+                                     samples_per_second_;
+      const int64_t wake_ns = deadline_ns - lead;
+      const timespec wake{static_cast<time_t>(wake_ns / 1'000'000'000), static_cast<long>(wake_ns % 1'000'000'000)};
+      while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, nullptr) == EINTR) {
+      }
+      clock_gettime(CLOCK_REALTIME, &now);
+      const int64_t late = static_cast<int64_t>(now.tv_sec) * 1'000'000'000 + now.tv_nsec - wake_ns;
+      loop.jitter.Add(late);
+      if (late > period) {
+        ++loop.stats.overruns;
+        if (overrun_metric_) {
+          overrun_metric_->Inc();
+        }
+      }
+      ++loop.stats.ticks;
+
+      if (lead && index % kErrorPollTicks == 0) {
+        loop.stats.launch_misses += LaunchErrors();
+      }
+
+      const auto smp_cnt = static_cast<uint16_t>(index % samples_per_second_);
+      const auto launch = static_cast<uint64_t>(deadline_ns + tai_offset_ns_);
+      for (size_t first = loop.first; first < loop.last; first += kBatch) {
+        const size_t count = loop.last - first < kBatch ? loop.last - first : kBatch;
+        for (size_t i = 0; i < count; ++i) {
+          auto& stream = streams_[first + i];
+          stream.source->Next(index, value, quality);
+          stream.encoder.SetSample(smp_cnt, value, quality);
+          vectors[i].iov_base = stream.encoder.data();
+          vectors[i].iov_len = stream.encoder.size();
+          messages[i].msg_hdr.msg_iov = &vectors[i];
+          messages[i].msg_hdr.msg_iovlen = 1;
+          if (lead) {
+            std::memcpy(CMSG_DATA(CMSG_FIRSTHDR(&messages[i].msg_hdr)), &launch, sizeof(launch));
+          }
+        }
+        size_t ok = 0;
+        if (xdp_) {
+          for (size_t i = 0; i < count; ++i) {
+            ok += xdp_->Send(static_cast<const uint8_t*>(vectors[i].iov_base), vectors[i].iov_len);
+          }
+          xdp_->Flush();
+        } else {
+          const int sent = sendmmsg(fd_, messages, static_cast<unsigned>(count), 0);
+          ok = sent > 0 ? static_cast<size_t>(sent) : 0;
+        }
+        loop.stats.frames += ok;
+        loop.stats.send_errors += count - ok;
+        if (ok != count && send_error_metric_) {
+          send_error_metric_->Inc(count - ok);
+        }
+        clock_gettime(CLOCK_REALTIME, &now);
+        const int64_t sent_ns = static_cast<int64_t>(now.tv_sec) * 1'000'000'000 + now.tv_nsec - wake_ns;
+        for (size_t i = 0; i < count; ++i) {
+          streams_[first + i].jitter.Add(sent_ns);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief read the error queue of the socket
+   * @return frames the qdisc dropped because of their launch time
+   */
+  size_t LaunchErrors() {
+    size_t errors = 0;
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_ll))];
+    for (;;) {
+      msghdr message{};
+      message.msg_control = control;
+      message.msg_controllen = sizeof(control);
+      if (recvmsg(fd_, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+        return errors;
+      }
+      for (cmsghdr* entry = CMSG_FIRSTHDR(&message); entry; entry = CMSG_NXTHDR(&message, entry)) {
+        sock_extended_err error;
+        std::memcpy(&error, CMSG_DATA(entry), sizeof(error));
+        if (error.ee_origin == SO_EE_ORIGIN_TXTIME) {
+          ++errors;
+        }
+      }
+    }
+  }
+
+  void Open() {
+    fd_ = socket(AF_PACKET, SOCK_RAW, 0);   // transmit only
+    if (fd_ < 0) {
+      throw std::runtime_error("SV publisher: packet socket failed: " + std::string(strerror(errno)));
+    }
+    ifreq ifr{};
+    std::strncpy(ifr.ifr_name, interface_name_.c_str(), IFNAMSIZ - 1);
+    if (ioctl(fd_, SIOCGIFHWADDR, &ifr) < 0) {
+      close(fd_);
+      fd_ = -1;
+      throw std::runtime_error("SV publisher: unknown interface " + interface_name_);
+    }
+    std::memcpy(mac_, ifr.ifr_hwaddr.sa_data, 6);
+
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = 0;
+    ifindex_ = static_cast<int>(if_nametoindex(interface_name_.c_str()));
+    addr.sll_ifindex = ifindex_;
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close(fd_);
+      fd_ = -1;
+      throw std::runtime_error("SV publisher: cannot bind to interface " + interface_name_);
+    }
+  }
+
+  std::string interface_name_;
+  uint32_t samples_per_second_;
+  int fd_{-1};
+  int ifindex_{0};
+  uint8_t mac_[6]{};
+  int64_t launch_lead_ns_{0};   ///< 0 - user-space timing
+  int64_t tai_offset_ns_{0};    ///< CLOCK_TAI - CLOCK_REALTIME
+  std::string timing_{"user space"};
+  std::unique_ptr<XdpSocket> xdp_;
+  std::string backend_{"packet socket"};
+  std::vector<Stream> streams_;
+  unsigned loop_count_{1};
+  MetricCounter* overrun_metric_{nullptr};
+  MetricCounter* send_error_metric_{nullptr};
+  std::vector<Loop> loops_;
+  std::atomic<bool> run_{true};
+};
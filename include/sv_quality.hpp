@@ -0,0 +1,334 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   streaming sample-quality checker for received SV streams
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+
+#include <sv.hpp>
+
+/**
+ * @brief kind of anomaly recorded in the event log
+ */
+enum class SvQualityEventType : uint8_t {
+  kGap,              ///< smpCnt values are missing
+  kDuplicate,        ///< smpCnt already received
+  kReordered,        ///< smpCnt arrived after a later one
+  kOutOfRange,       ///< smpCnt >= configured samples per second
+  kSynchChange,      ///< smpSynch changed
+  kConfRevChange,    ///< confRev changed
+  kQualityChange,    ///< worst validity over all channels changed
+  kStreamRestart,    ///< stream silent for longer than the restart timeout
+};
+
+inline const char* SvQualityEventName(SvQualityEventType type) {
+  switch (type) {
+    case SvQualityEventType::kGap:
+      return "gap";
+    case SvQualityEventType::kDuplicate:
+      return "duplicate";
+    case SvQualityEventType::kReordered:
+      return "reordered";
+    case SvQualityEventType::kOutOfRange:
+      return "out-of-range";
+    case SvQualityEventType::kSynchChange:
+      return "smpSynch";
+    case SvQualityEventType::kConfRevChange:
+      return "confRev";
+    case SvQualityEventType::kQualityChange:
+      return "quality";
+    case SvQualityEventType::kStreamRestart:
+      return "restart";
+  }
+  return "?";
+}
+
+/**
+ * @brief anomaly with its capture timestamp
+ * @desc value/expected depend on the type: smpCnt values, old/new smpSynch, confRev or validity
+ */
+struct SvQualityEvent {
+  timespec ts;
+  SvQualityEventType type;
+  uint8_t stream;
+  uint32_t expected;
+  uint32_t value;
+};
+
+/**
+ * @brief per stream state and counters, constant size
+ */
+struct SvStreamQuality {
+  SvIdString sv_id{};
+
+  // state machine
+  bool started{false};
+  uint16_t head{0};      ///< highest smpCnt received (modulo samples per second)
+  uint64_t window{0};    ///< bit i set: smpCnt head - i was received
+  uint8_t smp_synch{kSvSmpSynchNone};
+  uint32_t conf_rev{0};
+  uint32_t validity{kSvQualityGood};
+  timespec last_ts{};
+
+  // counters
+  uint64_t samples{0};
+  uint64_t missing{0};
+  uint64_t duplicates{0};
+  uint64_t reordered{0};
+  uint64_t wraps{0};
+  uint64_t out_of_range{0};
+  uint64_t synch_changes{0};
+  uint64_t conf_rev_changes{0};
+  uint64_t restarts{0};
+  uint64_t invalid_samples{0};
+  uint64_t questionable_samples{0};
+  uint64_t test_samples{0};
+};
+
+/**
+ * @brief sample-quality checker for a fixed number of streams
+ * @desc Runs inline in the capture path: a lookup by svID (hash, then compare) and a few integer operations per
+ *       ASDU, no allocation. The event log is a ring, the oldest events are overwritten.
+ * @tparam MaxStreams - number of streams tracked, further svIDs are counted as unknown
+ * @tparam LogCapacity - number of events kept
+ */
+template <size_t MaxStreams = 16, size_t LogCapacity = 256>
+class SvQualityMonitor {
+ public:
+  static_assert(MaxStreams <= 256, "stream index is stored in 8 bits");
+
+  /**
+   * @brief counters summed over all streams, kept current per ASDU, e.g. for metrics
+   */
+  struct Totals {
+    uint64_t missing{0};   ///< decreases when a sample counted as missing arrives late
+    uint64_t duplicates{0};
+    uint64_t reordered{0};
+  };
+
+  /**
+   * @brief constructor
+   * @param samples_per_second - smpCnt wraps to 0 at this value (4000 for 80 samples/cycle at 50 Hz)
+   * @param restart_timeout_ns - silence after which a stream is resynchronized instead of counting a gap
+   */
+  explicit SvQualityMonitor(uint32_t samples_per_second = 4000, int64_t restart_timeout_ns = 250'000'000)
+      : samples_per_second_(samples_per_second), restart_timeout_ns_(restart_timeout_ns) {}
+
+  /**
+   * @brief register an expected stream before the first frame, a stream that never arrives is printed with 0 samples
+   * @return false if all slots are in use
+   */
+  bool Expect(std::string_view sv_id) { return Find(sv_id) >= 0; }
+
+  /**
+   * @brief check all ASDU of a received frame
+   */
+  void Check(const SvFrame& frame, const timespec& ts) {
+    for (uint8_t i = 0; i < frame.no_asdu; ++i) {
+      Check(frame.asdu[i], ts);
+    }
+  }
+
+  /**
+   * @brief check one ASDU
+   */
+  void Check(const SvAsdu& asdu, const timespec& ts) {
+    int index = Find(asdu.sv_id);
+    if (index < 0) {
+      ++unknown_samples_;
+      return;
+    }
+    SvStreamQuality& s = streams_[index];
+    const auto stream = static_cast<uint8_t>(index);
+    ++s.samples;
+
+    CheckQuality(s, stream, asdu, ts);
+    if (s.started && s.smp_synch != asdu.smp_synch) {
+      ++s.synch_changes;
+      Log(ts, SvQualityEventType::kSynchChange, stream, s.smp_synch, asdu.smp_synch);
+    }
+    if (s.started && s.conf_rev != asdu.conf_rev) {
+      ++s.conf_rev_changes;
+      Log(ts, SvQualityEventType::kConfRevChange, stream, s.conf_rev, asdu.conf_rev);
+    }
+    s.smp_synch = asdu.smp_synch;
+    s.conf_rev = asdu.conf_rev;
+
+    const uint32_t cnt = asdu.smp_cnt;
+    if (cnt >= samples_per_second_) {
+      ++s.out_of_range;
+      Log(ts, SvQualityEventType::kOutOfRange, stream, samples_per_second_ - 1, cnt);
+      return;
+    }
+    if (s.started && ElapsedNs(s.last_ts, ts) > restart_timeout_ns_) {
+      ++s.restarts;
+      Log(ts, SvQualityEventType::kStreamRestart, stream, (s.head + 1u) % samples_per_second_, cnt);
+      s.started = false;
+    }
+    s.last_ts = ts;
+    if (!s.started) {
+      s.started = true;
+      s.head = static_cast<uint16_t>(cnt);
+      s.window = 1;
+      return;
+    }
+
+    const uint32_t ahead = (cnt + samples_per_second_ - s.head) % samples_per_second_;
+    if (ahead == 0) {
+      ++s.duplicates;
+      ++totals_.duplicates;
+      Log(ts, SvQualityEventType::kDuplicate, stream, (s.head + 1u) % samples_per_second_, cnt);
+    } else if (ahead <= samples_per_second_ / 2) {
+      if (ahead > 1) {
+        s.missing += ahead - 1;
+        totals_.missing += ahead - 1;
+        Log(ts, SvQualityEventType::kGap, stream, (s.head + 1u) % samples_per_second_, cnt);
+      }
+      if (cnt < s.head) {
+        ++s.wraps;
+      }
+      s.window = ahead >= 64 ? 1 : (s.window << ahead) | 1;
+      s.head = static_cast<uint16_t>(cnt);
+    } else {
+      const uint32_t behind = samples_per_second_ - ahead;
+      if (behind < 64 && (s.window >> behind) & 1) {
+        ++s.duplicates;
+        ++totals_.duplicates;
+        Log(ts, SvQualityEventType::kDuplicate, stream, (s.head + 1u) % samples_per_second_, cnt);
+      } else {
+        // a late sample was counted as missing when the gap was seen
+        if (behind < 64) {
+          s.window |= uint64_t{1} << behind;
+          if (s.missing) {
+            --s.missing;
+            --totals_.missing;
+          }
+        }
+        ++s.reordered;
+        ++totals_.reordered;
+        Log(ts, SvQualityEventType::kReordered, stream, (s.head + 1u) % samples_per_second_, cnt);
+      }
+    }
+  }
+
+  /**
+   * @brief print counters and the event log
+   */
+  void Print(std::FILE* out = stdout) const {
+    std::fprintf(out, "SV quality: %zu stream(s), %llu sample(s) of unknown streams\n", stream_count_,
+                 static_cast<unsigned long long>(unknown_samples_));
+    for (size_t i = 0; i < stream_count_; ++i) {
+      const SvStreamQuality& s = streams_[i];
+      std::fprintf(out,
+                   " [%zu] %.*s: samples=%llu missing=%llu duplicates=%llu reordered=%llu wraps=%llu "
+                   "out-of-range=%llu smpSynch=%u (changes=%llu) confRev=%u (changes=%llu) restarts=%llu "
+                   "invalid=%llu questionable=%llu test=%llu\n",
+                   i, s.sv_id.length, s.sv_id.text, ull(s.samples), ull(s.missing), ull(s.duplicates), ull(s.reordered),
+                   ull(s.wraps), ull(s.out_of_range), s.smp_synch, ull(s.synch_changes), s.conf_rev,
+                   ull(s.conf_rev_changes), ull(s.restarts), ull(s.invalid_samples), ull(s.questionable_samples),
+                   ull(s.test_samples));
+    }
+    const uint64_t kept = events_total_ < LogCapacity ? events_total_ : LogCapacity;
+    std::fprintf(out, "SV quality events: %llu total, %llu overwritten\n", ull(events_total_),
+                 ull(events_total_ - kept));
+    for (uint64_t n = events_total_ - kept; n < events_total_; ++n) {
+      const SvQualityEvent& e = events_[n % LogCapacity];
+      std::fprintf(out, " %lld.%09ld [%u] %s expected=%u value=%u\n", static_cast<long long>(e.ts.tv_sec),
+                   e.ts.tv_nsec, e.stream, SvQualityEventName(e.type), e.expected, e.value);
+    }
+  }
+
+  size_t StreamCount() const { return stream_count_; }
+  const SvStreamQuality& Stream(size_t index) const { return streams_[index]; }
+  uint64_t EventsTotal() const { return events_total_; }
+  const Totals& GetTotals() const { return totals_; }
+
+ private:
+  static unsigned long long ull(uint64_t value) { return static_cast<unsigned long long>(value); }
+
+  static int64_t ElapsedNs(const timespec& from, const timespec& to) {
+    return (static_cast<int64_t>(to.tv_sec) - from.tv_sec) * 1'000'000'000 + (to.tv_nsec - from.tv_nsec);
+  }
+
+  /**
+   * @brief find or register the stream of an svID
+   * @return stream index or -1 if all slots are in use
+   */
+  int Find(std::string_view id) {
+    if (last_index_ < stream_count_ && streams_[last_index_].sv_id.Equals(id)) {
+      return static_cast<int>(last_index_);
+    }
+    const uint32_t hash = SvIdHash(id);
+    for (size_t i = 0; i < stream_count_; ++i) {
+      if (streams_[i].sv_id.Equals(id, hash)) {
+        last_index_ = i;
+        return static_cast<int>(i);
+      }
+    }
+    if (stream_count_ == MaxStreams || !streams_[stream_count_].sv_id.Assign(id, hash)) {
+      return -1;
+    }
+    last_index_ = stream_count_;
+    return static_cast<int>(stream_count_++);
+  }
+
+  void CheckQuality(SvStreamQuality& s, uint8_t stream, const SvAsdu& asdu, const timespec& ts) {
+    uint32_t any = 0;
+    uint32_t worst = kSvQualityGood;
+    for (size_t ch = 0; ch < kSvChannels; ++ch) {
+      const uint32_t q = asdu.quality[ch];
+      const uint32_t validity = q & kSvQualityValidityMask;
+      any |= q;
+      // good < questionable < invalid
+      if (validity == kSvQualityInvalid || (validity == kSvQualityQuestionable && worst == kSvQualityGood)) {
+        worst = validity;
+      }
+    }
+    if (worst == kSvQualityInvalid) {
+      ++s.invalid_samples;
+    } else if (worst == kSvQualityQuestionable) {
+      ++s.questionable_samples;
+    }
+    if (any & kSvQualityTest) {
+      ++s.test_samples;
+    }
+    if (worst != s.validity) {
+      Log(ts, SvQualityEventType::kQualityChange, stream, s.validity, worst);
+      s.validity = worst;
+    }
+  }
+
+  void Log(const timespec& ts, SvQualityEventType type, uint8_t stream, uint32_t expected, uint32_t value) {
+    events_[events_total_ % LogCapacity] = SvQualityEvent{ts, type, stream, expected, value};
+    ++events_total_;
+  }
+
+  uint32_t samples_per_second_;
+  int64_t restart_timeout_ns_;
+  SvStreamQuality streams_[MaxStreams];
+  size_t stream_count_{0};
+  size_t last_index_{0};
+  uint64_t unknown_samples_{0};
+  Totals totals_;
+  SvQualityEvent events_[LogCapacity]{};
+  uint64_t events_total_{0};
+};
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   sample sources for the SV publisher
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numbers>
+#include <vector>
+
+#include <sv.hpp>
+
+/**
+ * @brief source of 9-2LE samples for one published stream
+ * @desc Next() is called from the publisher timing loop and must not block, parse or allocate.
+ */
+class SvSource {
+ public:
+  virtual ~SvSource() = default;
+
+  /**
+   * @brief sample number index of the stream (counting from the start of publishing)
+   * @param index - sample number
+   * @param value - 8 raw values (1 mA, 10 mV per LSB)
+   * @param quality - 8 quality words
+   */
+  virtual void Next(uint64_t index, int32_t* value, uint32_t* quality) = 0;
+};
+
+/**
+ * @brief precomputed samples played from memory, optionally in a loop
+ * @desc samples are stored sample-major, kSvChannels values per sample
+ */
+class SvTableSource : public SvSource {
+ public:
+  SvTableSource(std::vector<int32_t> samples, bool loop) : samples_(std::move(samples)), loop_(loop) {
+    count_ = samples_.size() / kSvChannels;
+  }
+
+  void Next(uint64_t index, int32_t* value, uint32_t* quality) override {
+    if (count_ == 0 || (!loop_ && index >= count_)) {
+      std::memset(value, 0, kSvChannels * sizeof(int32_t));
+      for (size_t ch = 0; ch < kSvChannels; ++ch) {
+        quality[ch] = kSvQualityInvalid | kSvQualityOldData;
+      }
+      return;
+    }
+    std::memcpy(value, &samples_[(index % count_) * kSvChannels], kSvChannels * sizeof(int32_t));
+    std::memset(quality, 0, kSvChannels * sizeof(uint32_t));
+  }
+
+  uint64_t Count() const { return count_; }
+
+ private:
+  std::vector<int32_t> samples_;
+  uint64_t count_{0};
+  bool loop_;
+};
+
+/**
+ * @brief balanced three phase currents and voltages, neutral channels zero
+ * @desc One period is precomputed if it is an integer number of samples, otherwise one second.
+ */
+class SvSineSource : public SvTableSource {
+ public:
+  /**
+   * @brief constructor
+   * @param samples_per_second - sample rate
+   * @param frequency - signal frequency in Hz
+   * @param current - RMS current in A
+   * @param voltage - RMS phase voltage in V
+   * @param phase - phase offset in radians, shifts all channels
+   */
+  SvSineSource(uint32_t samples_per_second, double frequency, double current, double voltage, double phase = 0)
+      : SvTableSource(Table(samples_per_second, frequency, current, voltage, phase), true) {}
+
+ private:
+  static std::vector<int32_t> Table(uint32_t samples_per_second, double frequency, double current, double voltage,
+                                    double phase) {
+    const double period = samples_per_second / frequency;
+    const size_t count = std::abs(period - std::round(period)) < 1e-9 ? static_cast<size_t>(std::round(period))
+                                                                       : samples_per_second;
+    std::vector<int32_t> samples(count * kSvChannels);
+    const double omega = 2.0 * std::numbers::pi * frequency / samples_per_second;
+    for (size_t n = 0; n < count; ++n) {
+      int32_t* sample = &samples[n * kSvChannels];
+      for (size_t p = 0; p < 3; ++p) {
+        const double angle = omega * static_cast<double>(n) + phase - 2.0 * std::numbers::pi * p / 3.0;
+        sample[p] = static_cast<int32_t>(std::lround(current * std::numbers::sqrt2 * std::cos(angle) * 1000.0));
+        sample[4 + p] = static_cast<int32_t>(std::lround(voltage * std::numbers::sqrt2 * std::cos(angle) * 100.0));
+      }
+    }
+    return samples;
+  }
+};
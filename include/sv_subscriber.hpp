@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   sampled values subscriber on a PACKET_MMAP (TPACKET_V3) receive ring or an AF_XDP socket
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sv.hpp>
+#include <xdp_socket.hpp>
+
+/**
+ * @brief one captured frame as delivered by the receive ring
+ */
+struct SvCapture {
+  const uint8_t* data;   ///< frame starting with destination MAC
+  size_t size;           ///< captured length
+  timespec ts;           ///< kernel receive timestamp (CLOCK_REALTIME), AF_XDP: time the batch was taken
+};
+
+/**
+ * @brief SV subscriber reading frames of ethertype 0x88BA from a memory mapped ring
+ * @desc The ring is walked without a syscall per frame; poll() is used only when the ring is empty.
+ *       Frames are decoded in place and handed to the handler together with the capture timestamp.
+ *       With UseXdp() the frames bypass the network stack through an AF_XDP socket; there is no kernel timestamp,
+ *       the capture carries the time the batch was taken from the RX ring.
+ */
+class SvSubscriber {
+ public:
+  struct Statistics {
+    uint64_t frames{0};           ///< frames taken from the ring
+    uint64_t frames_invalid{0};   ///< frames which failed to decode
+    uint64_t kernel_drops{0};     ///< frames dropped by the kernel (ring full)
+  };
+
+  explicit SvSubscriber(std::string interface_name) : interface_name_(std::move(interface_name)) {}
+  SvSubscriber(const SvSubscriber&) = delete;
+  SvSubscriber& operator=(const SvSubscriber&) = delete;
+  ~SvSubscriber() { Close(); }
+
+  /**
+   * @brief receive through an AF_XDP socket instead of the packet ring, before Start()
+   * @return false if AF_XDP is not available, the subscriber keeps the packet ring and Backend() tells why
+   */
+  bool UseXdp(const XdpOptions& options) {
+    try {
+      xdp_ = std::make_unique<XdpSocket>(interface_name_, options, true);
+      backend_ = xdp_->Mode();
+      return true;
+    } catch (const std::exception& error) {
+      backend_ = std::string("PACKET_MMAP, ") + error.what();
+      return false;
+    }
+  }
+
+  /**
+   * @brief receive path, e.g. "PACKET_MMAP" or "AF_XDP generic copy"
+   */
+  const std::string& Backend() const { return backend_; }
+
+  /**
+   * @brief receive until Stop() is called
+   * @param handler - callable as handler(const SvCapture&, const SvFrame&)
+   */
+  template <class Handler>
+  void Start(Handler&& handler) {
+    Start(handler, []() {});
+  }
+
+  /**
+   * @brief receive until Stop() is called
+   * @param handler - callable as handler(const SvCapture&, const SvFrame&)
+   * @param idle - callable as idle(), called when no frame arrived within the poll timeout, e.g. to flush buffers
+   */
+  template <class Handler, class Idle>
+  void Start(Handler&& handler, Idle&& idle) {
+    if (xdp_) {
+      StartXdp(handler, idle);
+      return;
+    }
+    Open();
+    SvFrame frame;
+    unsigned block_index = 0;
+    while (run_.load(std::memory_order_relaxed)) {
+      auto* block = reinterpret_cast<tpacket_block_desc*>(ring_ + block_index * kBlockSize);
+      if ((block->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+        pollfd pfd{fd_, POLLIN | POLLERR, 0};
+        if (poll(&pfd, 1, kPollTimeoutMs) == 0) {
+          idle();
+        }
+        continue;
+      }
+      const uint32_t packets = block->hdr.bh1.num_pkts;
+      auto* hdr = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(block) +
+                                                  block->hdr.bh1.offset_to_first_pkt);
+      for (uint32_t i = 0; i < packets; ++i) {
+        SvCapture capture{reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_mac, hdr->tp_snaplen,
+                          timespec{static_cast<time_t>(hdr->tp_sec), static_cast<long>(hdr->tp_nsec)}};
+        ++stats_.frames;
+        if (SvDecode(capture.data, capture.size, frame)) {
+          handler(capture, frame);
+        } else {
+          ++stats_.frames_invalid;
+        }
+        hdr = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(hdr) + hdr->tp_next_offset);
+      }
+      block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+      block_index = (block_index + 1) % kBlockCount;
+    }
+    Close();
+  }
+
+  void Stop() { run_ = false; }
+
+  /**
+   * @brief statistics, only consistent when read from the receiving thread or after Start() returned
+   */
+  const Statistics& GetStatistics() {
+    if (xdp_) {
+      const XdpSocket::Statistics kstats = xdp_->GetStatistics();   // cumulative
+      stats_.kernel_drops = kstats.rx_dropped + kstats.rx_ring_full + kstats.fill_ring_empty;
+    } else if (fd_ >= 0) {
+      tpacket_stats_v3 kstats{};
+      socklen_t length = sizeof(kstats);
+      if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &kstats, &length) == 0) {
+        stats_.kernel_drops += kstats.tp_drops;   // counters are reset by every read
+      }
+    }
+    return stats_;
+  }
+
+ private:
+  static constexpr unsigned kBlockSize = 1u << 18;
+  static constexpr unsigned kBlockCount = 16;
+  static constexpr unsigned kFrameSize = 2048;
+  static constexpr unsigned kBlockTimeoutMs = 1;   ///< retire partially filled blocks after 1 ms
+  static constexpr int kPollTimeoutMs = 100;       ///< bound for reacting on Stop()
+
+  void Open() {
+    fd_ = socket(AF_PACKET, SOCK_RAW, htons(kSvEtherType));
+    if (fd_ < 0) {
+      throw std::runtime_error("SV subscriber: packet socket failed: " + std::string(strerror(errno)));
+    }
+    int version = TPACKET_V3;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+      Close();
+      throw std::runtime_error("SV subscriber: TPACKET_V3 not supported");
+    }
+    tpacket_req3 req{};
+    req.tp_block_size = kBlockSize;
+    req.tp_block_nr = kBlockCount;
+    req.tp_frame_size = kFrameSize;
+    req.tp_frame_nr = (kBlockSize / kFrameSize) * kBlockCount;
+    req.tp_retire_blk_tov = kBlockTimeoutMs;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+      Close();
+      throw std::runtime_error("SV subscriber: PACKET_RX_RING failed: " + std::string(strerror(errno)));
+    }
+    void* ring = mmap(nullptr, ring_size(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd_, 0);
+    if (ring == MAP_FAILED) {
+      ring = mmap(nullptr, ring_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (ring == MAP_FAILED) {
+      Close();
+      throw std::runtime_error("SV subscriber: ring mmap failed");
+    }
+    ring_ = static_cast<uint8_t*>(ring);
+
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(kSvEtherType);
+    addr.sll_ifindex = static_cast<int>(if_nametoindex(interface_name_.c_str()));
+    if (addr.sll_ifindex == 0 || bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      Close();
+      throw std::runtime_error("SV subscriber: cannot bind to interface " + interface_name_);
+    }
+  }
+
+  void Close() {
+    if (ring_) {
+      GetStatistics();
+      munmap(ring_, ring_size());
+      ring_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  template <class Handler, class Idle>
+  void StartXdp(Handler& handler, Idle& idle) {
+    SvFrame frame;
+    SvCapture capture{nullptr, 0, {}};
+    bool stamped = false;
+    while (run_.load(std::memory_order_relaxed)) {
+      stamped = false;
+      const size_t received = xdp_->Receive(
+         [&](const uint8_t* data, size_t size) {
+           if (!stamped) {
+             clock_gettime(CLOCK_REALTIME, &capture.ts);
+             stamped = true;
+           }
+           capture.data = data;
+           capture.size = size;
+           ++stats_.frames;
+           if (SvDecode(data, size, frame)) {
+             handler(capture, frame);
+           } else {
+             ++stats_.frames_invalid;
+           }
+         },
+         kPollTimeoutMs);
+      if (received == 0) {
+        idle();
+      }
+    }
+    GetStatistics();
+  }
+
+  static constexpr size_t ring_size() { return static_cast<size_t>(kBlockSize) * kBlockCount; }
+
+  std::string interface_name_;
+  int fd_{-1};
+  uint8_t* ring_{nullptr};
+  std::atomic<bool> run_{true};
+  Statistics stats_;
+  std::unique_ptr<XdpSocket> xdp_;
+  std::string backend_{"PACKET_MMAP"};
+};
@@ -0,0 +1,333 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   per task activation statistics with optional perf_event_open counters
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <alloc_tracker.hpp>
+#include <cycle_clock.hpp>
+#include <latency_histogram.hpp>
+#include <metrics.hpp>
+#include <stats_page.hpp>
+#include <trace_events.hpp>
+#include <usdt.hpp>
+
+/**
+ * @brief counters read around task activations
+ */
+enum class TaskCounter : uint8_t {
+  kCycles,
+  kInstructions,
+  kCacheMisses,
+  kContextSwitches,
+  kCpuMigrations,
+  kPageFaults,
+  kCount,
+};
+
+constexpr size_t kTaskCounters = static_cast<size_t>(TaskCounter::kCount);
+
+/**
+ * @brief counter group of the calling thread
+ * @desc All counters that could be opened form one perf event group, so a read is one syscall. Counters which the
+ *       kernel or the hardware does not provide (no PMU in a VM, perf_event_paranoid) are left out and reported
+ *       as not available.
+ */
+class PerfCounters {
+ public:
+  PerfCounters() {
+    static constexpr std::pair<uint32_t, uint64_t> kEvents[kTaskCounters] = {
+       {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+       {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},   {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+       {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS}, {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    };
+    for (size_t i = 0; i < kTaskCounters; ++i) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = kEvents[i].first;
+      attr.config = kEvents[i].second;
+      // context switches and migrations happen in the kernel, hardware counters count user space only; software
+      // counters are not retried with exclude_kernel under perf_event_paranoid > 1, they would stay at 0
+      attr.exclude_kernel = kEvents[i].first == PERF_TYPE_SOFTWARE ? 0 : 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = leader_ < 0 ? 1 : 0;
+      const int counter_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+      if (counter_fd < 0) {
+        continue;
+      }
+      if (leader_ < 0) {
+        leader_ = counter_fd;
+      }
+      fds_.push_back(counter_fd);
+      slot_[fds_.size() - 1] = i;
+      available_[i] = true;
+    }
+    if (leader_ >= 0) {
+      ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+  ~PerfCounters() {
+    for (int fd : fds_) {
+      close(fd);
+    }
+  }
+
+  /**
+   * @brief read all counters, values of unavailable counters are 0
+   * @return false if no counter is available
+   */
+  bool Read(uint64_t (&values)[kTaskCounters]) const {
+    std::memset(values, 0, sizeof(values));
+    if (leader_ < 0) {
+      return false;
+    }
+    uint64_t buffer[1 + kTaskCounters];
+    if (read(leader_, buffer, sizeof(buffer)) < static_cast<ssize_t>(sizeof(uint64_t))) {
+      return false;
+    }
+    for (size_t i = 0; i < buffer[0] && i < fds_.size(); ++i) {
+      values[slot_[i]] = buffer[1 + i];
+    }
+    return true;
+  }
+
+  bool Available(TaskCounter counter) const { return available_[static_cast<size_t>(counter)]; }
+
+ private:
+  int leader_{-1};
+  std::vector<int> fds_;
+  size_t slot_[kTaskCounters]{};
+  bool available_[kTaskCounters]{};
+};
+
+/**
+ * @brief statistics of one task, updated by the task thread at the end of every activation
+ */
+class TaskStats {
+ public:
+  explicit TaskStats(std::string name)
+      : name_(std::move(name)),
+        metric_(Metrics().Histogram("bbx15_task_activation_seconds", "Duration of task activations",
+                                    "task=\"" + name_ + "\"")) {
+    Registry().Add(this);
+  }
+  TaskStats(const TaskStats&) = delete;
+  TaskStats& operator=(const TaskStats&) = delete;
+  ~TaskStats() { Registry().Remove(this); }
+
+  /**
+   * @brief counters are opened per thread, switch them on before the tasks start
+   */
+  static void EnableCounters(bool enable) { counters_enabled_ = enable; }
+  static bool CountersEnabled() { return counters_enabled_; }
+
+  const std::string& Name() const { return name_; }
+
+  void Add(int64_t duration_ns, const uint64_t (&delta)[kTaskCounters], const bool (&available)[kTaskCounters],
+           uint64_t allocations = 0) {
+    metric_.Observe(duration_ns);
+    StatsPage::Observe(page_slot_, duration_ns);
+    std::lock_guard lock(mutex_);
+    ++activations_;
+    duration_.Add(duration_ns);
+    allocations_ += allocations;
+    max_allocations_ = std::max(max_allocations_, allocations);
+    for (size_t i = 0; i < kTaskCounters; ++i) {
+      counters_[i] += delta[i];
+      available_[i] = available_[i] || available[i];
+    }
+  }
+
+  /**
+   * @brief print the statistics, nothing for a task that was never activated
+   */
+  void Print(std::FILE* out = stdout) const {
+    std::lock_guard lock(mutex_);
+    if (activations_ == 0) {
+      return;
+    }
+    std::fprintf(out, "task %s: activations=%llu\n", name_.c_str(), static_cast<unsigned long long>(activations_));
+    duration_.Print(" activation time", out);
+    if (AllocTracker::kEnabled) {
+      std::fprintf(out, " heap allocations: per activation mean=%.2f max=%llu, total=%llu\n",
+                   static_cast<double>(allocations_) / static_cast<double>(activations_),
+                   static_cast<unsigned long long>(max_allocations_), static_cast<unsigned long long>(allocations_));
+    }
+    if (!counters_enabled_) {
+      return;
+    }
+    static constexpr const char* kNames[kTaskCounters] = {"cycles",           "instructions",   "cache-misses",
+                                                          "context-switches", "cpu-migrations", "page-faults"};
+    std::fprintf(out, " ");
+    for (size_t i = 0; i < kTaskCounters; ++i) {
+      if (available_[i]) {
+        std::fprintf(out, " %s=%llu", kNames[i], static_cast<unsigned long long>(counters_[i]));
+      } else {
+        std::fprintf(out, " %s=n/a", kNames[i]);
+      }
+    }
+    const auto cycles = counters_[static_cast<size_t>(TaskCounter::kCycles)];
+    const auto instructions = counters_[static_cast<size_t>(TaskCounter::kInstructions)];
+    const auto misses = counters_[static_cast<size_t>(TaskCounter::kCacheMisses)];
+    if (cycles && instructions) {
+      std::fprintf(out, " IPC=%.2f", static_cast<double>(instructions) / static_cast<double>(cycles));
+    }
+    if (instructions && available_[static_cast<size_t>(TaskCounter::kCacheMisses)]) {
+      std::fprintf(out, " misses/kinstr=%.2f",
+                   1000.0 * static_cast<double>(misses) / static_cast<double>(instructions));
+    }
+    std::fprintf(out, "\n");
+  }
+
+  /**
+   * @brief print all live tasks
+   */
+  static void PrintAll(std::FILE* out = stdout) { Registry().Print(out); }
+
+  /**
+   * @brief publish the activation times of all tasks in the stats page, before the tasks start
+   */
+  static void AttachStatsPage(StatsPage& page) { Registry().Attach(page); }
+
+ private:
+  class List {
+   public:
+    void Add(TaskStats* stats) {
+      std::lock_guard lock(mutex_);
+      tasks_.push_back(stats);
+    }
+    void Remove(TaskStats* stats) {
+      std::lock_guard lock(mutex_);
+      std::erase(tasks_, stats);
+    }
+    void Print(std::FILE* out) {
+      std::lock_guard lock(mutex_);
+      for (const auto* stats : tasks_) {
+        stats->Print(out);
+      }
+    }
+    void Attach(StatsPage& page) {
+      std::lock_guard lock(mutex_);
+      for (auto* stats : tasks_) {
+        stats->page_slot_ = page.Allocate("task " + stats->name_, StatsSlotKind::kHistogram);
+      }
+    }
+
+   private:
+    std::mutex mutex_;
+    std::vector<TaskStats*> tasks_;
+  };
+
+  static List& Registry() {
+    static List list;
+    return list;
+  }
+
+  static inline bool counters_enabled_{false};
+  std::string name_;
+  MetricHistogram& metric_;   ///< activation times for the metrics endpoint
+  StatsPageSlot* page_slot_{nullptr};   ///< activation times in the stats page, written by the task thread
+  mutable std::mutex mutex_;
+  uint64_t activations_{0};
+  uint64_t allocations_{0};       ///< heap allocations inside the activations, with the allocation tracker
+  uint64_t max_allocations_{0};
+  LatencyHistogram duration_;
+  uint64_t counters_[kTaskCounters]{};
+  bool available_[kTaskCounters]{};
+};
+
+/**
+ * @brief scope of one task activation
+ * @desc Counters are read at the start and the end of the scope (one read() each) and the differences are added to
+ *       the task statistics; without counters only the duration is measured with the cycle clock.
+ * @code
+ *   static thread_local PerfCounters counters;   // opened once per thread
+ *   TaskActivation activation(stats, &counters);
+ * @endcode
+ */
+class TaskActivation {
+ public:
+  /**
+   * @brief start of the activation
+   * @param stats - statistics of the task
+   * @param counters - counter group of the calling thread, nullptr - duration only
+   */
+  TaskActivation(TaskStats& stats, const PerfCounters* counters) : stats_(stats), counters_(counters) {
+    if (counters_) {
+      counters_->Read(begin_);
+    }
+    allocations_ = AllocTracker::Thread().allocations;
+    start_ = CycleClock::Ticks();
+  }
+
+  ~TaskActivation() {
+    const uint64_t end_ticks = CycleClock::Ticks();
+    uint64_t delta[kTaskCounters]{};
+    bool available[kTaskCounters]{};
+    if (counters_ && counters_->Read(delta)) {
+      for (size_t i = 0; i < kTaskCounters; ++i) {
+        delta[i] -= begin_[i];
+        available[i] = counters_->Available(static_cast<TaskCounter>(i));
+      }
+    }
+    const int64_t duration_ns = CycleClock::TicksToNs(static_cast<int64_t>(end_ticks - start_));
+    BBX15_PROBE2(task_done, stats_.Name().c_str(), duration_ns);
+    if (Tracer::Enabled()) {
+      Tracer::Span(stats_.Name().c_str(), start_, end_ticks);
+    }
+    stats_.Add(duration_ns, delta, available, AllocTracker::Thread().allocations - allocations_);
+  }
+
+  TaskActivation(const TaskActivation&) = delete;
+  TaskActivation& operator=(const TaskActivation&) = delete;
+
+ private:
+  TaskStats& stats_;
+  const PerfCounters* counters_;
+  uint64_t begin_[kTaskCounters]{};
+  uint64_t allocations_{0};
+  uint64_t start_{0};
+};
+
+/**
+ * @brief counter group of the calling thread if counters are enabled, otherwise nullptr
+ */
+inline const PerfCounters* ThreadPerfCounters() {
+  if (!TaskStats::CountersEnabled()) {
+    return nullptr;
+  }
+  static thread_local PerfCounters counters;
+  return &counters;
+}
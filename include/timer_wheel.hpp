@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   hashed timer wheel for many periodic timers served by one thread
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief timer wheel with Slots slots, timers are identified by a dense index
+ * @desc Every timer is an intrusive list node in the slot of its due tick (modulo Slots), so scheduling and
+ *       cancelling are O(1) and a tick only visits the timers hashed into its slot. Timers further away than one
+ *       revolution stay in their slot until their tick comes round. Not thread safe.
+ * @tparam Slots - number of slots, one revolution
+ */
+template <size_t Slots = 1024>
+class TimerWheel {
+ public:
+  static constexpr uint64_t kIdle = UINT64_MAX;
+
+  /**
+   * @brief make room for timers [0, count)
+   */
+  void Reserve(size_t count) {
+    if (count > nodes_.size()) {
+      nodes_.resize(count);
+    }
+  }
+
+  /**
+   * @brief (re)arm a timer
+   * @param id - timer index
+   * @param due - absolute tick, a tick not later than Now() fires on the next Advance()
+   */
+  void Schedule(size_t id, uint64_t due) {
+    Cancel(id);
+    if (due <= now_) {
+      due = now_ + 1;
+    }
+    auto& node = nodes_[id];
+    const size_t slot = due % Slots;
+    node.due = due;
+    node.prev = kNone;
+    node.next = heads_[slot];
+    if (node.next != kNone) {
+      nodes_[node.next].prev = static_cast<uint32_t>(id);
+    }
+    heads_[slot] = static_cast<uint32_t>(id);
+    ++armed_;
+  }
+
+  void Cancel(size_t id) {
+    auto& node = nodes_[id];
+    if (node.due == kIdle) {
+      return;
+    }
+    if (node.prev != kNone) {
+      nodes_[node.prev].next = node.next;
+    } else {
+      heads_[node.due % Slots] = node.next;
+    }
+    if (node.next != kNone) {
+      nodes_[node.next].prev = node.prev;
+    }
+    node.due = kIdle;
+    --armed_;
+  }
+
+  /**
+   * @brief fire all timers due up to and including tick now
+   * @param fire - callable as fire(size_t id), may re-arm the timer
+   */
+  template <class Fire>
+  void Advance(uint64_t now, Fire&& fire) {
+    while (now_ < now) {
+      ++now_;
+      uint32_t id = heads_[now_ % Slots];
+      while (id != kNone) {
+        auto& node = nodes_[id];
+        const uint32_t next = node.next;
+        if (node.due == now_) {
+          Cancel(id);
+          fire(static_cast<size_t>(id));
+        }
+        id = next;
+      }
+      if (armed_ == 0) {
+        now_ = now;   // nothing to visit on the remaining ticks
+      }
+    }
+  }
+
+  /**
+   * @brief earliest tick with a timer in its slot, at most one revolution ahead; kIdle if no timer is armed
+   */
+  uint64_t NextDue() const {
+    if (armed_ == 0) {
+      return kIdle;
+    }
+    for (uint64_t tick = now_ + 1; tick <= now_ + Slots; ++tick) {
+      if (heads_[tick % Slots] != kNone) {
+        return tick;
+      }
+    }
+    return now_ + Slots;
+  }
+
+  uint64_t Now() const { return now_; }
+
+  /**
+   * @brief set the current tick without firing, used once before the first Advance()
+   */
+  void SetNow(uint64_t now) { now_ = now; }
+
+ private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  struct Node {
+    uint64_t due{kIdle};
+    uint32_t prev{kNone};
+    uint32_t next{kNone};
+  };
+
+  std::array<uint32_t, Slots> heads_ = MakeHeads();
+  std::vector<Node> nodes_;
+  uint64_t now_{0};
+  size_t armed_{0};
+
+  static constexpr std::array<uint32_t, Slots> MakeHeads() {
+    std::array<uint32_t, Slots> heads{};
+    heads.fill(kNone);
+    return heads;
+  }
+};
@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   span and counter trace events in per-thread buffers, exported as Chrome trace JSON
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cycle_clock.hpp>
+
+/**
+ * @brief recorder of trace events
+ * @desc Every thread writes into its own ring of the last kCapacity events, so recording is a few relaxed stores
+ *       without locks or syscalls; a disabled tracer costs one relaxed load per event. Event names must be string
+ *       literals or otherwise outlive the tracer. Buffers stay alive after their thread exits, so the trace can be
+ *       written at shutdown after all tasks are joined or at any time while they run; of the exited threads the
+ *       last kRetainedExited are kept, a new thread takes over the buffer of the thread exited first. The output is
+ *       the Chrome trace event JSON format, which chrome://tracing and ui.perfetto.dev open directly.
+ */
+class Tracer {
+ public:
+  static constexpr size_t kCapacity = 1 << 16;   ///< events kept per thread
+  static constexpr size_t kRetainedExited = 8;   ///< buffers of exited threads kept, older ones are reused
+
+  static void Enable(bool enable) { enabled_.store(enable, std::memory_order_relaxed); }
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief record a complete span [begin, end] in cycle clock ticks
+   */
+  static void Span(const char* name, uint64_t begin, uint64_t end) { Local().Push(Kind::kSpan, name, begin, end); }
+
+  /**
+   * @brief record a counter track value at the current time
+   */
+  static void Counter(const char* name, int64_t value) {
+    if (Enabled()) {
+      Local().Push(Kind::kCounter, name, CycleClock::Ticks(), static_cast<uint64_t>(value));
+    }
+  }
+
+  /**
+   * @brief register the buffer of the calling thread now instead of on its first event
+   */
+  static void RegisterThread() {
+    if (Enabled()) {
+      Local();
+    }
+  }
+
+  /**
+   * @brief write all recorded events as Chrome trace JSON
+   * @return number of events written
+   */
+  static size_t Write(const std::string& path) {
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out) {
+      throw std::runtime_error("Tracer: cannot open " + path);
+    }
+    const size_t events = Registry().Write(out);
+    std::fclose(out);
+    return events;
+  }
+
+ private:
+  enum class Kind : uint32_t { kSpan, kCounter };
+
+  /**
+   * @brief one event, fields are atomics so that a concurrent Write() reads them without a data race
+   * @desc sequence is the event index + 1 once the fields are complete and 0 while they are written; a reader
+   *       accepts the fields only if it sees the same index before and after reading them (seqlock).
+   */
+  struct Slot {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> begin{0};
+    std::atomic<uint64_t> end{0};   ///< end of a span, value of a counter
+    std::atomic<const char*> name{nullptr};
+    std::atomic<Kind> kind{Kind::kSpan};
+  };
+
+  class Buffer {
+   public:
+    Buffer() : slots_(new Slot[kCapacity]) { Attach(); }
+
+    /**
+     * @brief take the buffer over for the calling thread, the events of the previous one are dropped
+     */
+    void Attach() {
+      tid_ = static_cast<int>(syscall(SYS_gettid));
+      char name[16] = {};
+      pthread_getname_np(pthread_self(), name, sizeof(name));
+      name_ = name;
+      first_ = head_.load(std::memory_order_relaxed);
+      exited_ = 0;
+    }
+
+    void Push(Kind kind, const char* name, uint64_t begin, uint64_t end) {
+      const uint64_t head = head_.load(std::memory_order_relaxed);
+      Slot& slot = slots_[head % kCapacity];
+      slot.sequence.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);   // the reset is seen before any field of the new event
+      slot.begin.store(begin, std::memory_order_relaxed);
+      slot.end.store(end, std::memory_order_relaxed);
+      slot.name.store(name, std::memory_order_relaxed);
+      slot.kind.store(kind, std::memory_order_relaxed);
+      slot.sequence.store(head + 1, std::memory_order_release);
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief write the events of this thread, events overwritten while reading are dropped
+     */
+    size_t Write(std::FILE* out, bool& first) const {
+      std::fprintf(out, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                   first ? "" : ",", getpid(), tid_, name_.c_str());
+      first = false;
+      const uint64_t head = head_.load(std::memory_order_acquire);
+      const uint64_t tail = std::max(head > kCapacity ? head - kCapacity : 0, first_);
+      size_t written = 0;
+      for (uint64_t i = tail; i < head; ++i) {
+        const Slot& slot = slots_[i % kCapacity];
+        const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const uint64_t begin = slot.begin.load(std::memory_order_relaxed);
+        const uint64_t end = slot.end.load(std::memory_order_relaxed);
+        const char* name = slot.name.load(std::memory_order_relaxed);
+        const Kind kind = slot.kind.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence != i + 1 || slot.sequence.load(std::memory_order_relaxed) != i + 1 || !name) {
+          continue;   // being overwritten or overwritten by the writer meanwhile
+        }
+        const double ts = static_cast<double>(CycleClock::ToNs(begin)) / 1000.0;
+        if (kind == Kind::kSpan) {
+          const double dur = static_cast<double>(CycleClock::TicksToNs(static_cast<int64_t>(end - begin))) / 1000.0;
+          std::fprintf(out, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", name,
+                       getpid(), tid_, ts, dur);
+        } else {
+          std::fprintf(out,
+                       ",\n{\"ph\":\"C\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                       name, getpid(), tid_, ts, static_cast<long long>(end));
+        }
+        ++written;
+      }
+      return written;
+    }
+
+    uint64_t exited_{0};   ///< exit order of the owner thread, 0 while it runs; guarded by the list
+
+   private:
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> head_{0};
+    uint64_t first_{0};   ///< first event of the owner thread
+    int tid_{0};
+    std::string name_;
+  };
+
+  class List {
+   public:
+    /**
+     * @brief buffer for the calling thread: a new one, or that of the thread exited first if kRetainedExited
+     *        buffers of exited threads are kept already
+     */
+    Buffer* Add() {
+      std::lock_guard lock(mutex_);
+      Buffer* oldest = nullptr;
+      size_t exited = 0;
+      for (const auto& buffer : buffers_) {
+        if (buffer->exited_) {
+          ++exited;
+          oldest = !oldest || buffer->exited_ < oldest->exited_ ? buffer.get() : oldest;
+        }
+      }
+      if (exited >= kRetainedExited) {
+        oldest->Attach();
+        return oldest;
+      }
+      buffers_.push_back(std::make_unique<Buffer>());
+      return buffers_.back().get();
+    }
+
+    void Exit(Buffer* buffer) {
+      std::lock_guard lock(mutex_);
+      buffer->exited_ = ++exits_;
+    }
+
+    size_t Write(std::FILE* out) {
+      std::lock_guard lock(mutex_);
+      std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+      bool first = true;
+      size_t events = 0;
+      for (const auto& buffer : buffers_) {
+        events += buffer->Write(out, first);
+      }
+      std::fprintf(out, "\n]}\n");
+      return events;
+    }
+
+   private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+    uint64_t exits_{0};
+  };
+
+  static List& Registry() {
+    static List list;
+    return list;
+  }
+
+  /**
+   * @brief buffer of the calling thread, kept with its events when the thread exits
+   */
+  struct Owner {
+    Buffer* buffer;
+    ~Owner() { Registry().Exit(buffer); }
+  };
+
+  /**
+   * @brief buffer of the calling thread, registered on its first event
+   */
+  static Buffer& Local() {
+    static thread_local Owner owner{Registry().Add()};
+    return *owner.buffer;
+  }
+
+  static inline std::atomic<bool> enabled_{false};
+};
+
+/**
+ * @brief span of the enclosing scope, recorded only if the tracer was enabled at its start
+ */
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name) : name_(name), begin_(Tracer::Enabled() ? CycleClock::Ticks() : 0) {}
+  ~TraceSpan() {
+    if (begin_) {
+      Tracer::Span(name_, begin_, CycleClock::Ticks());
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  const char* name_;
+  uint64_t begin_;
+};
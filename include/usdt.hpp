@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   USDT static tracepoints (SystemTap sys/sdt.h note format) of provider bbx15
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+*
+* A probe is a single nop in the code plus an entry in the .note.stapsdt section naming the probe and describing
+* where its arguments are. perf, bpftrace and SystemTap read the notes and patch the nop when attaching, e.g.
+*   bpftrace -e 'usdt:./test_bbx15:bbx15:dispatch_begin { @[arg0] = count(); }'
+*   perf buildid-cache --add ./test_bbx15 && perf record -e sdt_bbx15:task_wakeup ...
+* If <sys/sdt.h> is available it is used, otherwise the note is emitted here. Define BBX15_NO_USDT to compile all
+* probes away.
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <type_traits>
+
+#if defined(BBX15_NO_USDT)
+
+#define BBX15_PROBE(name) \
+  do {                    \
+  } while (0)
+#define BBX15_PROBE1(name, a1) BBX15_PROBE(name)
+#define BBX15_PROBE2(name, a1, a2) BBX15_PROBE(name)
+#define BBX15_PROBE3(name, a1, a2, a3) BBX15_PROBE(name)
+
+#elif __has_include(<sys/sdt.h>)
+
+#include <sys/sdt.h>
+#define BBX15_PROBE(name) DTRACE_PROBE(bbx15, name)
+#define BBX15_PROBE1(name, a1) DTRACE_PROBE1(bbx15, name, a1)
+#define BBX15_PROBE2(name, a1, a2) DTRACE_PROBE2(bbx15, name, a1, a2)
+#define BBX15_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(bbx15, name, a1, a2, a3)
+
+#else
+
+namespace usdt_detail {
+/**
+ * @brief argument size for the note: negative for signed types, pointers as unsigned
+ */
+template <class T>
+constexpr int ArgSize() {
+  using U = std::decay_t<T>;
+  return std::is_signed_v<U> && !std::is_pointer_v<U> ? -static_cast<int>(sizeof(U)) : static_cast<int>(sizeof(U));
+}
+}   // namespace usdt_detail
+
+#if defined(__LP64__)
+#define BBX15_USDT_ADDR ".8byte"
+#else
+#define BBX15_USDT_ADDR ".4byte"
+#endif
+
+#if !defined(__LP64__)
+// memory only: a 64-bit argument in a register pair (e.g. r2:r3 on ARM32) cannot be described, the note would name
+// the first register with size 8
+#define BBX15_USDT_ARG "m"
+#elif defined(__x86_64__)
+#define BBX15_USDT_ARG "nor"   // immediate, memory or register as sys/sdt.h does
+#else
+#define BBX15_USDT_ARG "r"   // registers only, the operand syntax of immediates differs between assemblers
+#endif
+
+#define BBX15_USDT_NOTE(name, args)                                                         \
+  "990: nop\n"                                                                              \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                             \
+  ".balign 4\n"                                                                             \
+  ".4byte 992f-991f, 994f-993f, 3\n"                                                        \
+  "991: .asciz \"stapsdt\"\n"                                                               \
+  "992: .balign 4\n"                                                                        \
+  "993: " BBX15_USDT_ADDR " 990b\n"                                                         \
+  BBX15_USDT_ADDR " _.stapsdt.base\n"                                                       \
+  BBX15_USDT_ADDR " 0\n"                                                                    \
+  ".asciz \"bbx15\"\n"                                                                      \
+  ".asciz \"" #name "\"\n"                                                                  \
+  ".asciz \"" args "\"\n"                                                                   \
+  "994: .balign 4\n"                                                                        \
+  ".popsection\n"                                                                           \
+  ".ifndef _.stapsdt.base\n"                                                                \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"                   \
+  ".weak _.stapsdt.base\n"                                                                  \
+  ".hidden _.stapsdt.base\n"                                                                \
+  "_.stapsdt.base: .space 1\n"                                                              \
+  ".size _.stapsdt.base, 1\n"                                                               \
+  ".popsection\n"                                                                           \
+  ".endif\n"
+
+// the arguments are copied first: a memory operand needs an lvalue, the copies cost nothing with registers
+#define BBX15_USDT_COPY(n, value) const auto bbx15_usdt_a##n = (value)
+#define BBX15_USDT_IN(n) \
+  [s##n] "i"(usdt_detail::ArgSize<decltype(bbx15_usdt_a##n)>()), [a##n] BBX15_USDT_ARG(bbx15_usdt_a##n)
+
+#define BBX15_PROBE(name) __asm__ __volatile__(BBX15_USDT_NOTE(name, ""))
+#define BBX15_PROBE1(name, x1)                                                      \
+  do {                                                                              \
+    BBX15_USDT_COPY(1, x1);                                                         \
+    __asm__ __volatile__(BBX15_USDT_NOTE(name, "%c[s1]@%[a1]")::BBX15_USDT_IN(1));  \
+  } while (0)
+#define BBX15_PROBE2(name, x1, x2)                                                                          \
+  do {                                                                                                      \
+    BBX15_USDT_COPY(1, x1);                                                                                 \
+    BBX15_USDT_COPY(2, x2);                                                                                 \
+    __asm__ __volatile__(BBX15_USDT_NOTE(name, "%c[s1]@%[a1] %c[s2]@%[a2]")::BBX15_USDT_IN(1), BBX15_USDT_IN(2)); \
+  } while (0)
+#define BBX15_PROBE3(name, x1, x2, x3)                                                                      \
+  do {                                                                                                      \
+    BBX15_USDT_COPY(1, x1);                                                                                 \
+    BBX15_USDT_COPY(2, x2);                                                                                 \
+    BBX15_USDT_COPY(3, x3);                                                                                 \
+    __asm__ __volatile__(BBX15_USDT_NOTE(name, "%c[s1]@%[a1] %c[s2]@%[a2] %c[s3]@%[a3]")::BBX15_USDT_IN(1), \
+                         BBX15_USDT_IN(2), BBX15_USDT_IN(3));                                               \
+  } while (0)
+
+#endif
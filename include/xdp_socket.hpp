@@ -0,0 +1,452 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   AF_XDP socket for SV frames: UMEM frame pool, fill/completion rings and the XDP redirect program
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <sv.hpp>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/**
+ * @brief settings of an AF_XDP socket
+ */
+struct XdpOptions {
+  bool native{false};      ///< XDP in the driver, false - generic XDP (any interface, e.g. veth)
+  bool zero_copy{false};   ///< try zero-copy UMEM, falls back to copy mode if the driver cannot
+  int busy_poll_us{0};     ///< SO_BUSY_POLL and SO_PREFER_BUSY_POLL, spin instead of poll(); 0 - off
+  uint32_t queue{0};       ///< receive and transmit queue of the interface
+};
+
+namespace xdp_detail {
+
+inline long Bpf(int command, bpf_attr& attr) {
+  return syscall(__NR_bpf, command, &attr, sizeof(attr));
+}
+
+constexpr bpf_insn Insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+  bpf_insn insn{};
+  insn.code = code;
+  insn.dst_reg = dst & 0xf;
+  insn.src_reg = src & 0xf;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+/**
+ * @brief ring shared with the kernel, producer and consumer indices run freely and are masked on access
+ */
+struct Ring {
+  uint32_t* producer{nullptr};
+  uint32_t* consumer{nullptr};
+  uint32_t* flags{nullptr};
+  uint8_t* descs{nullptr};
+  uint32_t mask{0};
+  void* map{MAP_FAILED};
+  size_t map_size{0};
+
+  uint32_t Load(uint32_t* index) const { return std::atomic_ref<uint32_t>(*index).load(std::memory_order_acquire); }
+  void Store(uint32_t* index, uint32_t value) const {
+    std::atomic_ref<uint32_t>(*index).store(value, std::memory_order_release);
+  }
+  bool NeedWakeup() const { return std::atomic_ref<uint32_t>(*flags).load() & XDP_RING_NEED_WAKEUP; }
+  uint64_t& Address(uint32_t index) const { return reinterpret_cast<uint64_t*>(descs)[index & mask]; }
+  xdp_desc& Desc(uint32_t index) const { return reinterpret_cast<xdp_desc*>(descs)[index & mask]; }
+};
+
+}   // namespace xdp_detail
+
+/**
+ * @brief AF_XDP socket on one queue of an interface, for the SV publisher and subscriber
+ * @desc The UMEM is one mapped area of kFrames frames of kFrameSize bytes, the first half receives, the second
+ *       transmits. Received frames are read in place from the RX ring and handed back to the fill ring in batches;
+ *       transmitted frames are copied into a free UMEM frame, queued on the TX ring and reclaimed from the
+ *       completion ring. A receiving socket loads a small XDP program, built here without libbpf, that redirects
+ *       frames of ethertype 0x88BA (also VLAN tagged) to the socket and passes everything else to the stack; it is
+ *       attached through a BPF link and detached when the socket closes. Generic XDP works on any interface, native
+ *       XDP and zero-copy need driver support. The kernel wakes up the socket only when a ring asks for it
+ *       (XDP_USE_NEED_WAKEUP); with busy polling the receiving thread spins in recvfrom() instead of poll().
+ * @throw std::runtime_error from the constructor if AF_XDP or the program is not available
+ */
+class XdpSocket {
+ public:
+  static constexpr uint32_t kFrames = 4096;
+  static constexpr uint32_t kFrameSize = 2048;
+  static constexpr uint32_t kRingSize = 2048;   ///< entries of each ring
+  static constexpr uint32_t kMaxQueues = 64;    ///< entries of the socket map of the program
+
+  struct Statistics {
+    uint64_t rx_dropped{0};        ///< frames the kernel dropped for this socket
+    uint64_t rx_ring_full{0};      ///< frames dropped on a full RX ring
+    uint64_t fill_ring_empty{0};   ///< frames dropped without a free fill ring entry
+    uint64_t tx_full{0};           ///< Send() without a free frame or TX entry
+  };
+
+  /**
+   * @param interface_name - network interface
+   * @param options - XDP mode, zero-copy, busy polling and queue
+   * @param receive - load the redirect program and fill the fill ring; false - transmit only
+   */
+  XdpSocket(const std::string& interface_name, const XdpOptions& options, bool receive)
+      : interface_name_(interface_name), options_(options) {
+    try {
+      Open(receive);
+    } catch (...) {
+      Close();
+      throw;
+    }
+  }
+
+  XdpSocket(const XdpSocket&) = delete;
+  XdpSocket& operator=(const XdpSocket&) = delete;
+  ~XdpSocket() { Close(); }
+
+  /**
+   * @brief hand the received frames to the handler, wait up to timeout_ms (busy polling: spin once) if there are none
+   * @param handler - callable as handler(const uint8_t* data, size_t size), the data is valid during the call
+   * @return frames handled
+   */
+  template <class Handler>
+  size_t Receive(Handler&& handler, int timeout_ms) {
+    uint32_t available = rx_.Load(rx_.producer) - rx_consumer_;
+    if (!available) {
+      if (options_.busy_poll_us || fill_.NeedWakeup()) {
+        recvfrom(fd_, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+      }
+      if (!options_.busy_poll_us) {
+        pollfd pfd{fd_, POLLIN, 0};
+        poll(&pfd, 1, timeout_ms);
+      }
+      available = rx_.Load(rx_.producer) - rx_consumer_;
+      if (!available) {
+        return 0;
+      }
+    }
+    for (uint32_t i = 0; i < available; ++i) {
+      const xdp_desc& desc = rx_.Desc(rx_consumer_ + i);
+      handler(static_cast<const uint8_t*>(umem_) + desc.addr, static_cast<size_t>(desc.len));
+      // the frame goes back to the kernel, the fill ring always has room for the frames taken from the RX ring
+      fill_.Address(fill_producer_++) = desc.addr & ~static_cast<uint64_t>(kFrameSize - 1);
+    }
+    rx_consumer_ += available;
+    rx_.Store(rx_.consumer, rx_consumer_);
+    fill_.Store(fill_.producer, fill_producer_);
+    return available;
+  }
+
+  /**
+   * @brief queue a frame on the TX ring, sent by Flush()
+   * @return false if no UMEM frame or TX entry is free, the frame is dropped
+   */
+  bool Send(const uint8_t* data, size_t size) {
+    if (!free_count_) {
+      Reclaim();
+    }
+    if (!free_count_ || size > kFrameSize || tx_producer_ - tx_.Load(tx_.consumer) >= kRingSize) {
+      ++stats_.tx_full;
+      return false;
+    }
+    const uint64_t address = free_[--free_count_];
+    std::memcpy(static_cast<uint8_t*>(umem_) + address, data, size);
+    xdp_desc& desc = tx_.Desc(tx_producer_++);
+    desc.addr = address;
+    desc.len = static_cast<uint32_t>(size);
+    desc.options = 0;
+    return true;
+  }
+
+  /**
+   * @brief publish the queued frames to the kernel and wake it up if it asks for it
+   */
+  void Flush() {
+    tx_.Store(tx_.producer, tx_producer_);
+    if (tx_.NeedWakeup()) {
+      sendto(fd_, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    }
+    Reclaim();
+  }
+
+  Statistics GetStatistics() const {
+    Statistics stats = stats_;
+    xdp_statistics kstats{};
+    socklen_t length = sizeof(kstats);
+    if (getsockopt(fd_, SOL_XDP, XDP_STATISTICS, &kstats, &length) == 0) {
+      stats.rx_dropped = kstats.rx_dropped;
+      stats.rx_ring_full = kstats.rx_ring_full;
+      stats.fill_ring_empty = kstats.rx_fill_ring_empty_descs;
+    }
+    return stats;
+  }
+
+  /**
+   * @brief e.g. "AF_XDP generic copy busy-poll"
+   */
+  const std::string& Mode() const { return mode_; }
+
+ private:
+  /**
+   * @brief take the transmitted frames from the completion ring back into the free list
+   */
+  void Reclaim() {
+    const uint32_t producer = completion_.Load(completion_.producer);
+    for (; completion_consumer_ != producer; ++completion_consumer_) {
+      free_[free_count_++] = completion_.Address(completion_consumer_);
+    }
+    completion_.Store(completion_.consumer, completion_consumer_);
+  }
+
+  void MapRing(xdp_detail::Ring& ring, const xdp_ring_offset& offset, size_t desc_size, off_t pgoff) {
+    ring.map_size = offset.desc + kRingSize * desc_size;
+    ring.map = mmap(nullptr, ring.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, pgoff);
+    if (ring.map == MAP_FAILED) {
+      throw std::runtime_error("AF_XDP: ring mmap failed: " + std::string(strerror(errno)));
+    }
+    auto* base = static_cast<uint8_t*>(ring.map);
+    ring.producer = reinterpret_cast<uint32_t*>(base + offset.producer);
+    ring.consumer = reinterpret_cast<uint32_t*>(base + offset.consumer);
+    ring.flags = reinterpret_cast<uint32_t*>(base + offset.flags);
+    ring.descs = base + offset.desc;
+    ring.mask = kRingSize - 1;
+  }
+
+  void SetOption(int level, int name, int value, const char* what) {
+    if (setsockopt(fd_, level, name, &value, sizeof(value)) < 0) {
+      throw std::runtime_error(std::string("AF_XDP: ") + what + ": " + strerror(errno));
+    }
+  }
+
+  void Open(bool receive) {
+    ifindex_ = if_nametoindex(interface_name_.c_str());
+    if (!ifindex_) {
+      throw std::runtime_error("AF_XDP: unknown interface " + interface_name_);
+    }
+    fd_ = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+      throw std::runtime_error("AF_XDP: socket failed: " + std::string(strerror(errno)));
+    }
+
+    umem_size_ = static_cast<size_t>(kFrames) * kFrameSize;
+    umem_ = mmap(nullptr, umem_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (umem_ == MAP_FAILED) {
+      throw std::runtime_error("AF_XDP: UMEM mmap failed");
+    }
+    xdp_umem_reg reg{};
+    reg.addr = reinterpret_cast<uint64_t>(umem_);
+    reg.len = umem_size_;
+    reg.chunk_size = kFrameSize;
+    if (setsockopt(fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+      throw std::runtime_error("AF_XDP: UMEM registration failed: " + std::string(strerror(errno)));
+    }
+    SetOption(SOL_XDP, XDP_UMEM_FILL_RING, kRingSize, "fill ring");
+    SetOption(SOL_XDP, XDP_UMEM_COMPLETION_RING, kRingSize, "completion ring");
+    SetOption(SOL_XDP, XDP_RX_RING, kRingSize, "RX ring");
+    SetOption(SOL_XDP, XDP_TX_RING, kRingSize, "TX ring");
+
+    xdp_mmap_offsets offsets{};
+    socklen_t length = sizeof(offsets);
+    if (getsockopt(fd_, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &length) < 0) {
+      throw std::runtime_error("AF_XDP: ring offsets: " + std::string(strerror(errno)));
+    }
+    MapRing(fill_, offsets.fr, sizeof(uint64_t), static_cast<off_t>(XDP_UMEM_PGOFF_FILL_RING));
+    MapRing(completion_, offsets.cr, sizeof(uint64_t), static_cast<off_t>(XDP_UMEM_PGOFF_COMPLETION_RING));
+    MapRing(rx_, offsets.rx, sizeof(xdp_desc), XDP_PGOFF_RX_RING);
+    MapRing(tx_, offsets.tx, sizeof(xdp_desc), XDP_PGOFF_TX_RING);
+
+    // first half of the UMEM to the fill ring, second half free for transmission
+    fill_producer_ = fill_.Load(fill_.producer);
+    for (uint32_t i = 0; receive && i < kFrames / 2 && i < kRingSize; ++i) {
+      fill_.Address(fill_producer_++) = static_cast<uint64_t>(i) * kFrameSize;
+    }
+    fill_.Store(fill_.producer, fill_producer_);
+    rx_consumer_ = rx_.Load(rx_.consumer);
+    tx_producer_ = tx_.Load(tx_.producer);
+    completion_consumer_ = completion_.Load(completion_.consumer);
+    free_ = std::make_unique<uint64_t[]>(kFrames / 2);
+    for (uint32_t i = kFrames / 2; i < kFrames; ++i) {
+      free_[free_count_++] = static_cast<uint64_t>(i) * kFrameSize;
+    }
+
+    if (options_.busy_poll_us) {
+      SetOption(SOL_SOCKET, SO_PREFER_BUSY_POLL, 1, "SO_PREFER_BUSY_POLL");
+      SetOption(SOL_SOCKET, SO_BUSY_POLL, options_.busy_poll_us, "SO_BUSY_POLL");
+      SetOption(SOL_SOCKET, SO_BUSY_POLL_BUDGET, 64, "SO_BUSY_POLL_BUDGET");
+    }
+
+    sockaddr_xdp addr{};
+    addr.sxdp_family = AF_XDP;
+    addr.sxdp_ifindex = ifindex_;
+    addr.sxdp_queue_id = options_.queue;
+    addr.sxdp_flags = XDP_USE_NEED_WAKEUP | (options_.zero_copy ? XDP_ZEROCOPY : XDP_COPY);
+    int bound = bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    if (bound < 0 && options_.zero_copy) {
+      addr.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;   // the driver has no zero-copy support
+      bound = bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    if (bound < 0) {
+      throw std::runtime_error("AF_XDP: cannot bind to " + interface_name_ + ": " + strerror(errno));
+    }
+    xdp_options active{};
+    length = sizeof(active);
+    const bool zero_copy =
+       getsockopt(fd_, SOL_XDP, XDP_OPTIONS, &active, &length) == 0 && (active.flags & XDP_OPTIONS_ZEROCOPY);
+
+    if (receive) {
+      AttachProgram();
+    }
+    mode_ = std::string("AF_XDP ") + (options_.native ? "native" : "generic") + (zero_copy ? " zero-copy" : " copy") +
+            (options_.busy_poll_us ? " busy-poll" : "");
+  }
+
+  /**
+   * @brief load the redirect program, put the socket into its map and attach it to the interface
+   */
+  void AttachProgram() {
+    using xdp_detail::Insn;
+    bpf_attr attr{};
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = kMaxQueues;
+    map_fd_ = static_cast<int>(xdp_detail::Bpf(BPF_MAP_CREATE, attr));
+    if (map_fd_ < 0) {
+      throw std::runtime_error("AF_XDP: socket map: " + std::string(strerror(errno)));
+    }
+    const uint32_t key = options_.queue;
+    const uint32_t value = static_cast<uint32_t>(fd_);
+    attr = {};
+    attr.map_fd = static_cast<uint32_t>(map_fd_);
+    attr.key = reinterpret_cast<uint64_t>(&key);
+    attr.value = reinterpret_cast<uint64_t>(&value);
+    if (xdp_detail::Bpf(BPF_MAP_UPDATE_ELEM, attr) < 0) {
+      throw std::runtime_error("AF_XDP: socket map update: " + std::string(strerror(errno)));
+    }
+
+    // the ethertype as a native 16 bit load sees it
+    const int32_t sv = htons(kSvEtherType);
+    const int32_t vlan = htons(kVlanEtherType);
+    const bpf_insn program[] = {
+       Insn(BPF_LDX | BPF_W | BPF_MEM, 2, 1, 0, 0),             // r2 = ctx->data
+       Insn(BPF_LDX | BPF_W | BPF_MEM, 3, 1, 4, 0),             // r3 = ctx->data_end
+       Insn(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),           // r4 = r2
+       Insn(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, 18),          // r4 += 18, a VLAN tag and its ethertype
+       Insn(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 11, 0),            // if r4 > r3 goto pass
+       Insn(BPF_LDX | BPF_H | BPF_MEM, 4, 2, 12, 0),            // r4 = ethertype
+       Insn(BPF_JMP | BPF_JEQ | BPF_K, 4, 0, 3, sv),            // if r4 == SV goto redirect
+       Insn(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 8, vlan),          // if r4 != VLAN goto pass
+       Insn(BPF_LDX | BPF_H | BPF_MEM, 4, 2, 16, 0),            // r4 = ethertype behind the tag
+       Insn(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 6, sv),            // if r4 != SV goto pass
+       Insn(BPF_LDX | BPF_W | BPF_MEM, 2, 1, 16, 0),            // redirect: r2 = ctx->rx_queue_index
+       Insn(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd_),   // r1 = map
+       Insn(0, 0, 0, 0, 0),
+       Insn(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),    // r3 = XDP_PASS without a socket on the queue
+       Insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+       Insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+       Insn(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),    // pass: r0 = XDP_PASS
+       Insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    static const char license[] = "Dual MIT/GPL";
+    char log[4096] = "";
+    attr = {};
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+    attr.insns = reinterpret_cast<uint64_t>(program);
+    attr.license = reinterpret_cast<uint64_t>(license);
+    attr.log_level = 1;
+    attr.log_size = sizeof(log);
+    attr.log_buf = reinterpret_cast<uint64_t>(log);
+    program_fd_ = static_cast<int>(xdp_detail::Bpf(BPF_PROG_LOAD, attr));
+    if (program_fd_ < 0) {
+      throw std::runtime_error("AF_XDP: program load: " + std::string(strerror(errno)) + " " + log);
+    }
+    attr = {};
+    attr.link_create.prog_fd = static_cast<uint32_t>(program_fd_);
+    attr.link_create.target_ifindex = ifindex_;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = options_.native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+    link_fd_ = static_cast<int>(xdp_detail::Bpf(BPF_LINK_CREATE, attr));
+    if (link_fd_ < 0) {
+      throw std::runtime_error("AF_XDP: attach to " + interface_name_ + ": " + strerror(errno));
+    }
+  }
+
+  void Close() {
+    for (int* fd : {&link_fd_, &program_fd_, &map_fd_, &fd_}) {
+      if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+      }
+    }
+    for (auto* ring : {&fill_, &completion_, &rx_, &tx_}) {
+      if (ring->map != MAP_FAILED) {
+        munmap(ring->map, ring->map_size);
+        ring->map = MAP_FAILED;
+      }
+    }
+    if (umem_ != MAP_FAILED) {
+      munmap(umem_, umem_size_);
+      umem_ = MAP_FAILED;
+    }
+  }
+
+  std::string interface_name_;
+  XdpOptions options_;
+  std::string mode_;
+  uint32_t ifindex_{0};
+  int fd_{-1};
+  int map_fd_{-1};
+  int program_fd_{-1};
+  int link_fd_{-1};
+  void* umem_{MAP_FAILED};
+  size_t umem_size_{0};
+  xdp_detail::Ring fill_;
+  xdp_detail::Ring completion_;
+  xdp_detail::Ring rx_;
+  xdp_detail::Ring tx_;
+  uint32_t fill_producer_{0};         ///< cached producer and consumer indices, owned by the socket thread
+  uint32_t rx_consumer_{0};
+  uint32_t tx_producer_{0};
+  uint32_t completion_consumer_{0};
+  std::unique_ptr<uint64_t[]> free_;   ///< UMEM addresses of the free transmit frames
+  uint32_t free_count_{0};
+  Statistics stats_;
+};
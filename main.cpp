@@ -17,15 +17,46 @@
 // includes
 //-----------------------------------------------------------------------------
 #include <getopt.h>
+#include <async_log.hpp>
+#include <atomic>
+#include <comtrade.hpp>
 #include <chrono>
 #include <condition_variable>
+#include <config.hpp>
+#include <control_socket.hpp>
+#include <cycle_clock.hpp>
 #include <filesystem>
 #include <fstream>
 #include <fswatch.hpp>
+#include <fswatch_bounded.hpp>
+#include <goose_publisher.hpp>
+#include <goose_subscriber.hpp>
 #include <iostream>
+#include <lock_profiler.hpp>
+#include <memory>
+#include <metrics_server.hpp>
 #include <mutex>
+#include <numbers>
+#include <pcapng_writer.hpp>
+#include <poll.h>
+#include <pthread.h>
+#include <scl_parser.hpp>
+#include <sstream>
+#include <stats_page.hpp>
 #include <string>
+#include <sv_align.hpp>
+#include <sv_analysis.hpp>
+#include <sv_publisher.hpp>
+#include <sv_quality.hpp>
+#include <sv_subscriber.hpp>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <task_stats.hpp>
 #include <thread>
+#include <trace_events.hpp>
+#include <usdt.hpp>
+#include <variant>
 
 using namespace std::chrono_literals;
 
@@ -34,8 +65,47 @@ using namespace std::chrono_literals;
  */
 struct TaskEvent {
  public:
-  std::mutex event_mutex;
-  std::condition_variable event_condition;
+  explicit TaskEvent(const char* name) : event_mutex(name) {}
+
+  ProfiledMutex event_mutex;
+  ProfiledConditionVariable event_condition;
+};
+
+/**
+ * @brief task thread with a stop source of its own, a configuration reload restarts single tasks
+ */
+struct TaskThread {
+  explicit TaskThread(const char* task_name) : name(task_name) {}
+
+  void Start(void (*worker)(std::stop_token)) {
+    stop = std::stop_source();
+    thread = std::thread(worker, stop.get_token());
+  }
+
+  void RequestStop() { stop.request_stop(); }
+
+  void Join() {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  /**
+   * @brief SCHED_FIFO priority 1..99, 0 - SCHED_OTHER
+   * @return 0 or the error number, e.g. EPERM without CAP_SYS_NICE
+   */
+  int SetPriority(int priority) {
+    if (!thread.joinable()) {
+      return 0;
+    }
+    sched_param param{};
+    param.sched_priority = priority;
+    return pthread_setschedparam(thread.native_handle(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+  }
+
+  const char* name;   ///< as in the configuration file and the task statistics
+  std::stop_source stop;
+  std::thread thread;
 };
 
 //-----------------------------------------------------------------------------
@@ -44,12 +114,171 @@ struct TaskEvent {
 /**
  * @brief Events for three asynchronous tasks
  */
-TaskEvent taskEventStopFswatcher;
-TaskEvent taskEventStopTest;
+TaskEvent taskEventStopFswatcher("taskEventStopFswatcher");
+TaskEvent taskEventStopTest("taskEventStopTest");
+std::atomic<uint32_t> taskTestPeriodMs{1000};   ///< test task period without wakeups
+
+/**
+ * @brief all tasks, started and stopped by main and restarted by a configuration reload
+ */
+TaskThread workerTest("test");
+TaskThread workerFswatcher("fswatch");
+TaskThread workerSvSubscriber("sv-subscriber");
+TaskThread workerSvPublisher("sv-publisher");
+TaskThread workerGoosePublisher("goose-publisher");
+TaskThread workerGooseSubscriber("goose-subscriber");
+TaskThread workerMetrics("metrics");
+TaskThread* const allWorkers[] = {&workerTest,        &workerFswatcher,      &workerSvSubscriber,
+                                  &workerSvPublisher, &workerGoosePublisher, &workerGooseSubscriber,
+                                  &workerMetrics};
+
+/**
+ * @brief SV subscriber settings, the subscriber task runs only if an interface is given
+ */
+std::string svInterface;
+uint32_t svSamplesPerSecond{4000};
+uint32_t svNominalFrequency{50};
+double svAnalysisRate{0};   ///< phasor/RMS results per second, 0 - analysis off
+std::string svAlignStreams;  ///< comma separated svIDs to align by smpCnt, empty - alignment off
+uint32_t svAlignSkew{32};    ///< samples a stream may run ahead
+constexpr int64_t kSvAlignTimeoutNs = 10'000'000;
+std::string svCaptureFile;          ///< pcapng capture of received SV frames, empty - no capture
+uint64_t svCaptureRotateBytes{0};   ///< rotate capture files by size, 0 - off
+uint32_t svCaptureRotateSeconds{0}; ///< rotate capture files by capture time, 0 - off
+
+/**
+ * @brief SV publisher settings, the publisher task runs only if an interface is given
+ */
+std::string svPublishInterface;
+std::string svComtradeFiles;   ///< comma separated .cfg files, one stream each; empty - sine wave
+bool svComtradeLoop{false};
+uint32_t svSimulatedStreams{0};   ///< sine wave streams with distinct phase and amplitude, 0 - one stream
+uint32_t svPublishLoops{1};       ///< publisher timing loops, one per core
+uint32_t svLaunchTimeUs{0};       ///< SO_TXTIME hand-off ahead of the deadline, 0 - user-space timing
+std::string svXdpMode;            ///< AF_XDP backend of the SV tasks: generic native zerocopy, empty - off
+uint32_t svBusyPollUs{0};         ///< AF_XDP busy polling, 0 - off
+std::atomic<bool> svReportRequested{false};
+
+/**
+ * @brief GOOSE settings, publisher and subscriber tasks run only if an interface is given
+ */
+std::string goosePublishInterface;
+std::string gooseInterface;
+std::atomic<bool> gooseReportRequested{false};
+ProfiledMutex goosePublisherMutex("goosePublisherMutex");           ///< guards goosePublisher
+GoosePublisher* goosePublisher{nullptr};   ///< set while the publisher task runs, state changes from the console
+bool gooseState{false};
+uint32_t gooseChanges{0};
+
+/**
+ * @brief SCL file of the substation: the control blocks of the IED replace the simulated SV streams and the built-in
+ *        GOOSE control block, the file is reloaded with the configuration when it changes
+ */
+std::string sclFile;   ///< command line, empty - none
+std::string sclIed;
+std::vector<SclSvControl> svSclStreams;
+std::vector<std::string> svExpectedStreams;   ///< registered with the quality monitor of the subscriber
+std::vector<SclGseControl> gooseSclBlocks;
+
+/**
+ * @brief activation statistics of the tasks, perf counters only with --perf-counters
+ */
+TaskStats taskStatsTest("test");
+TaskStats taskStatsFswatch("fswatch");
+TaskStats taskStatsSvSubscriber("sv-subscriber");
+TaskStats taskStatsSvPublisher("sv-publisher");
+TaskStats taskStatsGoosePublisher("goose-publisher");
+TaskStats taskStatsGooseSubscriber("goose-subscriber");
+
+/**
+ * @brief trace event recording, written at shutdown and on demand from the console
+ */
+std::string traceFile;   ///< Chrome trace JSON output, empty - tracing off
+std::atomic<int64_t> taskTestPendingWakeups{0};   ///< WakeUpTasks() calls not yet served by the test task
+
+/**
+ * @brief metrics endpoint, task activation times are registered by the TaskStats objects
+ */
+std::string metricsAddress;   ///< Unix socket path or loopback TCP port, empty - no endpoint
+MetricCounter& metricFsEventsCreated =
+   Metrics().Counter("bbx15_fswatch_events_total", "File system events dispatched", "event=\"created\"");
+MetricCounter& metricFsEventsOpened =
+   Metrics().Counter("bbx15_fswatch_events_total", "File system events dispatched", "event=\"opened\"");
+MetricCounter& metricFsEventsClosed =
+   Metrics().Counter("bbx15_fswatch_events_total", "File system events dispatched", "event=\"closed\"");
+MetricCounter& metricFsEventsModified =
+   Metrics().Counter("bbx15_fswatch_events_total", "File system events dispatched", "event=\"modified\"");
+MetricCounter& metricFsEventsDeleted =
+   Metrics().Counter("bbx15_fswatch_events_total", "File system events dispatched", "event=\"deleted\"");
+MetricCounter& metricTaskWakeups = Metrics().Counter("bbx15_task_wakeups_total", "WakeUpTasks() calls");
+MetricCounter& metricSvFrames = Metrics().Counter("bbx15_sv_frames_total", "SV frames received");
+MetricGauge& metricSvMissing =
+   Metrics().Gauge("bbx15_sv_samples_missing", "SV samples lost, less those that arrived late, all streams");
+MetricCounter& metricSvDuplicates = Metrics().Counter("bbx15_sv_duplicates_total", "SV samples received twice");
+MetricCounter& metricSvReordered =
+   Metrics().Counter("bbx15_sv_reordered_total", "SV samples received after a later one");
+MetricCounter& metricSvOverruns =
+   Metrics().Counter("bbx15_sv_publisher_overruns_total", "SV publisher wake-ups later than one sample period");
+MetricCounter& metricSvSendErrors = Metrics().Counter("bbx15_sv_publisher_send_errors_total", "SV frames not sent");
+MetricCounter& metricGooseFrames = Metrics().Counter("bbx15_goose_frames_total", "GOOSE frames received");
+MetricCounter& metricGooseStateChanges =
+   Metrics().Counter("bbx15_goose_state_changes_total", "GOOSE state changes received");
+MetricCounter& metricGooseExpirations =
+   Metrics().Counter("bbx15_goose_expirations_total", "GOOSE control blocks whose timeAllowedtoLive elapsed");
+
+/**
+ * @brief shared memory stats page, slots are nullptr without --stats-page
+ */
+std::string statsPageName;   ///< page /dev/shm/<name>, empty - no page
+std::unique_ptr<StatsPage> statsPage;
+StatsPageSlot* pageFsEvents{nullptr};
+StatsPageSlot* pageTaskWakeups{nullptr};
+StatsPageSlot* pageSvFrames{nullptr};
+StatsPageSlot* pageGooseFrames{nullptr};
+StatsPageSlot* pageTestPendingWakeups{nullptr};   ///< wakeups found by the test task, written by the test task
+StatsPageSlot* pageTestWakeupLatency{nullptr};    ///< WakeUpTasks() to test activation, written by the test task
+std::atomic<uint64_t> taskTestWakeupTicks{0};     ///< CycleClock of the oldest WakeUpTasks() not yet served
+
+/**
+ * @brief control plane: console keys, the control socket and termination signals in the main loop
+ */
+std::string controlSocketPath;   ///< Unix socket for control commands, empty - console only
+bool quitRequested{false};       ///< main loop only
+ProfiledMutex fsWatcherMutex("fsWatcherMutex");      ///< guards fsWatcher
+/// set while the watcher task runs, roots are changed by control commands
+std::variant<fswatch*, bounded_fswatch*> fsWatcher{static_cast<fswatch*>(nullptr)};
+size_t fsWatchCapacity{0};   ///< watches of the fixed capacity watcher, 0 - fswatch
+
+/**
+ * @brief verbosity of the console output, changed by the control command "log"
+ */
+enum class LogLevel : int { kError, kWarning, kInfo, kDebug };
+std::atomic<LogLevel> logLevel{LogLevel::kInfo};
+constexpr const char* kLogLevels[] = {"error", "warning", "info", "debug"};
+
+/**
+ * @brief configuration file, watched by the file system watcher and reloaded by the main loop on change
+ * @desc Keys missing in the file keep the value of the command line. Without a file the command line options and
+ *       the root /tmp are the configuration.
+ */
+std::string configFile;            ///< empty - command line options only
+std::string configWatchPath;       ///< absolute path of the file, as reported by fswatch
+Config commandLineConfig;          ///< base of every reload
+Config activeConfig;               ///< main thread only
+struct stat configStat{};          ///< of the loaded file, an unchanged file is not reloaded
+struct stat sclStat{};             ///< of the loaded SCL file
+int configChangedFd{-1};           ///< eventfd, signalled by the fswatch callback
+std::shared_ptr<const Config> watchConfig;   ///< roots and filter of the fswatch callback, std::atomic_load/store
+constexpr int64_t kConfigSettleNs = 100'000'000;   ///< quiet time after the last change before the reload
 
 //-----------------------------------------------------------------------------
 // local/global Function Prototypes
 //-----------------------------------------------------------------------------
+void TaskWorker_SvSubscriber(std::stop_token token);
+void TaskWorker_SvPublisher(std::stop_token token);
+void TaskWorker_GoosePublisher(std::stop_token token);
+void TaskWorker_GooseSubscriber(std::stop_token token);
+static std::string ReloadConfig(bool forced);
 
 //-----------------------------------------------------------------------------
 // local Function Definitions
@@ -74,6 +303,34 @@ static void ShowVersion(const char* prog) {
 static void ShowUsage(const char* prog) {
   std::cout << "Usage: " << prog << " [OPTION]\n"
             << "  -v, --version            version\n"
+            << "  -i, --interface <name>   subscribe to SV frames on the interface\n"
+            << "  -r, --sv-rate <n>        SV samples per second, smpCnt wraps at n (default 4000)\n"
+            << "  -f, --frequency <hz>     nominal frequency for the SV analysis (default 50)\n"
+            << "  -a, --analysis <rate>    publish RMS/phasor/frequency of SV streams <rate> times per second\n"
+            << "  -A, --align <ids>        align the comma separated svIDs by smpCnt\n"
+            << "  -k, --align-skew <n>     maximum skew between aligned streams in samples (default 32)\n"
+            << "  -w, --write <file>       write received SV frames to pcapng file(s)\n"
+            << "  -S, --rotate-size <MB>   start a new capture file after <MB> megabytes\n"
+            << "  -T, --rotate-time <s>    start a new capture file after <s> seconds\n"
+            << "  -p, --publish <name>     publish SV streams on the interface\n"
+            << "  -c, --comtrade <files>   publish the comma separated COMTRADE .cfg files, one stream each\n"
+            << "  -l, --loop               repeat COMTRADE playback\n"
+            << "  -n, --simulate <n>       publish n simulated merging units (sine waves, distinct phases)\n"
+            << "  -N, --publish-loops <n>  spread the published streams over n timing loops, one per core\n"
+            << "  -L, --launch-time <us>   hand SV frames to the ETF qdisc <us> ahead with an SO_TXTIME launch time\n"
+            << "  -X, --xdp <mode>         SV over AF_XDP: generic (any interface), native or zerocopy\n"
+            << "  -B, --busy-poll <us>     AF_XDP busy polling instead of interrupts\n"
+            << "  -g, --goose <name>       publish a GOOSE control block on the interface\n"
+            << "  -G, --goose-subscribe <name> subscribe to GOOSE frames on the interface\n"
+            << "  -P, --perf-counters      count cycles, instructions, cache misses, switches per task\n"
+            << "  -t, --trace <file>       record task and fswatch events, write a Chrome trace JSON file\n"
+            << "  -M, --metrics <path|port> serve Prometheus metrics on a Unix socket or 127.0.0.1:<port>\n"
+            << "  -s, --stats-page <name>  publish statistics in /dev/shm/<name> for bbx15_top\n"
+            << "  -C, --control <path>     accept control commands on a Unix socket (send \"help\")\n"
+            << "  -F, --config <file>      configuration file, reloaded on change\n"
+            << "  -W, --watch-capacity <n> fixed capacity file system watcher of n directories, no heap use\n"
+            << "  -D, --scd <file>         SCL file (SCD/CID): SV and GOOSE control blocks, reloaded on change\n"
+            << "  -I, --ied <name>         IED of the SCL file whose control blocks are published\n"
             << "  -h, --help               this message\n\n";
 }
 
@@ -85,10 +342,38 @@ static void ShowUsage(const char* prog) {
 static void ProgramOptions(int argc, char* argv[]) {
   for (;;) {
     int option_index = 0;
-    static const char* short_options = "h?v";
+    static const char* short_options = "h?vi:r:f:a:A:k:w:S:T:p:c:ln:N:L:X:B:g:G:Pt:M:s:C:F:W:D:I:";
     static const struct option long_options[] = {
        {"help", no_argument, 0, 0},
        {"version", no_argument, 0, 'v'},
+       {"interface", required_argument, 0, 'i'},
+       {"sv-rate", required_argument, 0, 'r'},
+       {"frequency", required_argument, 0, 'f'},
+       {"analysis", required_argument, 0, 'a'},
+       {"align", required_argument, 0, 'A'},
+       {"align-skew", required_argument, 0, 'k'},
+       {"write", required_argument, 0, 'w'},
+       {"rotate-size", required_argument, 0, 'S'},
+       {"rotate-time", required_argument, 0, 'T'},
+       {"publish", required_argument, 0, 'p'},
+       {"comtrade", required_argument, 0, 'c'},
+       {"loop", no_argument, 0, 'l'},
+       {"simulate", required_argument, 0, 'n'},
+       {"publish-loops", required_argument, 0, 'N'},
+       {"launch-time", required_argument, 0, 'L'},
+       {"xdp", required_argument, 0, 'X'},
+       {"busy-poll", required_argument, 0, 'B'},
+       {"goose", required_argument, 0, 'g'},
+       {"goose-subscribe", required_argument, 0, 'G'},
+       {"perf-counters", no_argument, 0, 'P'},
+       {"trace", required_argument, 0, 't'},
+       {"metrics", required_argument, 0, 'M'},
+       {"stats-page", required_argument, 0, 's'},
+       {"control", required_argument, 0, 'C'},
+       {"config", required_argument, 0, 'F'},
+       {"watch-capacity", required_argument, 0, 'W'},
+       {"scd", required_argument, 0, 'D'},
+       {"ied", required_argument, 0, 'I'},
        {0, 0, 0, 0},
     };
 
@@ -110,6 +395,123 @@ static void ProgramOptions(int argc, char* argv[]) {
         ShowVersion(argv[0]);
         exit(EXIT_SUCCESS);
       }
+      case 'i': {
+        svInterface = optarg;
+        break;
+      }
+      case 'r': {
+        svSamplesPerSecond = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'f': {
+        svNominalFrequency = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'a': {
+        svAnalysisRate = std::stod(optarg);
+        break;
+      }
+      case 'A': {
+        svAlignStreams = optarg;
+        break;
+      }
+      case 'k': {
+        svAlignSkew = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'w': {
+        svCaptureFile = optarg;
+        break;
+      }
+      case 'S': {
+        svCaptureRotateBytes = std::stoull(optarg) << 20;
+        break;
+      }
+      case 'T': {
+        svCaptureRotateSeconds = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'p': {
+        svPublishInterface = optarg;
+        break;
+      }
+      case 'c': {
+        svComtradeFiles = optarg;
+        break;
+      }
+      case 'l': {
+        svComtradeLoop = true;
+        break;
+      }
+      case 'n': {
+        svSimulatedStreams = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'N': {
+        svPublishLoops = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'L': {
+        svLaunchTimeUs = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'X': {
+        svXdpMode = optarg;
+        if (svXdpMode != "generic" && svXdpMode != "native" && svXdpMode != "zerocopy") {
+          ShowUsage(argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'B': {
+        svBusyPollUs = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      }
+      case 'g': {
+        goosePublishInterface = optarg;
+        break;
+      }
+      case 'G': {
+        gooseInterface = optarg;
+        break;
+      }
+      case 'P': {
+        TaskStats::EnableCounters(true);
+        break;
+      }
+      case 't': {
+        traceFile = optarg;
+        Tracer::Enable(true);
+        break;
+      }
+      case 'M': {
+        metricsAddress = optarg;
+        break;
+      }
+      case 's': {
+        statsPageName = optarg;
+        break;
+      }
+      case 'C': {
+        controlSocketPath = optarg;
+        break;
+      }
+      case 'F': {
+        configFile = optarg;
+        break;
+      }
+      case 'W': {
+        fsWatchCapacity = std::stoul(optarg);
+        break;
+      }
+      case 'D': {
+        sclFile = optarg;
+        break;
+      }
+      case 'I': {
+        sclIed = optarg;
+        break;
+      }
       default: {
         ShowUsage(argv[0]);
         exit(-1);
@@ -119,23 +521,79 @@ static void ProgramOptions(int argc, char* argv[]) {
 }
 
 /**
- * @brief   get char from cin
+ * @brief data set of the published GOOSE control block: state, its quality and the number of changes
+ */
+static std::vector<GooseValue> GooseDataSet() {
+  return {GooseValue::Boolean(gooseState), GooseValue::Quality(kSvQualityGood), GooseValue::Unsigned(gooseChanges++)};
+}
+
+/**
+ * @brief write the recorded trace events
+ * @param file - output file, empty - the file given with --trace
+ * @return message for the console or the control client
+ */
+static std::string WriteTrace(std::string file) {
+  file = file.empty() ? traceFile : file;
+  if (!Tracer::Enabled() || file.empty()) {
+    return "tracing is off, start with --trace <file>\n";
+  }
+  try {
+    return std::to_string(Tracer::Write(file)) + " trace events written to " + file + "\n";
+  } catch (std::exception& error) {
+    return std::string(error.what()) + "\n";
+  }
+}
+
+/**
+ * @brief   handle a key from the console
+ * @param   var - key
  * @return bool
  *          true if received an exit command,
  *          otherwise - false
  **/
-static bool HandleGetChar() {
-  char var = getchar();
+static bool HandleConsoleKey(char var) {
   switch (var) {
     case '\n':
+    case '\r':
       break;
     case 'q': {
       std::cout << "Received QUIT command\nExiting.." << std::endl;
       return (true);
     }
+    case 's': {
+      svReportRequested = true;
+      gooseReportRequested = true;
+      break;
+    }
+    case 't': {
+      TaskStats::PrintAll();
+      LockProfiler::Print();
+      break;
+    }
+    case 'd': {
+      std::printf("%s", WriteTrace("").c_str());
+      break;
+    }
+    case 'r': {
+      std::printf("%s", ReloadConfig(true).c_str());
+      break;
+    }
+    case 'g': {
+      std::lock_guard lock(goosePublisherMutex);
+      if (goosePublisher) {
+        gooseState = !gooseState;
+        goosePublisher->SetValues(0, GooseDataSet());
+      }
+      break;
+    }
     default: {
       std::cout << "Console \n"
                 << " Key options are:\n"
+                << "  s - print SV and GOOSE statistics\n"
+                << "  g - toggle the published GOOSE state\n"
+                << "  t - print task statistics\n"
+                << "  d - write the trace file (with --trace)\n"
+                << "  r - reload the configuration file (with --config)\n"
                 << "  q - quit from the program" << std::endl;
       break;
     }
@@ -143,37 +601,478 @@ static bool HandleGetChar() {
   return false;
 }
 
+/**
+ * @brief set the log level by its name
+ * @return false for an unknown name
+ */
+static bool SetLogLevel(std::string_view name) {
+  for (int level = 0; level < 4; ++level) {
+    if (name == kLogLevels[level]) {
+      logLevel = static_cast<LogLevel>(level);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief the command line options as configuration, the base of the configuration file
+ */
+static Config CommandLineConfig() {
+  Config config;
+  config.roots = {"/tmp"};
+  config.sv = {svInterface,    svPublishInterface, svSamplesPerSecond, svNominalFrequency,
+               svAnalysisRate, svAlignStreams,     svAlignSkew,        svComtradeFiles,
+               svComtradeLoop, svSimulatedStreams, svPublishLoops,     svLaunchTimeUs,
+               svXdpMode,      svBusyPollUs,       {},                 {}};   // SCL blocks from LoadScl()
+  config.goose_publish = goosePublishInterface;
+  config.goose_subscribe = gooseInterface;
+  config.log_level = kLogLevels[static_cast<int>(logLevel.load())];
+  config.scl_file = sclFile.empty() ? "" : std::filesystem::absolute(sclFile).lexically_normal().string();
+  config.scl_ied = sclIed;
+  return config;
+}
+
+/**
+ * @brief store a setting, unchanged values are not written as running tasks may read them
+ */
+template <class T>
+static void Assign(T& setting, const T& value) {
+  if (setting != value) {
+    setting = value;
+  }
+}
+
+/**
+ * @brief settings of the SV and GOOSE tasks, only the stopped tasks may use changed values
+ */
+static void SetTaskSettings(const Config& config) {
+  Assign(svInterface, config.sv.subscribe);
+  Assign(svPublishInterface, config.sv.publish);
+  Assign(svSamplesPerSecond, config.sv.rate);
+  Assign(svNominalFrequency, config.sv.frequency);
+  Assign(svAnalysisRate, config.sv.analysis);
+  Assign(svAlignStreams, config.sv.align);
+  Assign(svAlignSkew, config.sv.align_skew);
+  Assign(svComtradeFiles, config.sv.comtrade);
+  Assign(svComtradeLoop, config.sv.loop);
+  Assign(svSimulatedStreams, config.sv.simulate);
+  Assign(svPublishLoops, config.sv.loops);
+  Assign(svLaunchTimeUs, config.sv.launch_time);
+  Assign(svXdpMode, config.sv.xdp);
+  Assign(svBusyPollUs, config.sv.busy_poll);
+  Assign(svSclStreams, config.sv.streams);
+  Assign(svExpectedStreams, config.sv.expected);
+  Assign(gooseSclBlocks, config.goose_blocks);
+  Assign(goosePublishInterface, config.goose_publish);
+  Assign(gooseInterface, config.goose_subscribe);
+  taskTestPeriodMs = config.test_period_ms;
+  SetLogLevel(config.log_level);
+}
+
+/**
+ * @brief roots of the watcher: the configured roots and the directory of the configuration file
+ * @desc Events in the directory of the file are filtered out unless it is below a configured root.
+ */
+static std::vector<std::string> WatchRoots(const Config& config) {
+  std::vector<std::string> roots = config.roots;
+  for (const std::string& file : {configWatchPath, config.scl_file}) {
+    if (file.empty()) {
+      continue;
+    }
+    const std::string dir = std::filesystem::path(file).parent_path().string();
+    const bool covered = std::any_of(roots.begin(), roots.end(), [&](const std::string& root) {
+      return dir == root || (dir.starts_with(root) && (dir[root.size()] == '/' || root == "/"));
+    });
+    if (!covered) {
+      roots.push_back(dir);
+    }
+  }
+  return roots;
+}
+
+/**
+ * @brief start a task with its configured priority
+ * @return warning for the console, empty on success
+ */
+static std::string StartTask(TaskThread& task, void (*worker)(std::stop_token), const Config& config) {
+  task.Start(worker);
+  const auto it = config.priorities.find(task.name);
+  if (it != config.priorities.end()) {
+    if (const int error = task.SetPriority(it->second)) {
+      return std::string("priority of ") + task.name + ": " + strerror(error) + "\n";
+    }
+  }
+  return "";
+}
+
+static std::string ReadConfigFile(const std::string& file) {
+  std::ifstream in(file);
+  if (!in) {
+    throw std::runtime_error("Config: cannot open " + file);
+  }
+  std::stringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+/**
+ * @brief call the function with the running file system watcher of either kind, with fsWatcherMutex held
+ * @return false if no watcher is running
+ */
+template <class Function>
+static bool WithFsWatcher(Function&& function) {
+  return std::visit(
+     [&](auto* watcher) {
+       if (watcher) {
+         function(*watcher);
+       }
+       return watcher != nullptr;
+     },
+     fsWatcher);
+}
+
+/**
+ * @brief apply a new configuration to the running tasks, only the parts in the difference are touched
+ * @return warnings for the console, empty if everything was applied
+ */
+static std::string ApplyConfig(const Config& config, const ConfigDiff& diff) {
+  std::string warnings;
+
+  // watches: add and remove the changed roots, the watches of the other roots stay in place
+  {
+    const std::vector<std::string> from = WatchRoots(activeConfig);
+    const std::vector<std::string> to = WatchRoots(config);
+    std::lock_guard lock(fsWatcherMutex);
+    WithFsWatcher([&](auto& watcher) {
+      for (const auto& root : to) {
+        try {
+          if (std::find(from.begin(), from.end(), root) == from.end()) {
+            watcher.add_root(root);
+          }
+        } catch (std::exception& error) {
+          warnings += "watch " + root + ": " + error.what() + "\n";
+        }
+      }
+      for (const auto& root : from) {
+        try {
+          if (std::find(to.begin(), to.end(), root) == to.end()) {
+            watcher.remove_root(root);
+          }
+        } catch (std::exception& error) {
+          warnings += "watch " + root + ": " + error.what() + "\n";
+        }
+      }
+    });
+  }
+  std::atomic_store_explicit(&watchConfig, std::make_shared<const Config>(config), std::memory_order_release);
+
+  // subscriptions and publishers: stop the changed tasks, then start them with their new settings
+  struct Restart {
+    bool changed;
+    TaskThread& task;
+    void (*worker)(std::stop_token);
+    const std::string& interface;
+  } restarts[] = {
+     {diff.sv_subscriber, workerSvSubscriber, TaskWorker_SvSubscriber, svInterface},
+     {diff.sv_publisher, workerSvPublisher, TaskWorker_SvPublisher, svPublishInterface},
+     {diff.goose_publisher, workerGoosePublisher, TaskWorker_GoosePublisher, goosePublishInterface},
+     {diff.goose_subscriber, workerGooseSubscriber, TaskWorker_GooseSubscriber, gooseInterface},
+  };
+  for (auto& restart : restarts) {
+    if (restart.changed) {
+      restart.task.RequestStop();
+    }
+  }
+  for (auto& restart : restarts) {
+    if (restart.changed) {
+      restart.task.Join();
+    }
+  }
+  SetTaskSettings(config);
+  for (auto& restart : restarts) {
+    if (restart.changed && !restart.interface.empty()) {
+      warnings += StartTask(restart.task, restart.worker, config);
+    }
+  }
+
+  // priorities of the tasks left running
+  for (const auto& name : diff.priorities) {
+    for (TaskThread* task : allWorkers) {
+      if (name == task->name) {
+        const auto it = config.priorities.find(name);
+        if (const int error = task->SetPriority(it == config.priorities.end() ? 0 : it->second)) {
+          warnings += "priority of " + name + ": " + strerror(error) + "\n";
+        }
+      }
+    }
+  }
+  activeConfig = config;
+  return warnings;
+}
+
+static bool SameFile(const struct stat& a, const struct stat& b) {
+  return a.st_ino == b.st_ino && a.st_size == b.st_size && a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+         a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+/**
+ * @brief reload the configuration file and the SCL file and apply the difference
+ * @desc The SCL file is parsed again only if it, its path or the IED changed, otherwise its control blocks are kept.
+ * @param forced - reload unchanged files as well
+ * @return report with the reload time, empty if the files are unchanged
+ */
+static std::string ReloadConfig(bool forced) {
+  if (configFile.empty() && activeConfig.scl_file.empty()) {
+    return "reload: no configuration file\n";
+  }
+  const uint64_t begin = CycleClock::Ticks();
+  struct stat st{};
+  if (!configFile.empty() && stat(configFile.c_str(), &st) < 0) {
+    return "reload: " + configFile + ": " + strerror(errno) + ", configuration kept\n";
+  }
+  struct stat scl{};
+  if (!activeConfig.scl_file.empty() && stat(activeConfig.scl_file.c_str(), &scl) < 0) {
+    return "reload: " + activeConfig.scl_file + ": " + strerror(errno) + ", configuration kept\n";
+  }
+  const bool scl_changed = !SameFile(scl, sclStat);
+  if (!forced && !scl_changed && SameFile(st, configStat)) {
+    return "";   // e.g. the close event of our own read
+  }
+  configStat = st;
+  sclStat = scl;
+
+  Config config = commandLineConfig;
+  try {
+    if (!configFile.empty()) {
+      config = ParseConfig(ReadConfigFile(configFile), commandLineConfig);
+    }
+    if (forced || scl_changed || config.scl_file != activeConfig.scl_file || config.scl_ied != activeConfig.scl_ied) {
+      sclStat = {};
+      if (!config.scl_file.empty()) {
+        stat(config.scl_file.c_str(), &sclStat);
+      }
+      LoadScl(config);
+    } else {
+      config.sv.streams = activeConfig.sv.streams;
+      config.sv.expected = activeConfig.sv.expected;
+      config.goose_blocks = activeConfig.goose_blocks;
+    }
+  } catch (std::exception& error) {
+    return "reload: " + std::string(error.what()) + ", configuration kept\n";
+  }
+  const ConfigDiff diff = DiffConfig(activeConfig, config);
+  const std::string warnings = diff.Empty() ? "" : ApplyConfig(config, diff);
+  const int64_t ns = CycleClock::TicksToNs(static_cast<int64_t>(CycleClock::Ticks() - begin));
+  char duration[32];
+  std::snprintf(duration, sizeof(duration), " in %.1f us\n", static_cast<double>(ns) / 1000.0);
+  return "reload: " + diff.Describe() + duration + warnings;
+}
+
+/**
+ * @brief   handle a command line from the control socket
+ * @param   line - command and argument separated by a space
+ * @return  reply to the client, always terminated by a new line
+ **/
+static std::string HandleControlCommand(std::string_view line) {
+  const size_t space = line.find(' ');
+  const std::string_view command = line.substr(0, space);
+  const std::string argument(space == std::string_view::npos ? std::string_view{} : line.substr(space + 1));
+
+  if (command == "stats") {
+    char* text = nullptr;
+    size_t size = 0;
+    std::FILE* out = open_memstream(&text, &size);
+    if (!out) {
+      return "error: out of memory\n";
+    }
+    TaskStats::PrintAll(out);
+    LockProfiler::Print(out);
+    std::fclose(out);
+    std::string reply(text, size);
+    std::free(text);
+    svReportRequested = true;   // SV and GOOSE engines print their statistics on the console
+    gooseReportRequested = true;
+    return reply.empty() ? "no task activations yet\n" : reply;
+  }
+  if (command == "stop") {
+    quitRequested = true;
+    return "stopping\n";
+  }
+  if (command == "reload") {
+    return ReloadConfig(true);
+  }
+  if (command == "add-root" || command == "remove-root") {
+    if (argument.empty()) {
+      return "error: " + std::string(command) + " needs a directory\n";
+    }
+    const std::string root = NormalRoot(argument);
+    Config config = activeConfig;
+    const auto it = std::find(config.roots.begin(), config.roots.end(), root);
+    if (command == "add-root") {
+      if (it != config.roots.end()) {
+        return "error: already a root: " + root + "\n";
+      }
+      if (!std::filesystem::is_directory(root)) {
+        return "error: not a directory: " + root + "\n";
+      }
+      config.roots.push_back(root);
+    } else {
+      if (it == config.roots.end()) {
+        return "error: not a watched root: " + root + "\n";
+      }
+      config.roots.erase(it);
+    }
+    // applied like a reload: the watcher and the filter of its callback see the same roots, until the next reload
+    const std::string warnings = ApplyConfig(config, DiffConfig(activeConfig, config));
+    return (command == "add-root" ? "adding " : "removing ") + root + "\n" + warnings;
+  }
+  if (command == "roots") {
+    std::lock_guard lock(fsWatcherMutex);
+    std::string reply;
+    const bool running = WithFsWatcher([&](auto& watcher) {
+      for (const auto& root : watcher.roots()) {
+        reply += root.string() + "\n";
+      }
+      reply = reply.empty() ? "no roots\n" : reply;
+    });
+    return running ? reply : "error: file system watcher not running\n";
+  }
+  if (command == "trace") {
+    return WriteTrace(argument);
+  }
+  if (command == "log") {
+    if (!argument.empty() && !SetLogLevel(argument)) {
+      return "error: unknown log level " + argument + "\n";
+    }
+    return std::string("log level ") + kLogLevels[static_cast<int>(logLevel.load())] + "\n";
+  }
+  return "commands:\n"
+         "  stats                 task statistics, SV/GOOSE statistics go to the console\n"
+         "  stop                  stop all tasks and exit\n"
+         "  reload                reload the configuration\n"
+         "  roots                 list the watched root directories\n"
+         "  add-root <dir>        watch another root directory\n"
+         "  remove-root <dir>     stop watching a root directory\n"
+         "  trace [file]          write the recorded trace events\n"
+         "  log [error|warning|info|debug] show or set the log level\n";
+}
+
 /**
  * @brief Waking up all running tasks
  * @param config - configuration the manager
  * @param all_tasks_wakeup - wakeup all tasks but not only file system event driving tasks
  */
 void WakeUpTasks(bool all_tasks_wakeup = true) {
+  BBX15_PROBE1(task_wakeup, all_tasks_wakeup);
+  TraceSpan span("WakeUpTasks");
+  metricTaskWakeups.Inc();
+  StatsPage::Add(pageTaskWakeups);
+  if (pageTestWakeupLatency) {
+    uint64_t none = 0;
+    taskTestWakeupTicks.compare_exchange_strong(none, CycleClock::Ticks(), std::memory_order_relaxed);
+  }
+  Tracer::Counter("test task pending wakeups", taskTestPendingWakeups.fetch_add(1, std::memory_order_relaxed) + 1);
   if (all_tasks_wakeup) {
-    std::unique_lock lck(taskEventStopFswatcher.event_mutex);
+    ProfiledLock lck(taskEventStopFswatcher.event_mutex);
     taskEventStopFswatcher.event_condition.notify_all();   // Wakes up stop a file system watcher
   }
   {
-    std::unique_lock lck(taskEventStopTest.event_mutex);
+    ProfiledLock lck(taskEventStopTest.event_mutex);
     taskEventStopTest.event_condition.notify_all();   // Wakes up a task
   }
 }
 
 /**
- * @brief File system watcher task main function
- * @desc This task is mandatory. fswatch library was used here.
- * @param lptr - log appender
- * @param cfg_converter - configuration
+ * @brief register the per thread buffers of the calling task before its first no-allocation region
+ */
+static void PrepareHotPath() {
+  ThreadPerfCounters();
+  AsyncLog::RegisterThread();
+  Tracer::RegisterThread();
+}
+
+/**
+ * @brief configuration bit of a file event
+ */
+static uint32_t WatchEvent(fswatch::Event type) {
+  switch (type) {
+    case fswatch::Event::FILE_CREATED:
+      return kWatchCreated;
+    case fswatch::Event::FILE_OPENED:
+      return kWatchOpened;
+    case fswatch::Event::FILE_MODIFIED:
+      return kWatchModified;
+    case fswatch::Event::FILE_CLOSED:
+      return kWatchClosed;
+    case fswatch::Event::FILE_DELETED:
+      return kWatchDeleted;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief path of an event of either watcher, zero terminated
+ */
+static std::string_view EventPath(const fswatch::EventInfo& event) {
+  return event.path.native();
+}
+
+static std::string_view EventPath(const bounded_fswatch::event_view& event) {
+  return event.path;
+}
+
+/**
+ * @brief run a file system watcher until the stop request
+ * @param watcher - fswatch or bounded_fswatch
  * @param token - stop task token
  */
-void TaskWorkerFsWatcher(std::stop_token token) {
-  using namespace std::chrono_literals;
-  const auto waitDuration = 2s;
-  auto watcher = fswatch("/tmp");
+template <class Watcher>
+static void RunFsWatcher(Watcher& watcher, std::stop_token token) {
+  uint64_t dispatched = 0;   // events passed to the callback
+  for (const auto& root : WatchRoots(*std::atomic_load(&watchConfig))) {
+    try {
+      watcher.add_root(root);
+    } catch (std::exception& error) {
+      BBX15_LOG("Filesystem watcher: %s\n", error.what());
+    }
+  }
 
-  // add watching events
-  watcher.on({fswatch::Event::FILE_CLOSED, fswatch::Event::FILE_MODIFIED, fswatch::Event::FILE_DELETED},
-             [&]([[maybe_unused]] auto& event) {
+  // add watching events, the configured roots and filter select the events passed on to the tasks
+  watcher.on({fswatch::Event::FILE_CREATED, fswatch::Event::FILE_OPENED, fswatch::Event::FILE_MODIFIED,
+              fswatch::Event::FILE_CLOSED, fswatch::Event::FILE_DELETED},
+             [&](auto& event) {
+               NoAllocRegion region("fswatch dispatch");
+               ++dispatched;
+               const std::string_view path = EventPath(event);
+               const auto config = std::atomic_load_explicit(&watchConfig, std::memory_order_acquire);
+               // reloaded only once a writer closed the file or it was renamed into place: an SCL file truncated
+               // or rewritten while it is mapped and parsed would raise SIGBUS
+               if ((event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) &&
+                   (path == configWatchPath || path == config->scl_file)) {
+                 const uint64_t one = 1;   // reloaded by the main loop once the file is quiet
+                 [[maybe_unused]] auto written = write(configChangedFd, &one, sizeof(one));
+               }
+               if (!config->Watched(WatchEvent(event.type), path)) {
+                 return;
+               }
+               TaskActivation activation(taskStatsFswatch, ThreadPerfCounters());
+               if (event.type == fswatch::Event::FILE_CREATED) {
+                 metricFsEventsCreated.Inc();
+               } else if (event.type == fswatch::Event::FILE_OPENED) {
+                 metricFsEventsOpened.Inc();
+               } else if (event.type == fswatch::Event::FILE_CLOSED) {
+                 metricFsEventsClosed.Inc();
+               } else if (event.type == fswatch::Event::FILE_MODIFIED) {
+                 metricFsEventsModified.Inc();
+               } else {
+                 metricFsEventsDeleted.Inc();
+               }
+               StatsPage::Add(pageFsEvents);
+               if (logLevel.load(std::memory_order_relaxed) >= LogLevel::kDebug) {
+                 BBX15_LOG("fswatch: %s\n", path.data());
+               }
                WakeUpTasks(false);   // Wake up sleeping tasks by an event in the file system
              });
 
@@ -189,38 +1088,71 @@ void TaskWorkerFsWatcher(std::stop_token token) {
     while (true) {
       // Start of locked block
       {
-        std::unique_lock lck(taskEventStopFswatcher.event_mutex);
+        ProfiledLock lck(taskEventStopFswatcher.event_mutex);
         taskEventStopFswatcher.event_condition.wait(lck, [&, token]() { return token.stop_requested(); });
       }
 
       //Stop if requested to stop
       if (token.stop_requested()) {
-        std::printf("Stop requested for a stop watcher task\n");
+        BBX15_LOG("Stop requested for a stop watcher task\n");
         break;
       }
     }   // End of while loop
-    watcher.stop();
-    // wakeup watcher via event in file system
-    std::ofstream tmpfile;
-    tmpfile.open("/tmp/~wakeup", std::ios_base::trunc);
-    tmpfile << "Wakeup\n";
-    tmpfile.close();
-    std::printf("Stop filesystem watcher task stopped\n");
+    watcher.stop();   // wakes up the watcher, no file system event needed
+    BBX15_LOG("Stop filesystem watcher task stopped\n");
   });
 
+  {
+    std::lock_guard lock(fsWatcherMutex);
+    fsWatcher = &watcher;
+  }
+  PrepareHotPath();
+  const uint64_t allocationsBefore = AllocTracker::Thread().allocations;
   try {
     watcher.start();
   } catch (std::filesystem::filesystem_error& error) {
-    std::printf("Filesystem exception was caught: %s\n", error.what());
+    BBX15_LOG("Filesystem exception was caught: %s\n", error.what());
   } catch (std::exception& error) {
-    std::printf("Exception was caught: %s\n", error.what());
+    BBX15_LOG("Exception was caught: %s\n", error.what());
   } catch (...) {
-    std::printf("Unknown exception was caught\n");
+    BBX15_LOG("Unknown exception was caught\n");
   }
 
+  {
+    std::lock_guard lock(fsWatcherMutex);
+    fsWatcher = static_cast<Watcher*>(nullptr);
+  }
   stop_watching_task.join();
 
-  std::printf("Filesystem watcher task stopped\n");
+  if (AllocTracker::kEnabled && dispatched) {
+    // decoding and watch setup included, the callback alone is in the task statistics
+    const uint64_t allocations = AllocTracker::Thread().allocations - allocationsBefore;
+    BBX15_LOG("fswatch: %llu events, %.2f heap allocations per event in the watcher thread\n",
+              static_cast<unsigned long long>(dispatched),
+              static_cast<double>(allocations) / static_cast<double>(dispatched));
+  }
+}
+
+/**
+ * @brief File system watcher task main function
+ * @desc This task is mandatory. fswatch library was used here, or with --watch-capacity the fixed capacity
+ *       bounded_fswatch, which allocates nothing after its start.
+ * @param token - stop task token
+ */
+void TaskWorkerFsWatcher(std::stop_token token) {
+  if (fsWatchCapacity) {
+    bounded_fswatch_limits limits;
+    limits.max_watches = fsWatchCapacity;
+    limits.name_bytes = fsWatchCapacity * 64;
+    bounded_fswatch watcher(limits);
+    BBX15_LOG("fswatch: fixed capacity of %zu directories, %zu bytes\n", limits.max_watches, watcher.memory_bytes());
+    RunFsWatcher(watcher, token);
+    watcher.print();
+  } else {
+    fswatch watcher;
+    RunFsWatcher(watcher, token);
+  }
+  BBX15_LOG("Filesystem watcher task stopped\n");
 }
 
 /**
@@ -238,19 +1170,387 @@ void TaskWorker_Test(std::stop_token token) {
     taskEventStopTest.event_condition.notify_all();
   });
 
+  PrepareHotPath();
+  uint64_t calibratedTicks = CycleClock::Ticks();
   while (true) {
+    NoAllocRegion region("test task cycle");
     {
-      std::unique_lock lck(taskEventStopTest.event_mutex);
-      taskEventStopTest.event_condition.wait_for(lck, 1s);
+      ProfiledLock lck(taskEventStopTest.event_mutex);
+      taskEventStopTest.event_condition.wait_for(
+         lck, std::chrono::milliseconds(taskTestPeriodMs.load(std::memory_order_relaxed)));
+    }
+    Tracer::Counter("test task pending wakeups", 0);
+    StatsPage::Set(pageTestPendingWakeups, taskTestPendingWakeups.exchange(0, std::memory_order_relaxed));
+    if (const uint64_t woken = taskTestWakeupTicks.exchange(0, std::memory_order_relaxed)) {
+      const int64_t latency = CycleClock::TicksToNs(static_cast<int64_t>(CycleClock::Ticks() - woken));
+      StatsPage::Observe(pageTestWakeupLatency, latency);
+    }
+    TaskActivation activation(taskStatsTest, ThreadPerfCounters());
+    // keep the instrumentation time stamps aligned with CLOCK_MONOTONIC, about once per second: an event storm
+    // wakes the task far more often
+    const uint64_t now = CycleClock::Ticks();
+    if (CycleClock::TicksToNs(static_cast<int64_t>(now - calibratedTicks)) >= 1'000'000'000) {
+      CycleClock::Recalibrate();
+      calibratedTicks = now;
     }
     //Stop if requested to stop
     if (token.stop_requested()) {
-      std::printf("Stop requested for a task\n");
+      BBX15_LOG("Stop requested for a task\n");
       break;
     }
   }   // End of while loop
 
-  std::printf("Test task stopped.\n");
+  BBX15_LOG("Test task stopped.\n");
+}
+
+/**
+ * @brief print a phasor result of the SV analysis
+ * @param result - RMS, phasors and frequency of one stream
+ */
+static void PrintSvPhasors(const SvPhasorResult& result) {
+  static_assert(kSvChannels == 8, "one RMS/phasor group per channel in the format");
+  char sv_id[kSvMaxIdLength + 1];
+  const size_t length = std::min(result.sv_id.size(), static_cast<size_t>(kSvMaxIdLength));
+  std::memcpy(sv_id, result.sv_id.data(), length);
+  sv_id[length] = '\0';
+  const float* rms = result.rms;
+  const float* mag = result.magnitude;
+  float deg[kSvChannels];
+  for (size_t ch = 0; ch < kSvChannels; ++ch) {
+    deg[ch] = result.angle[ch] * 180.0f / 3.14159265f;
+  }
+  BBX15_LOG("%lld.%06ld %s f=%.3f Hz"
+            " | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f"
+            " | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f\n",
+            static_cast<long long>(result.ts.tv_sec), result.ts.tv_nsec / 1000, sv_id, result.frequency, rms[0],
+            mag[0], deg[0], rms[1], mag[1], deg[1], rms[2], mag[2], deg[2], rms[3], mag[3], deg[3], rms[4], mag[4],
+            deg[4], rms[5], mag[5], deg[5], rms[6], mag[6], deg[6], rms[7], mag[7], deg[7]);
+}
+
+/**
+ * @brief pass the changes of the quality counters to the metrics, the counters rarely change per frame
+ * @param totals - counters of the quality monitor
+ * @param exported - counters already passed on, updated
+ */
+static void ExportQuality(const SvQualityMonitor<>::Totals& totals, SvQualityMonitor<>::Totals& exported) {
+  if (totals.missing != exported.missing) {
+    metricSvMissing.Set(static_cast<int64_t>(totals.missing));
+  }
+  if (totals.duplicates != exported.duplicates) {
+    metricSvDuplicates.Inc(totals.duplicates - exported.duplicates);
+  }
+  if (totals.reordered != exported.reordered) {
+    metricSvReordered.Inc(totals.reordered - exported.reordered);
+  }
+  exported = totals;
+}
+
+/**
+ * @brief AF_XDP settings of the SV tasks from the -X and -B options
+ */
+static XdpOptions SvXdpOptions() {
+  XdpOptions options;
+  options.native = svXdpMode != "generic";
+  options.zero_copy = svXdpMode == "zerocopy";
+  options.busy_poll_us = static_cast<int>(svBusyPollUs);
+  return options;
+}
+
+/**
+ * @brief SV subscriber task: checks sample quality of all received streams inline
+ * @desc with analysis rate set, RMS, phasors and frequency of all streams are published as well
+ * @param token - stop task token
+ */
+void TaskWorker_SvSubscriber(std::stop_token token) {
+  SvSubscriber subscriber(svInterface);
+  if (!svXdpMode.empty()) {
+    subscriber.UseXdp(SvXdpOptions());
+    BBX15_LOG("SV subscriber: %s\n", subscriber.Backend().c_str());
+  }
+  SvQualityMonitor<> quality(svSamplesPerSecond);
+  SvQualityMonitor<>::Totals exported;   // quality counters passed on to the metrics
+  metricSvMissing.Set(0);
+  size_t unmonitored = 0;
+  for (const std::string& sv_id : svExpectedStreams) {
+    unmonitored += !quality.Expect(sv_id);   // streams of the SCL file are reported before their first frame
+  }
+  if (unmonitored) {
+    BBX15_LOG("SV subscriber: %zu stream(s) of the SCL file not monitored, capacity exceeded\n", unmonitored);
+  }
+  std::unique_ptr<SvAnalysis<>> analysis;
+  std::unique_ptr<SvAlignBuffer<>> align;
+  SvAlignReport<> aligned;   // consumer of the aligned vectors
+  std::unique_ptr<PcapngWriter> capture_writer;
+
+  try {
+    if (svAnalysisRate > 0) {
+      analysis = std::make_unique<SvAnalysis<>>(svSamplesPerSecond, svNominalFrequency, svAnalysisRate, PrintSvPhasors);
+    }
+  } catch (std::exception& error) {
+    BBX15_LOG("SV analysis disabled: %s\n", error.what());
+  }
+  try {
+    if (!svAlignStreams.empty()) {
+      align = std::make_unique<SvAlignBuffer<>>(
+         svSamplesPerSecond, svAlignSkew, kSvAlignTimeoutNs, [&](const SvAlignBuffer<>::Sample& sample) {
+           if (aligned.Add(sample, align->StreamMask())) {
+             BBX15_LOG("SV alignment: smpCnt %u %s streams 0x%x\n", sample.smp_cnt,
+                       aligned.missing ? "without" : "complete,", aligned.missing ? aligned.missing : sample.present);
+           }
+         });
+      std::stringstream ids(svAlignStreams);
+      for (std::string id; std::getline(ids, id, ',');) {
+        align->AddStream(id);
+      }
+    }
+  } catch (std::exception& error) {
+    BBX15_LOG("SV alignment disabled: %s\n", error.what());
+    align.reset();
+  }
+  if (!svCaptureFile.empty()) {
+    capture_writer = std::make_unique<PcapngWriter>(svCaptureFile, svCaptureRotateBytes, svCaptureRotateSeconds);
+    capture_writer->Start();
+  }
+
+  std::stop_callback stop_cb(token, [&]() { subscriber.Stop(); });
+
+  auto print_statistics = [&]() {
+    const auto& stats = subscriber.GetStatistics();
+    std::printf("SV subscriber %s: frames=%llu invalid=%llu kernel drops=%llu\n", svInterface.c_str(),
+                static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.frames_invalid),
+                static_cast<unsigned long long>(stats.kernel_drops));
+    quality.Print();
+    if (align) {
+      align->Print();
+      aligned.Print();
+    }
+    if (capture_writer) {
+      capture_writer->Print();
+    }
+  };
+
+  try {
+    TaskActivation activation(taskStatsSvSubscriber, ThreadPerfCounters());   // the whole run
+    subscriber.Start([&](const SvCapture& capture, const SvFrame& frame) {
+      if (capture_writer) {
+        capture_writer->Write(capture.data, capture.size, capture.ts);
+      }
+      metricSvFrames.Inc();
+      StatsPage::Add(pageSvFrames);
+      quality.Check(frame, capture.ts);
+      ExportQuality(quality.GetTotals(), exported);
+      if (analysis) {
+        analysis->Process(frame, capture.ts);
+      }
+      if (align) {
+        align->Insert(frame, capture.ts);
+      }
+      if (svReportRequested.load(std::memory_order_relaxed)) {
+        svReportRequested = false;
+        print_statistics();
+      }
+    }, [&]() {
+      // all streams silent: the pending vectors time out without a further Insert()
+      if (align) {
+        timespec now{};
+        clock_gettime(CLOCK_REALTIME, &now);
+        align->Expire(now);
+      }
+      if (svReportRequested.load(std::memory_order_relaxed)) {
+        svReportRequested = false;
+        print_statistics();
+      }
+    });
+  } catch (std::exception& error) {
+    BBX15_LOG("SV subscriber exception was caught: %s\n", error.what());
+  }
+  if (capture_writer) {
+    capture_writer->Stop();
+  }
+
+  print_statistics();
+  BBX15_LOG("SV subscriber task stopped.\n");
+}
+
+/**
+ * @brief SV publisher task: COMTRADE playback, the control blocks of the SCL file or a sine wave stream
+ * @desc all COMTRADE files are parsed and resampled before the timing loop starts
+ * @param token - stop task token
+ */
+void TaskWorker_SvPublisher(std::stop_token token) {
+  try {
+    SvPublisher publisher(svPublishInterface, svSamplesPerSecond);
+    char sv_id[kSvMaxIdLength];
+    size_t index = 0;
+
+    std::stringstream files(svComtradeFiles);
+    for (std::string file; std::getline(files, file, ',');) {
+      std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02zu", index + 1);
+      auto source = std::make_unique<ComtradeSource>(file, svSamplesPerSecond, svComtradeLoop);
+      BBX15_LOG("SV publisher: %s plays %s (%llu samples)\n", sv_id, file.c_str(),
+                static_cast<unsigned long long>(source->Count()));
+      publisher.AddStream(sv_id, static_cast<uint16_t>(0x4000 + index), std::move(source));
+      ++index;
+    }
+    // the SCL control blocks publish a sine wave with the svID, address and VLAN of the substation configuration
+    for (const SclSvControl& cb : svSclStreams) {
+      const uint32_t rate = cb.smp_mod == "SmpPerPeriod" ? cb.smp_rate * svNominalFrequency : cb.smp_rate;
+      if (cb.smp_rate && rate != svSamplesPerSecond) {
+        BBX15_LOG("SV publisher: %s configured for %u samples/s, published with %u\n", cb.sv_id.c_str(), rate,
+                  svSamplesPerSecond);
+      }
+      publisher.AddStream(cb.sv_id, cb.address.valid ? cb.address.app_id : static_cast<uint16_t>(0x4000 + index),
+                          std::make_unique<SvSineSource>(svSamplesPerSecond, svNominalFrequency, 100.0, 230.0, 0.0),
+                          cb.conf_rev, kSvSmpSynchLocal, cb.address.valid ? cb.address.mac : nullptr,
+                          cb.address.vlan_id, cb.address.vlan_priority);
+      ++index;
+    }
+    if (!svSclStreams.empty()) {
+      BBX15_LOG("SV publisher: %zu stream(s) from the SCL file\n", svSclStreams.size());
+    }
+    // simulated merging units follow the COMTRADE streams, each with its own phase and load
+    for (uint32_t sim = 0; sim < svSimulatedStreams || index == 0; ++sim) {
+      std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02zu", index + 1);
+      const double phase = 2.0 * std::numbers::pi * sim / (svSimulatedStreams ? svSimulatedStreams : 1);
+      publisher.AddStream(sv_id, static_cast<uint16_t>(0x4000 + index),
+                          std::make_unique<SvSineSource>(svSamplesPerSecond, svNominalFrequency,
+                                                         100.0 + 10.0 * (sim % 10), 230.0, phase));
+      ++index;
+    }
+    publisher.SetLoops(svPublishLoops);
+    publisher.SetMetrics(&metricSvOverruns, &metricSvSendErrors);
+    if (!svXdpMode.empty()) {
+      publisher.UseXdp(SvXdpOptions());
+      BBX15_LOG("SV publisher: %s\n", publisher.Backend().c_str());
+    }
+    if (svLaunchTimeUs) {
+      publisher.SetLaunchTime(int64_t{svLaunchTimeUs} * 1000);
+      BBX15_LOG("SV publisher: %s\n", publisher.Timing().c_str());
+    }
+
+    std::stop_callback stop_cb(token, [&]() { publisher.Stop(); });
+    {
+      TaskActivation activation(taskStatsSvPublisher, ThreadPerfCounters());   // the whole run
+      publisher.Start();
+    }
+    publisher.Print(stdout, publisher.StreamCount() > 1);
+  } catch (std::exception& error) {
+    BBX15_LOG("SV publisher exception was caught: %s\n", error.what());
+  }
+  BBX15_LOG("SV publisher task stopped.\n");
+}
+
+/**
+ * @brief GOOSE publisher task: the control blocks of the SCL file or one built-in block, the state is toggled from
+ *        the console
+ * @desc The data set values are the built-in ones, the member types of the SCL data sets are not resolved.
+ * @param token - stop task token
+ */
+void TaskWorker_GoosePublisher(std::stop_token token) {
+  try {
+    GoosePublisher publisher(goosePublishInterface);
+    // the console must not reach the publisher once it is destroyed, whichever way the task ends
+    struct Unpublish {
+      ~Unpublish() {
+        std::lock_guard lock(goosePublisherMutex);
+        goosePublisher = nullptr;
+      }
+    } unpublish;
+    std::vector<GooseControlBlock> blocks;
+    for (const SclGseControl& cb : gooseSclBlocks) {
+      GooseControlBlock& config = blocks.emplace_back();
+      config.gocb_ref = cb.Reference();
+      config.dat_set = cb.DataSetReference();
+      config.go_id = cb.go_id.empty() ? config.gocb_ref : cb.go_id;
+      config.conf_rev = cb.conf_rev;
+      config.min_interval_ms = cb.min_time_ms ? cb.min_time_ms : config.min_interval_ms;
+      config.heartbeat_ms = cb.max_time_ms ? cb.max_time_ms : config.heartbeat_ms;
+      if (cb.address.valid) {
+        config.app_id = cb.address.app_id;
+        std::copy(std::begin(cb.address.mac), std::end(cb.address.mac), config.dst);
+        config.vlan_id = cb.address.vlan_id;
+        config.vlan_priority = cb.address.vlan_priority;
+      }
+    }
+    if (blocks.empty()) {
+      GooseControlBlock& config = blocks.emplace_back();
+      config.gocb_ref = "BBX15CTRL/LLN0$GO$gcb01";
+      config.dat_set = "BBX15CTRL/LLN0$dsGoose1";
+      config.go_id = "BBX15GOOSE1";
+    }
+    {
+      std::lock_guard lock(goosePublisherMutex);
+      for (const GooseControlBlock& config : blocks) {
+        publisher.AddControlBlock(config, GooseDataSet());
+      }
+      goosePublisher = &publisher;
+    }
+
+    std::stop_callback stop_cb(token, [&]() { publisher.Stop(); });
+    {
+      TaskActivation activation(taskStatsGoosePublisher, ThreadPerfCounters());   // the whole run
+      publisher.Start();
+    }
+    {
+      std::lock_guard lock(goosePublisherMutex);
+      goosePublisher = nullptr;
+    }
+    publisher.Print();
+  } catch (std::exception& error) {
+    BBX15_LOG("GOOSE publisher exception was caught: %s\n", error.what());
+  }
+  BBX15_LOG("GOOSE publisher task stopped.\n");
+}
+
+/**
+ * @brief GOOSE subscriber task, prints state changes and expired control blocks
+ * @param token - stop task token
+ */
+void TaskWorker_GooseSubscriber(std::stop_token token) {
+  GooseSubscriber subscriber(gooseInterface);
+  std::stop_callback stop_cb(token, [&]() { subscriber.Stop(); });
+  try {
+    TaskActivation activation(taskStatsGooseSubscriber, ThreadPerfCounters());   // the whole run
+    subscriber.Start(
+       [&](const GooseFrame& frame, const GooseSubscriber::Stream& stream, bool state_changed) {
+         metricGooseFrames.Inc();
+         StatsPage::Add(pageGooseFrames);
+         if (state_changed) {
+           metricGooseStateChanges.Inc();
+           BBX15_LOG("GOOSE %s: stNum=%u values=%zu\n", stream.gocb_ref.c_str(), frame.st_num, frame.count);
+         }
+         if (gooseReportRequested.load(std::memory_order_relaxed)) {
+           gooseReportRequested = false;
+           subscriber.Print();
+         }
+       },
+       [](const GooseSubscriber::Stream& stream) {
+         metricGooseExpirations.Inc();
+         BBX15_LOG("GOOSE %s: timeAllowedtoLive expired\n", stream.gocb_ref.c_str());
+       });
+  } catch (std::exception& error) {
+    BBX15_LOG("GOOSE subscriber exception was caught: %s\n", error.what());
+  }
+  subscriber.Print();
+  BBX15_LOG("GOOSE subscriber task stopped.\n");
+}
+
+/**
+ * @brief Metrics endpoint task main function
+ * @desc Runs at idle priority and only answers scrapes of the metrics registry
+ * @param token - stop task token
+ */
+void TaskWorker_Metrics(std::stop_token token) {
+  try {
+    MetricsServer server(metricsAddress);
+    std::stop_callback stop_cb(token, [&]() { server.Stop(); });
+    BBX15_LOG("Metrics served on %s\n", metricsAddress.c_str());
+    server.Start();
+    server.Print();
+  } catch (std::exception& error) {
+    BBX15_LOG("Metrics server exception was caught: %s\n", error.what());
+  }
+  BBX15_LOG("Metrics task stopped.\n");
 }
 
 /************************************************************************/ /**
@@ -262,10 +1562,6 @@ void TaskWorker_Test(std::stop_token token) {
 ****************************************************************************/
 
 int main(int argc, char** argv) {
-  std::stop_source stopSource;   // Create a stop source
-  std::thread workerFswatcher;
-  std::thread workerTest;
-
   //----------------------------------------------------------
   // parse parameters
   //----------------------------------------------------------
@@ -274,31 +1570,176 @@ int main(int argc, char** argv) {
   // show information
   ShowVersion(argv[0]);
 
+  // the configuration file overrides the command line options
+  commandLineConfig = CommandLineConfig();
+  activeConfig = commandLineConfig;
+  if (!configFile.empty()) {
+    try {
+      configWatchPath = std::filesystem::absolute(configFile).lexically_normal().string();
+      stat(configFile.c_str(), &configStat);
+      activeConfig = ParseConfig(ReadConfigFile(configFile), commandLineConfig);
+      std::printf("Configuration %s\n", configWatchPath.c_str());
+    } catch (std::exception& error) {
+      std::printf("%s\n", error.what());
+      return EXIT_FAILURE;
+    }
+  }
+  if (!activeConfig.scl_file.empty()) {
+    try {
+      const uint64_t begin = CycleClock::Ticks();
+      stat(activeConfig.scl_file.c_str(), &sclStat);
+      LoadScl(activeConfig);
+      std::printf("SCL %s: %zu SV and %zu GOOSE control block(s) of IED %s, %zu SV stream(s) expected, %.1f ms\n",
+                  activeConfig.scl_file.c_str(), activeConfig.sv.streams.size(), activeConfig.goose_blocks.size(),
+                  activeConfig.scl_ied.empty() ? "-" : activeConfig.scl_ied.c_str(), activeConfig.sv.expected.size(),
+                  static_cast<double>(CycleClock::TicksToNs(static_cast<int64_t>(CycleClock::Ticks() - begin))) / 1e6);
+    } catch (std::exception& error) {
+      std::printf("%s\n", error.what());
+      return EXIT_FAILURE;
+    }
+  }
+  if (!configFile.empty() || !activeConfig.scl_file.empty()) {
+    configChangedFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+  SetTaskSettings(activeConfig);
+  std::atomic_store(&watchConfig, std::make_shared<const Config>(activeConfig));
+
+  // publish the statistics page before the tasks start writing to it
+  if (!statsPageName.empty()) {
+    try {
+      statsPage = std::make_unique<StatsPage>(StatsPage::Create(statsPageName));
+      TaskStats::AttachStatsPage(*statsPage);
+      pageFsEvents = statsPage->Allocate("fswatch events", StatsSlotKind::kCounter);
+      pageTaskWakeups = statsPage->Allocate("task wakeups", StatsSlotKind::kCounter);
+      pageSvFrames = statsPage->Allocate("sv frames", StatsSlotKind::kCounter);
+      pageGooseFrames = statsPage->Allocate("goose frames", StatsSlotKind::kCounter);
+      pageTestPendingWakeups = statsPage->Allocate("test pending wakeups", StatsSlotKind::kGauge);
+      pageTestWakeupLatency = statsPage->Allocate("test wakeup latency", StatsSlotKind::kHistogram);
+      std::printf("Statistics page %s\n", statsPage->Path().c_str());
+    } catch (std::exception& error) {
+      std::printf("Statistics page disabled: %s\n", error.what());
+    }
+  }
+
+  // SIGINT/SIGTERM are blocked in all tasks and received by the main loop, e.g. systemctl stop
+  sigset_t stopSignals;
+  sigemptyset(&stopSignals);
+  sigaddset(&stopSignals, SIGINT);
+  sigaddset(&stopSignals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+  const int signalFd = signalfd(-1, &stopSignals, SFD_CLOEXEC);
+
+  std::unique_ptr<ControlSocket> control;
+  if (!controlSocketPath.empty()) {
+    try {
+      control = std::make_unique<ControlSocket>(controlSocketPath);
+      std::printf("Control socket %s\n", control->Path().c_str());
+    } catch (std::exception& error) {
+      std::printf("Control socket disabled: %s\n", error.what());
+    }
+  }
+
   //----------------------------------------------------------
   // go to idle in main
   //----------------------------------------------------------
-  // Create all workers and pass stop tokens
-  workerTest = std::move(std::thread(TaskWorker_Test, stopSource.get_token()));
+  // messages of the tasks are formatted by a background thread
+  AsyncLog::Start();
+
+  // Create all workers, each with its own stop source
+  std::string warnings = StartTask(workerTest, TaskWorker_Test, activeConfig);
   // start task filesystem watcher
-  workerFswatcher = std::move(std::thread(TaskWorkerFsWatcher, stopSource.get_token()));
+  warnings += StartTask(workerFswatcher, TaskWorkerFsWatcher, activeConfig);
+  // start SV subscriber if requested
+  if (!svInterface.empty()) {
+    warnings += StartTask(workerSvSubscriber, TaskWorker_SvSubscriber, activeConfig);
+  }
+  // start SV publisher if requested
+  if (!svPublishInterface.empty()) {
+    warnings += StartTask(workerSvPublisher, TaskWorker_SvPublisher, activeConfig);
+  }
+  // start GOOSE publisher and subscriber if requested
+  if (!goosePublishInterface.empty()) {
+    warnings += StartTask(workerGoosePublisher, TaskWorker_GoosePublisher, activeConfig);
+  }
+  if (!gooseInterface.empty()) {
+    warnings += StartTask(workerGooseSubscriber, TaskWorker_GooseSubscriber, activeConfig);
+  }
+  // start metrics endpoint if requested
+  if (!metricsAddress.empty()) {
+    warnings += StartTask(workerMetrics, TaskWorker_Metrics, activeConfig);
+  }
+  std::printf("%s", warnings.c_str());
 
-  // main loop or sleep
-  while (true) {
-    if (HandleGetChar()) {
+  // main loop: console keys, control commands, configuration changes and stop signals
+  bool console = true;       // false after end of input, e.g. detached with stdin on /dev/null
+  int64_t reloadDueNs = 0;   // a changed configuration is reloaded once the file is quiet
+  while (!quitRequested) {
+    std::vector<pollfd> fds{
+       {signalFd, POLLIN, 0}, {console ? STDIN_FILENO : -1, POLLIN, 0}, {configChangedFd, POLLIN, 0}};
+    if (control) {
+      control->AddPollFds(fds);
+    }
+    const int64_t waitNs = reloadDueNs ? std::max<int64_t>(reloadDueNs - CycleClock::MonotonicNs(), 0) : -1;
+    if (poll(fds.data(), fds.size(), waitNs < 0 ? -1 : static_cast<int>(waitNs / 1'000'000 + 1)) < 0) {
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      signalfd_siginfo info{};
+      [[maybe_unused]] auto got = read(signalFd, &info, sizeof(info));
+      std::printf("Received signal %u\n", info.ssi_signo);
       break;
     }
+    if (fds[1].revents) {
+      char keys[64];
+      const ssize_t size = read(STDIN_FILENO, keys, sizeof(keys));
+      console = size > 0;
+      for (ssize_t i = 0; i < size && !quitRequested; ++i) {
+        quitRequested = HandleConsoleKey(keys[i]);
+      }
+    }
+    if (fds[2].revents & POLLIN) {
+      uint64_t count;
+      [[maybe_unused]] auto got = read(configChangedFd, &count, sizeof(count));
+      reloadDueNs = CycleClock::MonotonicNs() + kConfigSettleNs;
+    }
+    if (reloadDueNs && CycleClock::MonotonicNs() >= reloadDueNs) {
+      reloadDueNs = 0;
+      std::printf("%s", ReloadConfig(false).c_str());
+    }
+    if (control) {
+      control->Process(fds, HandleControlCommand);
+    }
   }
+  control.reset();
 
   std::printf("Request stop all tasks\n");
-  // set token to stop all worker
-  stopSource.request_stop();
+  // set tokens to stop all workers
+  for (TaskThread* worker : allWorkers) {
+    worker->RequestStop();
+  }
 
   // wakeup all tasks
   WakeUpTasks(true);
 
   // Join threads
-  workerTest.join();
-  workerFswatcher.join();
+  for (TaskThread* worker : allWorkers) {
+    worker->Join();
+  }
+  if (configChangedFd >= 0) {
+    close(configChangedFd);
+  }
+  AsyncLog::Stop();
+  AsyncLog::Print();
+  AllocTracker::Print();
+  LockProfiler::Print();
+  TaskStats::PrintAll();
+  if (!traceFile.empty()) {
+    try {
+      std::printf("%zu trace events written to %s\n", Tracer::Write(traceFile), traceFile.c_str());
+    } catch (std::exception& error) {
+      std::printf("%s\n", error.what());
+    }
+  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   global operator new and delete counting the allocations for AllocTracker, linked with BBX15_ALLOC_TRACKER
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include <alloc_tracker.hpp>
+
+//-----------------------------------------------------------------------------
+// replacement of the global allocation functions
+//-----------------------------------------------------------------------------
+namespace alloc_tracker_detail {
+
+void* Allocate(size_t size, size_t alignment, bool nothrow) {
+  AllocTracker::OnAllocate(size);
+  size = size ? size : 1;
+  void* p = alignment > alignof(std::max_align_t)
+               ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+               : std::malloc(size);
+  if (!p && !nothrow) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void Free(void* p) {
+  if (p) {
+    AllocTracker::OnFree();
+    std::free(p);
+  }
+}
+
+}   // namespace alloc_tracker_detail
+
+void* operator new(size_t size) { return alloc_tracker_detail::Allocate(size, 0, false); }
+void* operator new[](size_t size) { return alloc_tracker_detail::Allocate(size, 0, false); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return alloc_tracker_detail::Allocate(size, 0, true);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return alloc_tracker_detail::Allocate(size, 0, true);
+}
+void* operator new(size_t size, std::align_val_t align) {
+  return alloc_tracker_detail::Allocate(size, static_cast<size_t>(align), false);
+}
+void* operator new[](size_t size, std::align_val_t align) {
+  return alloc_tracker_detail::Allocate(size, static_cast<size_t>(align), false);
+}
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return alloc_tracker_detail::Allocate(size, static_cast<size_t>(align), true);
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return alloc_tracker_detail::Allocate(size, static_cast<size_t>(align), true);
+}
+
+void operator delete(void* p) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete[](void* p) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete(void* p, size_t) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete[](void* p, size_t) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { alloc_tracker_detail::Free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { alloc_tracker_detail::Free(p); }
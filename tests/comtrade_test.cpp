@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   COMTRADE checks: ASCII decoding, resampling and the vector rounding against the scalar reference
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include <comtrade.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+/**
+ * @brief halves, values next to halves and random values give the same integers on the vector and scalar paths
+ */
+static void VectorRoundsAsScalar() {
+  alignas(16) float a[kSvChannels] = {0.5f, -0.5f, 1.5f, -1.5f, 2.5f, -2.5f, 0.49999997f, -0.49999997f};
+  alignas(16) float b[kSvChannels] = {};
+  int32_t vector[kSvChannels], scalar[kSvChannels];
+  sv_detail::SvLerp(a, b, 0.0f, vector);
+  sv_detail::SvLerpScalar(a, b, 0.0f, scalar);
+  const int32_t expected[kSvChannels] = {1, -1, 2, -2, 3, -3, 0, 0};
+  Check(std::equal(vector, vector + kSvChannels, expected), "halves rounded away from zero");
+  Check(std::equal(scalar, scalar + kSvChannels, expected), "scalar halves rounded away from zero");
+
+  std::mt19937 random(15);
+  std::uniform_real_distribution<float> values(-100000.0f, 100000.0f), fractions(0.0f, 1.0f);
+  std::uniform_int_distribution<int> halves(-1000, 1000);
+  bool same = true;
+  for (int round = 0; round < 100000 && same; ++round) {
+    for (size_t i = 0; i < kSvChannels; ++i) {
+      a[i] = round % 2 ? values(random) : static_cast<float>(halves(random)) + 0.5f;
+      b[i] = values(random);
+    }
+    const float t = round % 2 ? fractions(random) : 0.0f;
+    sv_detail::SvLerp(a, b, t, vector);
+    sv_detail::SvLerpScalar(a, b, t, scalar);
+    same = std::equal(vector, vector + kSvChannels, scalar);
+  }
+  Check(same, "vector and scalar lerp equal");
+}
+
+/**
+ * @brief ASCII record of two channels, 1 kHz: values scaled by a and b, resampled to the same rate unchanged
+ */
+static void AsciiRoundTrip() {
+  char pattern[] = "/tmp/bbx15_comtrade.XXXXXX";
+  if (!mkdtemp(pattern)) {
+    Check(false, "temporary directory");
+    return;
+  }
+  const std::filesystem::path dir(pattern);
+  std::ofstream(dir / "rec.cfg") << "station,device,1999\n"
+                                    "2,2A,0D\n"
+                                    "1,Ia,A,,A,0.5,0,0,-32767,32767,1,1,P\n"
+                                    "2,Va,A,,kV,0.001,1,0,-32767,32767,1,1,P\n"
+                                    "50\n"
+                                    "1\n"
+                                    "1000,4\n"
+                                    "01/01/2023,00:00:00.000000\n"
+                                    "01/01/2023,00:00:00.000000\n"
+                                    "ASCII\n"
+                                    "1\n";
+  std::ofstream(dir / "rec.dat") << "1,0,2,1000\r\n"
+                                    "2,1000,-3,-2000\r\n"
+                                    "3,2000,1.5e1,\r\n"
+                                    "4,3000,+7,x\r\n";
+
+  const ComtradeRecord record(dir / "rec.cfg");
+  Check(record.SampleCount() == 4, "four samples");
+  Check(record.Channels().size() == 2 && record.Channels()[1].unit == "kV", "two channels");
+  const double expected[4][2] = {{1.0, 2.0}, {-1.5, -1.0}, {7.5, 1.0}, {3.5, 1.0}};   // missing and x read as 0
+  bool values = record.SampleCount() == 4;
+  for (size_t n = 0; values && n < 4; ++n) {
+    values = std::fabs(record.Time(n) - static_cast<double>(n) / 1000.0) < 1e-12 &&
+             std::fabs(record.Value(0, n) - expected[n][0]) < 1e-9 &&
+             std::fabs(record.Value(1, n) - expected[n][1]) < 1e-9;
+  }
+  Check(values, "ASCII values and times decoded");
+
+  const std::vector<int32_t> samples = ComtradeResample(record, 1000, {0, -1, -1, -1, 1, -1, -1, -1});
+  bool resampled = samples.size() == 4 * kSvChannels;
+  for (size_t n = 0; resampled && n < 4; ++n) {
+    const int32_t* sample = &samples[n * kSvChannels];
+    resampled = sample[0] == std::lround(expected[n][0] * 1000) && sample[4] == std::lround(expected[n][1] * 100000);
+  }
+  Check(resampled, "resampled at the record rate in mA and 10 mV");
+  std::filesystem::remove_all(dir);
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  try {
+    VectorRoundsAsScalar();
+    AsciiRoundTrip();
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   configuration file checks: parsing on top of a base, errors with line numbers, event filter, reload diff
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <config.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+/**
+ * @return message of the std::runtime_error thrown by ParseConfig(), empty if it parsed
+ */
+static std::string ParseError(std::string_view text) {
+  try {
+    ParseConfig(text);
+  } catch (const std::runtime_error& error) {
+    return error.what();
+  }
+  return {};
+}
+
+static void Parse() {
+  Config base;
+  base.roots = {"/base"};
+  base.excludes = {"*.tmp"};
+  base.sv.subscribe = "eth0";
+  const Config config = ParseConfig("# comment\n"
+                                    "[watch]\n"
+                                    "root = /data/\n"
+                                    "root = /data/../data\n"
+                                    "root = relative\n"
+                                    "events = created, deleted\n"
+                                    "exclude = *.swp   # editor files\n"
+                                    "[task test]\n"
+                                    "period = 0\n"
+                                    "priority = 10\n"
+                                    "[task sv-publisher]\n"
+                                    "priority = 80\n"
+                                    "[log]\n"
+                                    "level = debug\n",
+                                    base);
+  const std::string relative = (std::filesystem::current_path() / "relative").lexically_normal().string();
+  Check(config.roots == std::vector<std::string>{"/data", relative}, "roots replace the base, normalized, unique");
+  Check(config.events == (kWatchCreated | kWatchDeleted), "events");
+  Check(config.excludes == std::vector<std::string>{"*.swp"}, "excludes replace the base, comment stripped");
+  Check(config.test_period_ms == 1 && config.priorities.size() == 2 && config.priorities.at("test") == 10 &&
+            config.priorities.at("sv-publisher") == 80,
+        "task period clamped, priorities per task");
+  Check(config.log_level == "debug" && config.sv.subscribe == "eth0", "set keys changed, others kept from the base");
+
+  Check(ParseError("[watch]\nroot = /a\n[nonsense]\n").starts_with("Config: line 3: unknown section"),
+        "unknown section reported with its line");
+  Check(ParseError("[task x]\n\npriority = 100\n") == "Config: line 3: priority out of range 0..99",
+        "priority out of range");
+  Check(ParseError("[watch]\nevents = closed, renamed\n") ==
+            "Config: line 2: invalid value for events: closed, renamed",
+        "unknown event");
+  Check(ParseError("[sv]\nrate = 4000x\n").starts_with("Config: line 2: invalid value for rate"), "invalid number");
+  Check(ParseError("root = /a\n") == "Config: line 1: unknown key root", "key outside a section");
+}
+
+static void Watched() {
+  const Config config = ParseConfig("[watch]\nroot = /data\nevents = closed, deleted\nexclude = *.swp\n");
+  Check(config.Watched(kWatchClosed, "/data/a.txt"), "file below a root");
+  Check(config.Watched(kWatchDeleted, "/data/sub/dir/a.txt"), "file deep below a root");
+  Check(!config.Watched(kWatchClosed, "/data2/a.txt"), "sibling with the root as prefix not watched");
+  Check(!config.Watched(kWatchClosed, "/data"), "the root itself not watched");
+  Check(!config.Watched(kWatchModified, "/data/a.txt"), "deselected event");
+  Check(!config.Watched(kWatchClosed, "/data/.a.txt.swp"), "excluded file name");
+  Check(config.Watched(kWatchClosed, "/data/swp/a.txt"), "exclude matches the file name only");
+  Check(ParseConfig("[watch]\nroot = /\n").Watched(kWatchClosed, "/a"), "file below the root directory");
+}
+
+static void Diff() {
+  const Config from =
+      ParseConfig("[watch]\nroot = /a\nroot = /b\n[task test]\npriority = 10\n[sv]\nsubscribe = eth1\n");
+  Check(DiffConfig(from, from).Empty() && DiffConfig(from, from).Describe() == "no changes", "no changes");
+
+  Config to = from;
+  to.roots.push_back("/c");
+  ConfigDiff diff = DiffConfig(from, to);
+  Check(diff.roots_added == std::vector<std::string>{"/c"} && diff.roots_removed.empty() && !diff.filter,
+        "added root");
+  Check(diff.Describe() == "+root /c", "added root described");
+
+  to = ParseConfig("[watch]\nroot = /b\nexclude = *.swp\n[task sv-publisher]\npriority = 80\n"
+                   "[sv]\nsubscribe = eth1\nanalysis = 10\npublish = eth2\n");
+  diff = DiffConfig(from, to);
+  Check(diff.roots_removed == std::vector<std::string>{"/a"} && diff.roots_added.empty(), "removed root");
+  Check(diff.filter && !diff.test && !diff.log, "excludes change the filter only");
+  Check(diff.priorities == std::vector<std::string>{"sv-publisher", "test"}, "new and dropped priorities");
+  Check(diff.sv_subscriber && diff.sv_publisher && !diff.goose_publisher && !diff.goose_subscriber,
+        "analysis restarts the subscriber, a new publisher starts");
+  Check(diff.Describe() ==
+            "-root /a, filter, priority sv-publisher, priority test, restart sv-subscriber, restart sv-publisher",
+        "reload described");
+
+  Config idle = from;
+  idle.sv.subscribe.clear();
+  to = idle;
+  to.sv.analysis = 10;
+  Check(DiffConfig(idle, to).Empty(), "options of a task that does not run restart nothing");
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  try {
+    Parse();
+    Watched();
+    Diff();
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
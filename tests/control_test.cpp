@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   control socket checks of test_bbx15: events below a root added at run time are dispatched, below a
+*          removed root they are not
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+/**
+ * @brief client of the control socket, one reply per command line
+ */
+class Client {
+public:
+  explicit Client(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    for (int attempt = 0; attempt < 50; ++attempt) {   // until test_bbx15 listens
+      fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+        return;
+      }
+      close(fd_);
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    throw std::runtime_error("Client: cannot connect to " + path);
+  }
+
+  ~Client() { close(fd_); }
+
+  std::string Send(const std::string& command) {
+    const std::string line = command + "\n";
+    if (write(fd_, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+      throw std::runtime_error("Client: write failed");
+    }
+    // the reply is complete when nothing follows for a while
+    std::string reply;
+    char buffer[4096];
+    pollfd poll_fd{fd_, POLLIN, 0};
+    while (poll(&poll_fd, 1, reply.empty() ? 2000 : 100) > 0) {
+      const ssize_t size = read(fd_, buffer, sizeof(buffer));
+      if (size <= 0) {
+        break;
+      }
+      reply.append(buffer, static_cast<size_t>(size));
+    }
+    return reply;
+  }
+
+private:
+  int fd_{-1};
+};
+
+static void WriteFile(const std::filesystem::path& path, const std::string& text) {
+  std::ofstream(path) << text;
+}
+
+/**
+ * @return fswatch activations in the "stats" reply, 0 if the task has none yet
+ */
+static unsigned long FsActivations(Client& client) {
+  const std::string stats = client.Send("stats");
+  const char* kTask = "task fswatch: activations=";
+  const size_t found = stats.find(kTask);
+  return found == std::string::npos ? 0 : std::strtoul(stats.c_str() + found + std::strlen(kTask), nullptr, 10);
+}
+
+/**
+ * @brief waits until the fswatch task counted more than the given activations
+ */
+static bool ActivatedAfter(Client& client, unsigned long activations) {
+  for (int attempt = 0; attempt < 20; ++attempt) {
+    if (FsActivations(client) > activations) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return false;
+}
+
+static int RuntimeRoots(const char* program) {
+  char pattern[] = "/tmp/bbx15_control.XXXXXX";
+  if (!mkdtemp(pattern)) {
+    throw std::runtime_error("mkdtemp failed");
+  }
+  const std::filesystem::path dir(pattern);
+  std::filesystem::create_directory(dir / "configured");
+  std::filesystem::create_directory(dir / "added");
+  WriteFile(dir / "bbx15.conf", "[watch]\nroot = " + (dir / "configured").string() + "\n");
+  const std::string socket_path = (dir / "control").string();
+  const std::string config_path = (dir / "bbx15.conf").string();
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    const int null = open("/dev/null", O_RDWR);
+    dup2(null, STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    execl(program, program, "-F", config_path.c_str(), "-C", socket_path.c_str(), static_cast<char*>(nullptr));
+    _exit(127);
+  }
+  {
+    Client client(socket_path);
+    const unsigned long before = FsActivations(client);
+    WriteFile(dir / "added" / "early", "1");
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    Check(FsActivations(client) == before, "event below a directory that is no root is ignored");
+
+    Check(client.Send("add-root " + (dir / "added").string()).starts_with("adding "), "add-root accepted");
+    Check(client.Send("add-root " + (dir / "added").string() + "/").starts_with("error: already a root"),
+          "add-root of a root rejected");
+    Check(client.Send("roots").find((dir / "added").string()) != std::string::npos, "added root watched");
+    const unsigned long added = FsActivations(client);
+    WriteFile(dir / "added" / "file", "1");
+    Check(ActivatedAfter(client, added), "event below the added root dispatched");
+
+    Check(client.Send("remove-root " + (dir / "added").string()).starts_with("removing "), "remove-root accepted");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const unsigned long removed = FsActivations(client);
+    WriteFile(dir / "added" / "late", "1");
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    Check(FsActivations(client) == removed, "event below the removed root ignored");
+    Check(client.Send("remove-root " + (dir / "added").string()).starts_with("error: not a watched root"),
+          "remove-root of no root rejected");
+
+    const unsigned long configured = FsActivations(client);
+    WriteFile(dir / "configured" / "file", "1");
+    Check(ActivatedAfter(client, configured), "event below the configured root still dispatched");
+    client.Send("stop");
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  Check(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "test_bbx15 stopped cleanly");
+  std::filesystem::remove_all(dir);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 2) {
+      std::printf("usage: %s <test_bbx15>\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+    return RuntimeRoots(argv[1]);
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   bounded watcher checks: events of new subdirectories, watch capacity exhausted and freed, roots removed
+*          while running; returns 77 (skipped) without inotify
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fswatch_bounded.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+/**
+ * @brief poll a condition of the watcher thread for up to 2 s
+ */
+static bool WaitFor(const std::function<bool()>& condition) {
+  for (int n = 0; n < 200; ++n) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return condition();
+}
+
+struct Seen {
+  std::mutex mutex;
+  std::vector<std::pair<fswatch::Event, std::string>> events;
+  uint32_t close_mask{0};
+
+  bool Has(fswatch::Event type, const std::string& path) {
+    std::lock_guard lock(mutex);
+    return std::find(events.begin(), events.end(), std::make_pair(type, path)) != events.end();
+  }
+};
+
+/**
+ * @brief root with room for two subdirectories
+ */
+static void Capacity(const std::string& dir) {
+  using Event = fswatch::Event;
+  bounded_fswatch_limits limits;
+  limits.max_watches = 3;
+  limits.name_bytes = dir.size() + 16;
+  bounded_fswatch watcher(limits);
+  const size_t memory = watcher.memory_bytes();
+  Seen seen;
+  watcher.add_root(dir);
+  watcher.on({Event::FILE_CREATED, Event::FILE_CLOSED, Event::DIR_CREATED},
+             [&](const bounded_fswatch::event_view& event) {
+               std::lock_guard lock(seen.mutex);
+               seen.events.emplace_back(event.type, std::string(event.path));
+               if (event.type == Event::FILE_CLOSED) {
+                 seen.close_mask |= event.mask;
+               }
+             });
+  std::thread thread([&]() { watcher.start(); });
+  Check(WaitFor([&]() { return watcher.counters().watches == 1; }), "root watched");
+
+  std::ofstream(dir + "/a.txt") << "a";
+  Check(WaitFor([&]() { return seen.Has(Event::FILE_CLOSED, dir + "/a.txt"); }), "file in the root closed");
+  Check(seen.Has(Event::FILE_CREATED, dir + "/a.txt") && (seen.close_mask & IN_CLOSE_WRITE),
+        "created before closed, closed after writing");
+
+  std::filesystem::create_directory(dir + "/d1");
+  Check(WaitFor([&]() { return watcher.counters().watches == 2; }), "new subdirectory watched");
+  std::ofstream(dir + "/d1/b.txt") << "b";
+  Check(WaitFor([&]() { return seen.Has(Event::FILE_CLOSED, dir + "/d1/b.txt"); }),
+        "file in the subdirectory with its full path");
+
+  std::filesystem::create_directory(dir + "/d2");
+  Check(WaitFor([&]() { return watcher.counters().watches == 3; }), "second subdirectory watched");
+  std::filesystem::create_directory(dir + "/d3");
+  Check(WaitFor([&]() { return watcher.counters().dropped_watches == 1; }), "third subdirectory beyond capacity");
+  Check(WaitFor([&]() { return seen.Has(Event::DIR_CREATED, dir + "/d3"); }), "directory beyond capacity reported");
+
+  std::filesystem::remove_all(dir + "/d1");
+  Check(WaitFor([&]() { return watcher.counters().watches == 2; }), "watch of a removed directory freed");
+  std::filesystem::create_directory(dir + "/d4");
+  Check(WaitFor([&]() { return watcher.counters().watches == 3; }), "freed watch reused");
+  std::ofstream(dir + "/d4/c.txt") << "c";
+  Check(WaitFor([&]() { return seen.Has(Event::FILE_CLOSED, dir + "/d4/c.txt"); }),
+        "path built after the name pool was compacted");
+
+  watcher.remove_root(dir);
+  Check(WaitFor([&]() { return watcher.counters().watches == 0 && watcher.counters().name_bytes == 0; }),
+        "removed root frees its subdirectories");
+  Check(watcher.roots().empty(), "no roots left");
+  watcher.stop();
+  thread.join();
+
+  const bounded_fswatch_counters counters = watcher.counters();
+  Check(counters.dropped_paths == 0 && counters.overflows == 0, "nothing else dropped");
+  Check(counters.events == seen.events.size(), "every dispatched event counted");
+  Check(watcher.memory_bytes() == memory, "storage fixed at construction");
+}
+
+static void Limits() {
+  bounded_fswatch_limits limits;
+  limits.max_subscribers = 1;
+  bounded_fswatch watcher(limits);
+  watcher.on(fswatch::Event::FILE_CLOSED, [](const bounded_fswatch::event_view&) {});
+  bool rejected = false;
+  try {
+    watcher.on(fswatch::Event::FILE_CREATED, [](const bounded_fswatch::event_view&) {});
+  } catch (const std::invalid_argument&) {
+    rejected = true;
+  }
+  Check(rejected, "subscriber beyond capacity rejected");
+  rejected = false;
+  try {
+    watcher.add_root("/nonexistent/bbx15");
+  } catch (const std::invalid_argument&) {
+    rejected = true;
+  }
+  Check(rejected, "root that is no directory rejected");
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  const int fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0) {
+    std::printf("inotify not available, skipped\n");
+    return 77;
+  }
+  close(fd);
+  char pattern[] = "/tmp/bbx15_fswatch.XXXXXX";
+  if (!mkdtemp(pattern)) {
+    std::printf("FAILED: temporary directory\n");
+    return EXIT_FAILURE;
+  }
+  try {
+    Limits();
+    Capacity(pattern);
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    ++failures;
+  }
+  std::filesystem::remove_all(pattern);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
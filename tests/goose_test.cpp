@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   GOOSE decoder checks: optional goID, data members against the mandatory header fields
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+#include <goose.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+using Bytes = std::vector<uint8_t>;
+
+static Bytes Tlv(uint8_t tag, const Bytes& value) {
+  Bytes tlv{tag};
+  if (value.size() >= 0x80) {
+    tlv.push_back(0x81);
+  }
+  tlv.push_back(static_cast<uint8_t>(value.size()));
+  tlv.insert(tlv.end(), value.begin(), value.end());
+  return tlv;
+}
+
+static Bytes Text(uint8_t tag, std::string_view text) { return Tlv(tag, Bytes(text.begin(), text.end())); }
+
+/**
+ * @brief ethernet frame with a goosePdu of the given fields
+ */
+static Bytes Frame(std::initializer_list<Bytes> fields) {
+  Bytes pdu_content;
+  for (const Bytes& field : fields) {
+    pdu_content.insert(pdu_content.end(), field.begin(), field.end());
+  }
+  const Bytes pdu = Tlv(0x61, pdu_content);
+  Bytes frame{0x01, 0x0C, 0xCD, 0x01, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x88, 0xB8, 0x00, 0x01};
+  const size_t length = 8 + pdu.size();
+  frame.insert(frame.end(), {static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length), 0, 0, 0, 0});
+  frame.insert(frame.end(), pdu.begin(), pdu.end());
+  return frame;
+}
+
+static Bytes Concat(std::initializer_list<Bytes> parts) {
+  Bytes all;
+  for (const Bytes& part : parts) {
+    all.insert(all.end(), part.begin(), part.end());
+  }
+  return all;
+}
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+int main() {
+  const Bytes gocb_ref = Text(0x80, "IED1LD0/LLN0$GO$gcb01");
+  const Bytes tal = Tlv(0x81, {0x07, 0xD0});
+  const Bytes dat_set = Text(0x82, "IED1LD0/LLN0$dsGoose1");
+  const Bytes go_id = Text(0x83, "IED1GOOSE1");
+  const Bytes t = Tlv(0x84, {0, 0, 0, 1, 0, 0, 0, 0});
+  const Bytes st_num = Tlv(0x85, {0x01});
+  const Bytes sq_num = Tlv(0x86, {0x02});
+  const Bytes tail = Concat({Tlv(0x87, {0x00}), Tlv(0x88, {0x01}), Tlv(0x89, {0x00}), Tlv(0x8A, {0x02})});
+  // the tags of boolean (0x83) and unsigned (0x86) members equal those of goID and sqNum in the header
+  const Bytes all_data = Tlv(0xAB, Concat({Tlv(0x83, {0x01}), Tlv(0x86, {0x05})}));
+  GooseFrame frame;
+
+  Bytes data = Frame({gocb_ref, tal, dat_set, go_id, t, st_num, sq_num, tail, all_data});
+  Check(GooseDecode(data.data(), data.size(), frame), "complete frame decoded");
+  Check(frame.go_id == "IED1GOOSE1", "goID");
+  Check(frame.count == 2 && frame.values[0] == GooseValue::Boolean(true) && frame.values[1] == GooseValue::Unsigned(5),
+        "allData members");
+
+  data = Frame({gocb_ref, tal, dat_set, t, st_num, sq_num, tail, all_data});
+  Check(GooseDecode(data.data(), data.size(), frame), "frame without the optional goID decoded");
+  Check(frame.go_id.empty(), "goID empty if not sent");
+  Check(frame.sq_num == 2 && frame.count == 2, "fields of the frame without goID");
+
+  data = Frame({gocb_ref, tal, dat_set, go_id, t, st_num, tail, all_data});
+  Check(!GooseDecode(data.data(), data.size(), frame), "frame without sqNum rejected despite an unsigned member");
+
+  data = Frame({gocb_ref, dat_set, go_id, t, st_num, sq_num, tail, all_data});
+  Check(!GooseDecode(data.data(), data.size(), frame), "frame without timeAllowedToLive rejected");
+
+  // bit strings: padding above 7, padding without octets and no padding octet are malformed, the member is skipped
+  const Bytes quality = Tlv(0x84, {0x03, 0x80, 0x40});
+  data = Frame({gocb_ref, tal, dat_set, go_id, t, st_num, sq_num, tail, Tlv(0xAB, quality)});
+  Check(GooseDecode(data.data(), data.size(), frame) && frame.count == 1 &&
+            frame.values[0] == GooseValue::Quality(0x0201),
+        "bit string of 13 bits decoded");
+  for (const Bytes& malformed : {Tlv(0x84, {0x08, 0xFF}), Tlv(0x84, {0x0F, 0xFF, 0xFF}), Tlv(0x84, {0x01}),
+                                 Tlv(0x84, {})}) {
+    data = Frame({gocb_ref, tal, dat_set, go_id, t, st_num, sq_num, tail,
+                  Tlv(0xAB, Concat({malformed, Tlv(0x83, {0x01})}))});
+    Check(GooseDecode(data.data(), data.size(), frame) && frame.count == 1 &&
+              frame.values[0] == GooseValue::Boolean(true),
+          "malformed bit string rejected");
+  }
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
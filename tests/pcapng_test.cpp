@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   pcapng writer checks: files read back block by block across buffer handovers and size rotation
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <pcapng_writer.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+static uint32_t Get32(const uint8_t* p) {
+  uint32_t value;
+  std::memcpy(&value, p, 4);
+  return value;
+}
+
+/**
+ * @brief frame n: length 60 + n % 241, bytes derived from n
+ */
+static std::vector<uint8_t> Frame(uint32_t n) {
+  std::vector<uint8_t> frame(60 + n % 241);
+  for (size_t i = 0; i < frame.size(); ++i) {
+    frame[i] = static_cast<uint8_t>(n * 7 + i);
+  }
+  return frame;
+}
+
+static constexpr uint64_t kStartNs = 1'700'000'000'000'000'000u;
+
+/**
+ * @brief frame n is captured at n ms + 1 ns, so a packet names its frame even if frames before it were dropped
+ */
+static timespec FrameTime(uint32_t n) {
+  const uint64_t ns = kStartNs + uint64_t{n} * 1'000'000u + 1;
+  return timespec{static_cast<time_t>(ns / 1'000'000'000u), static_cast<long>(ns % 1'000'000'000u)};
+}
+
+/**
+ * @brief parse one file: SHB and IDB first, then Enhanced Packet Blocks compared with the frame of their timestamp
+ * @param next - lowest frame number expected, frame numbers must increase
+ * @param packets - incremented per packet
+ * @return false if the file is not well formed or a packet differs
+ */
+static bool ReadBack(const std::filesystem::path& file, uint32_t& next, uint64_t& packets) {
+  std::ifstream in(file, std::ios::binary);
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (data.size() < 60 || Get32(data.data()) != 0x0A0D0D0A || Get32(data.data() + 8) != 0x1A2B3C4D ||
+      Get32(data.data() + 28) != 0x00000001 || Get32(data.data() + 28 + 20) != 0x00000009) {
+    return false;
+  }
+  size_t offset = 60;
+  while (offset < data.size()) {
+    const uint8_t* p = data.data() + offset;
+    const uint32_t length = Get32(p + 4);
+    if (offset + length > data.size() || Get32(p) != 0x00000006 || Get32(p + length - 4) != length) {
+      return false;
+    }
+    const uint64_t ns = (uint64_t{Get32(p + 12)} << 32) | Get32(p + 16);
+    if (ns < kStartNs || (ns - kStartNs) % 1'000'000u != 1 || (ns - kStartNs) / 1'000'000u < next) {
+      return false;
+    }
+    const auto n = static_cast<uint32_t>((ns - kStartNs) / 1'000'000u);
+    const std::vector<uint8_t> frame = Frame(n);
+    if (Get32(p + 20) != frame.size() || Get32(p + 24) != frame.size() || length != 32 + ((frame.size() + 3) & ~3u) ||
+        std::memcmp(p + 28, frame.data(), frame.size()) != 0) {
+      return false;
+    }
+    offset += length;
+    next = n + 1;
+    ++packets;
+  }
+  return offset == data.size();
+}
+
+/**
+ * @brief frames spread over several 64 KiB buffers; optionally rotated every 20000 bytes
+ */
+static void WriteAndReadBack(uint64_t max_file_bytes) {
+  char pattern[] = "/tmp/bbx15_pcapng.XXXXXX";
+  if (!mkdtemp(pattern)) {
+    Check(false, "temporary directory");
+    return;
+  }
+  const std::filesystem::path dir(pattern);
+  constexpr uint32_t kFrames = 2000;
+  PcapngWriter writer((dir / "capture.pcapng").string(), max_file_bytes, 0, 16 * 4096, 4);
+  writer.Start();
+  for (uint32_t n = 0; n < kFrames; ++n) {
+    const std::vector<uint8_t> frame = Frame(n);
+    writer.Write(frame.data(), frame.size(), FrameTime(n));
+  }
+  writer.Stop();
+  // the capture thread never waits for storage: on a slow disk frames are dropped, but counted
+  const PcapngWriter::Statistics stats = writer.GetStatistics();
+  Check(stats.frames + stats.drops == kFrames && stats.frames > 0 && stats.write_errors == 0,
+        "frames written or counted as dropped");
+
+  uint32_t next = 0;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  unsigned files = 0;
+  for (;; ++files) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "capture_%05u.pcapng", files);
+    const std::filesystem::path file = dir / name;
+    if (!std::filesystem::exists(file)) {
+      break;
+    }
+    const uint64_t size = std::filesystem::file_size(file);
+    bytes += size;
+    Check(!max_file_bytes || size <= max_file_bytes, "rotated file within the size limit");
+    Check(ReadBack(file, next, packets), "file well formed, packets equal to the written frames");
+  }
+  Check(packets == stats.frames, "every written frame read back once, in order");
+  Check(files == stats.files && bytes == stats.bytes, "file count and size as in the statistics");
+  Check(max_file_bytes ? files > 1 : files == 1, max_file_bytes ? "files rotated by size" : "one file");
+  std::filesystem::remove_all(dir);
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  try {
+    WriteAndReadBack(0);
+    WriteAndReadBack(20000);
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SV alignment checks: two skewed streams aligned by smpCnt, gaps of a stopped stream flushed by Expire()
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <sv_align.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+struct Row {
+  uint16_t smp_cnt;
+  uint32_t present;
+  int32_t ia[2];
+};
+
+static SvAsdu Asdu(std::string_view sv_id, uint16_t smp_cnt, int32_t ia) {
+  SvAsdu asdu;
+  asdu.sv_id = sv_id;
+  asdu.smp_cnt = smp_cnt;
+  asdu.value[0] = ia;
+  return asdu;
+}
+
+static timespec Us(int64_t us) { return timespec{static_cast<time_t>(us / 1'000'000), (us % 1'000'000) * 1000}; }
+
+/**
+ * @brief MU2 arrives 3 samples behind MU1, its current is the negative of MU1's; MU2 stops after smpCnt 19
+ */
+static void SkewedStreams() {
+  constexpr int64_t kTimeoutUs = 1000;
+  std::vector<Row> rows;
+  SvAlignReport<2> report;
+  SvAlignBuffer<2, 16> align(4000, 8, kTimeoutUs * 1000, [&](const SvAlignBuffer<2, 16>::Sample& sample) {
+    report.Add(sample, 3);
+    Row row{sample.smp_cnt, sample.present, {}};
+    for (size_t i = 0; i < 2; ++i) {
+      row.ia[i] = sample.value[i] ? sample.value[i][0] : -1;
+    }
+    rows.push_back(row);
+  });
+  align.AddStream("MU1");
+  align.AddStream("MU2");
+
+  // smpCnt 3990..3999 and 0..19: the wrap of the second lies in the aligned range
+  int64_t now_us = 0;
+  for (int n = 0; n < 33; ++n, now_us += 250) {
+    if (n < 30) {
+      align.Insert(Asdu("MU1", static_cast<uint16_t>((3990 + n) % 4000), 100 + n), Us(now_us));
+    }
+    if (n >= 3) {
+      align.Insert(Asdu("MU2", static_cast<uint16_t>((3990 + n - 3) % 4000), -(100 + n - 3)), Us(now_us));
+    }
+  }
+  bool aligned = rows.size() == 30;
+  for (size_t n = 0; aligned && n < rows.size(); ++n) {
+    aligned = rows[n].smp_cnt == (3990 + n) % 4000 && rows[n].present == 3 && rows[n].ia[0] == 100 + int32_t(n) &&
+              rows[n].ia[1] == -(100 + int32_t(n));
+  }
+  Check(aligned, "30 complete rows in smpCnt order with the samples of both streams");
+  Check(report.differential_max[0] == 0 && report.missing == 0, "differential current of opposite streams zero");
+
+  // MU2 stops: MU1's rows wait for it, then leave with the timeout flagged as gaps
+  for (int n = 30; n < 34; ++n, now_us += 250) {
+    align.Insert(Asdu("MU1", static_cast<uint16_t>((3990 + n) % 4000), 100 + n), Us(now_us));
+  }
+  Check(rows.size() == 30, "rows of the stopped stream wait for the timeout");
+  align.Expire(Us(now_us + kTimeoutUs * 2));   // no Insert() any more, as from the capture loop's timeout
+  bool gaps = rows.size() == 34;
+  for (size_t n = 30; gaps && n < rows.size(); ++n) {
+    gaps = rows[n].smp_cnt == (3990 + n) % 4000 && rows[n].present == 1 && rows[n].ia[1] == -1;
+  }
+  Check(gaps, "rows of the stopped stream flagged as gaps");
+  Check(report.missing == 2, "report names the missing stream");
+  const auto& stats = align.GetStatistics();
+  Check(stats.complete == 30 && stats.gaps == 4 && stats.timeout_flushes > 0 && stats.late == 0,
+        "statistics: complete rows, gaps and timeouts");
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  SkewedStreams();
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SV analysis checks: RMS, fundamental phasor and frequency of synthetic 9-2LE streams
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numbers>
+
+#include <sv_analysis.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+static bool Near(double value, double expected, double tolerance) { return std::fabs(value - expected) <= tolerance; }
+
+/**
+ * @brief one second at 4000 samples/s: 100 A RMS on IA, 230 V RMS on VA lagging by 30 degrees
+ * @param frequency - signal frequency, the window stays at the nominal 80 samples
+ * @return last published result
+ */
+static SvPhasorResult Sine(double frequency) {
+  constexpr double kPi = std::numbers::pi;
+  SvPhasorResult last{};
+  int published = 0;
+  SvAnalysis<2, 80> analysis(4000, 50, 50, [&](const SvPhasorResult& result) {
+    last = result;
+    ++published;
+  });
+  SvAsdu asdu;
+  asdu.sv_id = "MU1";
+  for (uint32_t n = 0; n < 4000; ++n) {
+    const double phase = 2.0 * kPi * frequency * n / 4000.0;
+    asdu.smp_cnt = static_cast<uint16_t>(n);
+    asdu.value[0] = static_cast<int32_t>(std::lround(100'000.0 * std::numbers::sqrt2 * std::cos(phase)));
+    asdu.value[4] = static_cast<int32_t>(std::lround(23'000.0 * std::numbers::sqrt2 * std::cos(phase - kPi / 6)));
+    analysis.Process(asdu, timespec{1, static_cast<long>(n) * 250'000});
+  }
+  Check(published == 50, "one result per cycle at publish rate 50");
+  return last;
+}
+
+static void NominalFrequency() {
+  const SvPhasorResult r = Sine(50.0);
+  Check(r.sv_id == "MU1", "result names the stream");
+  Check(Near(r.rms[0], 100.0, 0.05) && Near(r.magnitude[0], 100.0, 0.05), "IA: 100 A RMS and magnitude");
+  Check(Near(r.rms[4], 230.0, 0.05) && Near(r.magnitude[4], 230.0, 0.05), "VA: 230 V RMS and magnitude");
+  Check(r.rms[1] == 0 && r.magnitude[7] == 0, "unused channels zero");
+  // the window starts at smpCnt 0, so the angle is the phase at the start of the second
+  const double shift = r.angle[0] - r.angle[4];
+  Check(Near(shift, std::numbers::pi / 6, 1e-3), "VA lags IA by 30 degrees");
+  Check(Near(r.frequency, 50.0, 1e-3), "frequency 50 Hz");
+}
+
+static void OffNominalFrequency() {
+  const SvPhasorResult r = Sine(50.5);
+  Check(Near(r.frequency, 50.5, 0.01), "frequency 50.5 Hz from the rotating phasor");
+  Check(Near(r.rms[4], 230.0, 0.5), "VA RMS off nominal");
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  NominalFrequency();
+  OffNominalFrequency();
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
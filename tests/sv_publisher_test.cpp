@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SV publisher checks: sample rates that do not divide the second, one timing loop with AF_XDP
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <sv_publisher.hpp>
+#include <sv_source.hpp>
+#include <xdp_socket.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static constexpr int kSkipped = 77;   ///< ctest SKIP_RETURN_CODE
+
+static int Fail(const char* what) {
+  std::printf("FAILED: %s\n", what);
+  return EXIT_FAILURE;
+}
+
+static void Publish(SvPublisher& publisher, int milliseconds) {
+  std::thread stopper([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));   // Start() waits for the next second
+    publisher.Stop();
+  });
+  publisher.Start();
+  stopper.join();
+}
+
+/**
+ * @brief 4800 sps (60 Hz, 80 samples per cycle) has a period of 208333.3 ns and is published
+ */
+static int PublishesFractionalPeriod(const char* interface) {
+  SvPublisher publisher(interface, 4800);
+  publisher.AddStream("TESTMU60", 0x4000, std::make_unique<SvSineSource>(4800, 60.0, 100.0, 230.0, 0.0));
+  Publish(publisher, 1500);
+  if (publisher.GetStatistics().frames == 0) {
+    return Fail("4800 sps publisher sent no frame");
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief SetLoops(4) with AF_XDP must run one loop, the TX ring has a single producer
+ */
+static int XdpRunsOneLoop(const char* interface) {
+  SvPublisher publisher(interface, 4000);
+  char sv_id[kSvMaxIdLength];
+  for (unsigned i = 0; i < 8; ++i) {
+    std::snprintf(sv_id, sizeof(sv_id), "TESTMU%02u", i + 1);
+    publisher.AddStream(sv_id, static_cast<uint16_t>(0x4000 + i),
+                        std::make_unique<SvSineSource>(4000, 50.0, 100.0, 230.0, 0.0));
+  }
+  publisher.SetLoops(4);
+  if (!publisher.UseXdp(XdpOptions{})) {
+    std::printf("skipped: %s\n", publisher.Backend().c_str());
+    return kSkipped;
+  }
+  Publish(publisher, 1500);
+  if (publisher.LoopCount() != 1) {
+    return Fail("AF_XDP publisher runs more than one loop");
+  }
+  if (publisher.GetStatistics().frames == 0) {
+    return Fail("AF_XDP publisher sent no frame");
+  }
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+  try {
+    const char* interface = argc > 1 ? argv[1] : "lo";
+    const int result = PublishesFractionalPeriod(interface);
+    return result != EXIT_SUCCESS ? result : XdpRunsOneLoop(interface);
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SV stream checks: smpCnt gaps, duplicates, reordering and quality flags counted by the quality monitor;
+*          svIDs of the full VisibleString(SIZE(1..65)) in the quality monitor, the analysis and the alignment
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include <sv_align.hpp>
+#include <sv_analysis.hpp>
+#include <sv_quality.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+static timespec Ms(int64_t ms) { return timespec{static_cast<time_t>(ms / 1000), (ms % 1000) * 1'000'000}; }
+
+static void Feed(SvQualityMonitor<4>& quality, SvAsdu& asdu, uint16_t smp_cnt, int64_t ms) {
+  asdu.smp_cnt = smp_cnt;
+  quality.Check(asdu, Ms(ms));
+}
+
+static void SmpCntSequence() {
+  SvQualityMonitor<4> quality;
+  SvAsdu asdu;
+  asdu.sv_id = "MU1";
+  int64_t ms = 1000;
+  for (uint16_t cnt : {0, 1, 2, 5}) {
+    Feed(quality, asdu, cnt, ms++);
+  }
+  const SvStreamQuality& s = quality.Stream(0);
+  Check(s.samples == 4 && s.missing == 2 && quality.GetTotals().missing == 2, "gap of smpCnt 3 and 4 counted");
+
+  Feed(quality, asdu, 4, ms++);
+  Check(s.reordered == 1 && s.missing == 1 && quality.GetTotals().missing == 1,
+        "late smpCnt 4 counted as reordered, no longer missing");
+  Feed(quality, asdu, 4, ms++);
+  Feed(quality, asdu, 5, ms++);
+  Check(s.duplicates == 2 && quality.GetTotals().duplicates == 2, "repeated smpCnt 4 and 5 counted as duplicates");
+
+  Feed(quality, asdu, 4000, ms++);
+  Check(s.out_of_range == 1 && s.missing == 1, "smpCnt 4000 out of range, sequence unchanged");
+
+  for (uint16_t cnt = 6; cnt < 4000; ++cnt) {
+    Feed(quality, asdu, cnt, ms);
+  }
+  Feed(quality, asdu, 0, ms);
+  Feed(quality, asdu, 1, ms);
+  Check(s.wraps == 1 && s.missing == 1 && s.reordered == 1, "wrap from 3999 to 0 no gap");
+
+  // silence beyond the restart timeout: the stream resynchronizes instead of counting 99 missing samples
+  Feed(quality, asdu, 100, ms + 1000);
+  Feed(quality, asdu, 101, ms + 1001);
+  Check(s.restarts == 1 && s.missing == 1, "restart after silence not counted as gap");
+}
+
+static void QualityFlags() {
+  SvQualityMonitor<4> quality;
+  SvAsdu asdu;
+  asdu.sv_id = "MU1";
+  const uint64_t events = quality.EventsTotal();
+  Feed(quality, asdu, 0, 1000);
+  asdu.quality[2] = kSvQualityQuestionable;
+  Feed(quality, asdu, 1, 1001);
+  asdu.quality[5] = kSvQualityInvalid;   // invalid wins over questionable
+  Feed(quality, asdu, 2, 1002);
+  Feed(quality, asdu, 3, 1003);
+  asdu.quality[2] = kSvQualityGood;
+  asdu.quality[5] = kSvQualityTest;
+  Feed(quality, asdu, 4, 1004);
+
+  const SvStreamQuality& s = quality.Stream(0);
+  Check(s.questionable_samples == 1 && s.invalid_samples == 2, "worst validity of the channels counted per sample");
+  Check(s.test_samples == 1 && s.validity == kSvQualityGood, "test bit counted, validity back to good");
+  Check(quality.EventsTotal() - events == 3, "quality changes logged: questionable, invalid, good");
+}
+
+static void SvIdLengths() {
+  const std::string longest(kSvMaxIdLength, 'M');
+  const std::string too_long(kSvMaxIdLength + 1, 'M');
+  const timespec ts{1, 0};
+
+  SvQualityMonitor<4> quality;
+  Check(quality.Expect(longest), "quality: 65 character svID accepted");
+  Check(!quality.Expect(too_long), "quality: 66 character svID rejected");
+  SvAsdu asdu;
+  asdu.sv_id = longest;
+  quality.Check(asdu, ts);
+  Check(quality.StreamCount() == 1 && quality.Stream(0).sv_id.View() == longest && quality.Stream(0).samples == 1,
+        "quality: sample of the 65 character svID counted");
+
+  std::string published;
+  SvAnalysis<2, 80> analysis(4000, 50, 4000, [&](const SvPhasorResult& result) { published = result.sv_id; });
+  for (uint16_t n = 0; n < 80; ++n) {
+    asdu.smp_cnt = n;
+    analysis.Process(asdu, ts);
+  }
+  Check(published == longest, "analysis: result of the 65 character svID");
+
+  SvAlignBuffer<2, 8> align(4000, 4, 1'000'000, nullptr);
+  bool added = true;
+  try {
+    align.AddStream(longest);
+  } catch (const std::invalid_argument&) {
+    added = false;
+  }
+  Check(added, "alignment: 65 character svID accepted");
+  bool rejected = false;
+  try {
+    align.AddStream(too_long);
+  } catch (const std::invalid_argument&) {
+    rejected = true;
+  }
+  Check(rejected, "alignment: 66 character svID rejected");
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  SmpCntSequence();
+  QualityFlags();
+  SvIdLengths();
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
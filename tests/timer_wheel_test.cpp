@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   timer wheel checks: due ticks across revolutions, cancel, re-arm from the callback as the GOOSE publisher
+*          does for its retransmissions
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include <timer_wheel.hpp>
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    std::printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+using Fired = std::vector<std::pair<size_t, uint64_t>>;   // timer id, tick
+
+/**
+ * @brief timers sharing a slot in different revolutions fire on their own tick only
+ */
+static void DueTicks() {
+  TimerWheel<8> wheel;
+  wheel.Reserve(4);
+  Fired fired;
+  auto fire = [&](size_t id) { fired.emplace_back(id, wheel.Now()); };
+
+  Check(wheel.NextDue() == TimerWheel<8>::kIdle, "idle wheel has no due tick");
+  wheel.Schedule(0, 5);
+  wheel.Schedule(1, 5 + 8);    // same slot, next revolution
+  wheel.Schedule(2, 3);
+  wheel.Schedule(3, 5 + 16);   // same slot, two revolutions ahead
+  Check(wheel.NextDue() == 3, "next due tick");
+
+  wheel.Advance(4, fire);
+  Check(fired == Fired{{2, 3}}, "only the timer due at 3 fired up to 4");
+  wheel.Advance(12, fire);
+  Check(fired == Fired{{2, 3}, {0, 5}}, "timer of the next revolution waits in the shared slot");
+  wheel.Advance(13, fire);
+  Check(fired.size() == 3 && fired[2] == std::make_pair(size_t{1}, uint64_t{13}), "second revolution fired at 13");
+  wheel.Advance(100, fire);
+  Check(fired.size() == 4 && fired[3] == std::make_pair(size_t{3}, uint64_t{21}), "third revolution fired at 21");
+  Check(wheel.Now() == 100 && wheel.NextDue() == TimerWheel<8>::kIdle, "wheel idle at the requested tick");
+}
+
+/**
+ * @brief cancelled and re-scheduled timers, a due tick in the past
+ */
+static void CancelAndReschedule() {
+  TimerWheel<8> wheel;
+  wheel.Reserve(3);
+  wheel.SetNow(50);
+  Fired fired;
+  auto fire = [&](size_t id) { fired.emplace_back(id, wheel.Now()); };
+
+  wheel.Schedule(0, 55);
+  wheel.Schedule(1, 55);
+  wheel.Schedule(2, 55);
+  wheel.Cancel(1);   // middle of the slot list
+  wheel.Cancel(1);   // twice is harmless
+  wheel.Schedule(2, 60);
+  wheel.Advance(58, fire);
+  Check(fired == Fired{{0, 55}}, "cancelled and moved timers not fired at 55");
+  wheel.Schedule(1, 10);   // in the past: fires on the next tick
+  wheel.Advance(60, fire);
+  Check(fired == Fired{{0, 55}, {1, 59}, {2, 60}}, "past due tick fired next, moved timer at its new tick");
+}
+
+/**
+ * @brief GOOSE retransmission: each firing re-arms the timer with a doubled interval up to a maximum
+ */
+static void RearmFromCallback() {
+  TimerWheel<16> wheel;
+  wheel.Reserve(2);
+  std::vector<uint64_t> ticks;
+  uint64_t interval = 1;
+  wheel.Schedule(0, 1);
+  wheel.Schedule(1, 40);
+  wheel.Advance(200, [&](size_t id) {
+    if (id != 0) {
+      wheel.Cancel(0);   // e.g. a state change stops the retransmissions
+      return;
+    }
+    ticks.push_back(wheel.Now());
+    interval = interval < 16 ? interval * 2 : 16;
+    wheel.Schedule(0, wheel.Now() + interval);
+  });
+  Check(ticks == std::vector<uint64_t>{1, 3, 7, 15, 31}, "retransmissions at doubling intervals until cancelled");
+  Check(wheel.NextDue() == TimerWheel<16>::kIdle && wheel.Now() == 200, "no timer left after the cancel");
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main() {
+  DueTicks();
+  CancelAndReschedule();
+  RearmFromCallback();
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
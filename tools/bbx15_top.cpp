@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   live view of the shared memory statistics page of test_bbx15
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <stats_page.hpp>
+
+//-----------------------------------------------------------------------------
+// local/global Variables Definitions
+//-----------------------------------------------------------------------------
+static std::string pageName{"bbx15"};
+static double interval{1.0};       ///< refresh period in seconds
+static unsigned iterations{0};     ///< 0 - until interrupted
+static volatile sig_atomic_t run = 1;
+
+/************************************************************************/ /**
+* @brief   view help
+* @param  prog - Name of the program in the display help
+****************************************************************************/
+static void ShowUsage(const char* prog) {
+  std::cout << "Usage: " << prog << " [OPTION]\n"
+            << "  -n, --name <name>        statistics page /dev/shm/<name> (default bbx15)\n"
+            << "  -d, --delay <s>          refresh period in seconds (default 1)\n"
+            << "  -c, --count <n>          exit after n refreshes, no screen clearing\n"
+            << "  -h, --help               this message\n\n";
+}
+
+/************************************************************************/ /**
+* @brief   parse command line parameters
+* @param argc - number parameters in command line
+* @param argv - command line parameters as array
+****************************************************************************/
+static void ProgramOptions(int argc, char* argv[]) {
+  for (;;) {
+    int option_index = 0;
+    static const char* short_options = "h?n:d:c:";
+    static const struct option long_options[] = {
+       {"help", no_argument, 0, 'h'},
+       {"name", required_argument, 0, 'n'},
+       {"delay", required_argument, 0, 'd'},
+       {"count", required_argument, 0, 'c'},
+       {0, 0, 0, 0},
+    };
+    int var = getopt_long(argc, argv, short_options, long_options, &option_index);
+    if (var == EOF) {
+      break;
+    }
+    switch (var) {
+      case 'n': {
+        pageName = optarg;
+        break;
+      }
+      case 'd': {
+        interval = std::stod(optarg);
+        break;
+      }
+      case 'c': {
+        iterations = static_cast<unsigned>(std::stoul(optarg));
+        break;
+      }
+      case '?':
+      case 'h':
+      default: {
+        ShowUsage(argv[0]);
+        exit(var == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+      }
+    }
+  }
+}
+
+static int64_t MonotonicNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+/**
+ * @brief upper bound of the bucket holding the quantile in us, as LatencyHistogram::Percentile()
+ */
+static double PercentileUs(const StatsSnapshot& s, double quantile) {
+  const auto target = static_cast<uint64_t>(quantile * static_cast<double>(s.count));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kStatsPageBuckets; ++i) {
+    seen += s.buckets[i];
+    if (seen > target) {
+      const double bound = static_cast<double>(uint64_t{1} << i);
+      return bound * 1000.0 < static_cast<double>(s.max) ? bound : static_cast<double>(s.max) / 1000.0;
+    }
+  }
+  return static_cast<double>(s.max) / 1000.0;
+}
+
+/**
+ * @brief one screen: counters with their rate, gauges with their maximum, histograms with rate and quantiles
+ */
+static void Render(const StatsPage& page, const std::vector<StatsSnapshot>& now,
+                   const std::vector<StatsSnapshot>& last, double seconds) {
+  std::printf("%s  pid %d  up %.0f s%s\n\n", page.Path().c_str(), page.Pid(),
+              static_cast<double>(MonotonicNs() - page.StartNs()) / 1e9,
+              kill(page.Pid(), 0) == 0 ? "" : "  (process gone)");
+  std::printf("%-28s %14s %12s %10s %10s %10s %10s\n", "NAME", "COUNT/VALUE", "RATE/s", "MEAN us", "P99 us",
+              "MAX us", "LAST us");
+  for (size_t i = 0; i < now.size(); ++i) {
+    const StatsSnapshot& s = now[i];
+    const uint64_t before = i < last.size() ? last[i].count : 0;
+    const double rate = seconds > 0 ? static_cast<double>(s.count - before) / seconds : 0.0;
+    switch (s.kind) {
+      case StatsSlotKind::kCounter:
+        std::printf("%-28s %14llu %12.1f\n", s.name.c_str(), static_cast<unsigned long long>(s.count), rate);
+        break;
+      case StatsSlotKind::kGauge:
+        std::printf("%-28s %14lld %12s %10s %10s %10lld\n", s.name.c_str(), static_cast<long long>(s.value), "-", "-",
+                    "-", static_cast<long long>(s.max));
+        break;
+      case StatsSlotKind::kHistogram:
+        std::printf("%-28s %14llu %12.1f %10.1f %10.1f %10.1f %10.1f\n", s.name.c_str(),
+                    static_cast<unsigned long long>(s.count), rate,
+                    s.count ? static_cast<double>(s.sum) / static_cast<double>(s.count) / 1000.0 : 0.0,
+                    PercentileUs(s, 0.99), static_cast<double>(s.max) / 1000.0, static_cast<double>(s.value) / 1000.0);
+        break;
+      case StatsSlotKind::kFree:
+        break;
+    }
+  }
+  std::fflush(stdout);
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   maps the statistics page read-only and renders it until interrupted
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters.
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  ProgramOptions(argc, argv);
+  signal(SIGINT, [](int) { run = 0; });
+  signal(SIGTERM, [](int) { run = 0; });
+
+  try {
+    const StatsPage page = StatsPage::Open(pageName);
+    std::vector<StatsSnapshot> last;
+    int64_t last_ns = 0;
+    for (unsigned n = 0; run && (iterations == 0 || n < iterations); ++n) {
+      std::vector<StatsSnapshot> now;
+      const size_t slots = page.Slots();
+      for (size_t i = 0; i < slots; ++i) {
+        now.push_back(page.Read(i));
+      }
+      const int64_t now_ns = MonotonicNs();
+      if (iterations == 0) {
+        std::printf("\033[H\033[2J");   // home and clear screen
+      }
+      Render(page, now, last, last_ns ? static_cast<double>(now_ns - last_ns) / 1e9 : 0.0);
+      last = std::move(now);
+      last_ns = now_ns;
+      if (iterations == 0 || n + 1 < iterations) {
+        const auto seconds = static_cast<time_t>(interval);
+        const timespec wait{seconds, static_cast<long>((interval - static_cast<double>(seconds)) * 1e9)};
+        nanosleep(&wait, nullptr);
+      }
+    }
+  } catch (std::exception& error) {
+    std::fprintf(stderr, "%s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   fixed benchmark suite qualifying a board: JSON results, markdown comparison and baseline diff
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <getopt.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <bench_suite.hpp>
+#include <board_info.hpp>
+
+//-----------------------------------------------------------------------------
+// local/global Variables Definitions
+//-----------------------------------------------------------------------------
+static std::string interfaceName;   ///< SV publish measurement, skipped if empty
+static double durationSeconds{10.0};
+static std::string outputFile;
+static std::string baselineFile;
+static bool markdown{false};
+static double thresholdPercent{10.0};
+
+static constexpr uint32_t kSamplesPerSecond = 4000;
+static constexpr uint32_t kPublishStreams = 8;
+static constexpr unsigned kStormFiles = 20'000;
+static constexpr unsigned kEncodeFrames = 1'000'000;
+static constexpr int64_t kWakeupPeriodNs = 1'000'000;   ///< idle, as the test task
+static constexpr int64_t kJitterPeriodNs = 250'000;     ///< loaded, the SV sample interval at 4000 Hz
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+/************************************************************************/ /**
+* @fn      void ShowUsage(const char* prog)
+* @brief   view help
+* @param  prog - Name of the program in the display help
+****************************************************************************/
+static void ShowUsage(const char* prog) {
+  std::cout << "Usage: " << prog << " [OPTION]                        run the suite\n"
+            << "       " << prog << " -m <results.json>...             markdown table of boards\n"
+            << "       " << prog << " -b <baseline.json> <results.json> compare with a baseline\n"
+            << "  -i, --interface <name>   publish SV on the interface (publish jitter is skipped without)\n"
+            << "  -d, --duration <s>       run time of each timing measurement (default 10)\n"
+            << "  -o, --output <file>      write the JSON results to the file (default stdout)\n"
+            << "  -m, --markdown           print the JSON files given as a markdown comparison table\n"
+            << "  -b, --baseline <file>    print the changes of the JSON file given against the baseline\n"
+            << "  -t, --threshold <%>      change counted as regression by -b (default 10)\n"
+            << "  -h, --help               this message\n\n";
+}
+
+/************************************************************************/ /**
+* @brief   parse command line parameters
+* @param argc - number parameters in command line
+* @param argv - command line parameters as array
+****************************************************************************/
+static void ProgramOptions(int argc, char* argv[]) {
+  for (;;) {
+    int option_index = 0;
+    static const char* short_options = "h?i:d:o:mb:t:";
+    static const struct option long_options[] = {
+       {"help", no_argument, 0, 'h'},
+       {"interface", required_argument, 0, 'i'},
+       {"duration", required_argument, 0, 'd'},
+       {"output", required_argument, 0, 'o'},
+       {"markdown", no_argument, 0, 'm'},
+       {"baseline", required_argument, 0, 'b'},
+       {"threshold", required_argument, 0, 't'},
+       {0, 0, 0, 0},
+    };
+
+    int var = getopt_long(argc, argv, short_options, long_options, &option_index);
+
+    if (var == EOF) {
+      break;
+    }
+    switch (var) {
+      case 'i':
+        interfaceName = optarg;
+        break;
+      case 'd':
+        durationSeconds = std::stod(optarg);
+        break;
+      case 'o':
+        outputFile = optarg;
+        break;
+      case 'm':
+        markdown = true;
+        break;
+      case 'b':
+        baselineFile = optarg;
+        break;
+      case 't':
+        thresholdPercent = std::stod(optarg);
+        break;
+      default: {
+        ShowUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+    }
+  }
+  if ((markdown && optind >= argc) || (!baselineFile.empty() && optind + 1 != argc) || durationSeconds <= 0) {
+    ShowUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief run the suite, progress goes to stderr
+ */
+static BenchReport RunSuite() {
+  BenchReport report;
+  report.board = ReadBoardInfo();
+  char date[32];
+  const time_t now = time(nullptr);
+  tm utc{};
+  gmtime_r(&now, &utc);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  report.date = date;
+  const auto add = [&](std::string name, double value, std::string unit, bool higher_is_better = false) {
+    std::fprintf(stderr, "  %-36s %12.2f %s\n", name.c_str(), value, unit.c_str());
+    report.results.push_back(BenchResult{std::move(name), value, std::move(unit), higher_is_better});
+  };
+  std::fprintf(stderr, "board: %s, %s, %u cores, governor %s\n", report.board.model.c_str(), report.board.cpu.c_str(),
+               report.board.cores, report.board.governor.c_str());
+
+  const auto storm = bench_suite::RunFswatchStorm("/tmp", kStormFiles);
+  add("fswatch throughput", storm.events * 1e9 / static_cast<double>(storm.elapsed_ns), "events/s", true);
+  add("fswatch lost events", static_cast<double>(storm.expected - storm.events), "events");
+
+  auto idle = bench_suite::RunPeriodic(kWakeupPeriodNs, durationSeconds, false);
+  const auto wakeup = bench_suite::Summarize(idle.latency_ns);
+  add("wakeup latency p50", wakeup.p50_us, "us");
+  add("wakeup latency p99", wakeup.p99_us, "us");
+  add("wakeup latency max", wakeup.max_us, "us");
+
+  auto loaded = bench_suite::RunPeriodic(kJitterPeriodNs, durationSeconds, true);
+  const auto jitter = bench_suite::Summarize(loaded.jitter_ns);
+  add("scheduling jitter p99 (loaded)", jitter.p99_us, "us");
+  add("scheduling jitter max (loaded)", jitter.max_us, "us");
+
+  add("SV encode", bench_suite::SvEncodeCost(kEncodeFrames, kSamplesPerSecond), "ns/frame");
+
+  if (!interfaceName.empty()) {
+    const auto publish = bench_suite::RunSvPublish(interfaceName, kPublishStreams, kSamplesPerSecond,
+                                                   durationSeconds);
+    add("SV publish jitter p99 (8 streams)", publish.stream_p99_us, "us");
+    add("SV publish wakeup p99", publish.wake_p99_us, "us");
+    add("SV publish overruns", static_cast<double>(publish.overruns), "cycles");
+  }
+
+  char settings[128];
+  std::snprintf(settings, sizeof(settings), "%g s per timing measurement, SV publish %s, %s", durationSeconds,
+                interfaceName.empty() ? "skipped" : "on the interface",
+                idle.realtime && loaded.realtime ? "SCHED_FIFO" : "no SCHED_FIFO");
+  report.settings = settings;
+  return report;
+}
+
+static std::string Cell(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), std::fabs(value) >= 100 ? "%.0f" : "%.2f", value);
+  return text;
+}
+
+/**
+ * @brief one column per board, one row per result in the order of the first report
+ */
+static void PrintMarkdown(const std::vector<BenchReport>& reports) {
+  std::printf("| | |");
+  for (const auto& report : reports) {
+    std::printf(" %s |", report.board.model.c_str());
+  }
+  std::printf("\n|---|---|");
+  for (size_t i = 0; i < reports.size(); ++i) {
+    std::printf("---:|");
+  }
+  std::printf("\n");
+  const auto row = [&](const char* name, auto field) {
+    std::printf("| %s | |", name);
+    for (const auto& report : reports) {
+      std::printf(" %s |", field(report).c_str());
+    }
+    std::printf("\n");
+  };
+  row("cpu", [](const BenchReport& r) { return r.board.cpu; });
+  row("cores", [](const BenchReport& r) { return std::to_string(r.board.cores); });
+  row("kernel", [](const BenchReport& r) { return r.board.kernel; });
+  row("governor", [](const BenchReport& r) { return r.board.governor; });
+  row("date", [](const BenchReport& r) { return r.date; });
+
+  std::vector<const BenchResult*> names;
+  for (const auto& report : reports) {
+    for (const auto& result : report.results) {
+      if (std::find_if(names.begin(), names.end(), [&](auto* r) { return r->name == result.name; }) == names.end()) {
+        names.push_back(&result);
+      }
+    }
+  }
+  for (const BenchResult* name : names) {
+    std::printf("| %s | %s%s |", name->name.c_str(), name->unit.c_str(),
+                name->higher_is_better ? ", higher is better" : "");
+    for (const auto& report : reports) {
+      const BenchResult* result = report.Find(name->name);
+      std::printf(" %s |", result ? Cell(result->value).c_str() : "-");
+    }
+    std::printf("\n");
+  }
+}
+
+/**
+ * @brief changes against the baseline
+ * @return number of results worse than the threshold
+ */
+static unsigned PrintDiff(const BenchReport& baseline, const BenchReport& current) {
+  std::printf("baseline %s of %s, current %s of %s\n", baseline.date.c_str(), baseline.board.model.c_str(),
+              current.date.c_str(), current.board.model.c_str());
+  const auto changed = [](const char* what, const std::string& from, const std::string& to) {
+    if (from != to) {
+      std::printf("%s changed: %s -> %s\n", what, from.c_str(), to.c_str());
+    }
+  };
+  changed("board", baseline.board.model, current.board.model);
+  changed("kernel", baseline.board.kernel, current.board.kernel);
+  changed("governor", baseline.board.governor, current.board.governor);
+  changed("settings", baseline.settings, current.settings);
+
+  std::printf("\n| | | baseline | current | change | |\n|---|---|---:|---:|---:|---|\n");
+  unsigned regressions = 0;
+  for (const auto& result : current.results) {
+    const BenchResult* base = baseline.Find(result.name);
+    if (!base) {
+      std::printf("| %s | %s | - | %s | | new |\n", result.name.c_str(), result.unit.c_str(),
+                  Cell(result.value).c_str());
+      continue;
+    }
+    // a zero baseline, e.g. no lost events, regresses on any increase
+    const double change = base->value != 0 ? (result.value - base->value) * 100.0 / std::fabs(base->value)
+                                           : (result.value != 0 ? (result.value > 0 ? 100.0 : -100.0) : 0.0);
+    const double worse = result.higher_is_better ? -change : change;
+    const bool regression = worse > thresholdPercent;
+    regressions += regression;
+    std::printf("| %s | %s | %s | %s | %+.1f%% | %s |\n", result.name.c_str(), result.unit.c_str(),
+                Cell(base->value).c_str(), Cell(result.value).c_str(), change,
+                regression ? "**regression**" : (-worse > thresholdPercent ? "improved" : ""));
+  }
+  for (const auto& base : baseline.results) {
+    if (!current.Find(base.name)) {
+      std::printf("| %s | %s | %s | - | | missing |\n", base.name.c_str(), base.unit.c_str(),
+                  Cell(base.value).c_str());
+    }
+  }
+  std::printf("\n%u regression(s) beyond %.1f%%\n", regressions, thresholdPercent);
+  return regressions;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   runs the suite or reports stored results
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters.
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE, for -b also on a regression
+****************************************************************************/
+int main(int argc, char** argv) {
+  ProgramOptions(argc, argv);
+
+  try {
+    if (markdown) {
+      std::vector<BenchReport> reports;
+      for (int i = optind; i < argc; ++i) {
+        reports.push_back(BenchReport::ReadJson(argv[i]));
+      }
+      PrintMarkdown(reports);
+      return EXIT_SUCCESS;
+    }
+    if (!baselineFile.empty()) {
+      return PrintDiff(BenchReport::ReadJson(baselineFile), BenchReport::ReadJson(argv[optind])) ? EXIT_FAILURE
+                                                                                                  : EXIT_SUCCESS;
+    }
+
+    const BenchReport report = RunSuite();
+    std::FILE* out = outputFile.empty() ? stdout : std::fopen(outputFile.c_str(), "w");
+    if (!out) {
+      std::perror(outputFile.c_str());
+      return EXIT_FAILURE;
+    }
+    report.WriteJson(out);
+    if (out != stdout) {
+      std::fclose(out);
+    }
+  } catch (const std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#!/bin/bash
+#
+# Qualify the boards in target/ with the same benchmark suite (tools/board_bench.cpp):
+#   - board_bench is cross compiled with cmake/arm-none-linux-gnueabihf.cmake and copied to the /app of each
+#     board, mounted on the host at target/<ip>/app by target/<ip>/mount_nfs_*.sh; unmounted boards are skipped
+#   - each board runs the suite over ssh, the results are stored in doc/bench/<ip>.json
+#   - doc/bench/README.md is generated from all results, the comparison table of the boards
+#   - results are compared with doc/bench/baseline/<ip>.json if present, -s stores them as the new baseline
+#
+# usage: tools/board_bench.sh [-H] [-s] [-u <ssh user>] [-i <interface>] [-d <seconds>] [<board ip>...]
+#   -H  include the host, stored as doc/bench/host.json
+#
+
+set -e
+
+SOURCE=$(cd "$(dirname "$0")/.." && pwd)
+CMAKE=${CMAKE:-cmake}
+SSH_USER=root
+IFACE=eth0
+DURATION=10
+HOST=0
+STORE=0
+
+while getopts "Hsu:i:d:h" option; do
+  case $option in
+    H) HOST=1 ;;
+    s) STORE=1 ;;
+    u) SSH_USER=$OPTARG ;;
+    i) IFACE=$OPTARG ;;
+    d) DURATION=$OPTARG ;;
+    *)
+      echo "usage: $0 [-H] [-s] [-u <ssh user>] [-i <interface>] [-d <seconds>] [<board ip>...]"
+      exit 1
+      ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+BOARDS=("$@")
+if [ ${#BOARDS[@]} -eq 0 ]; then
+  for dir in "$SOURCE"/target/*.*.*.*/; do
+    BOARDS+=("$(basename "$dir")")
+  done
+fi
+
+RESULTS="$SOURCE/doc/bench"
+mkdir -p "$RESULTS/baseline"
+
+"$CMAKE" -S "$SOURCE" -B "$SOURCE/build-bench-host" -DCMAKE_BUILD_TYPE=Release > /dev/null
+"$CMAKE" --build "$SOURCE/build-bench-host" -j"$(nproc)" --target board_bench > /dev/null
+BENCH_HOST="$SOURCE/build-bench-host/board_bench"
+
+QUALIFIED=()
+if [ "$HOST" -eq 1 ]; then
+  echo "== host"
+  "$BENCH_HOST" -d "$DURATION" -o "$RESULTS/host.json"
+  QUALIFIED+=(host)
+fi
+
+BUILT_ARM=0
+for board in "${BOARDS[@]}"; do
+  app="$SOURCE/target/$board/app"
+  if [ ! -d "$app" ] || [ -z "$(ls -A "$app" 2> /dev/null)" ]; then
+    echo "== $board: skipped, $app is not mounted"
+    continue
+  fi
+  if [ "$BUILT_ARM" -eq 0 ]; then
+    "$CMAKE" -S "$SOURCE" -B "$SOURCE/build-bench-arm" -DCMAKE_BUILD_TYPE=Release \
+      -DCMAKE_TOOLCHAIN_FILE="$SOURCE/cmake/arm-none-linux-gnueabihf.cmake" > /dev/null
+    "$CMAKE" --build "$SOURCE/build-bench-arm" -j"$(nproc)" --target board_bench > /dev/null
+    BUILT_ARM=1
+  fi
+  echo "== $board"
+  mkdir -p "$app/board_bench"
+  cp "$SOURCE/build-bench-arm/board_bench" "$app/board_bench/"
+  if ssh "$SSH_USER@$board" "/app/board_bench/board_bench -i $IFACE -d $DURATION -o /app/board_bench/$board.json"; then
+    cp "$app/board_bench/$board.json" "$RESULTS/"
+    QUALIFIED+=("$board")
+  else
+    echo "== $board: suite failed" 1>&2
+  fi
+done
+
+# comparison table of every board with results, also of boards not run this time
+FILES=()
+for file in "$RESULTS"/*.json; do
+  [ -e "$file" ] && FILES+=("$file")
+done
+if [ ${#FILES[@]} -gt 0 ]; then
+  {
+    echo "Board Benchmarks"
+    echo "===="
+    echo
+    echo "Generated by tools/board_bench.sh from doc/bench/*.json, do not edit."
+    echo
+    "$BENCH_HOST" -m "${FILES[@]}"
+  } > "$RESULTS/README.md"
+  echo "== $RESULTS/README.md: ${#FILES[@]} board(s)"
+fi
+
+REGRESSED=0
+for board in "${QUALIFIED[@]}"; do
+  if [ -e "$RESULTS/baseline/$board.json" ]; then
+    echo "== $board against its baseline"
+    "$BENCH_HOST" -b "$RESULTS/baseline/$board.json" "$RESULTS/$board.json" || REGRESSED=1
+  fi
+  if [ "$STORE" -eq 1 ]; then
+    cp "$RESULTS/$board.json" "$RESULTS/baseline/"
+  fi
+done
+exit $REGRESSED
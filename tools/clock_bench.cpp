@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   cost per time stamp of the cycle clock against clock_gettime
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <board_info.hpp>
+#include <cycle_clock.hpp>
+
+/**
+ * @brief average cost of one call in ns
+ */
+template <class Call>
+static double Cost(Call&& call, unsigned count) {
+  volatile uint64_t sink = 0;
+  const int64_t start = CycleClock::MonotonicNs();
+  for (unsigned i = 0; i < count; ++i) {
+    sink = sink + static_cast<uint64_t>(call());
+  }
+  return static_cast<double>(CycleClock::MonotonicNs() - start) / count;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   prints the cost per time stamp and the deviation after recalibration
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters, optional: number of calls per measurement
+* @return EXIT_SUCCESS
+****************************************************************************/
+int main(int argc, char** argv) {
+  const unsigned count = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 10'000'000;
+
+  std::printf("board: %s\n", BoardIdentity().c_str());
+  std::printf("counter: %s, %.3f MHz\n", CycleClock::kHardware ? "hardware" : "clock_gettime fallback",
+              CycleClock::Frequency() / 1e6);
+
+  const auto monotonic = []() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_nsec;
+  };
+  std::printf("%-28s %8.2f ns\n", "clock_gettime(MONOTONIC)", Cost(monotonic, count));
+  std::printf("%-28s %8.2f ns\n", "CycleClock::Ticks()", Cost(CycleClock::Ticks, count));
+  std::printf("%-28s %8.2f ns\n", "CycleClock::NowNs()", Cost(CycleClock::NowNs, count));
+
+  for (int second = 1; second <= 3; ++second) {
+    const timespec wait{1, 0};
+    nanosleep(&wait, nullptr);
+    const int64_t deviation = CycleClock::Recalibrate();
+    std::printf("recalibration after %d s: deviation %lld ns, %.6f MHz\n", second, static_cast<long long>(deviation),
+                CycleClock::Frequency() / 1e6);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   fswatch throughput under a file storm: create, write, close and delete in a watched directory
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <bench_suite.hpp>
+#include <board_info.hpp>
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   prints the events per second and the cost per event of the watcher thread
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters, optional: number of files, directory for the storm (default /tmp),
+*          watches of the fixed capacity bounded_fswatch (default 0 - fswatch)
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  const unsigned files = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 20'000;
+  const std::string parent = argc > 2 ? argv[2] : "/tmp";
+  const size_t capacity = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 0;
+
+  try {
+    std::printf("board: %s\n", BoardIdentity().c_str());
+    const auto storm = bench_suite::RunFswatchStorm(parent, files, capacity);
+    std::printf("events: %llu of %llu in %.3f s, %.0f events/s\n", static_cast<unsigned long long>(storm.events),
+                static_cast<unsigned long long>(storm.expected), storm.elapsed_ns / 1e9,
+                storm.events ? storm.events * 1e9 / storm.elapsed_ns : 0.0);
+    std::printf("%-28s %8.2f ns\n", capacity ? "bounded_fswatch per event" : "fswatch storm per event",
+                storm.events ? static_cast<double>(storm.elapsed_ns) / storm.events : 0.0);
+    return storm.events == storm.expected ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   cost per message of the asynchronous logger against fprintf
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <async_log.hpp>
+#include <board_info.hpp>
+#include <cycle_clock.hpp>
+
+/**
+ * @brief average cost of one call in ns, measured in bursts that fit into a log ring
+ * @desc the formatter drains the ring between the bursts, so no message is dropped
+ */
+template <class Call>
+static double Cost(Call&& call, unsigned count) {
+  constexpr unsigned kBurst = AsyncLog::kRingRecords / 2;
+  int64_t total = 0;
+  for (unsigned done = 0; done < count; done += kBurst) {
+    const int64_t start = CycleClock::MonotonicNs();
+    for (unsigned i = 0; i < kBurst; ++i) {
+      call(done + i);
+    }
+    total += CycleClock::MonotonicNs() - start;
+    const timespec wait{0, 2 * AsyncLog::kFlushIntervalMs * 1'000'000};
+    nanosleep(&wait, nullptr);
+  }
+  return static_cast<double>(total) / ((count + kBurst - 1) / kBurst * kBurst);
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   prints the cost per message of the logger and of fprintf, output goes to /dev/null
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters, optional: number of messages per measurement
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  const unsigned count = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 100'000;
+  std::FILE* null = std::fopen("/dev/null", "w");
+  if (!null) {
+    std::perror("/dev/null");
+    return EXIT_FAILURE;
+  }
+
+  std::printf("board: %s\n", BoardIdentity().c_str());
+  const char* id = "BBX15MU01";
+  const float value = 230.0f;
+
+  AsyncLog::Start(null);
+  const double log_short = Cost([&](unsigned i) { BBX15_LOG("GOOSE %s: stNum=%u values=%zu\n", id, i, size_t{3}); },
+                                count);
+  const double log_phasor = Cost(
+     [&](unsigned i) {
+       BBX15_LOG("%u.%06u %s f=%.3f Hz | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f\n", i, i,
+                 id, value, value, value, value, value, value, value, value, value, value, value, value, value);
+     },
+     count);
+  AsyncLog::Stop();
+  const double print_short =
+     Cost([&](unsigned i) { std::fprintf(null, "GOOSE %s: stNum=%u values=%zu\n", id, i, size_t{3}); }, count);
+  const double print_phasor = Cost(
+     [&](unsigned i) {
+       std::fprintf(null, "%u.%06u %s f=%.3f Hz | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f | %.2f %.2f@%.1f\n",
+                    i, i, id, value, value, value, value, value, value, value, value, value, value, value, value,
+                    value);
+     },
+     count);
+
+  std::printf("%-28s %8.2f ns\n", "BBX15_LOG 3 arguments", log_short);
+  std::printf("%-28s %8.2f ns\n", "BBX15_LOG 16 arguments", log_phasor);
+  std::printf("%-28s %8.2f ns\n", "fprintf 3 arguments", print_short);
+  std::printf("%-28s %8.2f ns\n", "fprintf 16 arguments", print_phasor);
+  AsyncLog::Print();
+  std::fclose(null);
+  return EXIT_SUCCESS;
+}
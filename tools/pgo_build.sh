@@ -0,0 +1,142 @@
+#!/bin/bash
+#
+# Profile guided and link time optimized build for the host or a board in target/:
+#   1. reference build: Release, no profile, no LTO
+#   2. instrumented build (BBX15_PGO=GENERATE), trained with tools/pgo_train.sh
+#   3. the same build directory rebuilt from the profile with LTO (BBX15_PGO=USE, BBX15_LTO=ON)
+#   4. the benchmarks of both builds, best of 3 runs, and the gain per benchmark
+#
+# A board is cross compiled with cmake/arm-none-linux-gnueabihf.cmake; binaries and the training script are
+# copied to its /app, mounted on the host at target/<ip>/app by target/<ip>/mount_nfs_*.sh, and run over ssh.
+# The board writes its profile below /app as well, GCOV_PREFIX moves it there.
+#
+# usage: tools/pgo_build.sh [-b <board ip>] [-u <ssh user>] [-i <interface>] [-d <seconds>]
+#
+
+set -e
+export LC_ALL=C
+
+SOURCE=$(cd "$(dirname "$0")/.." && pwd)
+CMAKE=${CMAKE:-cmake}
+BOARD=
+SSH_USER=root
+IFACE=
+DURATION=20
+
+while getopts "b:u:i:d:h" option; do
+  case $option in
+    b) BOARD=$OPTARG ;;
+    u) SSH_USER=$OPTARG ;;
+    i) IFACE=$OPTARG ;;
+    d) DURATION=$OPTARG ;;
+    *)
+      echo "usage: $0 [-b <board ip>] [-u <ssh user>] [-i <interface>] [-d <training seconds>]"
+      exit 1
+      ;;
+  esac
+done
+
+if [ -n "$BOARD" ]; then
+  NAME=$BOARD
+  IFACE=${IFACE:-eth0}
+  CROSS=(-DCMAKE_TOOLCHAIN_FILE="$SOURCE/cmake/arm-none-linux-gnueabihf.cmake")
+  APP="$SOURCE/target/$BOARD/app"
+  REMOTE=/app/bbx15_pgo
+  if [ ! -d "$APP" ]; then
+    echo "pgo_build: $APP missing, mount the board with target/$BOARD/mount_nfs_*.sh" 1>&2
+    exit 1
+  fi
+else
+  NAME=host
+  IFACE=${IFACE:-lo}
+  CROSS=()
+fi
+
+BUILD="$SOURCE/build-pgo-$NAME"
+PROFILE="$BUILD/pgo/profile"
+TARGETS=(test_bbx15 sv_codec_bench fswatch_bench log_bench clock_bench sv_capacity)
+BENCHMARKS=("sv_codec_bench" "fswatch_bench 20000 /tmp" "log_bench")
+
+build() {   # <dir> <cmake options...>
+  local dir=$1
+  shift
+  "$CMAKE" -S "$SOURCE" -B "$dir" -DCMAKE_BUILD_TYPE=Release "${CROSS[@]}" "$@" > /dev/null
+  "$CMAKE" --build "$dir" -j"$(nproc)" --target "${TARGETS[@]}"
+}
+
+# copy the training script next to the binaries of a build, for a board both to its /app
+deploy() {   # <binary dir>
+  cp "$SOURCE/tools/pgo_train.sh" "$1/"
+  if [ -z "$BOARD" ]; then
+    return
+  fi
+  local copy
+  copy="$APP/bbx15_pgo/$(basename "$1")"
+  mkdir -p "$copy"
+  for target in "${TARGETS[@]}"; do
+    cp "$1/$target" "$copy/"
+  done
+  cp "$SOURCE/tools/pgo_train.sh" "$copy/"
+}
+
+# run <binary dir> <command line>: on the host in the binary dir, on the board in its copy below /app
+run() {
+  local dir=$1
+  shift
+  if [ -z "$BOARD" ]; then
+    (cd "$dir" && eval "$*")
+  else
+    # strip the components of the profile directory, the files land in $REMOTE/profile
+    local strip
+    strip=$(printf '%s' "$PROFILE" | tr -cd / | wc -c)
+    ssh "$SSH_USER@$BOARD" "cd $REMOTE/$(basename "$dir") && GCOV_PREFIX=$REMOTE/profile GCOV_PREFIX_STRIP=$strip $*"
+  fi
+}
+
+# best result of 3 runs of each "<name> <value> ns" line of the benchmarks
+measure() {   # <binary dir> <output file>
+  local dir=$1 out=$2
+  : > "$out"
+  for benchmark in "${BENCHMARKS[@]}"; do
+    for _ in 1 2 3; do
+      run "$dir" "./$benchmark" | grep ' ns$' >> "$out"
+    done
+  done
+  awk '{ value = $(NF - 1); $(NF - 1) = ""; $NF = ""; sub(/ +$/, "");
+         if (!($0 in best) || value < best[$0]) best[$0] = value }
+       END { for (name in best) printf "%s\t%s\n", name, best[name] }' "$out" |
+    sort -t "$(printf '\t')" -k1,1 > "$out.best"
+}
+
+echo "== reference build"
+build "$BUILD/ref" -DBBX15_PGO=OFF -DBBX15_LTO=OFF
+deploy "$BUILD/ref"
+
+echo "== instrumented build"
+build "$BUILD/pgo" -DBBX15_PGO=GENERATE -DBBX15_PGO_DIR="$PROFILE" -DBBX15_LTO=OFF
+deploy "$BUILD/pgo"
+rm -rf "$PROFILE"
+if [ -n "$BOARD" ]; then
+  rm -rf "$APP/bbx15_pgo/profile"
+fi
+
+echo "== training on $NAME ($IFACE, $DURATION s)"
+run "$BUILD/pgo" "./pgo_train.sh . $IFACE $DURATION"
+if [ -n "$BOARD" ]; then
+  mkdir -p "$PROFILE"
+  cp "$APP/bbx15_pgo/profile/"*.gcda "$PROFILE/"
+fi
+echo "profile: $(find "$PROFILE" -name '*.gcda' | wc -l) files in $PROFILE"
+
+echo "== optimized build"
+build "$BUILD/pgo" -DBBX15_PGO=USE -DBBX15_PGO_DIR="$PROFILE" -DBBX15_LTO=ON
+deploy "$BUILD/pgo"
+
+echo "== benchmarks on $NAME"
+measure "$BUILD/ref" "$BUILD/ref.txt"
+measure "$BUILD/pgo" "$BUILD/pgo.txt"
+printf "%-30s %12s %12s %8s\n" "benchmark" "reference" "pgo+lto" "gain"
+join -t "$(printf '\t')" "$BUILD/ref.txt.best" "$BUILD/pgo.txt.best" |
+  awk -F '\t' '{ printf "%-30s %9.2f ns %9.2f ns %+7.1f%%\n", $1, $2, $3, ($2 > 0 ? ($2 - $3) * 100 / $2 : 0) }'
+printf "%-30s %12s %12s\n" "test_bbx15 size" "$(stat -c %s "$BUILD/ref/test_bbx15")" \
+  "$(stat -c %s "$BUILD/pgo/test_bbx15")"
@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# Training workload of the profile guided build (tools/pgo_build.sh), run with the instrumented binaries:
+# test_bbx15 with the periodic test task, a file storm in its watched root, a configuration reload and
+# simulated merging units published and subscribed with GOOSE on one interface, then the benchmarks once.
+# Raw sockets need root. Runs on the host or on a board, only a POSIX shell is required.
+#
+# usage: pgo_train.sh <binary dir> [interface (default lo)] [seconds (default 20)]
+#
+
+BIN=${1:?usage: pgo_train.sh <binary dir> [interface] [seconds]}
+IFACE=${2:-lo}
+DURATION=${3:-20}
+
+if [ "$(id -u)" -ne 0 ]; then
+  echo "pgo_train: not root, the SV and GOOSE tasks cannot open raw sockets" 1>&2
+fi
+
+WORK=$(mktemp -d /tmp/bbx15_pgo.XXXXXX) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+mkdir "$WORK/storm"
+
+config() {
+  cat > "$WORK/bbx15.conf.new" <<EOF
+[watch]
+root = $WORK/storm
+[task test]
+period = $1
+[sv]
+publish = $IFACE
+subscribe = $IFACE
+simulate = 4
+analysis = 50
+[goose]
+publish = $IFACE
+subscribe = $IFACE
+EOF
+  mv "$WORK/bbx15.conf.new" "$WORK/bbx15.conf"
+}
+
+config 10
+echo "pgo_train: test_bbx15 on $IFACE for $DURATION s"
+"$BIN/test_bbx15" -F "$WORK/bbx15.conf" < /dev/null > "$WORK/test_bbx15.log" 2>&1 &
+PID=$!
+sleep 1
+
+# file storm: create, write, close and delete, a reload in the middle
+END=$(($(date +%s) + DURATION))
+HALF=$(($(date +%s) + DURATION / 2))
+RELOADED=0
+while [ "$(date +%s)" -lt "$END" ]; do
+  for n in 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19; do
+    echo "$n" > "$WORK/storm/f$n"
+  done
+  rm -f "$WORK/storm/"f*
+  if [ "$RELOADED" -eq 0 ] && [ "$(date +%s)" -ge "$HALF" ]; then
+    config 5
+    RELOADED=1
+  fi
+done
+
+kill -TERM "$PID"
+wait "$PID"
+STATUS=$?
+if [ "$STATUS" -ne 0 ]; then
+  echo "pgo_train: test_bbx15 exited with $STATUS" 1>&2
+  tail -n 20 "$WORK/test_bbx15.log" 1>&2
+  exit 1
+fi
+
+echo "pgo_train: benchmarks"
+"$BIN/sv_codec_bench" 200000 > /dev/null &&
+  "$BIN/fswatch_bench" 5000 /tmp > /dev/null &&
+  "$BIN/log_bench" 20000 > /dev/null &&
+  "$BIN/clock_bench" 100000 > /dev/null &&
+  "$BIN/sv_capacity" -i "$IFACE" -m 4 -d 2 > /dev/null || {
+  echo "pgo_train: a benchmark failed" 1>&2
+  exit 1
+}
+echo "pgo_train: done"
@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SCL parse speed against the read speed of the file, optionally of a generated SCD of a given size
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <getopt.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <board_info.hpp>
+#include <scl_parser.hpp>
+
+//-----------------------------------------------------------------------------
+// local/global Variables Definitions
+//-----------------------------------------------------------------------------
+static std::string sclFile;
+static uint32_t generateMegabytes{0};   ///< write a generated SCD of this size to the file first, 0 - parse as is
+static unsigned repeats{3};
+static bool printBlocks{false};
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+/************************************************************************/ /**
+* @fn      void ShowUsage(const char* prog)
+* @brief   view help
+* @param  prog - Name of the program in the display help
+****************************************************************************/
+static void ShowUsage(const char* prog) {
+  std::cout << "Usage: " << prog << " -f <file> [OPTION]\n"
+            << "  -f, --file <scd>         SCL file to parse\n"
+            << "  -g, --generate <MB>      write a generated SCD of about <MB> megabytes to the file first\n"
+            << "  -n, --repeat <n>         parse runs (default 3), the first one may read from the disk\n"
+            << "  -p, --print              print the extracted control blocks\n"
+            << "  -h, --help               this message\n\n";
+}
+
+/************************************************************************/ /**
+* @brief   parse command line parameters
+* @param argc - number parameters in command line
+* @param argv - command line parameters as array
+****************************************************************************/
+static void ProgramOptions(int argc, char* argv[]) {
+  for (;;) {
+    int option_index = 0;
+    static const char* short_options = "h?f:g:n:p";
+    static const struct option long_options[] = {
+       {"help", no_argument, 0, 'h'},
+       {"file", required_argument, 0, 'f'},
+       {"generate", required_argument, 0, 'g'},
+       {"repeat", required_argument, 0, 'n'},
+       {"print", no_argument, 0, 'p'},
+       {0, 0, 0, 0},
+    };
+
+    int var = getopt_long(argc, argv, short_options, long_options, &option_index);
+
+    if (var == EOF) {
+      break;
+    }
+    switch (var) {
+      case 'f':
+        sclFile = optarg;
+        break;
+      case 'g':
+        generateMegabytes = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'n':
+        repeats = static_cast<unsigned>(std::stoul(optarg));
+        break;
+      case 'p':
+        printBlocks = true;
+        break;
+      default: {
+        ShowUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+    }
+  }
+  if (sclFile.empty() || repeats == 0) {
+    ShowUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief an SCD of merging units and protection IEDs: one SV and one GOOSE control block each, with the bulk of a
+ *        real file in LN/DOI instances, the substation section and the data type templates
+ */
+static void GenerateScd(const std::string& file, uint64_t bytes) {
+  std::FILE* out = std::fopen(file.c_str(), "w");
+  if (!out) {
+    throw std::runtime_error("cannot create " + file);
+  }
+  constexpr unsigned kLnPerIed = 120;
+  constexpr unsigned kBytesPerIed = kLnPerIed * 280 + 2000;   // measured size of one IED below
+  const unsigned ieds = static_cast<unsigned>(bytes / kBytesPerIed) + 1;
+
+  std::fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<!-- generated by scl_bench -->\n"
+                    "<SCL xmlns=\"http://www.iec.ch/61850/2003/SCL\" version=\"2007\" revision=\"B\">\n"
+                    "  <Header id=\"bench\" nameStructure=\"IEDName\"/>\n"
+                    "  <Substation name=\"S1\">\n");
+  for (unsigned i = 0; i < ieds; ++i) {
+    std::fprintf(out, "    <VoltageLevel name=\"V%u\"><Bay name=\"B%u\"><LNode iedName=\"IED%04u\" lnClass=\"LLN0\" "
+                      "lnInst=\"\"/></Bay></VoltageLevel>\n",
+                 i, i, i);
+  }
+  std::fprintf(out, "  </Substation>\n  <Communication>\n    <SubNetwork name=\"PB\" type=\"8-MMS\">\n");
+  for (unsigned i = 0; i < ieds; ++i) {
+    std::fprintf(out,
+                 "      <ConnectedAP iedName=\"IED%04u\" apName=\"AP1\">\n"
+                 "        <Address><P type=\"IP\">10.0.%u.%u</P></Address>\n"
+                 "        <GSE ldInst=\"LD0\" cbName=\"gcb01\"><Address>\n"
+                 "          <P type=\"MAC-Address\">01-0C-CD-01-%02X-%02X</P><P type=\"APPID\">%04X</P>\n"
+                 "          <P type=\"VLAN-ID\">00A</P><P type=\"VLAN-PRIORITY\">4</P></Address>\n"
+                 "          <MinTime unit=\"s\" multiplier=\"m\">4</MinTime><MaxTime unit=\"s\" "
+                 "multiplier=\"m\">1000</MaxTime></GSE>\n"
+                 "        <SMV ldInst=\"MU01\" cbName=\"MSVCB01\"><Address>\n"
+                 "          <P type=\"MAC-Address\">01-0C-CD-04-%02X-%02X</P><P type=\"APPID\">%04X</P>\n"
+                 "          <P type=\"VLAN-ID\">000</P><P type=\"VLAN-PRIORITY\">4</P></Address></SMV>\n"
+                 "      </ConnectedAP>\n",
+                 i, i >> 8 & 0xFF, i & 0xFF, i >> 8, i & 0xFF, 0x0001 + i, i >> 8, i & 0xFF, 0x4000 + i);
+  }
+  std::fprintf(out, "    </SubNetwork>\n  </Communication>\n");
+  for (unsigned i = 0; i < ieds; ++i) {
+    std::fprintf(out,
+                 "  <IED name=\"IED%04u\" manufacturer=\"bench\" type=\"MU\">\n"
+                 "    <AccessPoint name=\"AP1\"><Server><Authentication/>\n"
+                 "      <LDevice inst=\"MU01\"><LN0 lnClass=\"LLN0\" inst=\"\" lnType=\"LLN0_T\">\n"
+                 "        <DataSet name=\"PhsMeas1\">\n",
+                 i);
+    for (const char* ln : {"TCTR1", "TCTR2", "TCTR3", "TCTR4", "TVTR1", "TVTR2", "TVTR3", "TVTR4"}) {
+      std::fprintf(out,
+                   "          <FCDA ldInst=\"MU01\" lnClass=\"%.4s\" lnInst=\"%s\" doName=\"%s\" fc=\"MX\"/>\n",
+                   ln, ln + 4, ln[1] == 'C' ? "AmpSv" : "VolSv");
+    }
+    std::fprintf(out,
+                 "        </DataSet>\n"
+                 "        <SampledValueControl name=\"MSVCB01\" datSet=\"PhsMeas1\" smvID=\"IED%04uMU01\" "
+                 "confRev=\"1\" smpRate=\"80\" nofASDU=\"1\" multicast=\"true\"><SmvOpts refreshTime=\"false\" "
+                 "sampleSynchronized=\"true\"/></SampledValueControl>\n"
+                 "      </LN0>\n",
+                 i);
+    for (unsigned ln = 0; ln < kLnPerIed / 2; ++ln) {
+      std::fprintf(out,
+                   "        <LN lnClass=\"TCTR\" inst=\"%u\" lnType=\"TCTR_T\"><DOI name=\"Beh\"><DAI name=\"stVal\">"
+                   "<Val>on</Val></DAI></DOI><DOI name=\"AmpSv\"><SDI name=\"instMag\"><DAI name=\"i\" "
+                   "sAddr=\"ch%u\"/></SDI><DAI name=\"q\"/></DOI><DOI name=\"NamPlt\"><DAI name=\"d\"><Val>current "
+                   "transformer &amp; merging unit channel</Val></DAI></DOI></LN>\n",
+                   ln + 1, ln);
+    }
+    std::fprintf(out,
+                 "      </LDevice>\n"
+                 "      <LDevice inst=\"LD0\"><LN0 lnClass=\"LLN0\" inst=\"\" lnType=\"LLN0_T\">\n"
+                 "        <DataSet name=\"dsGoose1\"><FCDA ldInst=\"LD0\" prefix=\"Q0\" lnClass=\"XCBR\" lnInst=\"1\" "
+                 "doName=\"Pos\" daName=\"stVal\" fc=\"ST\"/><FCDA ldInst=\"LD0\" prefix=\"Q0\" lnClass=\"XCBR\" "
+                 "lnInst=\"1\" doName=\"Pos\" daName=\"q\" fc=\"ST\"/></DataSet>\n"
+                 "        <GSEControl name=\"gcb01\" datSet=\"dsGoose1\" appID=\"IED%04uGOOSE1\" confRev=\"2\" "
+                 "type=\"GOOSE\"/>\n"
+                 "      </LN0>\n",
+                 i);
+    for (unsigned ln = 0; ln < kLnPerIed / 2; ++ln) {
+      std::fprintf(out,
+                   "        <LN prefix=\"Q0\" lnClass=\"XCBR\" inst=\"%u\" lnType=\"XCBR_T\"><DOI name=\"Pos\">"
+                   "<DAI name=\"ctlModel\"><Val>status-only</Val></DAI></DOI><DOI name=\"Loc\"><DAI name=\"stVal\">"
+                   "<Val>false</Val></DAI></DOI><!-- breaker --><DOI name=\"OpCnt\"/></LN>\n",
+                   ln + 1);
+    }
+    std::fprintf(out, "      </LDevice>\n    </Server></AccessPoint>\n  </IED>\n");
+  }
+  std::fprintf(out, "  <DataTypeTemplates>\n"
+                    "    <LNodeType id=\"LLN0_T\" lnClass=\"LLN0\"><DO name=\"Beh\" type=\"ENS_Beh\"/></LNodeType>\n"
+                    "    <DOType id=\"ENS_Beh\" cdc=\"ENS\"><DA name=\"stVal\" bType=\"Enum\" type=\"Beh\" "
+                    "fc=\"ST\"/></DOType>\n"
+                    "    <EnumType id=\"Beh\"><EnumVal ord=\"1\">on</EnumVal>"
+                    "<EnumVal ord=\"5\">off</EnumVal></EnumType>\n"
+                    "  </DataTypeTemplates>\n</SCL>\n");
+  std::fclose(out);
+}
+
+static double Seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+ * @brief read the whole file in 1 MB blocks, the speed the parser is measured against
+ */
+static uint64_t ReadFile(const std::string& file) {
+  const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("cannot open " + file);
+  }
+  std::vector<char> buffer(1 << 20);
+  uint64_t total = 0;
+  for (ssize_t length; (length = read(fd, buffer.data(), buffer.size())) > 0;) {
+    total += static_cast<uint64_t>(length);
+  }
+  close(fd);
+  return total;
+}
+
+/**
+ * @brief bytes held by the extracted control blocks
+ */
+static size_t ExtractedBytes(const Scl& scl) {
+  size_t bytes = sizeof(scl);
+  const auto strings = [](const std::vector<std::string>& members) {
+    size_t size = members.capacity() * sizeof(std::string);
+    for (const auto& member : members) {
+      size += member.capacity() > 15 ? member.capacity() + 1 : 0;
+    }
+    return size;
+  };
+  for (const auto& cb : scl.sv) {
+    bytes += sizeof(cb) + strings(cb.members);
+  }
+  for (const auto& cb : scl.goose) {
+    bytes += sizeof(cb) + strings(cb.members);
+  }
+  return bytes;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   parses an SCL file a number of times and prints the parse speed against the read speed
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters.
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  ProgramOptions(argc, argv);
+
+  try {
+    if (generateMegabytes) {
+      GenerateScd(sclFile, uint64_t{generateMegabytes} << 20);
+    }
+    std::printf("board: %s, %s\n", BoardIdentity().c_str(), sclFile.c_str());
+    for (unsigned run = 0; run < repeats; ++run) {
+      auto begin = std::chrono::steady_clock::now();
+      const uint64_t bytes = ReadFile(sclFile);
+      const double read_s = Seconds(begin);
+      begin = std::chrono::steady_clock::now();
+      const Scl scl = ReadScl(sclFile);
+      const double parse_s = Seconds(begin);
+      const double mb = static_cast<double>(bytes) / (1 << 20);
+      std::printf("%.1f MB: read %.1f ms (%.0f MB/s), parse %.1f ms (%.0f MB/s), %zu SV + %zu GOOSE control "
+                  "blocks in %zu KB\n",
+                  mb, read_s * 1e3, mb / read_s, parse_s * 1e3, mb / parse_s, scl.sv.size(), scl.goose.size(),
+                  ExtractedBytes(scl) >> 10);
+      if (printBlocks && run + 1 == repeats) {
+        scl.Print();
+      }
+    }
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::printf("max resident set %ld KB (mapped file pages included)\n", usage.ru_maxrss);
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SV publisher capacity sweep: streams per board until the jitter limit
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <getopt.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <thread>
+
+#include <board_info.hpp>
+#include <sv_publisher.hpp>
+
+//-----------------------------------------------------------------------------
+// local/global Variables Definitions
+//-----------------------------------------------------------------------------
+static std::string interfaceName;
+static uint32_t samplesPerSecond{4000};
+static uint32_t loopCount{1};
+static uint32_t maxStreams{1024};
+static double thresholdUs{100.0};   ///< p99 send jitter limit of the worst stream
+static double stepSeconds{3.0};     ///< run time per step, the first second is the start delay
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+/************************************************************************/ /**
+* @fn      void ShowUsage(const char* prog)
+* @brief   view help
+* @param  prog - Name of the program in the display help
+****************************************************************************/
+static void ShowUsage(const char* prog) {
+  std::cout << "Usage: " << prog << " -i <interface> [OPTION]\n"
+            << "  -i, --interface <name>   transmit interface\n"
+            << "  -r, --sv-rate <n>        SV samples per second (default 4000)\n"
+            << "  -N, --loops <n>          timing loops, one per core (default 1)\n"
+            << "  -m, --max <n>            largest number of streams tried (default 1024)\n"
+            << "  -t, --threshold <us>     p99 send jitter limit of the worst stream (default 100)\n"
+            << "  -d, --duration <s>       run time per step (default 3)\n"
+            << "  -h, --help               this message\n\n";
+}
+
+/************************************************************************/ /**
+* @brief   parse command line parameters
+* @param argc - number parameters in command line
+* @param argv - command line parameters as array
+****************************************************************************/
+static void ProgramOptions(int argc, char* argv[]) {
+  for (;;) {
+    int option_index = 0;
+    static const char* short_options = "h?i:r:N:m:t:d:";
+    static const struct option long_options[] = {
+       {"help", no_argument, 0, 'h'},
+       {"interface", required_argument, 0, 'i'},
+       {"sv-rate", required_argument, 0, 'r'},
+       {"loops", required_argument, 0, 'N'},
+       {"max", required_argument, 0, 'm'},
+       {"threshold", required_argument, 0, 't'},
+       {"duration", required_argument, 0, 'd'},
+       {0, 0, 0, 0},
+    };
+
+    int var = getopt_long(argc, argv, short_options, long_options, &option_index);
+
+    if (var == EOF) {
+      break;
+    }
+    switch (var) {
+      case 'i':
+        interfaceName = optarg;
+        break;
+      case 'r':
+        samplesPerSecond = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'N':
+        loopCount = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'm':
+        maxStreams = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 't':
+        thresholdUs = std::stod(optarg);
+        break;
+      case 'd':
+        stepSeconds = std::stod(optarg);
+        break;
+      default: {
+        ShowUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+    }
+  }
+  if (interfaceName.empty() || stepSeconds <= 1.0) {
+    ShowUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+struct Step {
+  uint32_t streams;
+  double worst_p99_us;     ///< p99 send jitter of the worst stream
+  double wake_p99_us;      ///< p99 wake-up jitter of the loops
+  uint64_t overruns;
+  uint64_t send_errors;
+};
+
+/**
+ * @brief publish n simulated streams for one step
+ */
+static Step Measure(uint32_t streams) {
+  SvPublisher publisher(interfaceName, samplesPerSecond);
+  char sv_id[kSvMaxIdLength];
+  for (uint32_t i = 0; i < streams; ++i) {
+    std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02u", i + 1);
+    publisher.AddStream(sv_id, static_cast<uint16_t>(0x4000 + i),
+                        std::make_unique<SvSineSource>(samplesPerSecond, 50.0, 100.0 + 10.0 * (i % 10), 230.0,
+                                                       2.0 * std::numbers::pi * i / streams));
+  }
+  publisher.SetLoops(loopCount);
+  std::thread stopper([&]() {
+    std::this_thread::sleep_for(std::chrono::duration<double>(stepSeconds));
+    publisher.Stop();
+  });
+  publisher.Start();
+  stopper.join();
+
+  Step step{streams, 0, publisher.Jitter().Percentile(0.99) / 1000.0, publisher.GetStatistics().overruns,
+            publisher.GetStatistics().send_errors};
+  for (size_t i = 0; i < publisher.StreamCount(); ++i) {
+    const double p99 = publisher.StreamJitter(i).Percentile(0.99) / 1000.0;
+    step.worst_p99_us = p99 > step.worst_p99_us ? p99 : step.worst_p99_us;
+  }
+  return step;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   doubles the number of streams until the jitter limit is exceeded, then bisects to the knee
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters.
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  ProgramOptions(argc, argv);
+
+  try {
+    std::printf("board: %s, %u cores, %u sps, %u loop(s), limit p99 %.1f us\n", BoardIdentity().c_str(),
+                std::thread::hardware_concurrency(), samplesPerSecond, loopCount, thresholdUs);
+    std::printf("%8s %12s %12s %10s %12s\n", "streams", "p99 worst", "p99 wake", "overruns", "send errors");
+
+    const auto passed = [](const Step& step) {
+      return step.worst_p99_us <= thresholdUs && step.overruns == 0 && step.send_errors == 0;
+    };
+    const auto run = [&](uint32_t streams) {
+      const Step step = Measure(streams);
+      std::printf("%8u %9.1f us %9.1f us %10llu %12llu %s\n", step.streams, step.worst_p99_us, step.wake_p99_us,
+                  static_cast<unsigned long long>(step.overruns), static_cast<unsigned long long>(step.send_errors),
+                  passed(step) ? "" : "*");
+      std::fflush(stdout);
+      return passed(step);
+    };
+
+    uint32_t good = 0, bad = 0;
+    for (uint32_t streams = 1; streams <= maxStreams; streams *= 2) {
+      if (!run(streams)) {
+        bad = streams;
+        break;
+      }
+      good = streams;
+    }
+    while (bad && bad - good > 1 && bad - good > good / 16) {
+      const uint32_t streams = good + (bad - good) / 2;
+      (run(streams) ? good : bad) = streams;
+    }
+    if (bad) {
+      std::printf("knee: %u stream(s) within %.1f us, %u exceed it\n", good, thresholdUs, bad);
+    } else {
+      std::printf("knee: not reached up to %u stream(s)\n", good);
+    }
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
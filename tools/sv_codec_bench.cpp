@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   cost per frame of the SV hot paths: encode, decode and phasor analysis
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include <board_info.hpp>
+#include <cycle_clock.hpp>
+#include <sv.hpp>
+#include <sv_analysis.hpp>
+#include <sv_source.hpp>
+
+static constexpr uint32_t kSamplesPerSecond = 4000;
+static constexpr size_t kStreams = 8;
+
+/**
+ * @brief average cost of one call in ns
+ */
+template <class Call>
+static double Cost(Call&& call, unsigned count) {
+  volatile uint64_t sink = 0;
+  const int64_t start = CycleClock::MonotonicNs();
+  for (unsigned i = 0; i < count; ++i) {
+    sink = sink + static_cast<uint64_t>(call(i));
+  }
+  return static_cast<double>(CycleClock::MonotonicNs() - start) / count;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   prints the cost per frame of each stage for 8 interleaved streams as the publisher and subscriber run them
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters, optional: number of frames per measurement
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  const unsigned count = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 1'000'000;
+
+  try {
+    std::printf("board: %s\n", BoardIdentity().c_str());
+    const uint8_t dst[6]{0x01, 0x0C, 0xCD, 0x04, 0x00, 0x01};
+    const uint8_t src[6]{0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    std::vector<SvEncoder> encoders;
+    std::vector<std::unique_ptr<SvSource>> sources;
+    for (size_t i = 0; i < kStreams; ++i) {
+      char sv_id[16];
+      std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02zu", i + 1);
+      encoders.emplace_back(dst, src, static_cast<uint16_t>(0x4000 + i), sv_id, 1);
+      sources.push_back(std::make_unique<SvSineSource>(kSamplesPerSecond, 50.0, 100.0, 63500.0,
+                                                       2.0 * std::numbers::pi * i / kStreams));
+    }
+
+    const double encode = Cost(
+       [&](unsigned i) {
+         int32_t value[kSvChannels];
+         uint32_t quality[kSvChannels];
+         const unsigned stream = i % kStreams;
+         const uint64_t index = i / kStreams;
+         sources[stream]->Next(index, value, quality);
+         encoders[stream].SetSample(static_cast<uint16_t>(index % kSamplesPerSecond), value, quality);
+         return encoders[stream].data()[encoders[stream].size() - 1];
+       },
+       count);
+
+    // one second of frames of all streams, decoded and analysed in the order they were sent
+    std::vector<std::vector<uint8_t>> frames;
+    for (uint64_t index = 0; index < kSamplesPerSecond; ++index) {
+      for (size_t stream = 0; stream < kStreams; ++stream) {
+        int32_t value[kSvChannels];
+        uint32_t quality[kSvChannels];
+        sources[stream]->Next(index, value, quality);
+        encoders[stream].SetSample(static_cast<uint16_t>(index), value, quality);
+        frames.emplace_back(encoders[stream].data(), encoders[stream].data() + encoders[stream].size());
+      }
+    }
+
+    SvFrame frame;
+    const double decode = Cost(
+       [&](unsigned i) {
+         const auto& data = frames[i % frames.size()];
+         return SvDecode(data.data(), data.size(), frame) ? frame.asdu[0].smp_cnt : 0u;
+       },
+       count);
+
+    uint64_t results = 0;
+    SvAnalysis<kStreams> analysis(kSamplesPerSecond, 50, 50.0, [&](const SvPhasorResult&) { ++results; });
+    timespec ts{};
+    const double analyse = Cost(
+       [&](unsigned i) {
+         const auto& data = frames[i % frames.size()];
+         if (!SvDecode(data.data(), data.size(), frame)) {
+           return uint64_t{0};
+         }
+         analysis.Process(frame, ts);
+         return results;
+       },
+       count);
+
+    std::printf("%-28s %8.2f ns\n", "SV encode per frame", encode);
+    std::printf("%-28s %8.2f ns\n", "SV decode per frame", decode);
+    std::printf("%-28s %8.2f ns\n", "SV decode+analysis per frame", analyse);
+  } catch (const std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,292 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   replay of a pcap/pcapng capture with the recorded frame timing
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <getopt.h>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cycle_clock.hpp>
+#include <latency_histogram.hpp>
+#include <pcap_file.hpp>
+
+//-----------------------------------------------------------------------------
+// local/global Variables Definitions
+//-----------------------------------------------------------------------------
+static std::string interfaceName;
+static std::string captureFile;
+static double timeScale{1.0};   ///< replay speed factor, 2.0 - twice as fast
+static unsigned loopCount{1};   ///< 0 - until interrupted
+static std::atomic<bool> run{true};
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+/************************************************************************/ /**
+* @fn      void ShowUsage(const char* prog)
+* @brief   view help
+* @param  prog - Name of the program in the display help
+****************************************************************************/
+static void ShowUsage(const char* prog) {
+  std::cout << "Usage: " << prog << " -i <interface> -f <capture> [OPTION]\n"
+            << "  -i, --interface <name>   transmit interface\n"
+            << "  -f, --file <capture>     pcap or pcapng capture\n"
+            << "  -s, --scale <factor>     replay speed, 2 - twice as fast (default 1)\n"
+            << "  -n, --loops <n>          replay n times, 0 - until interrupted (default 1)\n"
+            << "  -h, --help               this message\n\n";
+}
+
+/************************************************************************/ /**
+* @brief   parse command line parameters
+* @param argc - number parameters in command line
+* @param argv - command line parameters as array
+****************************************************************************/
+static void ProgramOptions(int argc, char* argv[]) {
+  for (;;) {
+    int option_index = 0;
+    static const char* short_options = "h?i:f:s:n:";
+    static const struct option long_options[] = {
+       {"help", no_argument, 0, 'h'},
+       {"interface", required_argument, 0, 'i'},
+       {"file", required_argument, 0, 'f'},
+       {"scale", required_argument, 0, 's'},
+       {"loops", required_argument, 0, 'n'},
+       {0, 0, 0, 0},
+    };
+
+    int var = getopt_long(argc, argv, short_options, long_options, &option_index);
+
+    if (var == EOF) {
+      break;
+    }
+    switch (var) {
+      case 'i':
+        interfaceName = optarg;
+        break;
+      case 'f':
+        captureFile = optarg;
+        break;
+      case 's':
+        timeScale = std::stod(optarg);
+        break;
+      case 'n':
+        loopCount = static_cast<unsigned>(std::stoul(optarg));
+        break;
+      default: {
+        ShowUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+    }
+  }
+  if (interfaceName.empty() || captureFile.empty() || timeScale <= 0) {
+    ShowUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief PACKET_MMAP transmit ring
+ * @desc Frames are copied into free slots ahead of their deadline; at the deadline only the status words are set and
+ *       the kernel is kicked with one send() for all frames due at that time.
+ */
+class TxRing {
+ public:
+  static constexpr unsigned kFrameSize = 2048;
+  static constexpr unsigned kFrameCount = 1024;
+
+  explicit TxRing(const std::string& interface_name) {
+    fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd_ < 0) {
+      throw std::runtime_error("packet socket failed: " + std::string(strerror(errno)));
+    }
+    int version = TPACKET_V2;
+    setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version));
+    tpacket_req req{};
+    req.tp_block_size = kFrameSize * 32;
+    req.tp_frame_size = kFrameSize;
+    req.tp_block_nr = kFrameCount / 32;
+    req.tp_frame_nr = kFrameCount;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+      close(fd_);
+      throw std::runtime_error("PACKET_TX_RING failed: " + std::string(strerror(errno)));
+    }
+    void* ring = mmap(nullptr, Size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (ring == MAP_FAILED) {
+      close(fd_);
+      throw std::runtime_error("TX ring mmap failed");
+    }
+    ring_ = static_cast<uint8_t*>(ring);
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_ifindex = static_cast<int>(if_nametoindex(interface_name.c_str()));
+    if (addr.sll_ifindex == 0 || bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      munmap(ring_, Size());
+      close(fd_);
+      throw std::runtime_error("cannot bind to interface " + interface_name);
+    }
+  }
+
+  ~TxRing() {
+    if (ring_) {
+      munmap(ring_, Size());
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  /**
+   * @brief copy a frame into a slot, waits until the kernel released the slot
+   */
+  void Load(unsigned slot, const PcapFrame& frame) {
+    auto* hdr = Header(slot);
+    while (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) {
+      send(fd_, nullptr, 0, MSG_DONTWAIT);
+    }
+    const uint32_t size = frame.size < kFrameSize - kDataOffset ? frame.size : kFrameSize - kDataOffset;
+    std::memcpy(reinterpret_cast<uint8_t*>(hdr) + kDataOffset, frame.data, size);
+    hdr->tp_len = size;
+  }
+
+  void Request(unsigned slot) { __atomic_store_n(&Header(slot)->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE); }
+
+  /**
+   * @brief transmit all requested slots
+   * @return false on error
+   */
+  bool Kick() { return send(fd_, nullptr, 0, MSG_DONTWAIT) >= 0 || errno == EAGAIN || errno == ENOBUFS; }
+
+ private:
+  static constexpr unsigned kDataOffset = TPACKET2_HDRLEN - sizeof(sockaddr_ll);
+
+  tpacket2_hdr* Header(unsigned slot) { return reinterpret_cast<tpacket2_hdr*>(ring_ + slot * kFrameSize); }
+  static constexpr size_t Size() { return static_cast<size_t>(kFrameSize) * kFrameCount; }
+
+  int fd_{-1};
+  uint8_t* ring_{nullptr};
+};
+
+/**
+ * @brief replay all frames once
+ * @param wake - wake-up/transmit time against the scheduled deadline
+ * @param interval - achieved inter-frame interval against the recorded (scaled) interval
+ */
+static uint64_t Replay(TxRing& tx, const std::vector<PcapFrame>& frames, LatencyHistogram& wake,
+                       LatencyHistogram& interval, uint64_t& errors, size_t base) {
+  // the kernel walks the ring from where the previous loop stopped, slots are offset by base
+  const auto slot = [base](size_t index) { return static_cast<unsigned>((base + index) % TxRing::kFrameCount); };
+  const size_t count = frames.size();
+  const size_t preload = count < TxRing::kFrameCount ? count : TxRing::kFrameCount;
+  for (size_t k = 0; k < preload; ++k) {
+    tx.Load(slot(k), frames[k]);
+  }
+  const int64_t first_ts = frames.front().ts_ns;
+  const int64_t start = CycleClock::MonotonicNs() + 10'000'000;
+  int64_t previous_sent = 0, previous_deadline = 0;
+  uint64_t sent = 0;
+
+  for (size_t k = 0; k < count && run.load(std::memory_order_relaxed);) {
+    const int64_t deadline = start + static_cast<int64_t>(static_cast<double>(frames[k].ts_ns - first_ts) / timeScale);
+    const timespec abs{static_cast<time_t>(deadline / 1'000'000'000), static_cast<long>(deadline % 1'000'000'000)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &abs, nullptr) == EINTR) {
+    }
+    // all frames recorded with the same timestamp leave with one kick
+    size_t last = k;
+    while (last + 1 < count && last + 1 < k + TxRing::kFrameCount && frames[last + 1].ts_ns == frames[k].ts_ns) {
+      ++last;
+    }
+    for (size_t j = k; j <= last; ++j) {
+      tx.Request(slot(j));
+    }
+    if (!tx.Kick()) {
+      ++errors;
+    }
+    const int64_t now = CycleClock::NowNs();
+    wake.Add(now - deadline);
+    if (previous_sent) {
+      interval.Add((now - previous_sent) - (deadline - previous_deadline));
+    }
+    previous_sent = now;
+    previous_deadline = deadline;
+    sent += last - k + 1;
+
+    // refill the released slots with the frames following the ring window
+    for (size_t j = k; j <= last; ++j) {
+      if (j + TxRing::kFrameCount < count) {
+        tx.Load(slot(j), frames[j + TxRing::kFrameCount]);
+      }
+    }
+    k = last + 1;
+  }
+  return sent;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   replays the capture
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters.
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  ProgramOptions(argc, argv);
+  signal(SIGINT, [](int) { run = false; });
+
+  try {
+    PcapFile capture(captureFile);
+    const auto& frames = capture.Frames();
+    if (frames.empty()) {
+      std::printf("%s: no frames\n", captureFile.c_str());
+      return EXIT_FAILURE;
+    }
+    const double duration = static_cast<double>(frames.back().ts_ns - frames.front().ts_ns) / 1e9;
+    std::printf("%s: %zu frames, %.3f s recorded, replay x%.2f on %s\n", captureFile.c_str(), frames.size(), duration,
+                timeScale, interfaceName.c_str());
+
+    TxRing tx(interfaceName);
+    LatencyHistogram wake, interval;
+    uint64_t sent = 0, errors = 0;
+    for (unsigned loop = 0; run && (loopCount == 0 || loop < loopCount); ++loop) {
+      sent += Replay(tx, frames, wake, interval, errors, static_cast<size_t>(sent));
+    }
+    std::printf("sent=%llu errors=%llu\n", static_cast<unsigned long long>(sent),
+                static_cast<unsigned long long>(errors));
+    wake.Print("deadline error");
+    interval.Print("interval error");
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
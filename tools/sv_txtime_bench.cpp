@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SV jitter on the wire with user-space timing and with SO_TXTIME launch times
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <getopt.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <bench_suite.hpp>
+#include <board_info.hpp>
+#include <latency_histogram.hpp>
+#include <sv.hpp>
+#include <sv_publisher.hpp>
+
+//-----------------------------------------------------------------------------
+// local/global Variables Definitions
+//-----------------------------------------------------------------------------
+static std::string txInterface;
+static std::string rxInterface;
+static uint32_t samplesPerSecond{4000};
+static uint32_t streamCount{8};
+static uint32_t leadUs{500};
+static double durationSeconds{5.0};   ///< per mode, the first second is the start delay
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+/************************************************************************/ /**
+* @fn      void ShowUsage(const char* prog)
+* @brief   view help
+* @param  prog - Name of the program in the display help
+****************************************************************************/
+static void ShowUsage(const char* prog) {
+  std::cout << "Usage: " << prog << " -i <interface> -R <interface> [OPTION]\n"
+            << "  -i, --interface <name>   transmit interface, with an etf qdisc for launch time, e.g.\n"
+            << "                           tc qdisc replace dev <name> root etf clockid CLOCK_TAI delta 200000\n"
+            << "  -R, --receive <name>     receive interface: the peer of a veth pair or a cable to the board\n"
+            << "  -r, --sv-rate <n>        SV samples per second (default 4000)\n"
+            << "  -n, --streams <n>        published streams (default 8)\n"
+            << "  -l, --lead <us>          launch time hand-off ahead of the deadline (default 500)\n"
+            << "  -d, --duration <s>       run time per mode (default 5)\n"
+            << "  -h, --help               this message\n\n";
+}
+
+/************************************************************************/ /**
+* @brief   parse command line parameters
+* @param argc - number parameters in command line
+* @param argv - command line parameters as array
+****************************************************************************/
+static void ProgramOptions(int argc, char* argv[]) {
+  for (;;) {
+    int option_index = 0;
+    static const char* short_options = "h?i:R:r:n:l:d:";
+    static const struct option long_options[] = {
+       {"help", no_argument, 0, 'h'},
+       {"interface", required_argument, 0, 'i'},
+       {"receive", required_argument, 0, 'R'},
+       {"sv-rate", required_argument, 0, 'r'},
+       {"streams", required_argument, 0, 'n'},
+       {"lead", required_argument, 0, 'l'},
+       {"duration", required_argument, 0, 'd'},
+       {0, 0, 0, 0},
+    };
+
+    int var = getopt_long(argc, argv, short_options, long_options, &option_index);
+
+    if (var == EOF) {
+      break;
+    }
+    switch (var) {
+      case 'i':
+        txInterface = optarg;
+        break;
+      case 'R':
+        rxInterface = optarg;
+        break;
+      case 'r':
+        samplesPerSecond = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'n':
+        streamCount = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'l':
+        leadUs = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'd':
+        durationSeconds = std::stod(optarg);
+        break;
+      default: {
+        ShowUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+    }
+  }
+  if (txInterface.empty() || rxInterface.empty() || durationSeconds <= 1.0 || streamCount == 0) {
+    ShowUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief SV packet socket with software receive time stamps
+ */
+static int OpenReceiver(const std::string& interface_name) {
+  const int fd = socket(AF_PACKET, SOCK_RAW, htons(kSvEtherType));
+  if (fd < 0) {
+    throw std::runtime_error("receiver: packet socket failed: " + std::string(strerror(errno)));
+  }
+  const int on = 1;
+  const int buffer = 4 << 20;
+  const timeval timeout{0, 100'000};
+  setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  sockaddr_ll addr{};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(kSvEtherType);
+  addr.sll_ifindex = static_cast<int>(if_nametoindex(interface_name.c_str()));
+  if (!addr.sll_ifindex || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    throw std::runtime_error("receiver: cannot bind to interface " + interface_name);
+  }
+  return fd;
+}
+
+struct Mode {
+  std::string timing;
+  LatencyHistogram wake;   ///< wake-up of the timing loop
+  LatencyHistogram wire;   ///< receive time stamp against the deadline of the sample
+  SvPublisher::Statistics stats;
+};
+
+/**
+ * @brief publish for one run and take the receive time of every frame against the deadline of its smpCnt
+ * @param lead_ns - launch time lead, 0 - user-space timing
+ */
+static Mode Measure(int64_t lead_ns) {
+  const int fd = OpenReceiver(rxInterface);
+  SvPublisher publisher(txInterface, samplesPerSecond);
+  char sv_id[kSvMaxIdLength];
+  for (uint32_t i = 0; i < streamCount; ++i) {
+    std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02u", i + 1);
+    publisher.AddStream(sv_id, static_cast<uint16_t>(0x4000 + i),
+                        std::make_unique<SvSineSource>(samplesPerSecond, 50.0, 100.0, 230.0,
+                                                       2.0 * std::numbers::pi * i / streamCount));
+  }
+  publisher.SetLaunchTime(lead_ns);
+
+  Mode mode;
+  std::atomic<bool> receiving{true};
+  std::thread receiver([&]() {
+    uint8_t frame[2048];
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(timespec))];
+    SvFrame decoded;
+    while (receiving.load(std::memory_order_relaxed)) {
+      iovec vector{frame, sizeof(frame)};
+      msghdr message{};
+      message.msg_iov = &vector;
+      message.msg_iovlen = 1;
+      message.msg_control = control;
+      message.msg_controllen = sizeof(control);
+      const ssize_t length = recvmsg(fd, &message, 0);
+      if (length <= 0 || !SvDecode(frame, static_cast<size_t>(length), decoded)) {
+        continue;
+      }
+      const cmsghdr* entry = CMSG_FIRSTHDR(&message);
+      if (!entry || entry->cmsg_level != SOL_SOCKET || entry->cmsg_type != SCM_TIMESTAMPNS) {
+        continue;
+      }
+      timespec stamp;
+      std::memcpy(&stamp, CMSG_DATA(entry), sizeof(stamp));
+      // the deadline of smpCnt nearest to the time stamp: in its second, the one before or the one after
+      const int64_t received = static_cast<int64_t>(stamp.tv_sec) * 1'000'000'000 + stamp.tv_nsec;
+      int64_t deadline = static_cast<int64_t>(stamp.tv_sec) * 1'000'000'000 +
+                         int64_t{decoded.asdu[0].smp_cnt} * 1'000'000'000 / samplesPerSecond;
+      if (deadline - received > 500'000'000) {
+        deadline -= 1'000'000'000;
+      } else if (received - deadline > 500'000'000) {
+        deadline += 1'000'000'000;
+      }
+      mode.wire.Add(received - deadline);
+    }
+  });
+
+  std::thread stopper([&]() {
+    std::this_thread::sleep_for(std::chrono::duration<double>(durationSeconds));
+    publisher.Stop();
+  });
+  bench_suite::SetRealtime(80);
+  publisher.Start();
+  stopper.join();
+  // frames still held back by the qdisc
+  std::this_thread::sleep_for(std::chrono::microseconds(2 * lead_ns / 1000 + 10'000));
+  receiving = false;
+  receiver.join();
+  close(fd);
+
+  mode.timing = publisher.Timing();
+  mode.wake = publisher.Jitter();
+  mode.stats = publisher.GetStatistics();
+  return mode;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   publishes with user-space timing, then with launch time, and prints the jitter of both on the wire
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters.
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  ProgramOptions(argc, argv);
+
+  try {
+    std::printf("board: %s, %s -> %s, %u stream(s), %u sps\n", BoardIdentity().c_str(), txInterface.c_str(),
+                rxInterface.c_str(), streamCount, samplesPerSecond);
+    for (const int64_t lead_ns : {int64_t{0}, int64_t{leadUs} * 1000}) {
+      const Mode mode = Measure(lead_ns);
+      std::printf("%s: frames=%llu send errors=%llu overruns=%llu launch misses=%llu\n", mode.timing.c_str(),
+                  static_cast<unsigned long long>(mode.stats.frames),
+                  static_cast<unsigned long long>(mode.stats.send_errors),
+                  static_cast<unsigned long long>(mode.stats.overruns),
+                  static_cast<unsigned long long>(mode.stats.launch_misses));
+      mode.wake.Print(" wake-up jitter");
+      mode.wire.Print(" wire: receive - deadline");
+      std::fflush(stdout);
+    }
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: MIT */
+//
+// Copyright (c) 2023 Alexander Sacharov <a.sacharov@gmx.de>
+//               All rights reserved.
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+//
+
+/************************************************************************/ /**
+* @file
+* @brief   SV publish and subscribe on packet sockets and on AF_XDP: CPU time per frame and jitter
+* @author A.Sacharov <a.sacharov@gmx.de> 29.10.23
+****************************************************************************/
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <getopt.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <bench_suite.hpp>
+#include <board_info.hpp>
+#include <latency_histogram.hpp>
+#include <sv.hpp>
+#include <sv_publisher.hpp>
+#include <sv_subscriber.hpp>
+#include <xdp_socket.hpp>
+
+//-----------------------------------------------------------------------------
+// local/global Variables Definitions
+//-----------------------------------------------------------------------------
+static std::string txInterface;
+static std::string rxInterface;
+static uint32_t samplesPerSecond{4000};
+static uint32_t streamCount{8};
+static double durationSeconds{5.0};   ///< per backend, the first second is the start delay
+static XdpOptions xdpOptions;
+
+//-----------------------------------------------------------------------------
+// local Function Definitions
+//-----------------------------------------------------------------------------
+
+/************************************************************************/ /**
+* @fn      void ShowUsage(const char* prog)
+* @brief   view help
+* @param  prog - Name of the program in the display help
+****************************************************************************/
+static void ShowUsage(const char* prog) {
+  std::cout << "Usage: " << prog << " -i <interface> -R <interface> [OPTION]\n"
+            << "  -i, --interface <name>   transmit interface, e.g. one end of a veth pair\n"
+            << "  -R, --receive <name>     receive interface: the peer of the veth pair or a cable to the board\n"
+            << "  -r, --sv-rate <n>        SV samples per second (default 4000)\n"
+            << "  -n, --streams <n>        published streams (default 8)\n"
+            << "  -X, --xdp <mode>         AF_XDP mode: generic (default), native or zerocopy\n"
+            << "  -B, --busy-poll <us>     AF_XDP busy polling, the subscriber spins\n"
+            << "  -d, --duration <s>       run time per backend (default 5)\n"
+            << "  -h, --help               this message\n\n";
+}
+
+/************************************************************************/ /**
+* @brief   parse command line parameters
+* @param argc - number parameters in command line
+* @param argv - command line parameters as array
+****************************************************************************/
+static void ProgramOptions(int argc, char* argv[]) {
+  for (;;) {
+    int option_index = 0;
+    static const char* short_options = "h?i:R:r:n:X:B:d:";
+    static const struct option long_options[] = {
+       {"help", no_argument, 0, 'h'},
+       {"interface", required_argument, 0, 'i'},
+       {"receive", required_argument, 0, 'R'},
+       {"sv-rate", required_argument, 0, 'r'},
+       {"streams", required_argument, 0, 'n'},
+       {"xdp", required_argument, 0, 'X'},
+       {"busy-poll", required_argument, 0, 'B'},
+       {"duration", required_argument, 0, 'd'},
+       {0, 0, 0, 0},
+    };
+
+    int var = getopt_long(argc, argv, short_options, long_options, &option_index);
+
+    if (var == EOF) {
+      break;
+    }
+    switch (var) {
+      case 'i':
+        txInterface = optarg;
+        break;
+      case 'R':
+        rxInterface = optarg;
+        break;
+      case 'r':
+        samplesPerSecond = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'n':
+        streamCount = static_cast<uint32_t>(std::stoul(optarg));
+        break;
+      case 'X': {
+        const std::string mode = optarg;
+        xdpOptions.native = mode != "generic";
+        xdpOptions.zero_copy = mode == "zerocopy";
+        break;
+      }
+      case 'B':
+        xdpOptions.busy_poll_us = std::stoi(optarg);
+        break;
+      case 'd':
+        durationSeconds = std::stod(optarg);
+        break;
+      default: {
+        ShowUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+    }
+  }
+  if (txInterface.empty() || rxInterface.empty() || durationSeconds <= 1.0 || streamCount == 0) {
+    ShowUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static int64_t ThreadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+struct Run {
+  std::string publisher_backend;
+  std::string subscriber_backend;
+  SvPublisher::Statistics published;
+  SvSubscriber::Statistics received;
+  int64_t publisher_cpu_ns{0};
+  int64_t subscriber_cpu_ns{0};
+  LatencyHistogram wake;      ///< wake-up of the timing loop
+  LatencyHistogram latency;   ///< handler time against the deadline of the sample
+};
+
+/**
+ * @brief publish and subscribe for one run, with both ends on packet sockets or both on AF_XDP
+ */
+static Run Measure(bool xdp) {
+  SvPublisher publisher(txInterface, samplesPerSecond);
+  char sv_id[kSvMaxIdLength];
+  for (uint32_t i = 0; i < streamCount; ++i) {
+    std::snprintf(sv_id, sizeof(sv_id), "BBX15MU%02u", i + 1);
+    publisher.AddStream(sv_id, static_cast<uint16_t>(0x4000 + i),
+                        std::make_unique<SvSineSource>(samplesPerSecond, 50.0, 100.0, 230.0,
+                                                       2.0 * std::numbers::pi * i / streamCount));
+  }
+  SvSubscriber subscriber(rxInterface);
+  if (xdp) {
+    publisher.UseXdp(xdpOptions);
+    subscriber.UseXdp(xdpOptions);
+  }
+
+  Run run;
+  std::thread receiver([&]() {
+    const int64_t cpu = ThreadCpuNs();
+    subscriber.Start([&](const SvCapture&, const SvFrame& frame) {
+      // the same clock for both backends, AF_XDP has no kernel time stamp
+      timespec now;
+      clock_gettime(CLOCK_REALTIME, &now);
+      const int64_t received = static_cast<int64_t>(now.tv_sec) * 1'000'000'000 + now.tv_nsec;
+      int64_t deadline = static_cast<int64_t>(now.tv_sec) * 1'000'000'000 +
+                         int64_t{frame.asdu[0].smp_cnt} * 1'000'000'000 / samplesPerSecond;
+      if (deadline - received > 500'000'000) {
+        deadline -= 1'000'000'000;
+      } else if (received - deadline > 500'000'000) {
+        deadline += 1'000'000'000;
+      }
+      run.latency.Add(received - deadline);
+    });
+    run.subscriber_cpu_ns = ThreadCpuNs() - cpu;
+  });
+
+  std::thread stopper([&]() {
+    std::this_thread::sleep_for(std::chrono::duration<double>(durationSeconds));
+    publisher.Stop();
+  });
+  bench_suite::SetRealtime(80);
+  const int64_t cpu = ThreadCpuNs();
+  publisher.Start();
+  run.publisher_cpu_ns = ThreadCpuNs() - cpu;
+  // threads of the next run inherit the policy, a spinning subscriber at the same priority would starve the stopper
+  const sched_param other{};
+  pthread_setschedparam(pthread_self(), SCHED_OTHER, &other);
+  stopper.join();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  subscriber.Stop();
+  receiver.join();
+
+  run.publisher_backend = publisher.Backend();
+  run.subscriber_backend = subscriber.Backend();
+  run.published = publisher.GetStatistics();
+  run.received = subscriber.GetStatistics();
+  run.wake = publisher.Jitter();
+  return run;
+}
+
+/************************************************************************/ /**
+* @fn      int main()
+* @brief   publishes and subscribes on packet sockets, then on AF_XDP, and prints CPU time and jitter of both
+* @param   argc will be the number of strings pointed to by argv.
+* @param   argv array of command line parameters.
+* @return EXIT_SUCCESS if successfully, otherwise - EXIT_FAILURE
+****************************************************************************/
+int main(int argc, char** argv) {
+  ProgramOptions(argc, argv);
+
+  try {
+    std::printf("board: %s, %s -> %s, %u stream(s), %u sps\n", BoardIdentity().c_str(), txInterface.c_str(),
+                rxInterface.c_str(), streamCount, samplesPerSecond);
+    for (const bool xdp : {false, true}) {
+      const Run run = Measure(xdp);
+      const auto per_frame = [](int64_t ns, uint64_t frames) {
+        return frames ? static_cast<double>(ns) / static_cast<double>(frames) : 0.0;
+      };
+      std::printf("publisher %s: frames=%llu send errors=%llu overruns=%llu cpu=%.0f ns/frame\n",
+                  run.publisher_backend.c_str(), static_cast<unsigned long long>(run.published.frames),
+                  static_cast<unsigned long long>(run.published.send_errors),
+                  static_cast<unsigned long long>(run.published.overruns),
+                  per_frame(run.publisher_cpu_ns, run.published.frames));
+      std::printf("subscriber %s: frames=%llu invalid=%llu kernel drops=%llu cpu=%.0f ns/frame\n",
+                  run.subscriber_backend.c_str(), static_cast<unsigned long long>(run.received.frames),
+                  static_cast<unsigned long long>(run.received.frames_invalid),
+                  static_cast<unsigned long long>(run.received.kernel_drops),
+                  per_frame(run.subscriber_cpu_ns, run.received.frames));
+      run.wake.Print(" wake-up jitter");
+      run.latency.Print(" receive - deadline");
+      std::fflush(stdout);
+    }
+  } catch (std::exception& error) {
+    std::printf("Exception was caught: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}